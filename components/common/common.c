@@ -1,15 +1,45 @@
 #include "common.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
 #include <string.h>
 
 static const char *TAG = "common";
 
+// 状态变化回调
+typedef struct {
+    iot_state_listener_t fn;
+    void *ctx;
+} state_listener_t;
+
+static state_listener_t s_listeners[IOT_STATE_MAX_LISTENERS];
+static int s_listener_count = 0;
+// 并行的启动阶段（BLE、WiFi）同时注册回调，setter又在各任务中遍历，注册表经 s_listener_mux 访问
+static portMUX_TYPE s_listener_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void notify_state_changed(iot_dp_id_t dp)
+{
+    // 在锁内复制注册表，回调在锁外执行（回调中会打日志、取互斥锁）
+    state_listener_t listeners[IOT_STATE_MAX_LISTENERS];
+    taskENTER_CRITICAL(&s_listener_mux);
+    int count = s_listener_count;
+    memcpy(listeners, s_listeners, count * sizeof(s_listeners[0]));
+    taskEXIT_CRITICAL(&s_listener_mux);
+
+    for (int i = 0; i < count; i++) {
+        listeners[i].fn(dp, listeners[i].ctx);
+    }
+}
+
 // 全局状态变量定义
 iot_device_state_t g_iot_state = {
     .device_status = "close",  // 默认值
     .test_value = 0            // 默认值
 };
 
+// 保护 g_iot_state 的多字段读写：采样、BLE、局域网、规则和云端命令在不同任务中并发修改
+static portMUX_TYPE s_state_mux = portMUX_INITIALIZER_UNLOCKED;
+
 /**
  * @brief 初始化全局状态
  */
@@ -24,17 +54,29 @@ void common_init(void)
              g_iot_state.device_status, (long)g_iot_state.test_value);
 }
 
+/**
+ * @brief 获取完整的状态快照
+ */
+void get_current_iot_snapshot(iot_device_state_t* out)
+{
+    taskENTER_CRITICAL(&s_state_mux);
+    *out = g_iot_state;
+    taskEXIT_CRITICAL(&s_state_mux);
+}
+
 /**
  * @brief 获取当前IOT设备状态
  */
 void get_current_iot_state(char* device_status, size_t status_size, int32_t* test_value)
 {
+    iot_device_state_t state;
+    get_current_iot_snapshot(&state);
     if (device_status && status_size > 0) {
-        strncpy(device_status, g_iot_state.device_status, status_size - 1);
+        strncpy(device_status, state.device_status, status_size - 1);
         device_status[status_size - 1] = '\0';
     }
     if (test_value) {
-        *test_value = g_iot_state.test_value;
+        *test_value = state.test_value;
     }
 }
 
@@ -44,9 +86,16 @@ void get_current_iot_state(char* device_status, size_t status_size, int32_t* tes
 void set_device_status(const char* device_status)
 {
     if (device_status) {
+        taskENTER_CRITICAL(&s_state_mux);
+        bool changed = strncmp(g_iot_state.device_status, device_status,
+                               sizeof(g_iot_state.device_status) - 1) != 0;
         strncpy(g_iot_state.device_status, device_status, sizeof(g_iot_state.device_status) - 1);
         g_iot_state.device_status[sizeof(g_iot_state.device_status) - 1] = '\0';
-        ESP_LOGI(TAG, "设备状态已更新: %s", g_iot_state.device_status);
+        taskEXIT_CRITICAL(&s_state_mux);
+        ESP_LOGI(TAG, "设备状态已更新: %.*s", (int)sizeof(g_iot_state.device_status) - 1, device_status);
+        if (changed) {
+            notify_state_changed(IOT_DP_DEVICE_STATUS);
+        }
     }
 }
 
@@ -55,6 +104,51 @@ void set_device_status(const char* device_status)
  */
 void set_test_value(int32_t test_value)
 {
+    taskENTER_CRITICAL(&s_state_mux);
+    bool changed = g_iot_state.test_value != test_value;
     g_iot_state.test_value = test_value;
-    ESP_LOGI(TAG, "测试数值已更新: %ld", (long)g_iot_state.test_value);
+    taskEXIT_CRITICAL(&s_state_mux);
+    ESP_LOGI(TAG, "测试数值已更新: %ld", (long)test_value);
+    if (changed) {
+        notify_state_changed(IOT_DP_TEST_VALUE);
+    }
+}
+
+/**
+ * @brief 注册状态变化回调
+ */
+int common_register_state_listener(iot_state_listener_t listener, void* ctx)
+{
+    if (!listener) {
+        return -1;
+    }
+    int ret = -1;
+    taskENTER_CRITICAL(&s_listener_mux);
+    if (s_listener_count < IOT_STATE_MAX_LISTENERS) {
+        s_listeners[s_listener_count].fn = listener;
+        s_listeners[s_listener_count].ctx = ctx;
+        s_listener_count++;
+        ret = 0;
+    }
+    taskEXIT_CRITICAL(&s_listener_mux);
+    return ret;
+}
+
+/**
+ * @brief 注销状态变化回调
+ */
+int common_unregister_state_listener(iot_state_listener_t listener, void* ctx)
+{
+    int ret = -1;
+    taskENTER_CRITICAL(&s_listener_mux);
+    for (int i = 0; i < s_listener_count; i++) {
+        if (s_listeners[i].fn == listener && s_listeners[i].ctx == ctx) {
+            memmove(&s_listeners[i], &s_listeners[i + 1], (s_listener_count - i - 1) * sizeof(s_listeners[0]));
+            s_listener_count--;
+            ret = 0;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_listener_mux);
+    return ret;
 }
@@ -20,6 +20,18 @@ extern "C" {
 #define TUYA_MQTT_URL           "mqtts://m1.tuyacn.com:8883"
 #define TUYA_DEVICE_ID          "2631a16994c01c1f45qfha"
 #define TUYA_DEVICE_SECRET      "ecw9VrT7fLlgP6br"
+#define TUYA_PERSISTENT_SESSION 0       // 是否使用持久会话：断线期间的QoS1命令由服务端保留，重连后补发
+
+/* 局域网控制配置 */
+#define LAN_CTRL_ENABLE         1       // 是否启用局域网直连控制
+#define LAN_CTRL_DISCOVERY_PORT 6667    // UDP发现端口
+#define LAN_CTRL_TCP_PORT       6668    // TCP命令端口
+#define LAN_CTRL_MAX_CLIENTS    4       // 最大同时连接的客户端数
+
+/* 网关配置：通过网关的MQTT连接为BLE子设备上报 */
+#define GATEWAY_ENABLE          0       // 是否启用网关模式
+#define GATEWAY_MAX_SUBDEVS     128     // 最大子设备数
+#define TUYA_SUBDEV_PRODUCT_ID  ""      // 子设备产品ID，在涂鸦平台创建子设备产品后填写
 
 /* BLE配置 */
 #define BLE_DEVICE_NAME         "ESP32C5_BLE_SERVER"
@@ -41,14 +53,52 @@ typedef struct {
     int32_t test_value;      // 测试数值
 } iot_device_state_t;
 
+// 数据点值类型
+typedef enum {
+    IOT_DP_TYPE_INT = 0,        // int32_t
+    IOT_DP_TYPE_STR,            // 以'\0'结尾的字符串
+} iot_dp_type_t;
+
+/*
+ * 数据点(DP)定义表，增加DP时只需在这里加一行，DP编号、标识符表和BLE特征值表都由它生成
+ * X(名称, 云端标识符, 值类型, iot_device_state_t中的字段, BLE特征值编号, GATT单位)
+ * BLE特征值编号一经发布不可更改，手机按它区分特征值；GATT单位0x2700表示无单位
+ */
+#define IOT_DP_SCHEMA(X) \
+    X(DEVICE_STATUS, "device_status", IOT_DP_TYPE_STR, device_status, 0x20, 0x2700) \
+    X(TEST_VALUE,    "test_value",    IOT_DP_TYPE_INT, test_value,    0x21, 0x2700)
+
+// 数据点(DP)编号，用于标记一次命令影响了哪些DP
+typedef enum {
+#define IOT_DP_ENUM_ENTRY(name, code, type, field, chr_id, unit) IOT_DP_##name,
+    IOT_DP_SCHEMA(IOT_DP_ENUM_ENTRY)
+#undef IOT_DP_ENUM_ENTRY
+    IOT_DP_MAX
+} iot_dp_id_t;
+
+#define IOT_DP_BIT(dp)          (1UL << (dp))
+#define IOT_DP_ALL_MASK         (IOT_DP_BIT(IOT_DP_MAX) - 1)
+
+// 状态变化回调，dp为发生变化的数据点
+typedef void (*iot_state_listener_t)(iot_dp_id_t dp, void* ctx);
+
+#define IOT_STATE_MAX_LISTENERS 8
+
 // 全局状态变量声明
 extern iot_device_state_t g_iot_state;
 
 /**
- * @brief 初始化全局状态
+ * @brief 初始化全局状态为默认值（保存过的状态由 iot_persist_start 恢复）
  */
 void common_init(void);
 
+/**
+ * @brief 在锁内复制完整的设备状态，生成多字段报文（应答、BLE、持久化）时用它取一致的快照
+ * 
+ * @param out 输出的状态快照
+ */
+void get_current_iot_snapshot(iot_device_state_t* out);
+
 /**
  * @brief 获取当前IOT设备状态
  * 
@@ -72,6 +122,24 @@ void set_device_status(const char* device_status);
  */
 void set_test_value(int32_t test_value);
 
+/**
+ * @brief 注册状态变化回调，状态值实际改变时在调用setter的任务中回调；可在并行的启动阶段中同时调用
+ * 
+ * @param listener 回调函数
+ * @param ctx 回调上下文
+ * @return int 0表示成功，-1表示回调已满
+ */
+int common_register_state_listener(iot_state_listener_t listener, void* ctx);
+
+/**
+ * @brief 注销状态变化回调，组件停止后重新启动时先注销再注册，避免占用两个位置
+ * 
+ * @param listener 注册时的回调函数
+ * @param ctx 注册时的回调上下文
+ * @return int 0表示成功，-1表示未注册
+ */
+int common_unregister_state_listener(iot_state_listener_t listener, void* ctx);
+
 #ifdef __cplusplus
 }
 #endif
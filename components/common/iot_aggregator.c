@@ -0,0 +1,61 @@
+#include "iot_aggregator.h"
+#include <string.h>
+
+void iot_agg_init(iot_aggregator_t *agg)
+{
+    memset(agg, 0, sizeof(*agg));
+}
+
+void iot_agg_add(iot_aggregator_t *agg, uint8_t dp, int32_t value, int64_t t_us)
+{
+    if (dp >= IOT_AGG_MAX_DP) {
+        return;
+    }
+
+    iot_agg_window_t *w = &agg->win[dp];
+    if (w->count == 0) {
+        w->min = value;
+        w->max = value;
+        w->t_first_us = t_us;
+        w->t_min_us = t_us;
+        w->t_max_us = t_us;
+    } else if (value < w->min) {
+        w->min = value;
+        w->t_min_us = t_us;
+    } else if (value > w->max) {
+        w->max = value;
+        w->t_max_us = t_us;
+    }
+    w->last = value;
+    w->t_last_us = t_us;
+    w->sum += value;
+    w->count++;
+}
+
+uint32_t iot_agg_close(iot_aggregator_t *agg, uint8_t dp, iot_agg_result_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (dp >= IOT_AGG_MAX_DP) {
+        return 0;
+    }
+
+    iot_agg_window_t *w = &agg->win[dp];
+    if (w->count > 0) {
+        // 整数除法向零截断，按符号加半个count实现四舍五入
+        int64_t half = w->count / 2;
+        int64_t mean = (w->sum >= 0) ? (w->sum + half) / w->count : (w->sum - half) / w->count;
+
+        out->count = w->count;
+        out->min = w->min;
+        out->max = w->max;
+        out->mean = (int32_t)mean;
+        out->last = w->last;
+        out->t_start_us = w->t_first_us;
+        out->t_end_us = w->t_last_us;
+        out->t_min_us = w->t_min_us;
+        out->t_max_us = w->t_max_us;
+    }
+
+    memset(w, 0, sizeof(*w));
+    return out->count;
+}
@@ -0,0 +1,69 @@
+#ifndef IOT_AGGREGATOR_H
+#define IOT_AGGREGATOR_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 定点窗口聚合（min/max/mean/last），不依赖ESP-IDF ========== */
+
+#define IOT_AGG_MAX_DP  8   // 支持的DP编号范围 [0, IOT_AGG_MAX_DP)
+
+// 正在累计的窗口
+typedef struct {
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    int32_t last;
+    int64_t sum;
+    int64_t t_first_us;
+    int64_t t_last_us;
+    int64_t t_min_us;
+    int64_t t_max_us;
+} iot_agg_window_t;
+
+// 关闭窗口后的结果
+typedef struct {
+    uint32_t count;         // 窗口内样本数，为0时其余字段无效
+    int32_t min;
+    int32_t max;
+    int32_t mean;           // 四舍五入到与样本相同的定点精度
+    int32_t last;
+    int64_t t_start_us;     // 第一个样本时刻
+    int64_t t_end_us;       // 最后一个样本时刻（即last的时刻）
+    int64_t t_min_us;       // 最小值出现时刻
+    int64_t t_max_us;       // 最大值出现时刻
+} iot_agg_result_t;
+
+typedef struct {
+    iot_agg_window_t win[IOT_AGG_MAX_DP];
+} iot_aggregator_t;
+
+/**
+ * @brief 初始化聚合器
+ */
+void iot_agg_init(iot_aggregator_t *agg);
+
+/**
+ * @brief 累计一个样本
+ *
+ * @param dp 数据点编号
+ * @param value 定点数值
+ * @param t_us 采样时刻
+ */
+void iot_agg_add(iot_aggregator_t *agg, uint8_t dp, int32_t value, int64_t t_us);
+
+/**
+ * @brief 关闭当前窗口，输出结果并开始新窗口
+ *
+ * @return uint32_t 窗口内样本数
+ */
+uint32_t iot_agg_close(iot_aggregator_t *agg, uint8_t dp, iot_agg_result_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_AGGREGATOR_H */
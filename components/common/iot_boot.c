@@ -0,0 +1,166 @@
+#include "iot_boot.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "iot_trace.h"
+
+static const char *TAG = "iot_boot";
+
+static const iot_boot_stage_t *s_stages = NULL;
+static int s_count = 0;
+static iot_boot_trace_t s_trace[IOT_BOOT_MAX_STAGES];
+static EventGroupHandle_t s_done = NULL;    // 每个阶段结束（无论成败）置位一个bit
+static uint32_t s_failed = 0;               // 失败或跳过的阶段
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* 依赖必须指向表内阶段且不成环，否则会有阶段永远等待 */
+static bool deps_valid(const iot_boot_stage_t* stages, int count)
+{
+    uint32_t all = (uint32_t)((1ULL << count) - 1);
+    uint32_t resolved = 0;
+    for (int i = 0; i < count; i++) {
+        if (stages[i].deps & ~all || stages[i].deps & IOT_BOOT_DEP(i)) {
+            return false;
+        }
+    }
+    // 按拓扑顺序逐轮标记，某轮没有进展说明有环
+    while (resolved != all) {
+        uint32_t before = resolved;
+        for (int i = 0; i < count; i++) {
+            if ((stages[i].deps & ~resolved) == 0) {
+                resolved |= IOT_BOOT_DEP(i);
+            }
+        }
+        if (resolved == before) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void stage_task(void *arg)
+{
+    int idx = (int)(intptr_t)arg;
+    const iot_boot_stage_t *stage = &s_stages[idx];
+    iot_boot_trace_t *trace = &s_trace[idx];
+
+    if (stage->deps) {
+        xEventGroupWaitBits(s_done, stage->deps, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    portENTER_CRITICAL(&s_mux);
+    bool dep_failed = s_failed & stage->deps;
+    portEXIT_CRITICAL(&s_mux);
+
+    trace->start_us = esp_timer_get_time();
+    if (dep_failed) {
+        trace->state = IOT_BOOT_SKIPPED;
+        trace->err = ESP_ERR_INVALID_STATE;
+    } else {
+        trace->state = IOT_BOOT_RUNNING;
+        IOT_TRACE_BEGIN(stage->name);
+        trace->err = stage->fn();
+        IOT_TRACE_END(stage->name);
+        trace->state = trace->err == ESP_OK ? IOT_BOOT_DONE : IOT_BOOT_FAILED;
+    }
+    trace->end_us = esp_timer_get_time();
+
+    if (trace->state == IOT_BOOT_DONE) {
+        ESP_LOGI(TAG, "[%lld ms] %s 完成, 耗时 %lld ms", trace->end_us / 1000, stage->name,
+                 (trace->end_us - trace->start_us) / 1000);
+    } else {
+        ESP_LOGE(TAG, "[%lld ms] %s %s: %s", trace->end_us / 1000, stage->name,
+                 trace->state == IOT_BOOT_SKIPPED ? "跳过" : "失败", esp_err_to_name(trace->err));
+        portENTER_CRITICAL(&s_mux);
+        s_failed |= IOT_BOOT_DEP(idx);
+        portEXIT_CRITICAL(&s_mux);
+    }
+
+    uint32_t all = (uint32_t)((1ULL << s_count) - 1);
+    if ((xEventGroupSetBits(s_done, IOT_BOOT_DEP(idx)) & all) == all) {
+        iot_boot_log_trace();
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t iot_boot_run(const iot_boot_stage_t* stages, int count)
+{
+    if (s_stages) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!stages || count <= 0 || count > IOT_BOOT_MAX_STAGES || !deps_valid(stages, count)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_done = xEventGroupCreate();
+    if (!s_done) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_stages = stages;
+    s_count = count;
+    for (int i = 0; i < count; i++) {
+        s_trace[i] = (iot_boot_trace_t){ .name = stages[i].name, .state = IOT_BOOT_PENDING };
+    }
+
+    ESP_LOGI(TAG, "[%lld ms] 启动 %d 个阶段", esp_timer_get_time() / 1000, count);
+    for (int i = 0; i < count; i++) {
+        uint32_t stack = stages[i].stack ? stages[i].stack : IOT_BOOT_STAGE_STACK;
+        if (xTaskCreate(stage_task, stages[i].name, stack, (void *)(intptr_t)i,
+                        IOT_BOOT_STAGE_PRIO, NULL) != pdPASS) {
+            // 已创建的阶段可能在等它，标记失败让其跳过
+            ESP_LOGE(TAG, "创建阶段任务 %s 失败", stages[i].name);
+            s_trace[i].state = IOT_BOOT_FAILED;
+            s_trace[i].err = ESP_ERR_NO_MEM;
+            portENTER_CRITICAL(&s_mux);
+            s_failed |= IOT_BOOT_DEP(i);
+            portEXIT_CRITICAL(&s_mux);
+            xEventGroupSetBits(s_done, IOT_BOOT_DEP(i));
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t iot_boot_wait(uint32_t mask, uint32_t timeout_ms)
+{
+    if (!s_done) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    mask &= (uint32_t)((1ULL << s_count) - 1);
+    TickType_t ticks = timeout_ms ? pdMS_TO_TICKS(timeout_ms) : portMAX_DELAY;
+    EventBits_t bits = xEventGroupWaitBits(s_done, mask, pdFALSE, pdTRUE, ticks);
+    if ((bits & mask) != mask) {
+        return ESP_ERR_TIMEOUT;
+    }
+    portENTER_CRITICAL(&s_mux);
+    bool failed = s_failed & mask;
+    portEXIT_CRITICAL(&s_mux);
+    return failed ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t iot_boot_get_trace(int idx, iot_boot_trace_t* out)
+{
+    if (!out || idx < 0 || idx >= s_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = s_trace[idx];
+    return ESP_OK;
+}
+
+void iot_boot_log_trace(void)
+{
+    static const char *const state_names[] = { "等待", "执行中", "完成", "失败", "跳过" };
+
+    ESP_LOGI(TAG, "启动轨迹（开机后毫秒）:");
+    for (int i = 0; i < s_count; i++) {
+        iot_boot_trace_t t = s_trace[i];
+        if (t.state == IOT_BOOT_PENDING) {
+            ESP_LOGI(TAG, "  %-10s %s", t.name, state_names[t.state]);
+        } else if (t.state == IOT_BOOT_RUNNING) {
+            ESP_LOGI(TAG, "  %-10s %7lld -> ...     %s", t.name, t.start_us / 1000, state_names[t.state]);
+        } else {
+            ESP_LOGI(TAG, "  %-10s %7lld -> %7lld  %s", t.name, t.start_us / 1000, t.end_us / 1000,
+                     state_names[t.state]);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef IOT_BOOT_H
+#define IOT_BOOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 分阶段并行启动 ==========
+ *
+ * 每个阶段在独立的任务中执行，依赖的阶段全部成功后才开始；
+ * 依赖失败的阶段跳过。各阶段的开始/结束时刻（开机后微秒）记录在启动轨迹中。
+ */
+
+#define IOT_BOOT_MAX_STAGES     16
+#define IOT_BOOT_STAGE_STACK    4096
+#define IOT_BOOT_STAGE_PRIO     4
+
+#define IOT_BOOT_DEP(idx)       (1UL << (idx))
+#define IOT_BOOT_ALL            ((1UL << IOT_BOOT_MAX_STAGES) - 1)
+
+typedef esp_err_t (*iot_boot_fn_t)(void);
+
+typedef struct {
+    const char* name;
+    iot_boot_fn_t fn;
+    uint32_t deps;          // 依赖阶段的 IOT_BOOT_DEP 位掩码
+    uint32_t stack;         // 任务栈大小，0表示 IOT_BOOT_STAGE_STACK
+} iot_boot_stage_t;
+
+typedef enum {
+    IOT_BOOT_PENDING = 0,   // 等待依赖
+    IOT_BOOT_RUNNING,
+    IOT_BOOT_DONE,
+    IOT_BOOT_FAILED,
+    IOT_BOOT_SKIPPED,       // 依赖失败，未执行
+} iot_boot_state_t;
+
+// 单个阶段的启动轨迹
+typedef struct {
+    const char* name;
+    iot_boot_state_t state;
+    esp_err_t err;
+    int64_t start_us;       // 开始执行时刻（开机后微秒）
+    int64_t end_us;         // 结束时刻
+} iot_boot_trace_t;
+
+/**
+ * @brief 启动所有阶段，立即返回
+ *
+ * @param stages 阶段表（须长期有效），依赖只能指向表内的阶段
+ * @param count 阶段数
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_INVALID_ARG表示依赖越界或有环
+ */
+esp_err_t iot_boot_run(const iot_boot_stage_t* stages, int count);
+
+/**
+ * @brief 等待指定阶段全部结束
+ *
+ * @param mask 阶段的 IOT_BOOT_DEP 位掩码
+ * @param timeout_ms 超时（毫秒），0表示永久等待
+ * @return esp_err_t ESP_OK表示全部成功，ESP_FAIL表示有阶段失败或跳过，ESP_ERR_TIMEOUT表示超时
+ */
+esp_err_t iot_boot_wait(uint32_t mask, uint32_t timeout_ms);
+
+/**
+ * @brief 获取阶段的启动轨迹
+ *
+ * @param idx 阶段序号
+ * @param out 输出轨迹
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_boot_get_trace(int idx, iot_boot_trace_t* out);
+
+/**
+ * @brief 打印启动轨迹
+ */
+void iot_boot_log_trace(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_BOOT_H */
@@ -0,0 +1,137 @@
+#include "iot_hist_codec.h"
+#include <string.h>
+
+static uint64_t zigzag_encode(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static int varint_put(uint8_t *out, uint64_t v)
+{
+    int n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+static int varint_get(const uint8_t *buf, uint16_t len, uint16_t *pos, uint64_t *v)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*pos >= len) {
+            return -1;
+        }
+        uint8_t b = buf[(*pos)++];
+        result |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void iot_hist_enc_init(iot_hist_enc_t *enc, uint8_t *buf, uint16_t cap)
+{
+    memset(enc, 0, sizeof(*enc));
+    enc->buf = buf;
+    enc->cap = cap;
+}
+
+int iot_hist_enc_append(iot_hist_enc_t *enc, uint8_t dp, int64_t t_ms, int32_t value)
+{
+    if (dp >= IOT_HIST_MAX_DP) {
+        return -2;
+    }
+    if (enc->count == 0) {
+        enc->t_first_ms = t_ms;
+        enc->t_last_ms = t_ms;
+    }
+
+    // 该DP在块内的第一条记录写绝对时间，之后写二阶差分；
+    // 周期采样时二阶差分和异或结果大多为0，各占1字节
+    iot_hist_dp_state_t *st = &enc->st[dp];
+    int64_t delta = st->seen ? t_ms - st->t : 0;
+    int64_t dod = st->seen ? delta - st->delta : t_ms;
+    uint8_t rec[IOT_HIST_RECORD_MAX];
+    int n = 0;
+    rec[n++] = dp;
+    n += varint_put(&rec[n], zigzag_encode(dod));
+    n += varint_put(&rec[n], (uint32_t)(value ^ st->value));
+
+    if (enc->len + n > enc->cap) {
+        return -1;
+    }
+    memcpy(&enc->buf[enc->len], rec, n);
+    enc->len += n;
+    enc->count++;
+
+    st->t = t_ms;
+    st->delta = delta;
+    st->value = value;
+    st->seen = 1;
+    if (t_ms < enc->t_first_ms) {
+        enc->t_first_ms = t_ms;
+    }
+    if (t_ms > enc->t_last_ms) {
+        enc->t_last_ms = t_ms;
+    }
+    return n;
+}
+
+void iot_hist_dec_init(iot_hist_dec_t *dec, const uint8_t *buf, uint16_t len)
+{
+    memset(dec, 0, sizeof(*dec));
+    dec->buf = buf;
+    dec->len = len;
+}
+
+int iot_hist_dec_next(iot_hist_dec_t *dec, iot_hist_point_t *point)
+{
+    if (dec->pos >= dec->len) {
+        return 0;
+    }
+
+    uint8_t dp = dec->buf[dec->pos++];
+    uint64_t dod, x;
+    if (dp >= IOT_HIST_MAX_DP ||
+        varint_get(dec->buf, dec->len, &dec->pos, &dod) != 0 ||
+        varint_get(dec->buf, dec->len, &dec->pos, &x) != 0) {
+        return -1;
+    }
+
+    iot_hist_dp_state_t *st = &dec->st[dp];
+    if (st->seen) {
+        st->delta += zigzag_decode(dod);
+        st->t += st->delta;
+    } else {
+        st->t = zigzag_decode(dod);
+        st->seen = 1;
+    }
+    st->value ^= (int32_t)(uint32_t)x;
+
+    point->dp = dp;
+    point->t_ms = st->t;
+    point->value = st->value;
+    return 1;
+}
+
+uint32_t iot_hist_crc32(const uint8_t *buf, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
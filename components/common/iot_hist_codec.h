@@ -0,0 +1,105 @@
+#ifndef IOT_HIST_CODEC_H
+#define IOT_HIST_CODEC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 历史数据块编解码，不依赖ESP-IDF ==========
+ *
+ * 每条记录: dp(1字节) + 时间戳二阶差分(zigzag varint) + 与上一值的异或(varint)
+ * 差分状态按DP独立维护，每个块从零开始，块之间互不依赖，可单独解码
+ */
+
+#define IOT_HIST_MAX_DP         8
+#define IOT_HIST_MAGIC          0x48495354u     // "HIST"
+#define IOT_HIST_RECORD_MAX     16              // 单条记录最大编码长度
+#define IOT_HIST_RAW_RECORD     13              // 未压缩记录长度：dp + int64时间 + int32值
+
+// 块头（与负载一起写入flash）
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // 块序号，单调递增
+    int64_t t_first_ms;     // 块内最早时间
+    int64_t t_last_ms;      // 块内最晚时间
+    uint16_t count;         // 记录数
+    uint16_t len;           // 负载字节数
+    uint32_t crc;           // 负载CRC32
+} iot_hist_block_hdr_t;
+
+// 一个历史数据点
+typedef struct {
+    uint8_t dp;
+    int64_t t_ms;           // Unix时间（毫秒）
+    int32_t value;
+} iot_hist_point_t;
+
+// 单个DP的差分状态
+typedef struct {
+    int64_t t;
+    int64_t delta;
+    int32_t value;
+    uint8_t seen;
+} iot_hist_dp_state_t;
+
+typedef struct {
+    uint8_t *buf;
+    uint16_t cap;
+    uint16_t len;
+    uint16_t count;
+    int64_t t_first_ms;
+    int64_t t_last_ms;
+    iot_hist_dp_state_t st[IOT_HIST_MAX_DP];
+} iot_hist_enc_t;
+
+typedef struct {
+    const uint8_t *buf;
+    uint16_t len;
+    uint16_t pos;
+    iot_hist_dp_state_t st[IOT_HIST_MAX_DP];
+} iot_hist_dec_t;
+
+/**
+ * @brief 初始化编码器
+ *
+ * @param enc 编码器
+ * @param buf 负载缓冲区
+ * @param cap 缓冲区容量
+ */
+void iot_hist_enc_init(iot_hist_enc_t *enc, uint8_t *buf, uint16_t cap);
+
+/**
+ * @brief 追加一条记录
+ *
+ * @return int 编码字节数（>0），-1表示块已满，-2表示参数错误
+ */
+int iot_hist_enc_append(iot_hist_enc_t *enc, uint8_t dp, int64_t t_ms, int32_t value);
+
+/**
+ * @brief 初始化解码器
+ *
+ * @param dec 解码器
+ * @param buf 负载
+ * @param len 负载字节数
+ */
+void iot_hist_dec_init(iot_hist_dec_t *dec, const uint8_t *buf, uint16_t len);
+
+/**
+ * @brief 解码下一条记录
+ *
+ * @return int 1表示取到记录，0表示已结束，-1表示数据损坏
+ */
+int iot_hist_dec_next(iot_hist_dec_t *dec, iot_hist_point_t *point);
+
+/**
+ * @brief 计算CRC32（IEEE 802.3）
+ */
+uint32_t iot_hist_crc32(const uint8_t *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_HIST_CODEC_H */
@@ -0,0 +1,293 @@
+/*
+ * 本地历史数据存储：RAM当前块 + flash循环块区
+ *
+ * 块写入前若位于扇区起始则先擦除整个扇区，因此每次覆盖会同时丢弃同一扇区内最旧的几个块
+ */
+
+#include "iot_history.h"
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+
+static const char *TAG = "history";
+
+#define HIST_HDR_SIZE       sizeof(iot_hist_block_hdr_t)
+#define HIST_PAYLOAD_SIZE   (IOT_HISTORY_BLOCK_SIZE - HIST_HDR_SIZE)
+
+static const esp_partition_t *s_part = NULL;
+static uint32_t s_slots = 0;                // 分区可容纳的块数
+static uint32_t s_next_seq = 0;             // 当前RAM块写入flash时使用的序号
+static SemaphoreHandle_t s_lock = NULL;
+
+static uint8_t s_block_buf[IOT_HISTORY_BLOCK_SIZE];    // 块头 + 当前块负载
+static iot_hist_enc_t s_head;
+static iot_history_stats_t s_stats;
+
+static size_t slot_offset(uint32_t seq)
+{
+    return (size_t)(seq % s_slots) * IOT_HISTORY_BLOCK_SIZE;
+}
+
+static void reset_head(void)
+{
+    iot_hist_enc_init(&s_head, s_block_buf + HIST_HDR_SIZE, HIST_PAYLOAD_SIZE);
+}
+
+/* 扫描所有块头，找到最新的序号 */
+static void recover_write_position(void)
+{
+    iot_hist_block_hdr_t hdr;
+    bool found = false;
+    uint32_t max_seq = 0;
+
+    for (uint32_t slot = 0; slot < s_slots; slot++) {
+        if (esp_partition_read(s_part, (size_t)slot * IOT_HISTORY_BLOCK_SIZE, &hdr, sizeof(hdr)) != ESP_OK) {
+            continue;
+        }
+        if (hdr.magic != IOT_HIST_MAGIC || hdr.seq % s_slots != slot) {
+            continue;
+        }
+        if (!found || hdr.seq > max_seq) {
+            max_seq = hdr.seq;
+            found = true;
+        }
+    }
+    s_next_seq = found ? max_seq + 1 : 0;
+
+    // 上次掉电时可能写了一半，该位置不是擦除状态就跳到下一个扇区
+    uint32_t slots_per_sector = s_part->erase_size / IOT_HISTORY_BLOCK_SIZE;
+    uint32_t in_sector = s_next_seq % slots_per_sector;
+    if (in_sector != 0) {
+        uint32_t magic = 0;
+        esp_partition_read(s_part, slot_offset(s_next_seq), &magic, sizeof(magic));
+        if (magic != 0xFFFFFFFFu) {
+            s_next_seq += slots_per_sector - in_sector;
+        }
+    }
+}
+
+/* 把当前块写入flash，调用方须持有 s_lock */
+static esp_err_t write_head_locked(void)
+{
+    if (s_head.count == 0) {
+        return ESP_OK;
+    }
+
+    size_t offset = slot_offset(s_next_seq);
+    esp_err_t err = ESP_OK;
+    if (offset % s_part->erase_size == 0) {
+        err = esp_partition_erase_range(s_part, offset, s_part->erase_size);
+    }
+    if (err == ESP_OK) {
+        iot_hist_block_hdr_t hdr = {
+            .magic = IOT_HIST_MAGIC,
+            .seq = s_next_seq,
+            .t_first_ms = s_head.t_first_ms,
+            .t_last_ms = s_head.t_last_ms,
+            .count = s_head.count,
+            .len = s_head.len,
+            .crc = iot_hist_crc32(s_head.buf, s_head.len),
+        };
+        memcpy(s_block_buf, &hdr, sizeof(hdr));
+        err = esp_partition_write(s_part, offset, s_block_buf, HIST_HDR_SIZE + s_head.len);
+    }
+
+    if (err == ESP_OK) {
+        s_stats.blocks_written++;
+    } else {
+        s_stats.flash_errors++;
+        ESP_LOGW(TAG, "写入块 %lu 失败: %s", (unsigned long)s_next_seq, esp_err_to_name(err));
+    }
+    // 失败也前进，避免反复写同一个坏块
+    s_next_seq++;
+    reset_head();
+    return err;
+}
+
+/* 解码一个块负载并按条件回调，回调要求停止时返回false */
+static bool emit_block(const uint8_t *payload, uint16_t len, uint32_t dp_mask,
+                       int64_t from_ms, int64_t to_ms,
+                       iot_history_cb_t cb, void *ctx, uint32_t *emitted)
+{
+    iot_hist_dec_t dec;
+    iot_hist_point_t point;
+    int rc;
+
+    iot_hist_dec_init(&dec, payload, len);
+    while ((rc = iot_hist_dec_next(&dec, &point)) == 1) {
+        if (!(dp_mask & (1u << point.dp)) || point.t_ms < from_ms || point.t_ms > to_ms) {
+            continue;
+        }
+        (*emitted)++;
+        if (!cb(&point, ctx)) {
+            return false;
+        }
+    }
+    if (rc < 0) {
+        ESP_LOGW(TAG, "块数据损坏，已跳过剩余记录");
+    }
+    return true;
+}
+
+esp_err_t iot_history_init(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                      IOT_HISTORY_PARTITION);
+    if (!s_part) {
+        ESP_LOGW(TAG, "未找到 %s 分区，历史存储不可用", IOT_HISTORY_PARTITION);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (s_part->erase_size % IOT_HISTORY_BLOCK_SIZE != 0 || s_part->size < s_part->erase_size * 2) {
+        ESP_LOGE(TAG, "%s 分区大小不合适", IOT_HISTORY_PARTITION);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_slots = s_part->size / IOT_HISTORY_BLOCK_SIZE;
+
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    recover_write_position();
+    reset_head();
+    ESP_LOGI(TAG, "历史存储就绪: %lu 个块, 下一块序号 %lu",
+             (unsigned long)s_slots, (unsigned long)s_next_seq);
+    return ESP_OK;
+}
+
+esp_err_t iot_history_append(uint8_t dp, int64_t t_ms, int32_t value)
+{
+    if (!s_lock || t_ms < IOT_HISTORY_MIN_VALID_MS) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (dp >= IOT_HIST_MAX_DP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = ESP_OK;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int n = iot_hist_enc_append(&s_head, dp, t_ms, value);
+    if (n == -1) {
+        err = write_head_locked();
+        n = iot_hist_enc_append(&s_head, dp, t_ms, value);
+    }
+    if (n > 0) {
+        s_stats.points++;
+        s_stats.raw_bytes += IOT_HIST_RAW_RECORD;
+        s_stats.encoded_bytes += n;
+    }
+    iot_latency_record(&s_stats.append, (uint32_t)(esp_timer_get_time() - start));
+    xSemaphoreGive(s_lock);
+
+    return err;
+}
+
+esp_err_t iot_history_flush(void)
+{
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = write_head_locked();
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t iot_history_query(uint32_t dp_mask, int64_t from_ms, int64_t to_ms,
+                            iot_history_cb_t cb, void* ctx)
+{
+    if (!cb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+#if CONFIG_IOT_STATIC_MEMORY
+    // 查询只在BLE历史任务中串行执行
+    static uint8_t s_query_buf[IOT_HISTORY_BLOCK_SIZE] __attribute__((aligned(4)));
+    uint8_t *buf = s_query_buf;
+#else
+    uint8_t *buf = malloc(IOT_HISTORY_BLOCK_SIZE);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    iot_hist_block_hdr_t *hdr = (iot_hist_block_hdr_t *)buf;
+    int64_t start = esp_timer_get_time();
+    uint32_t emitted = 0;
+    bool more = true;
+
+    // flash中的块写入后不再修改，只在读取序号时加锁，回调期间不阻塞追加
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t end_seq = s_next_seq;
+    xSemaphoreGive(s_lock);
+    uint32_t first_seq = (end_seq > s_slots) ? end_seq - s_slots : 0;
+
+    for (uint32_t seq = first_seq; more && seq < end_seq; seq++) {
+        size_t offset = slot_offset(seq);
+        if (esp_partition_read(s_part, offset, hdr, HIST_HDR_SIZE) != ESP_OK ||
+            hdr->magic != IOT_HIST_MAGIC || hdr->seq != seq || hdr->len > HIST_PAYLOAD_SIZE) {
+            continue;
+        }
+        if (hdr->t_last_ms < from_ms || hdr->t_first_ms > to_ms) {
+            continue;
+        }
+        uint16_t len = hdr->len;
+        if (esp_partition_read(s_part, offset, buf, HIST_HDR_SIZE + len) != ESP_OK ||
+            hdr->seq != seq || hdr->len != len ||
+            iot_hist_crc32(buf + HIST_HDR_SIZE, len) != hdr->crc) {
+            // 读取期间被新块覆盖或数据损坏
+            continue;
+        }
+        more = emit_block(buf + HIST_HDR_SIZE, len, dp_mask, from_ms, to_ms, cb, ctx, &emitted);
+    }
+
+    // 最后输出RAM中尚未写入flash的当前块
+    if (more) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        uint16_t len = s_head.len;
+        bool overlap = s_head.count > 0 && s_head.t_last_ms >= from_ms && s_head.t_first_ms <= to_ms;
+        if (overlap) {
+            memcpy(buf, s_head.buf, len);
+        }
+        xSemaphoreGive(s_lock);
+        if (overlap) {
+            emit_block(buf, len, dp_mask, from_ms, to_ms, cb, ctx, &emitted);
+        }
+    }
+#if !CONFIG_IOT_STATIC_MEMORY
+    free(buf);
+#endif
+
+    s_stats.last_query_points = emitted;
+    s_stats.last_query_us = (uint32_t)(esp_timer_get_time() - start);
+    ESP_LOGI(TAG, "查询完成: %lu 个样本, 耗时 %lu us",
+             (unsigned long)emitted, (unsigned long)s_stats.last_query_us);
+    return ESP_OK;
+}
+
+esp_err_t iot_history_get_stats(iot_history_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+    }
+    *stats = s_stats;
+    if (s_lock) {
+        xSemaphoreGive(s_lock);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,82 @@
+#ifndef IOT_HISTORY_H
+#define IOT_HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "iot_metrics.h"
+#include "iot_hist_codec.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 本地历史数据存储 ==========
+ *
+ * 样本先压缩写入RAM中的当前块，块满后写入 "history" 分区，分区按块循环覆盖
+ */
+
+#define IOT_HISTORY_PARTITION       "history"
+#define IOT_HISTORY_BLOCK_SIZE      1024            // 块大小（含块头），须整除flash扇区
+#define IOT_HISTORY_MIN_VALID_MS    1577836800000LL // 2020-01-01，早于此时间视为未对时
+
+// 查询回调，返回false停止查询
+typedef bool (*iot_history_cb_t)(const iot_hist_point_t* point, void* ctx);
+
+// 存储统计
+typedef struct {
+    uint32_t points;                // 已写入的样本数
+    uint32_t raw_bytes;             // 未压缩时需要的字节数
+    uint32_t encoded_bytes;         // 压缩后的字节数（不含块头）
+    uint32_t blocks_written;        // 写入flash的块数
+    uint32_t flash_errors;          // flash读写失败次数
+    iot_latency_stat_t append;      // 单次追加耗时（含块满时的flash写入）
+    uint32_t last_query_points;     // 最近一次查询输出的样本数
+    uint32_t last_query_us;         // 最近一次查询耗时
+} iot_history_stats_t;
+
+/**
+ * @brief 初始化历史存储，扫描分区恢复写入位置
+ *
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_NOT_FOUND表示分区表中没有history分区
+ */
+esp_err_t iot_history_init(void);
+
+/**
+ * @brief 追加一个样本
+ *
+ * @param dp 数据点编号
+ * @param t_ms Unix时间（毫秒）
+ * @param value 定点数值
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_INVALID_STATE表示未初始化或系统时间未同步
+ */
+esp_err_t iot_history_append(uint8_t dp, int64_t t_ms, int32_t value);
+
+/**
+ * @brief 把RAM中的当前块写入flash（例如重启前调用）
+ */
+esp_err_t iot_history_flush(void);
+
+/**
+ * @brief 按时间范围查询，按块从旧到新依次回调
+ *
+ * @param dp_mask 数据点位掩码，bit n 对应 dp n
+ * @param from_ms 起始时间（含）
+ * @param to_ms 结束时间（含）
+ * @param cb 回调，在调用者任务中执行
+ * @param ctx 回调上下文
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_history_query(uint32_t dp_mask, int64_t from_ms, int64_t to_ms,
+                            iot_history_cb_t cb, void* ctx);
+
+/**
+ * @brief 获取存储统计
+ */
+esp_err_t iot_history_get_stats(iot_history_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_HISTORY_H */
@@ -0,0 +1,42 @@
+#include "iot_metrics.h"
+#include <string.h>
+
+/**
+ * @brief 清零时延统计
+ */
+void iot_latency_reset(iot_latency_stat_t *stat)
+{
+    if (stat) {
+        memset(stat, 0, sizeof(*stat));
+    }
+}
+
+/**
+ * @brief 记录一次时延样本
+ */
+void iot_latency_record(iot_latency_stat_t *stat, uint32_t latency_us)
+{
+    if (!stat) {
+        return;
+    }
+    if (stat->count == 0 || latency_us < stat->min_us) {
+        stat->min_us = latency_us;
+    }
+    if (latency_us > stat->max_us) {
+        stat->max_us = latency_us;
+    }
+    stat->last_us = latency_us;
+    stat->total_us += latency_us;
+    stat->count++;
+}
+
+/**
+ * @brief 获取平均时延
+ */
+uint32_t iot_latency_avg_us(const iot_latency_stat_t *stat)
+{
+    if (!stat || stat->count == 0) {
+        return 0;
+    }
+    return (uint32_t)(stat->total_us / stat->count);
+}
@@ -0,0 +1,48 @@
+#ifndef IOT_METRICS_H
+#define IOT_METRICS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 运行时测量（instrumentation）========== */
+
+// 时延统计，单位微秒
+typedef struct {
+    uint32_t count;      // 样本数
+    uint32_t last_us;    // 最近一次
+    uint32_t min_us;     // 最小值
+    uint32_t max_us;     // 最大值
+    uint64_t total_us;   // 累计值，用于求平均
+} iot_latency_stat_t;
+
+/**
+ * @brief 清零时延统计
+ *
+ * @param stat 统计对象
+ */
+void iot_latency_reset(iot_latency_stat_t *stat);
+
+/**
+ * @brief 记录一次时延样本
+ *
+ * @param stat 统计对象
+ * @param latency_us 时延（微秒）
+ */
+void iot_latency_record(iot_latency_stat_t *stat, uint32_t latency_us);
+
+/**
+ * @brief 获取平均时延
+ *
+ * @param stat 统计对象
+ * @return uint32_t 平均时延（微秒），无样本时返回0
+ */
+uint32_t iot_latency_avg_us(const iot_latency_stat_t *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_METRICS_H */
@@ -0,0 +1,192 @@
+#include "iot_persist.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "common.h"
+
+static const char *TAG = "iot_persist";
+
+#define PERSIST_NVS_KEY         "state"
+#define PERSIST_VERSION         1
+
+// NVS中保存的记录，state之前的字段不参与"内容是否变化"的比较
+typedef struct {
+    uint8_t version;
+    uint8_t reserved[3];
+    uint32_t lifetime_writes;
+    iot_device_state_t state;
+} persist_record_t;
+
+_Static_assert(sizeof(iot_device_state_t) <= IOT_PERSIST_BLOB_MAX, "state too large");
+
+static iot_persist_core_t s_core;
+static SemaphoreHandle_t s_lock = NULL;
+static esp_timer_handle_t s_timer = NULL;
+static uint32_t s_lifetime_writes = 0;
+
+static void snapshot(iot_device_state_t* out)
+{
+    get_current_iot_snapshot(out);
+}
+
+static esp_err_t write_record(const iot_device_state_t* state)
+{
+    persist_record_t rec = {
+        .version = PERSIST_VERSION,
+        .lifetime_writes = s_lifetime_writes + 1,
+        .state = *state,
+    };
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(IOT_PERSIST_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_blob(nvs, PERSIST_NVS_KEY, &rec, sizeof(rec));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    if (err == ESP_OK) {
+        s_lifetime_writes = rec.lifetime_writes;
+    }
+    return err;
+}
+
+/* 按决策写入；写Flash期间不持锁，setter不会被阻塞 */
+static esp_err_t persist_poll(bool force)
+{
+    iot_device_state_t state;
+    snapshot(&state);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    iot_persist_action_t action = iot_persist_core_poll(&s_core, esp_timer_get_time(),
+                                                        &state, sizeof(state), force);
+    xSemaphoreGive(s_lock);
+    if (action != IOT_PERSIST_WRITE) {
+        return ESP_OK;
+    }
+
+    esp_err_t err = write_record(&state);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    iot_persist_core_committed(&s_core, esp_timer_get_time(), &state, sizeof(state), err == ESP_OK);
+    xSemaphoreGive(s_lock);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "保存状态失败: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "状态已保存: %s/%ld, 累计写入 %lu 次", state.device_status,
+                 (long)state.test_value, (unsigned long)s_lifetime_writes);
+    }
+    return err;
+}
+
+static void arm_timer(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int64_t due = iot_persist_core_next_due(&s_core);
+    xSemaphoreGive(s_lock);
+
+    esp_timer_stop(s_timer);
+    if (due != INT64_MAX) {
+        int64_t delay = due - esp_timer_get_time();
+        esp_timer_start_once(s_timer, delay > 0 ? (uint64_t)delay : 0);
+    }
+}
+
+/* 在esp_timer任务中执行，单次NVS写入为毫秒级 */
+static void persist_timer_cb(void* arg)
+{
+    persist_poll(false);
+    arm_timer();
+}
+
+static void on_state_changed(iot_dp_id_t dp, void* ctx)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    iot_persist_core_note_change(&s_core, esp_timer_get_time());
+    xSemaphoreGive(s_lock);
+    arm_timer();
+}
+
+static void on_shutdown(void)
+{
+    persist_poll(true);
+}
+
+esp_err_t iot_persist_start(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+    iot_persist_core_init(&s_core, IOT_PERSIST_QUIET_MS, IOT_PERSIST_MAX_HOLD_MS,
+                          IOT_PERSIST_BURST, IOT_PERSIST_REFILL_MS);
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 恢复上次保存的状态，直接写入全局变量，不触发状态变化回调
+    persist_record_t rec;
+    size_t len = sizeof(rec);
+    nvs_handle_t nvs;
+    if (nvs_open(IOT_PERSIST_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        if (nvs_get_blob(nvs, PERSIST_NVS_KEY, &rec, &len) == ESP_OK &&
+            len == sizeof(rec) && rec.version == PERSIST_VERSION) {
+            rec.state.device_status[sizeof(rec.state.device_status) - 1] = '\0';
+            g_iot_state = rec.state;
+            s_lifetime_writes = rec.lifetime_writes;
+            ESP_LOGI(TAG, "已恢复状态: device_status=%s, test_value=%ld",
+                     rec.state.device_status, (long)rec.state.test_value);
+        }
+        nvs_close(nvs);
+    }
+    iot_device_state_t state;
+    snapshot(&state);
+    iot_persist_core_set_saved(&s_core, &state, sizeof(state));
+
+    const esp_timer_create_args_t args = {
+        .callback = persist_timer_cb,
+        .name = "iot_persist",
+    };
+    esp_err_t err = esp_timer_create(&args, &s_timer);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (common_register_state_listener(on_state_changed, NULL) != 0) {
+        return ESP_ERR_NO_MEM;
+    }
+    // 重启（WiFi重试用尽、SNTP失败、OTA等）前写入未保存的变化
+    esp_register_shutdown_handler(on_shutdown);
+    return ESP_OK;
+}
+
+esp_err_t iot_persist_flush(void)
+{
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = persist_poll(true);
+    arm_timer();
+    return err;
+}
+
+esp_err_t iot_persist_get_info(iot_persist_info_t* info)
+{
+    if (!info) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    info->stats = s_core.stats;
+    xSemaphoreGive(s_lock);
+    info->lifetime_writes = s_lifetime_writes;
+    int64_t uptime_s = esp_timer_get_time() / 1000000;
+    info->writes_per_hour = uptime_s > 0 ? (uint32_t)((int64_t)info->stats.writes * 3600 / uptime_s) : 0;
+    return ESP_OK;
+}
@@ -0,0 +1,59 @@
+#ifndef IOT_PERSIST_H
+#define IOT_PERSIST_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "iot_persist_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 设备状态持久化 ==========
+ *
+ * g_iot_state 保存在NVS中，重启后恢复，不再回到默认值等待云端下发。
+ * 状态变化经防抖合并后写入，内容未变时不写，写入次数受预算限制以保护Flash寿命；
+ * esp_restart() 前把未写入的变化立即写入。
+ */
+
+#define IOT_PERSIST_NVS_NAMESPACE   "iot_state"
+#define IOT_PERSIST_QUIET_MS        3000            // 最后一次变化后安静3秒再写
+#define IOT_PERSIST_MAX_HOLD_MS     30000           // 持续变化时最多推迟30秒
+#define IOT_PERSIST_BURST           4               // 最多连续写入次数
+#define IOT_PERSIST_REFILL_MS       (5 * 60 * 1000) // 之后每5分钟一次，即持续不超过12次/小时
+
+typedef struct {
+    iot_persist_stats_t stats;
+    uint32_t lifetime_writes;   // 累计写入次数（随状态一起保存，跨重启）
+    uint32_t writes_per_hour;   // 本次开机以来的平均写入频率
+} iot_persist_info_t;
+
+/**
+ * @brief 从NVS恢复 g_iot_state 并开始跟踪状态变化
+ *
+ * 须在 common_init 之后、其他组件读取状态之前调用，NVS须已初始化
+ *
+ * @return esp_err_t ESP_OK表示成功（没有保存的状态时保持默认值）
+ */
+esp_err_t iot_persist_start(void);
+
+/**
+ * @brief 立即写入未保存的变化，忽略防抖和预算
+ *
+ * @return esp_err_t ESP_OK表示已写入或无需写入
+ */
+esp_err_t iot_persist_flush(void);
+
+/**
+ * @brief 获取写入统计
+ *
+ * @param info 输出统计
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_persist_get_info(iot_persist_info_t* info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_PERSIST_H */
@@ -0,0 +1,109 @@
+#include "iot_persist_core.h"
+#include <string.h>
+
+void iot_persist_core_init(iot_persist_core_t* core, uint32_t quiet_ms, uint32_t max_hold_ms,
+                           uint8_t burst, uint32_t refill_ms)
+{
+    memset(core, 0, sizeof(*core));
+    core->quiet_us = (int64_t)quiet_ms * 1000;
+    core->max_hold_us = (int64_t)max_hold_ms * 1000;
+    core->refill_us = (int64_t)refill_ms * 1000;
+    core->burst = burst ? burst : 1;
+    core->tokens = core->burst;
+}
+
+void iot_persist_core_set_saved(iot_persist_core_t* core, const void* blob, uint16_t len)
+{
+    if (len > IOT_PERSIST_BLOB_MAX) {
+        return;
+    }
+    memcpy(core->saved, blob, len);
+    core->saved_len = len;
+}
+
+void iot_persist_core_note_change(iot_persist_core_t* core, int64_t now_us)
+{
+    if (!core->dirty) {
+        core->dirty = true;
+        core->first_change_us = now_us;
+    }
+    core->last_change_us = now_us;
+    core->stats.changes++;
+}
+
+static void refill(iot_persist_core_t* core, int64_t now_us)
+{
+    while (core->tokens < core->burst && now_us >= core->refill_at_us) {
+        core->tokens++;
+        core->refill_at_us += core->refill_us;
+    }
+}
+
+static int64_t debounce_due(const iot_persist_core_t* core)
+{
+    int64_t quiet = core->last_change_us + core->quiet_us;
+    int64_t hold = core->first_change_us + core->max_hold_us;
+    return quiet < hold ? quiet : hold;
+}
+
+int64_t iot_persist_core_next_due(const iot_persist_core_t* core)
+{
+    if (!core->dirty) {
+        return INT64_MAX;
+    }
+    int64_t due = debounce_due(core);
+    if (core->tokens == 0 && core->refill_at_us > due) {
+        due = core->refill_at_us;
+    }
+    return due;
+}
+
+iot_persist_action_t iot_persist_core_poll(iot_persist_core_t* core, int64_t now_us,
+                                           const void* blob, uint16_t len, bool force)
+{
+    if (!core->dirty || len > IOT_PERSIST_BLOB_MAX) {
+        return IOT_PERSIST_IDLE;
+    }
+    if (!force && now_us < debounce_due(core)) {
+        return IOT_PERSIST_IDLE;
+    }
+    // 来回切换后回到已保存的值，无需写入
+    if (core->saved_len == len && memcmp(core->saved, blob, len) == 0) {
+        core->dirty = false;
+        core->stats.skipped_same++;
+        return IOT_PERSIST_SKIP;
+    }
+    refill(core, now_us);
+    if (!force && core->tokens == 0) {
+        core->stats.deferred++;
+        return IOT_PERSIST_DEFER;
+    }
+    core->write_us = now_us;
+    return IOT_PERSIST_WRITE;
+}
+
+void iot_persist_core_committed(iot_persist_core_t* core, int64_t now_us,
+                                const void* blob, uint16_t len, bool ok)
+{
+    refill(core, now_us);
+    if (core->tokens == core->burst) {
+        core->refill_at_us = now_us + core->refill_us;
+    }
+    if (core->tokens > 0) {
+        core->tokens--;
+    }
+
+    if (!ok) {
+        core->stats.failed++;
+        core->first_change_us = now_us;
+        core->last_change_us = now_us;
+        return;
+    }
+    core->stats.writes++;
+    iot_persist_core_set_saved(core, blob, len);
+    if (core->last_change_us <= core->write_us) {
+        core->dirty = false;
+    } else {
+        core->first_change_us = now_us;     // 写入期间的变化作为新一轮
+    }
+}
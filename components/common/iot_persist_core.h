@@ -0,0 +1,101 @@
+#ifndef IOT_PERSIST_CORE_H
+#define IOT_PERSIST_CORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 状态持久化的写入决策，不依赖ESP-IDF ==========
+ *
+ * 连续变化合并为一次写入：最后一次变化后安静 quiet_us，或第一次变化后最多 max_hold_us；
+ * 与上次写入的内容相同时不写；写入次数受令牌桶限制（最多连续 burst 次，之后每 refill_us 一次），
+ * 令牌不足时推迟到补充令牌的时刻。时间由调用方传入（微秒）。
+ */
+
+#define IOT_PERSIST_BLOB_MAX    64
+
+typedef enum {
+    IOT_PERSIST_IDLE = 0,       // 没有待写的变化，或未到防抖时刻
+    IOT_PERSIST_SKIP,           // 内容与上次写入相同，已清除待写标记
+    IOT_PERSIST_DEFER,          // 写入预算用完，推迟
+    IOT_PERSIST_WRITE,          // 调用方写入后调用 iot_persist_core_committed
+} iot_persist_action_t;
+
+typedef struct {
+    uint32_t changes;           // 状态变化次数
+    uint32_t writes;            // 成功写入次数
+    uint32_t skipped_same;      // 内容未变而省去的写入
+    uint32_t deferred;          // 因预算推迟的次数
+    uint32_t failed;            // 写入失败次数
+} iot_persist_stats_t;
+
+typedef struct {
+    int64_t quiet_us;
+    int64_t max_hold_us;
+    int64_t refill_us;
+    uint8_t burst;
+
+    bool dirty;
+    int64_t first_change_us;    // 本轮第一次变化
+    int64_t last_change_us;     // 本轮最后一次变化
+    int64_t write_us;           // 最近一次WRITE决策的时刻
+
+    uint8_t tokens;
+    int64_t refill_at_us;       // 下一个令牌的补充时刻（令牌未满时有效）
+
+    uint8_t saved[IOT_PERSIST_BLOB_MAX];
+    uint16_t saved_len;         // 0表示尚无已保存内容
+
+    iot_persist_stats_t stats;
+} iot_persist_core_t;
+
+/**
+ * @brief 初始化，令牌桶为满
+ */
+void iot_persist_core_init(iot_persist_core_t* core, uint32_t quiet_ms, uint32_t max_hold_ms,
+                           uint8_t burst, uint32_t refill_ms);
+
+/**
+ * @brief 设置已保存的内容（启动时从存储中恢复后调用），不计入写入次数
+ */
+void iot_persist_core_set_saved(iot_persist_core_t* core, const void* blob, uint16_t len);
+
+/**
+ * @brief 记录一次状态变化
+ */
+void iot_persist_core_note_change(iot_persist_core_t* core, int64_t now_us);
+
+/**
+ * @brief 下次需要调用 iot_persist_core_poll 的时刻，没有待写变化时返回INT64_MAX
+ */
+int64_t iot_persist_core_next_due(const iot_persist_core_t* core);
+
+/**
+ * @brief 判断现在是否写入
+ *
+ * @param core 决策状态
+ * @param now_us 当前时刻
+ * @param blob 当前要保存的内容
+ * @param len 内容长度，不超过 IOT_PERSIST_BLOB_MAX
+ * @param force 为true时忽略防抖时刻和预算（如重启前）
+ * @return iot_persist_action_t 决策
+ */
+iot_persist_action_t iot_persist_core_poll(iot_persist_core_t* core, int64_t now_us,
+                                           const void* blob, uint16_t len, bool force);
+
+/**
+ * @brief 记录WRITE决策的写入结果
+ *
+ * 写入期间又有变化时保持待写标记；写入失败也消耗一个令牌，并在安静时间后重试
+ */
+void iot_persist_core_committed(iot_persist_core_t* core, int64_t now_us,
+                                const void* blob, uint16_t len, bool ok);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_PERSIST_CORE_H */
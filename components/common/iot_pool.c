@@ -0,0 +1,67 @@
+#include "iot_pool.h"
+#include <string.h>
+
+void iot_pool_init(iot_pool_t* pool)
+{
+    memset(pool, 0, sizeof(*pool));
+}
+
+int iot_pool_add_class(iot_pool_t* pool, void* storage, uint16_t block_size, uint16_t count)
+{
+    if (!storage || count == 0 || pool->num_classes >= IOT_POOL_MAX_CLASSES ||
+        block_size < sizeof(void*) || block_size % IOT_POOL_ALIGN != 0 ||
+        (uintptr_t)storage % IOT_POOL_ALIGN != 0) {
+        return -1;
+    }
+    if (pool->num_classes > 0 && pool->cls[pool->num_classes - 1].block_size >= block_size) {
+        return -1;
+    }
+
+    iot_pool_class_t* cls = &pool->cls[pool->num_classes++];
+    cls->base = storage;
+    cls->block_size = block_size;
+    cls->count = count;
+    cls->free_list = NULL;
+    // 逆序入链，使低地址的块先被分配
+    for (int i = count - 1; i >= 0; i--) {
+        void** block = (void**)(cls->base + (size_t)i * block_size);
+        *block = cls->free_list;
+        cls->free_list = block;
+    }
+    return 0;
+}
+
+void* iot_pool_alloc(iot_pool_t* pool, size_t size)
+{
+    for (int i = 0; i < pool->num_classes; i++) {
+        iot_pool_class_t* cls = &pool->cls[i];
+        if (cls->block_size < size || !cls->free_list) {
+            continue;
+        }
+        void** block = cls->free_list;
+        cls->free_list = *block;
+        if (++cls->in_use > cls->peak) {
+            cls->peak = cls->in_use;
+        }
+        return block;
+    }
+    pool->fails++;
+    return NULL;
+}
+
+bool iot_pool_free(iot_pool_t* pool, void* ptr)
+{
+    uint8_t* p = ptr;
+    for (int i = 0; i < pool->num_classes; i++) {
+        iot_pool_class_t* cls = &pool->cls[i];
+        if (p < cls->base || p >= cls->base + (size_t)cls->block_size * cls->count) {
+            continue;
+        }
+        void** block = ptr;
+        *block = cls->free_list;
+        cls->free_list = block;
+        cls->in_use--;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,67 @@
+#ifndef IOT_POOL_H
+#define IOT_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 定长块内存池，不依赖ESP-IDF ==========
+ *
+ * 若干种块大小，每种一段调用方提供的连续存储，空闲块串成链表，分配和释放均为O(1)。
+ * 不加锁，由调用方互斥。
+ */
+
+#define IOT_POOL_MAX_CLASSES    4
+#define IOT_POOL_ALIGN          8
+
+typedef struct {
+    uint8_t* base;
+    uint16_t block_size;
+    uint16_t count;
+    void* free_list;
+    uint16_t in_use;
+    uint16_t peak;              // 最大同时占用块数
+} iot_pool_class_t;
+
+typedef struct {
+    iot_pool_class_t cls[IOT_POOL_MAX_CLASSES];
+    int num_classes;
+    uint32_t fails;             // 没有合适空闲块的次数
+} iot_pool_t;
+
+void iot_pool_init(iot_pool_t* pool);
+
+/**
+ * @brief 添加一种块大小，须按块大小升序添加
+ *
+ * @param pool 内存池
+ * @param storage 存储空间，至少 block_size*count 字节，按 IOT_POOL_ALIGN 对齐
+ * @param block_size 块大小，须为 IOT_POOL_ALIGN 的倍数
+ * @param count 块数
+ * @return int 0表示成功，-1表示参数错误或种类已满
+ */
+int iot_pool_add_class(iot_pool_t* pool, void* storage, uint16_t block_size, uint16_t count);
+
+/**
+ * @brief 从能容纳size的最小一种块中分配，该种用完时向更大的块借用
+ *
+ * @return void* 块地址，NULL表示没有合适的空闲块
+ */
+void* iot_pool_alloc(iot_pool_t* pool, size_t size);
+
+/**
+ * @brief 释放块
+ *
+ * @return bool false表示ptr不属于内存池（调用方按堆内存释放）
+ */
+bool iot_pool_free(iot_pool_t* pool, void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_POOL_H */
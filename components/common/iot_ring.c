@@ -0,0 +1,45 @@
+#include "iot_ring.h"
+
+int iot_ring_init(iot_ring_t *ring, iot_sample_t *storage, uint32_t capacity)
+{
+    if (!ring || !storage || capacity < 2 || (capacity & (capacity - 1)) != 0) {
+        return -1;
+    }
+    ring->buf = storage;
+    ring->mask = capacity - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 0;
+}
+
+bool iot_ring_push(iot_ring_t *ring, const iot_sample_t *sample)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail > ring->mask) {
+        return false;
+    }
+    ring->buf[head & ring->mask] = *sample;
+    // 先写数据再发布head，消费者看到新head时数据已就绪
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool iot_ring_pop(iot_ring_t *ring, iot_sample_t *sample)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+    *sample = ring->buf[tail & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint32_t iot_ring_count(iot_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail;
+}
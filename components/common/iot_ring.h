@@ -0,0 +1,61 @@
+#ifndef IOT_RING_H
+#define IOT_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 单生产者单消费者无锁采样环形缓冲区 ========== */
+
+// 一个采样点
+typedef struct {
+    int64_t t_us;       // 采样时刻（开机后微秒）
+    int32_t value;      // 定点数值，精度由DP自行约定
+    uint8_t dp;         // 数据点编号
+} iot_sample_t;
+
+typedef struct {
+    iot_sample_t *buf;
+    uint32_t mask;              // 容量-1，容量须为2的幂
+    _Atomic uint32_t head;      // 生产者写位置
+    _Atomic uint32_t tail;      // 消费者读位置
+} iot_ring_t;
+
+/**
+ * @brief 初始化环形缓冲区
+ *
+ * @param ring 缓冲区对象
+ * @param storage 存储空间
+ * @param capacity 容量，须为2的幂
+ * @return int 0表示成功，-1表示参数错误
+ */
+int iot_ring_init(iot_ring_t *ring, iot_sample_t *storage, uint32_t capacity);
+
+/**
+ * @brief 写入一个采样点（仅生产者调用）
+ *
+ * @return true 成功，false 缓冲区已满
+ */
+bool iot_ring_push(iot_ring_t *ring, const iot_sample_t *sample);
+
+/**
+ * @brief 取出一个采样点（仅消费者调用）
+ *
+ * @return true 成功，false 缓冲区为空
+ */
+bool iot_ring_pop(iot_ring_t *ring, iot_sample_t *sample);
+
+/**
+ * @brief 当前缓冲的采样点数
+ */
+uint32_t iot_ring_count(iot_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_RING_H */
@@ -0,0 +1,278 @@
+#include "iot_rule.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "common.h"
+#include "iot_sched.h"
+
+static const char *TAG = "iot_rule";
+
+#define RULE_NVS_KEY            "blob"
+
+// 引擎含规则集副本和索引，约6KB，静态分配
+static iot_rule_core_t s_core;
+static SemaphoreHandle_t s_lock = NULL;     // 递归锁：动作调用setter会重入状态回调
+static iot_latency_stat_t s_eval;
+
+// 分片接收缓冲
+static uint8_t s_rx_buf[IOT_RULE_BLOB_MAX];
+static uint16_t s_rx_len = 0;
+static uint16_t s_rx_total = 0;
+
+_Static_assert(IOT_DP_MAX <= IOT_RULE_MAX_DP, "too many DPs for rules");
+_Static_assert(sizeof(g_iot_state.device_status) > IOT_RULE_STR_MAX, "rule string too long");
+
+static const iot_rule_dp_type_t s_dp_types[IOT_DP_MAX] = {
+#define DP_TYPE_ENTRY(name, code, type, field, chr_id, unit) \
+    [IOT_DP_##name] = (type) == IOT_DP_TYPE_STR ? IOT_RULE_DP_STR : IOT_RULE_DP_INT,
+    IOT_DP_SCHEMA(DP_TYPE_ENTRY)
+#undef DP_TYPE_ENTRY
+};
+
+/* 按DP类型分派，类型不符的组合由规则校验排除，不会被调用 */
+static int32_t dp_int_IOT_DP_TYPE_INT(int32_t value)
+{
+    return value;
+}
+
+static int32_t dp_int_IOT_DP_TYPE_STR(const char* value)
+{
+    return 0;
+}
+
+static bool dp_str_eq_IOT_DP_TYPE_INT(int32_t value, const uint8_t* s, uint8_t len)
+{
+    return false;
+}
+
+static bool dp_str_eq_IOT_DP_TYPE_STR(const char* value, const uint8_t* s, uint8_t len)
+{
+    return strnlen(value, IOT_RULE_STR_MAX + 1) == len && memcmp(value, s, len) == 0;
+}
+
+static void dp_set_int_IOT_DP_TYPE_INT(void (*setter)(int32_t), int32_t value)
+{
+    setter(value);
+}
+
+static void dp_set_int_IOT_DP_TYPE_STR(void (*setter)(const char*), int32_t value)
+{
+}
+
+static void dp_set_str_IOT_DP_TYPE_INT(void (*setter)(int32_t), const char* value)
+{
+}
+
+static void dp_set_str_IOT_DP_TYPE_STR(void (*setter)(const char*), const char* value)
+{
+    setter(value);
+}
+
+static int32_t rule_get_int(uint8_t dp, void* ctx)
+{
+    switch (dp) {
+#define DP_GET_ENTRY(name, code, type, field, chr_id, unit) \
+    case IOT_DP_##name: \
+        return dp_int_##type(g_iot_state.field);
+    IOT_DP_SCHEMA(DP_GET_ENTRY)
+#undef DP_GET_ENTRY
+    default:
+        return 0;
+    }
+}
+
+static bool rule_str_eq(uint8_t dp, const uint8_t* s, uint8_t len, void* ctx)
+{
+    iot_device_state_t state;
+    get_current_iot_snapshot(&state);   // 字符串DP可能正被其他任务改写
+    switch (dp) {
+#define DP_STR_EQ_ENTRY(name, code, type, field, chr_id, unit) \
+    case IOT_DP_##name: \
+        return dp_str_eq_##type(state.field, s, len);
+    IOT_DP_SCHEMA(DP_STR_EQ_ENTRY)
+#undef DP_STR_EQ_ENTRY
+    default:
+        return false;
+    }
+}
+
+static void rule_set_int(uint8_t dp, int32_t value, void* ctx)
+{
+    switch (dp) {
+#define DP_SET_INT_ENTRY(name, code, type, field, chr_id, unit) \
+    case IOT_DP_##name: \
+        dp_set_int_##type(set_##field, value); \
+        break;
+    IOT_DP_SCHEMA(DP_SET_INT_ENTRY)
+#undef DP_SET_INT_ENTRY
+    default:
+        break;
+    }
+}
+
+static void rule_set_str(uint8_t dp, const uint8_t* s, uint8_t len, void* ctx)
+{
+    char value[IOT_RULE_STR_MAX + 1];
+    memcpy(value, s, len);
+    value[len] = '\0';
+    switch (dp) {
+#define DP_SET_STR_ENTRY(name, code, type, field, chr_id, unit) \
+    case IOT_DP_##name: \
+        dp_set_str_##type(set_##field, value); \
+        break;
+    IOT_DP_SCHEMA(DP_SET_STR_ENTRY)
+#undef DP_SET_STR_ENTRY
+    default:
+        break;
+    }
+}
+
+static void on_state_changed(iot_dp_id_t dp, void* ctx)
+{
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    // 只统计最外层，嵌套求值的耗时计入触发它的那次变化
+    bool outer = s_core.depth == 0 && iot_rule_core_watches(&s_core, (uint8_t)dp);
+    int64_t start = outer ? esp_timer_get_time() : 0;
+    iot_rule_core_on_change(&s_core, (uint8_t)dp);
+    if (outer) {
+        iot_latency_record(&s_eval, (uint32_t)(esp_timer_get_time() - start));
+    }
+    xSemaphoreGiveRecursive(s_lock);
+}
+
+/* 在调度任务中保存，不占用下发通道（BLE主机任务、MQTT事件任务） */
+static void save_job(void* ctx)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(IOT_RULE_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+        err = nvs_set_blob(nvs, RULE_NVS_KEY, s_core.blob, s_core.blob_len);
+        xSemaphoreGiveRecursive(s_lock);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "保存规则集失败: %s", esp_err_to_name(err));
+    }
+}
+
+esp_err_t iot_rule_start(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateRecursiveMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    const iot_rule_io_t io = {
+        .get_int = rule_get_int,
+        .str_eq = rule_str_eq,
+        .set_int = rule_set_int,
+        .set_str = rule_set_str,
+    };
+    iot_rule_core_init(&s_core, s_dp_types, IOT_DP_MAX, &io);
+
+    // 借用分片缓冲读取，此时还没有下发通道
+    size_t len = sizeof(s_rx_buf);
+    nvs_handle_t nvs;
+    if (nvs_open(IOT_RULE_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        if (nvs_get_blob(nvs, RULE_NVS_KEY, s_rx_buf, &len) == ESP_OK) {
+            int count = iot_rule_core_load(&s_core, s_rx_buf, len);
+            if (count < 0) {
+                ESP_LOGW(TAG, "保存的规则集无效，已忽略");
+            } else {
+                ESP_LOGI(TAG, "已恢复 %d 条规则 (%u 字节)", count, (unsigned)len);
+            }
+        }
+        nvs_close(nvs);
+    }
+
+    if (common_register_state_listener(on_state_changed, NULL) != 0) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t iot_rule_install(const uint8_t* blob, size_t len)
+{
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    int count = iot_rule_core_load(&s_core, blob, len);
+    xSemaphoreGiveRecursive(s_lock);
+    if (count < 0) {
+        ESP_LOGW(TAG, "规则集校验失败 (%u 字节)，保留原规则", (unsigned)len);
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_LOGI(TAG, "已安装 %d 条规则 (%u 字节)", count, (unsigned)len);
+    if (iot_sched_after("rule_save", 0, save_job, NULL, NULL) != ESP_OK) {
+        save_job(NULL);
+    }
+    return ESP_OK;
+}
+
+esp_err_t iot_rule_put_chunk(const uint8_t* data, size_t len)
+{
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!data || len < IOT_RULE_CHUNK_HDR_LEN || len > IOT_RULE_CHUNK_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint16_t off = (uint16_t)(data[0] | (data[1] << 8));
+    uint16_t total = (uint16_t)(data[2] | (data[3] << 8));
+    size_t n = len - IOT_RULE_CHUNK_HDR_LEN;
+
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    if (off == 0) {
+        s_rx_len = 0;
+        s_rx_total = total;
+    }
+    esp_err_t err = ESP_OK;
+    if (total == 0 || total > sizeof(s_rx_buf) || (size_t)off + n > total) {
+        err = ESP_ERR_INVALID_SIZE;
+    } else if (off != s_rx_len || total != s_rx_total) {
+        err = ESP_ERR_INVALID_STATE;   // 丢失或乱序的分片
+    }
+    if (err != ESP_OK) {
+        s_rx_len = 0;
+        s_rx_total = 0;
+        xSemaphoreGiveRecursive(s_lock);
+        ESP_LOGW(TAG, "规则分片无效: offset=%u total=%u len=%u", off, total, (unsigned)n);
+        return err;
+    }
+    memcpy(s_rx_buf + off, data + IOT_RULE_CHUNK_HDR_LEN, n);
+    s_rx_len = (uint16_t)(off + n);
+    if (s_rx_len == s_rx_total) {
+        err = iot_rule_install(s_rx_buf, s_rx_len);
+        s_rx_len = 0;
+        s_rx_total = 0;
+    }
+    xSemaphoreGiveRecursive(s_lock);
+    return err;
+}
+
+esp_err_t iot_rule_get_info(iot_rule_info_t* info)
+{
+    if (!info) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTakeRecursive(s_lock, portMAX_DELAY);
+    info->stats = s_core.stats;
+    info->count = s_core.count;
+    info->blob_len = s_core.blob_len;
+    info->eval = s_eval;
+    xSemaphoreGiveRecursive(s_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,74 @@
+#ifndef IOT_RULE_H
+#define IOT_RULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "iot_metrics.h"
+#include "iot_rule_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 本地联动规则 ==========
+ *
+ * 规则集（格式见 iot_rule_core.h，可用 tools/iot_rule_compile.py 生成）分片后通过云端property/set
+ * （local_rules字段，每条一个base64编码的分片）或BLE规则特征值下发，保存在NVS中，开机后恢复。
+ * 状态变化时在调用setter的任务中同步求值引用该DP的规则，条件由假变真时直接调用setter执行动作，不经过云端。
+ */
+
+#define IOT_RULE_NVS_NAMESPACE  "iot_rule"
+#define IOT_RULE_PROPERTY_CODE  "local_rules"   // property/set中携带规则集分片（base64）的字段
+#define IOT_RULE_CHUNK_HDR_LEN  4               // 分片头: 偏移(2) + 总长(2)，小端
+#define IOT_RULE_CHUNK_MAX      512             // 单个分片（含分片头）的上限，受MQTT接收缓冲和ATT属性长度限制
+
+typedef struct {
+    iot_rule_stats_t stats;
+    uint16_t count;             // 当前规则数
+    uint16_t blob_len;          // 当前规则集字节数
+    iot_latency_stat_t eval;    // 一次DP变化的求值耗时（含动作及其引起的嵌套求值）
+} iot_rule_info_t;
+
+/**
+ * @brief 从NVS恢复规则集并开始跟踪状态变化
+ *
+ * 须在 iot_persist_start 之后调用，恢复的状态不会触发规则
+ *
+ * @return esp_err_t ESP_OK表示成功（没有保存的规则集时为空）
+ */
+esp_err_t iot_rule_start(void);
+
+/**
+ * @brief 校验并替换规则集，随后在后台保存到NVS
+ *
+ * @param blob 规则集，规则数为0表示清空
+ * @param len 长度
+ * @return esp_err_t ESP_OK表示已生效，ESP_ERR_INVALID_ARG表示校验失败（原规则集不变）
+ */
+esp_err_t iot_rule_install(const uint8_t* blob, size_t len);
+
+/**
+ * @brief 接收一个规则集分片
+ *
+ * 分片: 偏移(2) + 总长(2) + 数据，按顺序写入，偏移为0时重新开始；收齐后调用 iot_rule_install
+ *
+ * @param data 分片
+ * @param len 分片长度
+ * @return esp_err_t ESP_OK表示已接收（或收齐后安装成功），其他值表示分片或规则集无效，须从偏移0重发
+ */
+esp_err_t iot_rule_put_chunk(const uint8_t* data, size_t len);
+
+/**
+ * @brief 获取规则统计
+ *
+ * @param info 输出统计
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_rule_get_info(iot_rule_info_t* info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_RULE_H */
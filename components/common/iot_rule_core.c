@@ -0,0 +1,346 @@
+#include "iot_rule_core.h"
+#include <string.h>
+#include "iot_hist_codec.h"
+
+#define RULE_HDR_LEN    3       // id + 条件长度 + 动作长度
+
+static uint16_t get_u16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static int32_t get_i32(const uint8_t* p)
+{
+    return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+    return (uint32_t)get_i32(p);
+}
+
+/* 单条指令的长度（含操作码），按剩余字节数检查，未知操作码或越界返回0 */
+static size_t insn_len(const uint8_t* p, size_t avail)
+{
+    size_t n;
+    switch (p[0]) {
+    case IOT_RULE_OP_PUSH_DP:
+    case IOT_RULE_OP_PUSH_I8:
+        n = 2;
+        break;
+    case IOT_RULE_OP_PUSH_I32:
+        n = 5;
+        break;
+    case IOT_RULE_OP_EQ: case IOT_RULE_OP_NE: case IOT_RULE_OP_LT:
+    case IOT_RULE_OP_LE: case IOT_RULE_OP_GT: case IOT_RULE_OP_GE:
+    case IOT_RULE_OP_AND: case IOT_RULE_OP_OR: case IOT_RULE_OP_NOT:
+    case IOT_RULE_OP_ADD: case IOT_RULE_OP_SUB:
+        n = 1;
+        break;
+    case IOT_RULE_OP_STR_EQ:
+    case IOT_RULE_OP_SET_STR:
+        if (avail < 3) {
+            return 0;
+        }
+        n = 3 + (size_t)p[2];
+        break;
+    case IOT_RULE_OP_SET_INT:
+        n = 6;
+        break;
+    default:
+        return 0;
+    }
+    return n <= avail ? n : 0;
+}
+
+static bool dp_is(const iot_rule_core_t* core, uint8_t dp, iot_rule_dp_type_t type)
+{
+    return dp < core->dp_count && core->dp_types[dp] == type;
+}
+
+static bool verify_cond(const iot_rule_core_t* core, const uint8_t* p, size_t len)
+{
+    int sp = 0;
+    size_t i = 0;
+    while (i < len) {
+        size_t n = insn_len(p + i, len - i);
+        if (n == 0) {
+            return false;
+        }
+        const uint8_t* op = p + i;
+        switch (op[0]) {
+        case IOT_RULE_OP_PUSH_DP:
+            if (!dp_is(core, op[1], IOT_RULE_DP_INT)) {
+                return false;
+            }
+            sp++;
+            break;
+        case IOT_RULE_OP_STR_EQ:
+            if (!dp_is(core, op[1], IOT_RULE_DP_STR) || op[2] > IOT_RULE_STR_MAX) {
+                return false;
+            }
+            sp++;
+            break;
+        case IOT_RULE_OP_PUSH_I8:
+        case IOT_RULE_OP_PUSH_I32:
+            sp++;
+            break;
+        case IOT_RULE_OP_NOT:
+            if (sp < 1) {
+                return false;
+            }
+            break;
+        case IOT_RULE_OP_SET_INT:
+        case IOT_RULE_OP_SET_STR:
+            return false;
+        default:
+            if (sp < 2) {
+                return false;
+            }
+            sp--;
+            break;
+        }
+        if (sp > IOT_RULE_STACK_DEPTH) {
+            return false;
+        }
+        i += n;
+    }
+    return sp == 1;
+}
+
+static bool verify_act(const iot_rule_core_t* core, const uint8_t* p, size_t len)
+{
+    size_t i = 0;
+    while (i < len) {
+        size_t n = insn_len(p + i, len - i);
+        if (n == 0) {
+            return false;
+        }
+        const uint8_t* op = p + i;
+        if (op[0] == IOT_RULE_OP_SET_INT) {
+            if (!dp_is(core, op[1], IOT_RULE_DP_INT)) {
+                return false;
+            }
+        } else if (op[0] == IOT_RULE_OP_SET_STR) {
+            if (!dp_is(core, op[1], IOT_RULE_DP_STR) || op[2] > IOT_RULE_STR_MAX) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+int iot_rule_core_verify(const iot_rule_core_t* core, const uint8_t* blob, size_t len)
+{
+    if (!blob || len < IOT_RULE_HDR_LEN + IOT_RULE_CRC_LEN || len > IOT_RULE_BLOB_MAX) {
+        return -1;
+    }
+    if (blob[0] != 'R' || blob[1] != 'L' || blob[2] != IOT_RULE_VERSION) {
+        return -1;
+    }
+    size_t body_end = len - IOT_RULE_CRC_LEN;
+    if (iot_hist_crc32(blob, (uint32_t)body_end) != get_u32(blob + body_end)) {
+        return -1;
+    }
+    uint16_t count = get_u16(blob + 3);
+    if (count > IOT_RULE_MAX_RULES) {
+        return -1;
+    }
+
+    size_t pos = IOT_RULE_HDR_LEN;
+    for (uint16_t r = 0; r < count; r++) {
+        if (body_end - pos < RULE_HDR_LEN) {
+            return -1;
+        }
+        size_t cond_len = blob[pos + 1];
+        size_t act_len = blob[pos + 2];
+        pos += RULE_HDR_LEN;
+        if (cond_len == 0 || act_len == 0 || body_end - pos < cond_len + act_len) {
+            return -1;
+        }
+        if (!verify_cond(core, blob + pos, cond_len) ||
+            !verify_act(core, blob + pos + cond_len, act_len)) {
+            return -1;
+        }
+        pos += cond_len + act_len;
+    }
+    return pos == body_end ? (int)count : -1;
+}
+
+/* 求值条件，字节码已校验 */
+static bool eval_cond(const iot_rule_core_t* core, const uint8_t* p, const uint8_t* end)
+{
+    int32_t st[IOT_RULE_STACK_DEPTH];
+    int sp = 0;
+    while (p < end) {
+        int32_t a, b;
+        switch (*p) {
+        case IOT_RULE_OP_PUSH_DP:
+            st[sp++] = core->io.get_int(p[1], core->io.ctx);
+            p += 2;
+            continue;
+        case IOT_RULE_OP_PUSH_I8:
+            st[sp++] = (int8_t)p[1];
+            p += 2;
+            continue;
+        case IOT_RULE_OP_PUSH_I32:
+            st[sp++] = get_i32(p + 1);
+            p += 5;
+            continue;
+        case IOT_RULE_OP_STR_EQ:
+            st[sp++] = core->io.str_eq(p[1], p + 3, p[2], core->io.ctx);
+            p += 3 + p[2];
+            continue;
+        case IOT_RULE_OP_NOT:
+            st[sp - 1] = !st[sp - 1];
+            p++;
+            continue;
+        default:
+            break;
+        }
+        b = st[--sp];
+        a = st[sp - 1];
+        switch (*p) {
+        case IOT_RULE_OP_EQ:  a = a == b; break;
+        case IOT_RULE_OP_NE:  a = a != b; break;
+        case IOT_RULE_OP_LT:  a = a < b; break;
+        case IOT_RULE_OP_LE:  a = a <= b; break;
+        case IOT_RULE_OP_GT:  a = a > b; break;
+        case IOT_RULE_OP_GE:  a = a >= b; break;
+        case IOT_RULE_OP_AND: a = a && b; break;
+        case IOT_RULE_OP_OR:  a = a || b; break;
+        case IOT_RULE_OP_ADD: a = (int32_t)((uint32_t)a + (uint32_t)b); break;
+        case IOT_RULE_OP_SUB: a = (int32_t)((uint32_t)a - (uint32_t)b); break;
+        default: break;
+        }
+        st[sp - 1] = a;
+        p++;
+    }
+    return st[0] != 0;
+}
+
+static void run_actions(iot_rule_core_t* core, const uint8_t* p, const uint8_t* end)
+{
+    while (p < end) {
+        if (*p == IOT_RULE_OP_SET_INT) {
+            core->io.set_int(p[1], get_i32(p + 2), core->io.ctx);
+            p += 6;
+        } else {
+            core->io.set_str(p[1], p + 3, p[2], core->io.ctx);
+            p += 3 + p[2];
+        }
+    }
+}
+
+void iot_rule_core_init(iot_rule_core_t* core, const iot_rule_dp_type_t* dp_types, uint8_t dp_count,
+                        const iot_rule_io_t* io)
+{
+    memset(core, 0, sizeof(*core));
+    core->dp_count = dp_count > IOT_RULE_MAX_DP ? IOT_RULE_MAX_DP : dp_count;
+    for (uint8_t i = 0; i < core->dp_count; i++) {
+        core->dp_types[i] = (uint8_t)dp_types[i];
+    }
+    core->io = *io;
+}
+
+int iot_rule_core_load(iot_rule_core_t* core, const uint8_t* blob, size_t len)
+{
+    int count = iot_rule_core_verify(core, blob, len);
+    if (count < 0) {
+        core->stats.rejects++;
+        return -1;
+    }
+
+    memcpy(core->blob, blob, len);
+    core->blob_len = (uint16_t)len;
+    core->count = (uint16_t)count;
+    memset(core->deps, 0, sizeof(core->deps));
+    memset(core->active, 0, sizeof(core->active));
+
+    // 建立索引：各规则的偏移和条件引用的DP
+    size_t pos = IOT_RULE_HDR_LEN;
+    for (int r = 0; r < count; r++) {
+        const uint8_t* cond = core->blob + pos + RULE_HDR_LEN;
+        const uint8_t* cond_end = cond + core->blob[pos + 1];
+        core->rule_off[r] = (uint16_t)pos;
+        for (const uint8_t* p = cond; p < cond_end; p += insn_len(p, (size_t)(cond_end - p))) {
+            if (*p == IOT_RULE_OP_PUSH_DP || *p == IOT_RULE_OP_STR_EQ) {
+                core->deps[p[1]][r / 32] |= 1UL << (r % 32);
+            }
+        }
+        pos += RULE_HDR_LEN + core->blob[pos + 1] + core->blob[pos + 2];
+    }
+
+    // 已经成立的条件视为已触发，避免加载时（如开机恢复）集中执行一批动作
+    for (int r = 0; r < count; r++) {
+        const uint8_t* rule = core->blob + core->rule_off[r];
+        const uint8_t* cond = rule + RULE_HDR_LEN;
+        if (eval_cond(core, cond, cond + rule[1])) {
+            core->active[r / 32] |= 1UL << (r % 32);
+        }
+    }
+    core->stats.loads++;
+    return count;
+}
+
+static void eval_rule(iot_rule_core_t* core, int r)
+{
+    const uint8_t* rule = core->blob + core->rule_off[r];
+    const uint8_t* cond = rule + RULE_HDR_LEN;
+    const uint8_t* act = cond + rule[1];
+    uint32_t bit = 1UL << (r % 32);
+    uint32_t* word = &core->active[r / 32];
+
+    core->stats.evals++;
+    bool now = eval_cond(core, cond, act);
+    if (now == ((*word & bit) != 0)) {
+        return;
+    }
+    if (!now) {
+        *word &= ~bit;
+        return;
+    }
+    // 先置位再执行，动作引起的重入求值看到的是已触发状态
+    *word |= bit;
+    core->stats.fires++;
+    run_actions(core, act, act + rule[2]);
+}
+
+void iot_rule_core_on_change(iot_rule_core_t* core, uint8_t dp)
+{
+    if (dp >= core->dp_count) {
+        return;
+    }
+    core->stats.changes++;
+    if (core->depth >= IOT_RULE_MAX_DEPTH) {
+        core->stats.depth_drops++;
+        return;
+    }
+    core->depth++;
+    int words = (core->count + 31) / 32;
+    for (int w = 0; w < words; w++) {
+        uint32_t bits = core->deps[dp][w];
+        while (bits) {
+            int b = __builtin_ctz(bits);
+            bits &= bits - 1;
+            eval_rule(core, w * 32 + b);
+        }
+    }
+    core->depth--;
+}
+
+bool iot_rule_core_watches(const iot_rule_core_t* core, uint8_t dp)
+{
+    if (dp >= core->dp_count) {
+        return false;
+    }
+    for (int w = 0; w < IOT_RULE_WORDS; w++) {
+        if (core->deps[dp][w]) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,136 @@
+#ifndef IOT_RULE_CORE_H
+#define IOT_RULE_CORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 本地联动规则：字节码校验与增量求值，不依赖ESP-IDF ==========
+ *
+ * 规则集格式（小端）：
+ *   'R' 'L' 版本(1) 规则数(2) | 规则... | CRC32(4)，CRC覆盖之前的全部字节
+ *   规则: id(1) 条件长度(1) 动作长度(1) 条件字节码 动作字节码
+ *
+ * 条件是栈式表达式，求值结果非0为真；动作只在条件由假变真时执行一次（边沿触发），
+ * 条件保持为真不会重复执行。加载时一次性校验（操作码、栈深度、DP编号和类型、长度），
+ * 求值时不再做边界检查。每个DP记录引用它的规则，DP变化时只求值这些规则。
+ */
+
+#define IOT_RULE_MAX_RULES      256
+#define IOT_RULE_BLOB_MAX       4096
+#define IOT_RULE_MAX_DP         16
+#define IOT_RULE_STACK_DEPTH    8
+#define IOT_RULE_MAX_DEPTH      4       // 动作引起的DP变化可再触发规则，最多嵌套这么多层
+#define IOT_RULE_STR_MAX        31
+#define IOT_RULE_VERSION        1
+#define IOT_RULE_HDR_LEN        5
+#define IOT_RULE_CRC_LEN        4
+
+#define IOT_RULE_WORDS          (IOT_RULE_MAX_RULES / 32)
+
+// 条件操作码
+#define IOT_RULE_OP_PUSH_DP     0x01    // dp(1)：压入整数DP的当前值
+#define IOT_RULE_OP_PUSH_I8     0x02    // v(1)
+#define IOT_RULE_OP_PUSH_I32    0x03    // v(4)
+#define IOT_RULE_OP_EQ          0x10
+#define IOT_RULE_OP_NE          0x11
+#define IOT_RULE_OP_LT          0x12
+#define IOT_RULE_OP_LE          0x13
+#define IOT_RULE_OP_GT          0x14
+#define IOT_RULE_OP_GE          0x15
+#define IOT_RULE_OP_AND         0x20
+#define IOT_RULE_OP_OR          0x21
+#define IOT_RULE_OP_NOT         0x22
+#define IOT_RULE_OP_ADD         0x28
+#define IOT_RULE_OP_SUB         0x29
+#define IOT_RULE_OP_STR_EQ      0x30    // dp(1) len(1) 字节：字符串DP等于常量时压入1
+
+// 动作操作码
+#define IOT_RULE_OP_SET_INT     0x80    // dp(1) v(4)
+#define IOT_RULE_OP_SET_STR     0x81    // dp(1) len(1) 字节
+
+typedef enum {
+    IOT_RULE_DP_INT = 0,
+    IOT_RULE_DP_STR,
+} iot_rule_dp_type_t;
+
+// 读写DP的回调，由调用方实现
+typedef struct {
+    int32_t (*get_int)(uint8_t dp, void* ctx);
+    bool (*str_eq)(uint8_t dp, const uint8_t* s, uint8_t len, void* ctx);
+    void (*set_int)(uint8_t dp, int32_t value, void* ctx);
+    void (*set_str)(uint8_t dp, const uint8_t* s, uint8_t len, void* ctx);
+    void* ctx;
+} iot_rule_io_t;
+
+typedef struct {
+    uint32_t loads;             // 成功加载的规则集
+    uint32_t rejects;           // 校验失败被拒绝的规则集
+    uint32_t changes;           // 收到的DP变化
+    uint32_t evals;             // 求值的规则条数
+    uint32_t fires;             // 执行动作的次数
+    uint32_t depth_drops;       // 嵌套过深而忽略的DP变化
+} iot_rule_stats_t;
+
+typedef struct {
+    uint8_t blob[IOT_RULE_BLOB_MAX];
+    uint16_t blob_len;
+    uint16_t count;
+    uint16_t rule_off[IOT_RULE_MAX_RULES];      // 各规则在blob中的偏移
+    uint32_t deps[IOT_RULE_MAX_DP][IOT_RULE_WORDS];  // 引用各DP的规则位图
+    uint32_t active[IOT_RULE_WORDS];            // 条件当前为真的规则
+    uint8_t dp_count;
+    uint8_t dp_types[IOT_RULE_MAX_DP];
+    uint8_t depth;
+    iot_rule_io_t io;
+    iot_rule_stats_t stats;
+} iot_rule_core_t;
+
+/**
+ * @brief 初始化，规则集为空
+ *
+ * @param core 规则引擎
+ * @param dp_types 各DP的值类型
+ * @param dp_count DP个数，不超过 IOT_RULE_MAX_DP
+ * @param io 读写DP的回调
+ */
+void iot_rule_core_init(iot_rule_core_t* core, const iot_rule_dp_type_t* dp_types, uint8_t dp_count,
+                        const iot_rule_io_t* io);
+
+/**
+ * @brief 校验规则集，不修改引擎
+ *
+ * @return int 规则数，-1表示格式错误
+ */
+int iot_rule_core_verify(const iot_rule_core_t* core, const uint8_t* blob, size_t len);
+
+/**
+ * @brief 校验并替换规则集，按当前状态初始化各规则的真假，不执行动作
+ *
+ * 校验失败时保留原规则集
+ *
+ * @return int 规则数，-1表示格式错误
+ */
+int iot_rule_core_load(iot_rule_core_t* core, const uint8_t* blob, size_t len);
+
+/**
+ * @brief DP发生变化，求值引用它的规则，条件由假变真的执行动作
+ *
+ * 动作引起的DP变化会重入本函数，嵌套超过 IOT_RULE_MAX_DEPTH 层的变化被忽略
+ */
+void iot_rule_core_on_change(iot_rule_core_t* core, uint8_t dp);
+
+/**
+ * @brief 规则是否引用了该DP
+ */
+bool iot_rule_core_watches(const iot_rule_core_t* core, uint8_t dp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_RULE_CORE_H */
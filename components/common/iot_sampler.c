@@ -0,0 +1,194 @@
+/*
+ * 采样流水线：esp_timer 周期回调作为生产者写入无锁环形缓冲区，
+ * 聚合任务取出样本做窗口聚合，上报时关闭窗口取结果
+ */
+
+#include "iot_sampler.h"
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "iot_ring.h"
+#include "iot_static.h"
+
+static const char *TAG = "sampler";
+
+#define SAMPLER_DRAIN_PERIOD_MS 50      // 聚合任务取样周期
+
+typedef struct {
+    iot_dp_id_t dp;
+    iot_sample_read_fn_t read_fn;
+    void *ctx;
+    uint32_t divider;
+} sample_source_t;
+
+static sample_source_t s_sources[IOT_SAMPLER_MAX_SOURCES];
+static int s_source_count = 0;
+static uint32_t s_tick = 0;
+
+static iot_sample_t s_ring_storage[IOT_SAMPLER_RING_SIZE];
+static iot_ring_t s_ring;
+static iot_aggregator_t s_agg;
+static SemaphoreHandle_t s_agg_lock = NULL;     // 保护聚合器，同时保证环形缓冲区只有一个消费者
+static esp_timer_handle_t s_timer = NULL;
+static iot_sample_sink_t s_sink = NULL;
+static void *s_sink_ctx = NULL;
+
+static iot_sampler_stats_t s_stats;
+static uint64_t s_total_cycles = 0;
+
+/* 生产者：esp_timer 回调中读取各采样源并入队 */
+static void sampler_timer_cb(void *arg)
+{
+    s_tick++;
+    for (int i = 0; i < s_source_count; i++) {
+        const sample_source_t *src = &s_sources[i];
+        if (s_tick % src->divider != 0) {
+            continue;
+        }
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        iot_sample_t sample = {
+            .t_us = esp_timer_get_time(),
+            .value = src->read_fn(src->ctx),
+            .dp = (uint8_t)src->dp,
+        };
+        bool ok = iot_ring_push(&s_ring, &sample);
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+        if (ok) {
+            s_stats.samples++;
+        } else {
+            s_stats.dropped++;
+        }
+        s_total_cycles += cycles;
+        if (cycles > s_stats.max_cycles) {
+            s_stats.max_cycles = cycles;
+        }
+    }
+}
+
+/* 消费者：把缓冲区中的样本累计到聚合窗口，调用方须持有 s_agg_lock */
+static void drain_ring_locked(void)
+{
+    iot_sample_t sample;
+    while (iot_ring_pop(&s_ring, &sample)) {
+        iot_agg_add(&s_agg, sample.dp, sample.value, sample.t_us);
+        if (s_sink) {
+            s_sink(&sample, s_sink_ctx);
+        }
+    }
+}
+
+static void sampler_task(void *arg)
+{
+    while (1) {
+        xSemaphoreTake(s_agg_lock, portMAX_DELAY);
+        drain_ring_locked();
+        xSemaphoreGive(s_agg_lock);
+        vTaskDelay(pdMS_TO_TICKS(SAMPLER_DRAIN_PERIOD_MS));
+    }
+}
+
+esp_err_t iot_sampler_add_source(iot_dp_id_t dp, iot_sample_read_fn_t read_fn, void* ctx, uint32_t divider)
+{
+    if (!read_fn || dp >= IOT_DP_MAX || dp >= IOT_AGG_MAX_DP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_timer) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_source_count >= IOT_SAMPLER_MAX_SOURCES) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_sources[s_source_count].dp = dp;
+    s_sources[s_source_count].read_fn = read_fn;
+    s_sources[s_source_count].ctx = ctx;
+    s_sources[s_source_count].divider = divider ? divider : 1;
+    s_source_count++;
+    return ESP_OK;
+}
+
+void iot_sampler_set_sink(iot_sample_sink_t sink, void* ctx)
+{
+    s_sink_ctx = ctx;
+    s_sink = sink;
+}
+
+IOT_TASK_MEM(s_sampler_task_mem, 2048);
+
+esp_err_t iot_sampler_start(uint32_t rate_hz)
+{
+    if (s_timer) {
+        return ESP_OK;
+    }
+    if (rate_hz == 0) {
+        rate_hz = IOT_SAMPLER_DEFAULT_HZ;
+    }
+
+    iot_ring_init(&s_ring, s_ring_storage, IOT_SAMPLER_RING_SIZE);
+    iot_agg_init(&s_agg);
+    s_agg_lock = xSemaphoreCreateMutex();
+    if (!s_agg_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (iot_task_create(sampler_task, "sampler", &s_sampler_task_mem, NULL, 4, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t args = {
+        .callback = sampler_timer_cb,
+        .name = "sampler",
+    };
+    esp_err_t err = esp_timer_create(&args, &s_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(s_timer, 1000000 / rate_hz);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "启动采样定时器失败: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "采样已启动: %lu Hz, %d 个采样源", (unsigned long)rate_hz, s_source_count);
+    return ESP_OK;
+}
+
+esp_err_t iot_sampler_take_window(iot_dp_id_t dp, iot_agg_result_t* out)
+{
+    if (!out || dp >= IOT_AGG_MAX_DP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_agg_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_agg_lock, portMAX_DELAY);
+    drain_ring_locked();
+    iot_agg_close(&s_agg, (uint8_t)dp, out);
+    xSemaphoreGive(s_agg_lock);
+    return ESP_OK;
+}
+
+int64_t iot_sampler_to_epoch_ms(int64_t t_us)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t now_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    return now_ms - (esp_timer_get_time() - t_us) / 1000;
+}
+
+esp_err_t iot_sampler_get_stats(iot_sampler_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = s_stats;
+    uint32_t total = s_stats.samples + s_stats.dropped;
+    stats->avg_cycles = total ? (uint32_t)(s_total_cycles / total) : 0;
+    return ESP_OK;
+}
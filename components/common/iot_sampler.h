@@ -0,0 +1,84 @@
+#ifndef IOT_SAMPLER_H
+#define IOT_SAMPLER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "common.h"
+#include "iot_aggregator.h"
+#include "iot_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 采样与聚合 ========== */
+
+#define IOT_SAMPLER_MAX_SOURCES     4
+#define IOT_SAMPLER_RING_SIZE       256     // 须为2的幂
+#define IOT_SAMPLER_DEFAULT_HZ      10
+
+// 采样读取函数，在 esp_timer 任务中调用，须快速返回
+typedef int32_t (*iot_sample_read_fn_t)(void* ctx);
+
+// 样本旁路输出，在聚合任务中对每个样本调用（例如写入本地历史）
+typedef void (*iot_sample_sink_t)(const iot_sample_t* sample, void* ctx);
+
+// 采样统计
+typedef struct {
+    uint32_t samples;           // 已写入环形缓冲区的样本数
+    uint32_t dropped;           // 缓冲区满丢弃的样本数
+    uint32_t avg_cycles;        // 每个样本的平均CPU周期（含读取和入队）
+    uint32_t max_cycles;        // 单个样本的最大CPU周期
+} iot_sampler_stats_t;
+
+/**
+ * @brief 注册采样源（须在 iot_sampler_start 之前调用）
+ *
+ * @param dp 数据点编号
+ * @param read_fn 读取函数
+ * @param ctx 读取函数上下文
+ * @param divider 分频，每 divider 个采样节拍读取一次，0按1处理
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_sampler_add_source(iot_dp_id_t dp, iot_sample_read_fn_t read_fn, void* ctx, uint32_t divider);
+
+/**
+ * @brief 设置样本旁路输出
+ *
+ * @param sink 输出函数，NULL表示取消
+ * @param ctx 输出函数上下文
+ */
+void iot_sampler_set_sink(iot_sample_sink_t sink, void* ctx);
+
+/**
+ * @brief 启动周期采样
+ *
+ * @param rate_hz 采样节拍频率（10~100Hz），0表示使用默认值
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_sampler_start(uint32_t rate_hz);
+
+/**
+ * @brief 关闭指定DP的当前聚合窗口并取出结果
+ *
+ * @param dp 数据点编号
+ * @param out 输出结果，count为0表示窗口内没有样本
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_sampler_take_window(iot_dp_id_t dp, iot_agg_result_t* out);
+
+/**
+ * @brief 把采样时刻（开机后微秒）换算为Unix时间（毫秒）
+ */
+int64_t iot_sampler_to_epoch_ms(int64_t t_us);
+
+/**
+ * @brief 获取采样统计
+ */
+esp_err_t iot_sampler_get_stats(iot_sampler_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_SAMPLER_H */
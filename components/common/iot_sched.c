@@ -0,0 +1,183 @@
+#include "iot_sched.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "iot_static.h"
+
+static const char *TAG = "iot_sched";
+
+static iot_sched_core_t s_core;
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_task = NULL;
+static esp_timer_handle_t s_timer = NULL;
+IOT_TASK_MEM(s_task_mem, IOT_SCHED_TASK_STACK);
+
+static void sched_timer_cb(void *arg)
+{
+    xTaskNotifyGive(s_task);
+}
+
+/* 工作任务：执行到期任务，再把定时器设到下一个到期时刻 */
+static void sched_task(void *arg)
+{
+    while (1) {
+        int64_t now = esp_timer_get_time();
+        int id;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        while ((id = iot_sched_core_take_due(&s_core, now)) != IOT_SCHED_NONE) {
+            iot_job_fn_t fn = s_core.jobs[id].fn;
+            void *ctx = s_core.jobs[id].ctx;
+            xSemaphoreGive(s_lock);
+
+            // 执行期间不持锁，任务函数中可以添加或取消任务
+            int64_t start = esp_timer_get_time();
+            fn(ctx);
+            uint32_t run_us = (uint32_t)(esp_timer_get_time() - start);
+
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            iot_sched_core_finish(&s_core, id, start, run_us);
+            if (s_core.jobs[id].period_us > 0 && run_us > s_core.jobs[id].period_us) {
+                ESP_LOGW(TAG, "任务 %s 耗时 %lu us 超过周期", s_core.jobs[id].name, (unsigned long)run_us);
+            }
+        }
+        int64_t next = iot_sched_core_next_due(&s_core);
+        xSemaphoreGive(s_lock);
+
+        esp_timer_stop(s_timer);
+        if (next != INT64_MAX) {
+            int64_t delay = next - esp_timer_get_time();
+            if (delay <= 0) {
+                continue;       // 执行期间又有任务到期
+            }
+            esp_timer_start_once(s_timer, (uint64_t)delay);
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+esp_err_t iot_sched_start(void)
+{
+    if (s_task) {
+        return ESP_OK;
+    }
+    iot_sched_core_init(&s_core);
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t args = {
+        .callback = sched_timer_cb,
+        .name = "iot_sched",
+    };
+    esp_err_t err = esp_timer_create(&args, &s_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "创建定时器失败: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (iot_task_create(sched_task, "iot_sched", &s_task_mem, NULL, IOT_SCHED_TASK_PRIO, &s_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t add_job(const char* name, uint32_t period_ms, uint32_t phase_ms,
+                         iot_job_fn_t fn, void* ctx, int* job_id)
+{
+    if (!s_task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!fn) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int id = iot_sched_core_add(&s_core, name, fn, ctx, (int64_t)period_ms * 1000,
+                                (int64_t)phase_ms * 1000, esp_timer_get_time());
+    xSemaphoreGive(s_lock);
+    if (id == IOT_SCHED_NONE) {
+        ESP_LOGE(TAG, "任务已满, 无法添加 %s", name ? name : "");
+        return ESP_ERR_NO_MEM;
+    }
+    if (job_id) {
+        *job_id = id;
+    }
+
+    // 让工作任务按新的最早到期时刻重设定时器
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+esp_err_t iot_sched_every(const char* name, uint32_t period_ms, uint32_t phase_ms,
+                          iot_job_fn_t fn, void* ctx, int* job_id)
+{
+    if (period_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return add_job(name, period_ms, phase_ms, fn, ctx, job_id);
+}
+
+esp_err_t iot_sched_after(const char* name, uint32_t delay_ms, iot_job_fn_t fn, void* ctx, int* job_id)
+{
+    return add_job(name, 0, delay_ms, fn, ctx, job_id);
+}
+
+esp_err_t iot_sched_set_period(int job_id, uint32_t period_ms)
+{
+    if (!s_task) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool ok = iot_sched_core_set_period(&s_core, job_id, (int64_t)period_ms * 1000);
+    xSemaphoreGive(s_lock);
+    if (!ok) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+void iot_sched_cancel(int job_id)
+{
+    if (!s_task) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    iot_sched_core_cancel(&s_core, job_id);
+    xSemaphoreGive(s_lock);
+    xTaskNotifyGive(s_task);
+}
+
+esp_err_t iot_sched_get_job(int job_id, iot_job_t* out)
+{
+    if (!out || !s_task || job_id < 0 || job_id >= IOT_SCHED_MAX_JOBS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_core.jobs[job_id];
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+void iot_sched_log_stats(void)
+{
+    if (!s_task) {
+        return;
+    }
+    for (int i = 0; i < IOT_SCHED_MAX_JOBS; i++) {
+        iot_job_t job;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        job = s_core.jobs[i];
+        xSemaphoreGive(s_lock);
+        if (!job.active || job.runs == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-12s 执行 %lu 次, 耗时 avg %lu / max %lu us, 超时 %lu, 跳过 %lu, 最大延迟 %lu us",
+                 job.name ? job.name : "-", (unsigned long)job.runs,
+                 (unsigned long)iot_latency_avg_us(&job.run_time), (unsigned long)job.run_time.max_us,
+                 (unsigned long)job.overruns, (unsigned long)job.missed, (unsigned long)job.max_late_us);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef IOT_SCHED_H
+#define IOT_SCHED_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "iot_sched_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 周期任务调度 ==========
+ *
+ * esp_timer 在最早到期时刻唤醒 "iot_sched" 工作任务，所有任务函数都在该任务中依次执行，
+ * 可以阻塞（如发布MQTT），但会推迟其后到期的任务
+ */
+
+#define IOT_SCHED_TASK_STACK    4096
+#define IOT_SCHED_TASK_PRIO     3
+
+/**
+ * @brief 启动调度器
+ *
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_sched_start(void);
+
+/**
+ * @brief 添加周期任务，到期时刻为 添加时刻+phase+n*period，不随执行耗时漂移
+ *
+ * @param name 任务名（须长期有效）
+ * @param period_ms 周期（毫秒）
+ * @param phase_ms 首次执行距现在的时间，用于错开多个同周期任务
+ * @param fn 任务函数
+ * @param ctx 任务函数参数
+ * @param job_id 输出任务ID，可为NULL
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_NO_MEM表示任务已满
+ */
+esp_err_t iot_sched_every(const char* name, uint32_t period_ms, uint32_t phase_ms,
+                          iot_job_fn_t fn, void* ctx, int* job_id);
+
+/**
+ * @brief 添加一次性任务，delay_ms后执行一次
+ *
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_NO_MEM表示任务已满
+ */
+esp_err_t iot_sched_after(const char* name, uint32_t delay_ms, iot_job_fn_t fn, void* ctx, int* job_id);
+
+/**
+ * @brief 修改周期任务的周期，以上次到期时刻为基准，不随调用时刻漂移；可在任务函数中调用
+ *
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_INVALID_ARG表示任务不存在或不是周期任务
+ */
+esp_err_t iot_sched_set_period(int job_id, uint32_t period_ms);
+
+/**
+ * @brief 取消任务
+ */
+void iot_sched_cancel(int job_id);
+
+/**
+ * @brief 获取任务的执行统计
+ *
+ * @param job_id 任务ID
+ * @param out 输出任务信息（含执行次数、耗时、超时和跳过的周期数）
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_sched_get_job(int job_id, iot_job_t* out);
+
+/**
+ * @brief 打印所有任务的执行统计
+ */
+void iot_sched_log_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_SCHED_H */
@@ -0,0 +1,131 @@
+#include "iot_sched_core.h"
+#include <string.h>
+
+void iot_sched_core_init(iot_sched_core_t* core)
+{
+    memset(core, 0, sizeof(*core));
+}
+
+int iot_sched_core_add(iot_sched_core_t* core, const char* name, iot_job_fn_t fn, void* ctx,
+                       int64_t period_us, int64_t phase_us, int64_t now_us)
+{
+    if (!fn || period_us < 0 || phase_us < 0) {
+        return IOT_SCHED_NONE;
+    }
+    for (int i = 0; i < IOT_SCHED_MAX_JOBS; i++) {
+        iot_job_t* job = &core->jobs[i];
+        if (job->active || job->running) {
+            continue;
+        }
+        memset(job, 0, sizeof(*job));
+        job->name = name;
+        job->fn = fn;
+        job->ctx = ctx;
+        job->period_us = period_us;
+        job->next_us = now_us + phase_us;
+        job->active = true;
+        return i;
+    }
+    return IOT_SCHED_NONE;
+}
+
+void iot_sched_core_cancel(iot_sched_core_t* core, int id)
+{
+    if (id >= 0 && id < IOT_SCHED_MAX_JOBS) {
+        core->jobs[id].active = false;
+    }
+}
+
+bool iot_sched_core_set_period(iot_sched_core_t* core, int id, int64_t period_us)
+{
+    if (id < 0 || id >= IOT_SCHED_MAX_JOBS || period_us <= 0) {
+        return false;
+    }
+    iot_job_t* job = &core->jobs[id];
+    if (!job->active || job->period_us == 0) {
+        return false;
+    }
+    // 执行中的任务已按旧周期排好下次，以本次到期时刻为基准重新计算
+    int64_t last_due = job->running ? job->due_us : job->next_us - job->period_us;
+    job->period_us = period_us;
+    job->next_us = last_due + period_us;
+    return true;
+}
+
+int64_t iot_sched_core_next_due(const iot_sched_core_t* core)
+{
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < IOT_SCHED_MAX_JOBS; i++) {
+        const iot_job_t* job = &core->jobs[i];
+        // 正在执行的周期任务须等本次执行完，避免同一任务并发
+        if (job->active && !job->running && job->next_us < next) {
+            next = job->next_us;
+        }
+    }
+    return next;
+}
+
+int iot_sched_core_take_due(iot_sched_core_t* core, int64_t now_us)
+{
+    int best = IOT_SCHED_NONE;
+    for (int i = 0; i < IOT_SCHED_MAX_JOBS; i++) {
+        const iot_job_t* job = &core->jobs[i];
+        if (job->active && !job->running && job->next_us <= now_us &&
+            (best == IOT_SCHED_NONE || job->next_us < core->jobs[best].next_us)) {
+            best = i;
+        }
+    }
+    if (best == IOT_SCHED_NONE) {
+        return IOT_SCHED_NONE;
+    }
+
+    iot_job_t* job = &core->jobs[best];
+    job->due_us = job->next_us;
+    if (job->period_us == 0) {
+        job->active = false;
+    } else {
+        // 在原到期时刻上累加周期，保持相位；错过的周期直接跳过
+        job->next_us += job->period_us;
+        if (job->next_us <= now_us) {
+            int64_t behind = (now_us - job->next_us) / job->period_us + 1;
+            job->next_us += behind * job->period_us;
+            job->missed += (uint32_t)behind;
+        }
+    }
+    job->running = true;
+    job->runs++;
+    return best;
+}
+
+void iot_sched_core_finish(iot_sched_core_t* core, int id, int64_t start_us, uint32_t run_us)
+{
+    if (id < 0 || id >= IOT_SCHED_MAX_JOBS) {
+        return;
+    }
+    iot_job_t* job = &core->jobs[id];
+    job->running = false;
+    // 按实际开始时刻计算：同一轮里排在慢任务后面的等待也算作延迟
+    int64_t late = start_us - job->due_us;
+    if (late > (int64_t)job->max_late_us) {
+        job->max_late_us = late > UINT32_MAX ? UINT32_MAX : (uint32_t)late;
+    }
+    iot_latency_record(&job->run_time, run_us);
+    if (job->period_us > 0 && run_us > job->period_us) {
+        job->overruns++;
+    }
+}
+
+int iot_sched_core_run_due(iot_sched_core_t* core, int64_t (*now_fn)(void* clock_ctx), void* clock_ctx)
+{
+    // 只执行本轮开始时已到期的任务，执行期间新到期的留到下一轮，耗时过长的任务不会独占
+    int64_t now = now_fn(clock_ctx);
+    int count = 0;
+    int id;
+    while ((id = iot_sched_core_take_due(core, now)) != IOT_SCHED_NONE) {
+        int64_t start = now_fn(clock_ctx);
+        core->jobs[id].fn(core->jobs[id].ctx);
+        iot_sched_core_finish(core, id, start, (uint32_t)(now_fn(clock_ctx) - start));
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,113 @@
+#ifndef IOT_SCHED_CORE_H
+#define IOT_SCHED_CORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "iot_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 周期任务调度核心，不依赖ESP-IDF ==========
+ *
+ * 时间由调用方传入（微秒），可用虚拟时钟做确定性测试。
+ * 周期任务按 起点+相位+n*周期 的绝对时刻到期，不受执行耗时影响而漂移；
+ * 落后超过一个周期时跳过错过的周期，不补跑。
+ */
+
+#define IOT_SCHED_MAX_JOBS      12
+#define IOT_SCHED_NONE          (-1)
+
+typedef void (*iot_job_fn_t)(void* ctx);
+
+typedef struct {
+    const char* name;
+    iot_job_fn_t fn;
+    void* ctx;
+    int64_t period_us;              // 0表示一次性任务
+    int64_t next_us;                // 下次到期时刻
+    int64_t due_us;                 // 本次执行对应的到期时刻，取出时记录
+    bool active;                    // 等待到期
+    bool running;                   // 已取出尚未执行完，槽位不可复用
+    uint32_t runs;
+    uint32_t overruns;              // 执行耗时超过周期的次数
+    uint32_t missed;                // 因落后而跳过的周期数
+    uint32_t max_late_us;           // 最大启动延迟（实际开始时刻-到期时刻），排在慢任务后面的等待也计入
+    iot_latency_stat_t run_time;    // 执行耗时
+} iot_job_t;
+
+typedef struct {
+    iot_job_t jobs[IOT_SCHED_MAX_JOBS];
+} iot_sched_core_t;
+
+void iot_sched_core_init(iot_sched_core_t* core);
+
+/**
+ * @brief 添加任务
+ *
+ * @param core 调度器
+ * @param name 任务名（须长期有效）
+ * @param fn 执行函数
+ * @param ctx 执行函数参数
+ * @param period_us 周期，0表示一次性任务
+ * @param phase_us 首次到期距now的时间
+ * @param now_us 当前时刻
+ * @return int 任务ID，IOT_SCHED_NONE表示任务已满或参数错误
+ */
+int iot_sched_core_add(iot_sched_core_t* core, const char* name, iot_job_fn_t fn, void* ctx,
+                       int64_t period_us, int64_t phase_us, int64_t now_us);
+
+/**
+ * @brief 取消任务（正在执行的任务本次仍会执行完）
+ */
+void iot_sched_core_cancel(iot_sched_core_t* core, int id);
+
+/**
+ * @brief 修改周期任务的周期，下次到期时刻为上次到期时刻+新周期，不随调用时刻漂移
+ *
+ * 可在任务函数中调用（此时上次到期时刻即本次执行对应的到期时刻）
+ *
+ * @return bool false表示任务不存在、不是周期任务或周期为0
+ */
+bool iot_sched_core_set_period(iot_sched_core_t* core, int id, int64_t period_us);
+
+/**
+ * @brief 最早的到期时刻，没有任务时返回INT64_MAX
+ */
+int64_t iot_sched_core_next_due(const iot_sched_core_t* core);
+
+/**
+ * @brief 取出一个已到期的任务（最早到期的优先），并安排其下次到期时刻
+ *
+ * 调用方在 iot_sched_core_finish 之前执行 jobs[id].fn，执行期间可不持锁
+ *
+ * @return int 任务ID，IOT_SCHED_NONE表示没有到期任务
+ */
+int iot_sched_core_take_due(iot_sched_core_t* core, int64_t now_us);
+
+/**
+ * @brief 记录一次执行完成
+ *
+ * @param core 调度器
+ * @param id 任务ID
+ * @param start_us 实际开始执行的时刻
+ * @param run_us 执行耗时
+ */
+void iot_sched_core_finish(iot_sched_core_t* core, int id, int64_t start_us, uint32_t run_us);
+
+/**
+ * @brief 执行本轮开始时已到期的任务（单线程场景，如虚拟时钟测试）
+ *
+ * @param core 调度器
+ * @param now_fn 读取当前时刻，用于统计执行耗时
+ * @param clock_ctx now_fn的参数
+ * @return int 本次执行的任务数
+ */
+int iot_sched_core_run_due(iot_sched_core_t* core, int64_t (*now_fn)(void* clock_ctx), void* clock_ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_SCHED_CORE_H */
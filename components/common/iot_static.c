@@ -0,0 +1,145 @@
+#include "iot_static.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+
+static const char *TAG = "iot_static";
+
+#if CONFIG_IOT_STATIC_MEMORY
+#define POOL_SMALL_SIZE     48      // 一个cJSON节点（40字节）或短字符串
+#define POOL_MEDIUM_SIZE    128
+#define POOL_LARGE_SIZE     640
+
+static uint8_t s_pool_small[CONFIG_IOT_POOL_SMALL_COUNT * POOL_SMALL_SIZE] __attribute__((aligned(IOT_POOL_ALIGN)));
+#if CONFIG_IOT_POOL_MEDIUM_COUNT > 0
+static uint8_t s_pool_medium[CONFIG_IOT_POOL_MEDIUM_COUNT * POOL_MEDIUM_SIZE] __attribute__((aligned(IOT_POOL_ALIGN)));
+#endif
+#if CONFIG_IOT_POOL_LARGE_COUNT > 0
+static uint8_t s_pool_large[CONFIG_IOT_POOL_LARGE_COUNT * POOL_LARGE_SIZE] __attribute__((aligned(IOT_POOL_ALIGN)));
+#endif
+
+static iot_pool_t s_pool;
+static bool s_pool_ready = false;
+static uint32_t s_pool_fails = 0;
+#endif
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool s_steady = false;
+static volatile uint32_t s_steady_allocs = 0;
+static volatile uint32_t s_steady_bytes = 0;
+static volatile uint32_t s_last_alloc_size = 0;
+
+BaseType_t iot_task_create(TaskFunction_t fn, const char* name, const iot_task_mem_t* mem,
+                           void* arg, UBaseType_t prio, TaskHandle_t* handle)
+{
+    TaskHandle_t task;
+#if CONFIG_IOT_STATIC_MEMORY
+    task = xTaskCreateStatic(fn, name, mem->stack_size, arg, prio, mem->stack, mem->tcb);
+    if (!task) {
+        return pdFAIL;
+    }
+#else
+    if (xTaskCreate(fn, name, mem->stack_size, arg, prio, &task) != pdPASS) {
+        return pdFAIL;
+    }
+#endif
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+#if CONFIG_IOT_STATIC_MEMORY
+static void pool_init_locked(void)
+{
+    iot_pool_init(&s_pool);
+    iot_pool_add_class(&s_pool, s_pool_small, POOL_SMALL_SIZE, CONFIG_IOT_POOL_SMALL_COUNT);
+#if CONFIG_IOT_POOL_MEDIUM_COUNT > 0
+    iot_pool_add_class(&s_pool, s_pool_medium, POOL_MEDIUM_SIZE, CONFIG_IOT_POOL_MEDIUM_COUNT);
+#endif
+#if CONFIG_IOT_POOL_LARGE_COUNT > 0
+    iot_pool_add_class(&s_pool, s_pool_large, POOL_LARGE_SIZE, CONFIG_IOT_POOL_LARGE_COUNT);
+#endif
+    s_pool_ready = true;
+}
+#endif
+
+void* iot_static_alloc(size_t size)
+{
+#if CONFIG_IOT_STATIC_MEMORY
+    portENTER_CRITICAL(&s_mux);
+    if (!s_pool_ready) {
+        pool_init_locked();
+    }
+    void* ptr = iot_pool_alloc(&s_pool, size);
+    if (!ptr) {
+        s_pool_fails++;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    if (ptr) {
+        return ptr;
+    }
+    ESP_LOGW(TAG, "内存池用完, %u 字节改从堆分配", (unsigned)size);
+#endif
+    return malloc(size);
+}
+
+void iot_static_free(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+#if CONFIG_IOT_STATIC_MEMORY
+    portENTER_CRITICAL(&s_mux);
+    bool owned = s_pool_ready && iot_pool_free(&s_pool, ptr);
+    portEXIT_CRITICAL(&s_mux);
+    if (owned) {
+        return;
+    }
+#endif
+    free(ptr);
+}
+
+void iot_static_mark_steady(void)
+{
+    s_steady_allocs = 0;
+    s_steady_bytes = 0;
+    s_steady = true;
+}
+
+void iot_static_get_stats(iot_static_stats_t* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+#if CONFIG_IOT_STATIC_MEMORY
+    portENTER_CRITICAL(&s_mux);
+    if (s_pool_ready) {
+        memcpy(stats->classes, s_pool.cls, sizeof(stats->classes));
+        stats->num_classes = s_pool.num_classes;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    stats->pool_fails = s_pool_fails;
+#endif
+#if CONFIG_HEAP_USE_HOOKS
+    stats->heap_hooks = true;
+#endif
+    stats->steady_allocs = s_steady_allocs;
+    stats->steady_bytes = s_steady_bytes;
+    stats->last_alloc_size = s_last_alloc_size;
+}
+
+#if CONFIG_HEAP_USE_HOOKS
+/* heap组件在每次分配后调用，可能处于中断中或cache关闭期间，只做计数 */
+IRAM_ATTR void esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps)
+{
+    if (s_steady && ptr) {
+        s_steady_allocs++;
+        s_steady_bytes += size;
+        s_last_alloc_size = size;
+    }
+}
+
+IRAM_ATTR void esp_heap_trace_free_hook(void* ptr)
+{
+}
+#endif
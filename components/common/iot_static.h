@@ -0,0 +1,89 @@
+#ifndef IOT_STATIC_H
+#define IOT_STATIC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "iot_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 静态内存模式（CONFIG_IOT_STATIC_MEMORY）==========
+ *
+ * 开启后常驻任务的栈和TCB使用静态数组，JSON解析使用定长块内存池，启动完成后本项目组件不再申请堆内存。
+ * 关闭时同一套接口退化为 xTaskCreate / malloc。
+ */
+
+// 任务内存，用 IOT_TASK_MEM 在文件作用域定义
+typedef struct {
+    StackType_t* stack;
+    StaticTask_t* tcb;
+    uint32_t stack_size;        // 字节
+} iot_task_mem_t;
+
+#if CONFIG_IOT_STATIC_MEMORY
+#define IOT_TASK_MEM(var, stack_bytes)                                          \
+    static StackType_t var##_stack[(stack_bytes) / sizeof(StackType_t)];        \
+    static StaticTask_t var##_tcb;                                              \
+    static const iot_task_mem_t var = { var##_stack, &var##_tcb, (stack_bytes) }
+#else
+#define IOT_TASK_MEM(var, stack_bytes)                                          \
+    static const iot_task_mem_t var = { NULL, NULL, (stack_bytes) }
+#endif
+
+typedef struct {
+    iot_pool_class_t classes[IOT_POOL_MAX_CLASSES];
+    int num_classes;
+    uint32_t pool_fails;        // 内存池用完、改从堆分配的次数
+    bool heap_hooks;            // CONFIG_HEAP_USE_HOOKS 开启时以下计数有效
+    uint32_t steady_allocs;     // iot_static_mark_steady 之后的堆分配次数（全系统）
+    uint32_t steady_bytes;
+    uint32_t last_alloc_size;
+} iot_static_stats_t;
+
+/**
+ * @brief 创建常驻任务，静态模式下使用mem中的栈和TCB
+ *
+ * 同一个mem只能用于一个存活的任务，任务不应自行删除后再用同一个mem重建
+ *
+ * @param fn 任务函数
+ * @param name 任务名
+ * @param mem 任务内存
+ * @param arg 任务参数
+ * @param prio 优先级
+ * @param handle 输出任务句柄，可为NULL
+ * @return BaseType_t pdPASS表示成功
+ */
+BaseType_t iot_task_create(TaskFunction_t fn, const char* name, const iot_task_mem_t* mem,
+                           void* arg, UBaseType_t prio, TaskHandle_t* handle);
+
+/**
+ * @brief 从内存池分配（非静态模式下为malloc），内存池用完时从堆分配并计数
+ */
+void* iot_static_alloc(size_t size);
+
+/**
+ * @brief 释放 iot_static_alloc 分配的内存
+ */
+void iot_static_free(void* ptr);
+
+/**
+ * @brief 标记启动完成，此后的堆分配计入 steady_allocs
+ */
+void iot_static_mark_steady(void);
+
+/**
+ * @brief 获取内存池和稳态堆分配统计
+ */
+void iot_static_get_stats(iot_static_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_STATIC_H */
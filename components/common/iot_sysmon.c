@@ -0,0 +1,241 @@
+#include "iot_sysmon.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "iot_static.h"
+
+static const char *TAG = "sysmon";
+
+/* 采样数据 */
+static iot_sysmon_snapshot_t s_snapshot;
+static SemaphoreHandle_t s_lock = NULL;
+static uint32_t s_period_ms = IOT_SYSMON_DEFAULT_PERIOD_MS;
+static bool s_started = false;
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+/* uxTaskGetSystemState 的输出放在静态区，避免占用采样任务的栈 */
+static TaskStatus_t s_task_status[IOT_SYSMON_MAX_TASKS];
+
+/* 上一次采样时各任务的运行时间计数，用于计算周期内CPU占比 */
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t run_time;
+} task_run_time_t;
+
+static task_run_time_t s_prev_run_time[IOT_SYSMON_MAX_TASKS];
+static uint32_t s_prev_total_run_time = 0;
+
+static uint32_t prev_run_time_of(TaskHandle_t handle)
+{
+    for (int i = 0; i < IOT_SYSMON_MAX_TASKS; i++) {
+        if (s_prev_run_time[i].handle == handle) {
+            return s_prev_run_time[i].run_time;
+        }
+    }
+    return 0;
+}
+#endif
+
+static bool sysmon_lock_init(void)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+    }
+    return s_lock != NULL;
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+/* 按栈余量从小到大排序，截断时保留最接近溢出的任务 */
+static void sort_by_stack_hwm(TaskStatus_t *ts, UBaseType_t n)
+{
+    for (UBaseType_t i = 1; i < n; i++) {
+        TaskStatus_t cur = ts[i];
+        UBaseType_t j = i;
+        while (j > 0 && ts[j - 1].usStackHighWaterMark > cur.usStackHighWaterMark) {
+            ts[j] = ts[j - 1];
+            j--;
+        }
+        ts[j] = cur;
+    }
+}
+#endif
+
+/* 采集任务信息：栈余量和CPU占比 */
+static void sample_tasks(iot_sysmon_snapshot_t *snap)
+{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    uint32_t total_run_time = 0;
+    TaskStatus_t *status = s_task_status;
+    UBaseType_t capacity = IOT_SYSMON_MAX_TASKS;
+    UBaseType_t live = uxTaskGetNumberOfTasks();
+    if (live > capacity) {
+        // uxTaskGetSystemState 在数组不够大时不返回任何数据，按当前任务数临时分配（多留几个给采样期间新建的任务）
+        capacity = live + 4;
+        status = malloc(capacity * sizeof(TaskStatus_t));
+        if (!status) {
+            ESP_LOGW(TAG, "任务数 %u 超过 %d 且内存不足, 本次不采集任务信息", (unsigned)live, IOT_SYSMON_MAX_TASKS);
+            snap->task_count = 0;
+            snap->tasks_total = (uint8_t)(live > UINT8_MAX ? UINT8_MAX : live);
+            snap->truncated_samples++;
+            return;
+        }
+    }
+    UBaseType_t n = uxTaskGetSystemState(status, capacity, &total_run_time);
+    snap->tasks_total = (uint8_t)(n > UINT8_MAX ? UINT8_MAX : n);
+    if (n > IOT_SYSMON_MAX_TASKS) {
+        sort_by_stack_hwm(status, n);
+        ESP_LOGW(TAG, "任务数 %u 超过 %d, 只保留栈余量最小的 %d 个", (unsigned)n,
+                 IOT_SYSMON_MAX_TASKS, IOT_SYSMON_MAX_TASKS);
+        snap->truncated_samples++;
+        n = IOT_SYSMON_MAX_TASKS;
+    }
+
+    uint32_t total_delta = total_run_time - s_prev_total_run_time;
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *ts = &status[i];
+        iot_sysmon_task_t *out = &snap->tasks[i];
+
+        strncpy(out->name, ts->pcTaskName, sizeof(out->name) - 1);
+        out->name[sizeof(out->name) - 1] = '\0';
+        // ESP-IDF 中栈以字节为单位
+        out->stack_hwm_bytes = ts->usStackHighWaterMark;
+        out->priority = (uint8_t)ts->uxCurrentPriority;
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        uint32_t task_delta = ts->ulRunTimeCounter - prev_run_time_of(ts->xHandle);
+        out->cpu_permille = (total_delta > 0) ?
+                            (uint16_t)(((uint64_t)task_delta * 1000) / total_delta) : 0;
+#else
+        out->cpu_permille = 0;
+#endif
+    }
+    snap->task_count = (uint8_t)n;
+
+    // 保存本次计数，下次采样计算差值
+    memset(s_prev_run_time, 0, sizeof(s_prev_run_time));
+    for (UBaseType_t i = 0; i < n; i++) {
+        s_prev_run_time[i].handle = status[i].xHandle;
+        s_prev_run_time[i].run_time = status[i].ulRunTimeCounter;
+    }
+    s_prev_total_run_time = total_run_time;
+    if (status != s_task_status) {
+        free(status);
+    }
+#else
+    snap->task_count = 0;
+    snap->tasks_total = 0;
+#endif
+}
+
+/* 采集堆信息 */
+static void sample_heap(iot_sysmon_snapshot_t *snap)
+{
+    snap->free_heap = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    snap->min_free_heap = esp_get_minimum_free_heap_size();
+    snap->largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+    snap->fragmentation_pct = (snap->free_heap > 0) ?
+        (uint8_t)(100 - ((uint64_t)snap->largest_free_block * 100) / snap->free_heap) : 0;
+}
+
+esp_err_t iot_sysmon_sample_now(void)
+{
+    if (!sysmon_lock_init()) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_snapshot.timestamp_us = esp_timer_get_time();
+    sample_heap(&s_snapshot);
+    sample_tasks(&s_snapshot);
+    s_snapshot.sample_count++;
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+/* 采样任务 */
+static void sysmon_task(void *arg)
+{
+    static char report[512];
+
+    while (1) {
+        iot_sysmon_sample_now();
+        iot_sysmon_format_report(report, sizeof(report));
+        ESP_LOGI(TAG, "%s", report);
+        vTaskDelay(pdMS_TO_TICKS(s_period_ms));
+    }
+}
+
+IOT_TASK_MEM(s_sysmon_task_mem, 3072);
+
+esp_err_t iot_sysmon_start(uint32_t period_ms)
+{
+    if (s_started) {
+        return ESP_OK;
+    }
+    if (!sysmon_lock_init()) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_period_ms = (period_ms > 0) ? period_ms : IOT_SYSMON_DEFAULT_PERIOD_MS;
+    if (iot_task_create(sysmon_task, "sysmon", &s_sysmon_task_mem, NULL, 1, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "创建采样任务失败");
+        return ESP_FAIL;
+    }
+
+    s_started = true;
+    ESP_LOGI(TAG, "资源监控已启动, 周期 %lu ms", (unsigned long)s_period_ms);
+    return ESP_OK;
+}
+
+esp_err_t iot_sysmon_get_snapshot(iot_sysmon_snapshot_t *snapshot)
+{
+    if (!snapshot) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock || s_snapshot.sample_count == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *snapshot = s_snapshot;
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+int iot_sysmon_format_report(char *buf, size_t size)
+{
+    if (!buf || size == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+    if (!s_lock || s_snapshot.sample_count == 0) {
+        return 0;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const iot_sysmon_snapshot_t *snap = &s_snapshot;
+    int len = snprintf(buf, size, "heap free=%lu,min=%lu,max_blk=%lu,frag=%u%% |",
+                       (unsigned long)snap->free_heap, (unsigned long)snap->min_free_heap,
+                       (unsigned long)snap->largest_free_block, snap->fragmentation_pct);
+    for (int i = 0; i < snap->task_count && len > 0 && (size_t)len < size; i++) {
+        const iot_sysmon_task_t *t = &snap->tasks[i];
+        len += snprintf(buf + len, size - len, " %s:%lu/%u.%u%%",
+                        t->name, (unsigned long)t->stack_hwm_bytes,
+                        t->cpu_permille / 10, t->cpu_permille % 10);
+    }
+    if (snap->tasks_total > snap->task_count && len > 0 && (size_t)len < size) {
+        len += snprintf(buf + len, size - len, " +%u", snap->tasks_total - snap->task_count);
+    }
+    xSemaphoreGive(s_lock);
+
+    return ((size_t)len < size) ? len : (int)size - 1;
+}
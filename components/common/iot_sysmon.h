@@ -0,0 +1,84 @@
+#ifndef IOT_SYSMON_H
+#define IOT_SYSMON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 运行时资源监控 ========== */
+
+// 快照中最多保留的任务数，系统任务更多时保留栈余量最小的并计入 truncated_samples
+#ifdef CONFIG_IOT_SYSMON_MAX_TASKS
+#define IOT_SYSMON_MAX_TASKS        CONFIG_IOT_SYSMON_MAX_TASKS
+#else
+#define IOT_SYSMON_MAX_TASKS        40
+#endif
+#define IOT_SYSMON_TASK_NAME_LEN    16
+#define IOT_SYSMON_DEFAULT_PERIOD_MS 60000  // 默认采样周期
+
+// 单个任务的资源信息
+typedef struct {
+    char name[IOT_SYSMON_TASK_NAME_LEN];
+    uint32_t stack_hwm_bytes;   // 栈历史最低剩余（字节）
+    uint16_t cpu_permille;      // 上个采样周期内的CPU占比（千分比）
+    uint8_t priority;           // 当前优先级
+} iot_sysmon_task_t;
+
+// 一次采样的快照
+typedef struct {
+    int64_t timestamp_us;           // 采样时刻（开机后微秒）
+    uint32_t sample_count;          // 累计采样次数
+    uint32_t free_heap;             // 当前空闲堆
+    uint32_t min_free_heap;         // 开机以来最低空闲堆
+    uint32_t largest_free_block;    // 最大连续空闲块
+    uint8_t fragmentation_pct;      // 碎片率 = 100 - 最大块/空闲总量
+    uint8_t task_count;             // tasks[] 中有效的任务数
+    uint8_t tasks_total;            // 采样时系统中的任务数，大于task_count表示快照被截断
+    uint32_t truncated_samples;     // 累计被截断的采样次数
+    iot_sysmon_task_t tasks[IOT_SYSMON_MAX_TASKS];
+} iot_sysmon_snapshot_t;
+
+/**
+ * @brief 启动周期性资源采样任务
+ *
+ * @param period_ms 采样周期（毫秒），0表示使用默认值
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_sysmon_start(uint32_t period_ms);
+
+/**
+ * @brief 立即采样一次（也可在未启动采样任务时使用）
+ *
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_sysmon_sample_now(void);
+
+/**
+ * @brief 获取最近一次采样快照
+ *
+ * @param snapshot 输出快照
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_INVALID_STATE表示尚未采样
+ */
+esp_err_t iot_sysmon_get_snapshot(iot_sysmon_snapshot_t *snapshot);
+
+/**
+ * @brief 生成紧凑的诊断报告字符串
+ *
+ * 格式: "heap free=..,min=..,max_blk=..,frag=..% | 任务名:栈余量/CPU% ... [+N]"，+N为截断的任务数
+ *
+ * @param buf 输出缓冲区
+ * @param size 缓冲区大小
+ * @return int 写入的字符数（不含结尾'\0'）
+ */
+int iot_sysmon_format_report(char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_SYSMON_H */
@@ -0,0 +1,204 @@
+#include "iot_trace.h"
+
+#if CONFIG_IOT_TRACE
+#include <stdio.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_private/esp_clk.h"
+#include "iot_trace_core.h"
+
+static const char *TAG = "iot_trace";
+
+#define TRACE_SYNC_PERIOD_US    (8 * 1000 * 1000)   // 小于周期计数器的回绕时间，防止丢失高位
+
+static iot_trace_event_t s_events[CONFIG_IOT_TRACE_EVENTS];
+static iot_trace_ring_t s_ring = {
+    .events = s_events,
+    .size = CONFIG_IOT_TRACE_EVENTS,
+};
+static volatile bool s_enabled = false;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_sync_timer = NULL;
+static uint32_t s_task_overflows = 0;
+static uint32_t s_cycles_per_event = 0;
+
+static IRAM_ATTR void record(uint8_t type, const char* name, uint16_t arg, void* task)
+{
+    portENTER_CRITICAL_SAFE(&s_mux);
+    iot_trace_ring_put(&s_ring, esp_cpu_get_cycle_count(), type, name, arg, task);
+    portEXIT_CRITICAL_SAFE(&s_mux);
+}
+
+IRAM_ATTR void iot_trace_record(iot_trace_ev_t type, const char* name, uint16_t arg)
+{
+    if (s_enabled) {
+        record((uint8_t)type, name, arg, xTaskGetCurrentTaskHandle());
+    }
+}
+
+#if CONFIG_IOT_TRACE_TASK_SWITCH
+/* 在调度器中调用，此时当前任务已是切入的任务 */
+IRAM_ATTR void iot_trace_task_switched_in(void)
+{
+    if (s_enabled) {
+        record(IOT_TRACE_EV_SWITCH, NULL, 0, xTaskGetCurrentTaskHandle());
+    }
+}
+#endif
+
+/* 没有其他事件时也定期记录，保证相邻事件间隔不超过周期计数器的回绕时间 */
+static void sync_timer_cb(void* arg)
+{
+    iot_trace_record(IOT_TRACE_EV_INSTANT, "trace_sync", 0);
+}
+
+esp_err_t iot_trace_start(void)
+{
+    if (!s_sync_timer) {
+        const esp_timer_create_args_t args = {
+            .callback = sync_timer_cb,
+            .name = "iot_trace",
+        };
+        esp_err_t err = esp_timer_create(&args, &s_sync_timer);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    // 测量记录开销，测量用的事件随后清除
+    s_enabled = true;
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < 64; i++) {
+        iot_trace_record(IOT_TRACE_EV_INSTANT, "trace_calib", i);
+    }
+    s_cycles_per_event = (esp_cpu_get_cycle_count() - start) / 64;
+
+    portENTER_CRITICAL(&s_mux);
+    iot_trace_ring_clear(&s_ring);
+    portEXIT_CRITICAL(&s_mux);
+    esp_timer_start_periodic(s_sync_timer, TRACE_SYNC_PERIOD_US);
+    ESP_LOGI(TAG, "开始记录, 缓冲 %d 个事件, 每个事件约 %lu 周期",
+             CONFIG_IOT_TRACE_EVENTS, (unsigned long)s_cycles_per_event);
+    return ESP_OK;
+}
+
+void iot_trace_stop(void)
+{
+    s_enabled = false;
+    if (s_sync_timer) {
+        esp_timer_stop(s_sync_timer);
+    }
+}
+
+esp_err_t iot_trace_dump(iot_trace_emit_t emit, void* ctx)
+{
+    if (!emit) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool was_enabled = s_enabled;
+    s_enabled = false;
+
+    // 记录已停止，之后不会再写入
+    portENTER_CRITICAL(&s_mux);
+    iot_trace_ring_t ring = s_ring;
+    portEXIT_CRITICAL(&s_mux);
+    uint32_t count = iot_trace_ring_count(&ring);
+    uint32_t overwritten = iot_trace_ring_overwritten(&ring);
+
+    // 任务数超过表长时 uxTaskGetSystemState 一个也不返回，这些任务转换时按句柄显示
+    static TaskStatus_t tasks[IOT_TRACE_MAX_TASKS];
+    UBaseType_t total = uxTaskGetNumberOfTasks();
+    UBaseType_t n = uxTaskGetSystemState(tasks, IOT_TRACE_MAX_TASKS, NULL);
+    if (n < total) {
+        s_task_overflows++;
+        ESP_LOGW(TAG, "任务数 %u 超过 %d, 导出中不含任务名", (unsigned)total, IOT_TRACE_MAX_TASKS);
+    }
+    if (overwritten > 0) {
+        ESP_LOGW(TAG, "缓冲区已满, 最早的 %lu 个事件被覆盖", (unsigned long)overwritten);
+    }
+
+    char line[96];
+    snprintf(line, sizeof(line), "H,%lu,%lu,%lu,%u", (unsigned long)esp_clk_cpu_freq(), (unsigned long)count,
+             (unsigned long)overwritten, (unsigned)(total - n));
+    emit(line, ctx);
+
+    // 已删除的任务不在列表中，转换时按句柄显示
+    for (UBaseType_t i = 0; i < n; i++) {
+        snprintf(line, sizeof(line), "K,%p,%s", tasks[i].xHandle, tasks[i].pcTaskName);
+        emit(line, ctx);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const iot_trace_event_t *ev = iot_trace_ring_at(&ring, i);
+        snprintf(line, sizeof(line), "%c,%llu,%p,%u,%s", ev->type, (unsigned long long)iot_trace_event_cycles(ev),
+                 ev->task, ev->arg, ev->name ? ev->name : "");
+        emit(line, ctx);
+    }
+
+    s_enabled = was_enabled;
+    return ESP_OK;
+}
+
+esp_err_t iot_trace_get_info(iot_trace_info_t* info)
+{
+    if (!info) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_mux);
+    info->recorded = s_ring.head;
+    info->overwritten = iot_trace_ring_overwritten(&s_ring);
+    portEXIT_CRITICAL(&s_mux);
+    info->task_overflows = s_task_overflows;
+    info->cycles_per_event = s_cycles_per_event;
+    return ESP_OK;
+}
+
+static void emit_uart(const char* line, void* ctx)
+{
+    printf("%s\n", line);
+}
+
+esp_err_t iot_trace_dump_uart(void)
+{
+    printf("IOTTRACE BEGIN\n");
+    esp_err_t err = iot_trace_dump(emit_uart, NULL);
+    printf("IOTTRACE END\n");
+    return err;
+}
+
+#else /* !CONFIG_IOT_TRACE */
+
+void iot_trace_record(iot_trace_ev_t type, const char* name, uint16_t arg)
+{
+}
+
+esp_err_t iot_trace_start(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void iot_trace_stop(void)
+{
+}
+
+esp_err_t iot_trace_dump(iot_trace_emit_t emit, void* ctx)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t iot_trace_get_info(iot_trace_info_t* info)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t iot_trace_dump_uart(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif /* CONFIG_IOT_TRACE */
@@ -0,0 +1,105 @@
+#ifndef IOT_TRACE_H
+#define IOT_TRACE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 执行轨迹（CONFIG_IOT_TRACE）==========
+ *
+ * 事件记录到RAM环形缓冲区（满时覆盖最旧的事件），导出后在PC上用
+ * tools/iot_trace_to_perfetto.py 转换为 Chrome/Perfetto 可加载的轨迹。
+ * 事件名须为长期有效的字符串（通常是字面量）；关闭时宏展开为空。
+ */
+
+// 导出时能给出名字的任务数，任务更多时计入 task_overflows
+#ifdef CONFIG_IOT_TRACE_MAX_TASKS
+#define IOT_TRACE_MAX_TASKS         CONFIG_IOT_TRACE_MAX_TASKS
+#else
+#define IOT_TRACE_MAX_TASKS         32
+#endif
+
+typedef enum {
+    IOT_TRACE_EV_BEGIN = 'B',
+    IOT_TRACE_EV_END = 'E',
+    IOT_TRACE_EV_INSTANT = 'i',
+    IOT_TRACE_EV_SWITCH = 'S',      // 任务切入，由 traceTASK_SWITCHED_IN 记录
+} iot_trace_ev_t;
+
+#if CONFIG_IOT_TRACE
+#define IOT_TRACE_BEGIN(name)           iot_trace_record(IOT_TRACE_EV_BEGIN, (name), 0)
+#define IOT_TRACE_END(name)             iot_trace_record(IOT_TRACE_EV_END, (name), 0)
+#define IOT_TRACE_INSTANT(name, arg)    iot_trace_record(IOT_TRACE_EV_INSTANT, (name), (arg))
+#else
+#define IOT_TRACE_BEGIN(name)           ((void)0)
+#define IOT_TRACE_END(name)             ((void)0)
+#define IOT_TRACE_INSTANT(name, arg)    ((void)0)
+#endif
+
+// 导出时逐行输出，line不含换行符
+typedef void (*iot_trace_emit_t)(const char* line, void* ctx);
+
+typedef struct {
+    uint32_t recorded;          // 本次开始以来记录的事件数
+    uint32_t overwritten;       // 缓冲区满被覆盖的事件数
+    uint32_t task_overflows;    // 任务数超过 IOT_TRACE_MAX_TASKS 而未导出任务名的次数
+    uint32_t cycles_per_event;  // 开始时测得的单个事件记录开销
+} iot_trace_info_t;
+
+/**
+ * @brief 记录一个事件（通过 IOT_TRACE_* 宏调用），可在任务和中断中调用
+ *
+ * @param type 事件类型
+ * @param name 事件名
+ * @param arg 附加数值（如数据长度），Perfetto中显示为参数
+ */
+void iot_trace_record(iot_trace_ev_t type, const char* name, uint16_t arg);
+
+/**
+ * @brief 开始记录，同时测量并打印单个事件的记录开销
+ *
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_NOT_SUPPORTED表示未开启 CONFIG_IOT_TRACE
+ */
+esp_err_t iot_trace_start(void);
+
+/**
+ * @brief 停止记录，缓冲区内容保留到下次开始
+ */
+void iot_trace_stop(void);
+
+/**
+ * @brief 导出缓冲区（导出期间暂停记录）
+ *
+ * 输出格式逐行为：
+ *   H,<cpu_hz>,<事件数>,<被覆盖的事件数>,<未导出名字的任务数>   文件头
+ *   K,<任务句柄>,<任务名>          当前存在的任务
+ *   <类型>,<周期数>,<任务句柄>,<参数>,<事件名>
+ *
+ * @param emit 行输出函数（UART、BLE等）
+ * @param ctx emit参数
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t iot_trace_dump(iot_trace_emit_t emit, void* ctx);
+
+/**
+ * @brief 获取记录统计
+ *
+ * @param info 输出统计
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_NOT_SUPPORTED表示未开启 CONFIG_IOT_TRACE
+ */
+esp_err_t iot_trace_get_info(iot_trace_info_t* info);
+
+/**
+ * @brief 导出到UART（标准输出），前后加 IOTTRACE BEGIN/END 标记
+ */
+esp_err_t iot_trace_dump_uart(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_TRACE_H */
@@ -0,0 +1,95 @@
+#ifndef IOT_TRACE_CORE_H
+#define IOT_TRACE_CORE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========== 执行轨迹的环形缓冲区，不依赖ESP-IDF ==========
+ *
+ * 满时覆盖最旧的事件并计数；周期数由调用方传入，回绕时高8位加一，组成40位时间。
+ * 在调度器钩子中调用，函数都强制内联，随调用方一起放在IRAM中；加锁由调用方负责。
+ */
+
+// 目标芯片上16字节
+typedef struct {
+    uint32_t cycles;
+    uint8_t cycles_hi;
+    uint8_t type;
+    uint16_t arg;
+    const char* name;
+    void* task;
+} iot_trace_event_t;
+
+typedef struct {
+    iot_trace_event_t* events;
+    uint32_t size;
+    uint32_t head;              // 已写入的事件总数
+    uint32_t last_cycles;
+    uint8_t cycles_hi;
+} iot_trace_ring_t;
+
+#define IOT_TRACE_INLINE    static inline __attribute__((always_inline))
+
+IOT_TRACE_INLINE void iot_trace_ring_init(iot_trace_ring_t* ring, iot_trace_event_t* events, uint32_t size)
+{
+    ring->events = events;
+    ring->size = size;
+    ring->head = 0;
+    ring->last_cycles = 0;
+    ring->cycles_hi = 0;
+}
+
+/* 清空事件，保留40位时间的高位 */
+IOT_TRACE_INLINE void iot_trace_ring_clear(iot_trace_ring_t* ring)
+{
+    ring->head = 0;
+}
+
+IOT_TRACE_INLINE void iot_trace_ring_put(iot_trace_ring_t* ring, uint32_t cycles, uint8_t type,
+                                         const char* name, uint16_t arg, void* task)
+{
+    if (cycles < ring->last_cycles) {
+        ring->cycles_hi++;
+    }
+    ring->last_cycles = cycles;
+    iot_trace_event_t* ev = &ring->events[ring->head % ring->size];
+    ev->cycles = cycles;
+    ev->cycles_hi = ring->cycles_hi;
+    ev->type = type;
+    ev->arg = arg;
+    ev->name = name;
+    ev->task = task;
+    ring->head++;
+}
+
+/* 缓冲区中的事件数 */
+IOT_TRACE_INLINE uint32_t iot_trace_ring_count(const iot_trace_ring_t* ring)
+{
+    return ring->head < ring->size ? ring->head : ring->size;
+}
+
+/* 被覆盖的最旧事件数 */
+IOT_TRACE_INLINE uint32_t iot_trace_ring_overwritten(const iot_trace_ring_t* ring)
+{
+    return ring->head - iot_trace_ring_count(ring);
+}
+
+/* 第i个事件，0为缓冲区中最旧的 */
+IOT_TRACE_INLINE const iot_trace_event_t* iot_trace_ring_at(const iot_trace_ring_t* ring, uint32_t i)
+{
+    return &ring->events[(ring->head - iot_trace_ring_count(ring) + i) % ring->size];
+}
+
+IOT_TRACE_INLINE uint64_t iot_trace_event_cycles(const iot_trace_event_t* ev)
+{
+    return ((uint64_t)ev->cycles_hi << 32) | ev->cycles;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IOT_TRACE_CORE_H */
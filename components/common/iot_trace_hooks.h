@@ -0,0 +1,18 @@
+/*
+ * 由工程CMakeLists强制包含到每个源文件，在FreeRTOS.h之前定义任务切换钩子
+ * 不能包含其他项目头文件
+ */
+#ifndef IOT_TRACE_HOOKS_H
+#define IOT_TRACE_HOOKS_H
+
+#ifndef __ASSEMBLER__
+#include "sdkconfig.h"
+
+#if CONFIG_IOT_TRACE_TASK_SWITCH
+void iot_trace_task_switched_in(void);
+#define traceTASK_SWITCHED_IN()     iot_trace_task_switched_in()
+#endif
+
+#endif /* __ASSEMBLER__ */
+
+#endif /* IOT_TRACE_HOOKS_H */
@@ -10,6 +10,9 @@
 #include "nvs_flash.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
 
 /* Bluetooth */
 #include "esp_bt.h"
@@ -24,6 +27,11 @@
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
 #include "use_ble_server.h"
+#include "common.h"
+#include "iot_static.h"
+#include "iot_trace.h"
+
+void ble_store_config_init(void);
 
 static const char *TAG = "BLE_SERVER";
 
@@ -35,7 +43,45 @@ static uint16_t conn_handle = 0;
 static uint8_t received_data[256];
 static uint16_t received_len = 0;
 
+/* 配网 */
+static ble_prov_config_t prov_config;
+static use_ble_prov_handler_t prov_handler = NULL;
+static uint16_t prov_status_handle = 0;
+static bool prov_status_subscribed = false;
+
+/* 历史数据查询 */
+#define HIST_FRAME_DATA     0x01    // [type][seq][记录 * N]
+#define HIST_FRAME_END      0x02    // [type][seq][总数 u32][状态 u8]
+#define HIST_FRAME_HDR_LEN  2
+#define HIST_RECORD_LEN     13      // dp(1) + t_ms(8) + value(4)，小端
+#define HIST_NOTIFY_RETRY   50
+
+static use_ble_history_handler_t history_handler = NULL;
+static uint16_t history_handle = 0;
+static bool history_subscribed = false;
+static QueueHandle_t history_queue = NULL;
+static uint8_t history_frame[512];
+static uint16_t history_frame_len = 0;
+static uint16_t history_frame_max = 0;
+static uint8_t history_seq = 0;
+static uint32_t history_total = 0;
+
+/* 云端桥接：MQTT不可用时经手机转发，帧格式由上层定义 */
+static use_ble_bridge_rx_t bridge_handler = NULL;
+static uint16_t bridge_handle = 0;
+static bool bridge_subscribed = false;
+
+/* 本地联动规则下发 */
+#define RULES_CHUNK_MAX     512     // ATT属性值上限
+static use_ble_rules_handler_t rules_handler = NULL;
+static uint8_t rules_chunk[RULES_CHUNK_MAX];
+
+/* 被动扫描（网关模式） */
+static use_ble_adv_handler_t adv_handler = NULL;
+static bool host_synced = false;
+
 static void start_advertising(void);
+static void start_scan(void);
 
 /* UUID 定义 */
 static const ble_uuid128_t gatt_svr_svc_uuid =
@@ -46,6 +92,60 @@ static const ble_uuid128_t gatt_svr_chr_uuid =
     BLE_UUID128_INIT(0x00, 0x00, 0x00, 0x00, 0x11, 0x11, 0x11, 0x11,
                      0x22, 0x22, 0x22, 0x22, 0x33, 0x33, 0x33, 0x33);
 
+/* 配网特征值 UUID：在数据特征值 UUID 基础上改变首字节 */
+#define PROV_CHR_UUID(b0) \
+    BLE_UUID128_INIT((b0), 0x00, 0x00, 0x00, 0x11, 0x11, 0x11, 0x11, \
+                     0x22, 0x22, 0x22, 0x22, 0x33, 0x33, 0x33, 0x33)
+
+static const ble_uuid128_t prov_ssid_uuid = PROV_CHR_UUID(0x01);     // SSID（写）
+static const ble_uuid128_t prov_pass_uuid = PROV_CHR_UUID(0x02);     // 密码（写）
+static const ble_uuid128_t prov_bssid_uuid = PROV_CHR_UUID(0x03);    // BSSID(6)+信道(1)（写，可选）
+static const ble_uuid128_t prov_ctrl_uuid = PROV_CHR_UUID(0x04);     // 写0x01应用配置
+static const ble_uuid128_t prov_status_uuid = PROV_CHR_UUID(0x05);   // 配网进度（读/通知）
+
+static uint8_t prov_status = BLE_PROV_STATUS_IDLE;
+
+static const ble_uuid128_t history_uuid = PROV_CHR_UUID(0x10);      // 历史查询（写）/结果（通知）
+static const ble_uuid128_t bridge_uuid = PROV_CHR_UUID(0x11);       // 云端桥接下行（写）/上行（通知）
+static const ble_uuid128_t rules_uuid = PROV_CHR_UUID(0x12);        // 本地联动规则集分片（写）
+
+/* 数据点特征值：由 IOT_DP_SCHEMA 生成，每个DP一个读/通知特征值，带表示格式描述符 */
+#define DP_VALUE_MAX            32
+#define GATT_DSC_PRESENT_FMT    0x2904
+#define GATT_FORMAT_SINT32      0x10
+#define GATT_FORMAT_UTF8S       0x19
+#define GATT_NAMESPACE_BT_SIG   0x01
+
+/* 预编码的读缓存：写入不活动的一份后切换，读回调只做一次拷贝 */
+typedef struct {
+    uint8_t buf[2][DP_VALUE_MAX];
+    uint8_t len[2];
+    volatile uint8_t active;
+} dp_cache_t;
+
+static dp_cache_t dp_cache[IOT_DP_MAX];
+static uint16_t dp_val_handles[IOT_DP_MAX];
+static portMUX_TYPE dp_cache_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t dp_read_count = 0;
+static uint64_t dp_read_total_cycles = 0;
+static uint32_t dp_read_max_cycles = 0;
+
+static const ble_uuid128_t dp_chr_uuids[IOT_DP_MAX] = {
+#define DP_UUID_ENTRY(name, code, type, field, chr_id, unit) [IOT_DP_##name] = PROV_CHR_UUID(chr_id),
+    IOT_DP_SCHEMA(DP_UUID_ENTRY)
+#undef DP_UUID_ENTRY
+};
+
+/* 表示格式：格式(1) 指数(1) 单位(2) 命名空间(1) 描述(2)，描述按SIG约定为序号（第1个、第2个...） */
+static const uint8_t dp_formats[IOT_DP_MAX][7] = {
+#define DP_FORMAT_ENTRY(name, code, type, field, chr_id, unit) \
+    [IOT_DP_##name] = { (type) == IOT_DP_TYPE_INT ? GATT_FORMAT_SINT32 : GATT_FORMAT_UTF8S, 0, \
+                        (uint8_t)(unit), (uint8_t)((unit) >> 8), GATT_NAMESPACE_BT_SIG, \
+                        (uint8_t)(IOT_DP_##name + 1), 0 },
+    IOT_DP_SCHEMA(DP_FORMAT_ENTRY)
+#undef DP_FORMAT_ENTRY
+};
+
 /* 打印接收到的数据 */
 static void print_received_data(void)
 {
@@ -72,6 +172,7 @@ static void print_received_data(void)
 static int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                               struct ble_gatt_access_ctxt *ctxt, void *arg)
 {
+    IOT_TRACE_INSTANT("gatt_chr", ctxt->op);
     switch (ctxt->op) {
     case BLE_GATT_ACCESS_OP_READ_CHR:
         ESP_LOGI(TAG, "APP 读取特征值");
@@ -99,6 +200,233 @@ static int gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
     }
 }
 
+/* 数据点特征值读回调：从预编码缓存拷贝，通知也经由这里取值 */
+static int gatt_svr_dp_access(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    IOT_TRACE_INSTANT("gatt_dp", ctxt->op);
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    const dp_cache_t *c = arg;
+    uint8_t slot = c->active;
+    int rc = os_mbuf_append(ctxt->om, c->buf[slot], c->len[slot]);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    dp_read_count++;
+    dp_read_total_cycles += cycles;
+    if (cycles > dp_read_max_cycles) {
+        dp_read_max_cycles = cycles;
+    }
+    return (rc == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static int gatt_svr_dp_dsc_access(uint16_t conn_handle, uint16_t attr_handle,
+                                  struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_DSC) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    int rc = os_mbuf_append(ctxt->om, arg, sizeof(dp_formats[0]));
+    return (rc == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static uint8_t dp_encode_IOT_DP_TYPE_INT(uint8_t *buf, int32_t value)
+{
+    uint32_t v = (uint32_t)value;
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (uint8_t)(v >> (8 * i));
+    }
+    return 4;
+}
+
+static uint8_t dp_encode_IOT_DP_TYPE_STR(uint8_t *buf, const char *value)
+{
+    size_t len = strnlen(value, DP_VALUE_MAX);
+    memcpy(buf, value, len);
+    return (uint8_t)len;
+}
+
+/* 按当前状态重新编码一个DP的读缓存 */
+static void dp_cache_update(iot_dp_id_t dp)
+{
+    uint8_t buf[DP_VALUE_MAX];
+    uint8_t len;
+    iot_device_state_t state;
+
+    get_current_iot_snapshot(&state);
+    switch (dp) {
+#define DP_ENCODE_ENTRY(name, code, type, field, chr_id, unit) \
+    case IOT_DP_##name: \
+        len = dp_encode_##type(buf, state.field); \
+        break;
+    IOT_DP_SCHEMA(DP_ENCODE_ENTRY)
+#undef DP_ENCODE_ENTRY
+    default:
+        return;
+    }
+
+    dp_cache_t *c = &dp_cache[dp];
+    portENTER_CRITICAL(&dp_cache_mux);
+    uint8_t next = c->active ^ 1;
+    memcpy(c->buf[next], buf, len);
+    c->len[next] = len;
+    c->active = next;
+    portEXIT_CRITICAL(&dp_cache_mux);
+}
+
+/* 状态变化时更新缓存，已订阅的连接由协议栈回调读回调取值发送通知 */
+static void dp_state_listener(iot_dp_id_t dp, void *ctx)
+{
+    dp_cache_update(dp);
+    if (host_synced) {
+        ble_gatts_chr_updated(dp_val_handles[dp]);
+    }
+}
+
+/* 配网特征值读写回调 */
+static int gatt_svr_prov_access(uint16_t conn_handle, uint16_t attr_handle,
+                                struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    IOT_TRACE_INSTANT("gatt_prov", ctxt->op);
+    const ble_uuid_t *uuid = ctxt->chr->uuid;
+    uint8_t buf[64];
+    uint16_t len = 0;
+
+    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+        if (ble_uuid_cmp(uuid, &prov_status_uuid.u) == 0) {
+            os_mbuf_append(ctxt->om, &prov_status, sizeof(prov_status));
+            return 0;
+        }
+        return BLE_ATT_ERR_READ_NOT_PERMITTED;
+    }
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    if (OS_MBUF_PKTLEN(ctxt->om) > sizeof(buf)) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &len);
+
+    if (ble_uuid_cmp(uuid, &prov_ssid_uuid.u) == 0) {
+        if (len == 0 || len >= sizeof(prov_config.ssid)) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        memset(&prov_config, 0, sizeof(prov_config));
+        memcpy(prov_config.ssid, buf, len);
+        ESP_LOGI(TAG, "配网: SSID=%s", prov_config.ssid);
+    } else if (ble_uuid_cmp(uuid, &prov_pass_uuid.u) == 0) {
+        if (len >= sizeof(prov_config.password)) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        memset(prov_config.password, 0, sizeof(prov_config.password));
+        memcpy(prov_config.password, buf, len);
+        ESP_LOGI(TAG, "配网: 已收到密码");
+    } else if (ble_uuid_cmp(uuid, &prov_bssid_uuid.u) == 0) {
+        if (len != 7) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        memcpy(prov_config.bssid, buf, 6);
+        prov_config.channel = buf[6];
+        prov_config.bssid_set = true;
+        ESP_LOGI(TAG, "配网: BSSID=%02x:%02x:%02x:%02x:%02x:%02x 信道=%d",
+                 buf[0], buf[1], buf[2], buf[3], buf[4], buf[5], buf[6]);
+    } else if (ble_uuid_cmp(uuid, &prov_ctrl_uuid.u) == 0) {
+        if (len != 1 || buf[0] != 0x01) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        if (prov_config.ssid[0] == '\0' || !prov_handler) {
+            use_ble_server_prov_notify_status(BLE_PROV_STATUS_FAILED);
+            return 0;
+        }
+        ESP_LOGI(TAG, "配网: 应用配置");
+        use_ble_server_prov_notify_status(BLE_PROV_STATUS_APPLYING);
+        if (prov_handler(&prov_config) != ESP_OK) {
+            use_ble_server_prov_notify_status(BLE_PROV_STATUS_FAILED);
+        }
+    } else {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    return 0;
+}
+
+/* 历史特征值写回调：dp_mask(1) + from_s(4) + to_s(4)，小端 */
+static int gatt_svr_history_access(uint16_t conn_handle, uint16_t attr_handle,
+                                   struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    IOT_TRACE_INSTANT("gatt_history", ctxt->op);
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    uint8_t buf[9];
+    uint16_t len = 0;
+    if (OS_MBUF_PKTLEN(ctxt->om) != sizeof(buf)) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &len);
+
+    ble_history_query_t query = {
+        .dp_mask = buf[0],
+        .from_s = (uint32_t)buf[1] | ((uint32_t)buf[2] << 8) | ((uint32_t)buf[3] << 16) | ((uint32_t)buf[4] << 24),
+        .to_s = (uint32_t)buf[5] | ((uint32_t)buf[6] << 8) | ((uint32_t)buf[7] << 16) | ((uint32_t)buf[8] << 24),
+    };
+    // 查询在历史任务中执行，不阻塞 NimBLE 主机任务
+    if (!history_queue || xQueueSend(history_queue, &query, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "历史查询进行中，忽略新请求");
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    return 0;
+}
+
+/* 桥接特征值写回调：整帧交给上层，上层须快速返回 */
+static int gatt_svr_bridge_access(uint16_t conn_handle, uint16_t attr_handle,
+                                  struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    IOT_TRACE_INSTANT("gatt_bridge", ctxt->op);
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+
+    uint8_t buf[256];
+    uint16_t len = 0;
+    if (OS_MBUF_PKTLEN(ctxt->om) > sizeof(buf)) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &len);
+    if (bridge_handler) {
+        IOT_TRACE_BEGIN("bridge_rx");
+        bridge_handler(buf, len);
+        IOT_TRACE_END("bridge_rx");
+    }
+    return 0;
+}
+
+/* 规则特征值写回调：偏移(2) + 总长(2) + 数据，收齐后由上层校验并安装 */
+static int gatt_svr_rules_access(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    IOT_TRACE_INSTANT("gatt_rules", ctxt->op);
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    if (OS_MBUF_PKTLEN(ctxt->om) > sizeof(rules_chunk)) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    uint16_t len = 0;
+    ble_hs_mbuf_to_flat(ctxt->om, rules_chunk, sizeof(rules_chunk), &len);
+    if (!rules_handler || rules_handler(rules_chunk, len) != ESP_OK) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    return 0;
+}
+
+/* 修改凭据或设备行为的写入须在已加密、经passkey认证（防中间人）的连接上进行 */
+#define BLE_SECURE_WRITE (BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC | BLE_GATT_CHR_F_WRITE_AUTHEN)
+
 /* GATT 服务定义 */
 static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
     {
@@ -109,6 +437,61 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
             .access_cb = gatt_svr_chr_access,
             .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE,
         }, {
+            .uuid = &prov_ssid_uuid.u,
+            .access_cb = gatt_svr_prov_access,
+            .flags = BLE_SECURE_WRITE,
+        }, {
+            .uuid = &prov_pass_uuid.u,
+            .access_cb = gatt_svr_prov_access,
+            .flags = BLE_SECURE_WRITE,
+        }, {
+            .uuid = &prov_bssid_uuid.u,
+            .access_cb = gatt_svr_prov_access,
+            .flags = BLE_SECURE_WRITE,
+        }, {
+            .uuid = &prov_ctrl_uuid.u,
+            .access_cb = gatt_svr_prov_access,
+            .flags = BLE_SECURE_WRITE,
+        }, {
+            .uuid = &prov_status_uuid.u,
+            .access_cb = gatt_svr_prov_access,
+            .val_handle = &prov_status_handle,
+            .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+        }, {
+            .uuid = &history_uuid.u,
+            .access_cb = gatt_svr_history_access,
+            .val_handle = &history_handle,
+            .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_NOTIFY,
+        }, {
+            .uuid = &bridge_uuid.u,
+            .access_cb = gatt_svr_bridge_access,
+            .val_handle = &bridge_handle,
+            // 下行消息会进入MQTT主题路由，须配对加密后才能写入；消息本身另有签名
+            .flags = BLE_SECURE_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP | BLE_GATT_CHR_F_NOTIFY,
+        }, {
+            .uuid = &rules_uuid.u,
+            .access_cb = gatt_svr_rules_access,
+            // 规则动作会直接改写DP，与配网信息一样须配对加密后才能写入
+            .flags = BLE_SECURE_WRITE,
+        },
+#define DP_CHR_ENTRY(name, code, type, field, chr_id, unit) { \
+            .uuid = &dp_chr_uuids[IOT_DP_##name].u, \
+            .access_cb = gatt_svr_dp_access, \
+            .arg = &dp_cache[IOT_DP_##name], \
+            .val_handle = &dp_val_handles[IOT_DP_##name], \
+            .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY, \
+            .descriptors = (struct ble_gatt_dsc_def[]) { { \
+                .uuid = BLE_UUID16_DECLARE(GATT_DSC_PRESENT_FMT), \
+                .att_flags = BLE_ATT_F_READ, \
+                .access_cb = gatt_svr_dp_dsc_access, \
+                .arg = (void *)dp_formats[IOT_DP_##name], \
+            }, { \
+                0, \
+            } }, \
+        },
+        IOT_DP_SCHEMA(DP_CHR_ENTRY)
+#undef DP_CHR_ENTRY
+        {
             0, /* No more characteristics in this service */
         } },
     }, {
@@ -116,6 +499,21 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
     },
 };
 
+/* 配对passkey：Kconfig配置的固定值，为0时由设备密钥派生（FNV-1a 取模 1000000），手机App按同样方法计算 */
+static uint32_t ble_passkey(void)
+{
+#if CONFIG_USE_BLE_PASSKEY
+    return CONFIG_USE_BLE_PASSKEY;
+#else
+    uint32_t h = 2166136261u;
+    for (const char *p = TUYA_DEVICE_SECRET; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619u;
+    }
+    return h % 1000000;
+#endif
+}
+
 /* GAP 事件处理 */
 static int gap_event(struct ble_gap_event *event, void *arg)
 {
@@ -143,6 +541,9 @@ static int gap_event(struct ble_gap_event *event, void *arg)
         ESP_LOGI(TAG, "设备断开连接，开始重新广播");
         connected = false;
         conn_handle = 0;
+        prov_status_subscribed = false;
+        history_subscribed = false;
+        bridge_subscribed = false;
         start_advertising();
         return 0;
 
@@ -151,6 +552,47 @@ static int gap_event(struct ble_gap_event *event, void *arg)
         start_advertising();
         return 0;
 
+    case BLE_GAP_EVENT_SUBSCRIBE:
+        if (event->subscribe.attr_handle == prov_status_handle) {
+            prov_status_subscribed = event->subscribe.cur_notify;
+            ESP_LOGI(TAG, "配网进度通知: %s", prov_status_subscribed ? "已订阅" : "已取消");
+        } else if (event->subscribe.attr_handle == history_handle) {
+            history_subscribed = event->subscribe.cur_notify;
+            ESP_LOGI(TAG, "历史数据通知: %s", history_subscribed ? "已订阅" : "已取消");
+        } else if (event->subscribe.attr_handle == bridge_handle) {
+            bridge_subscribed = event->subscribe.cur_notify;
+            ESP_LOGI(TAG, "云端桥接通知: %s", bridge_subscribed ? "已订阅" : "已取消");
+        }
+        return 0;
+
+    case BLE_GAP_EVENT_PASSKEY_ACTION:
+        // 设备没有显示屏，"显示"的是标签上（或由设备密钥派生）的固定passkey，由手机输入
+        if (event->passkey.params.action == BLE_SM_IOACT_DISP) {
+            struct ble_sm_io pkey = {
+                .action = BLE_SM_IOACT_DISP,
+                .passkey = ble_passkey(),
+            };
+            int rc = ble_sm_inject_io(event->passkey.conn_handle, &pkey);
+            if (rc != 0) {
+                ESP_LOGW(TAG, "提供配对passkey失败: %d", rc);
+            }
+        }
+        return 0;
+
+    case BLE_GAP_EVENT_ENC_CHANGE:
+        ESP_LOGI(TAG, "链路加密%s, 状态=%d", event->enc_change.status == 0 ? "成功" : "失败",
+                 event->enc_change.status);
+        return 0;
+
+    case BLE_GAP_EVENT_REPEAT_PAIRING: {
+        // 手机删除了配对信息后重新配对：删掉旧的绑定再继续
+        struct ble_gap_conn_desc desc;
+        if (ble_gap_conn_find(event->repeat_pairing.conn_handle, &desc) == 0) {
+            ble_store_util_delete_peer(&desc.peer_id_addr);
+        }
+        return BLE_GAP_REPEAT_PAIRING_RETRY;
+    }
+
     case BLE_GAP_EVENT_MTU:
         ESP_LOGI(TAG, "🔄 MTU 协商完成!");
         ESP_LOGI(TAG, "连接句柄=%d, 协商后MTU=%d 字节", 
@@ -168,6 +610,82 @@ static int gap_event(struct ble_gap_event *event, void *arg)
     }
 }
 
+/* 发送一帧通知，协议栈发送缓冲耗尽时等待重试 */
+static esp_err_t notify_retry(uint16_t attr_handle, const bool *subscribed, const uint8_t *data, uint16_t len)
+{
+    for (int retry = 0; retry < HIST_NOTIFY_RETRY; retry++) {
+        if (!connected || !*subscribed) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        struct os_mbuf *om = ble_hs_mbuf_from_flat(data, len);
+        if (om) {
+            int rc = ble_gatts_notify_custom(conn_handle, attr_handle, om);
+            if (rc == 0) {
+                return ESP_OK;
+            }
+            if (rc != BLE_HS_ENOMEM) {
+                return ESP_FAIL;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return ESP_ERR_TIMEOUT;
+}
+
+static esp_err_t history_notify(const uint8_t *data, uint16_t len)
+{
+    return notify_retry(history_handle, &history_subscribed, data, len);
+}
+
+static esp_err_t history_flush_frame(void)
+{
+    if (history_frame_len <= HIST_FRAME_HDR_LEN) {
+        return ESP_OK;
+    }
+    history_frame[0] = HIST_FRAME_DATA;
+    history_frame[1] = history_seq++;
+    esp_err_t err = history_notify(history_frame, history_frame_len);
+    history_frame_len = HIST_FRAME_HDR_LEN;
+    return err;
+}
+
+/* 历史查询任务：执行查询并把结果按MTU分帧通知手机 */
+static void history_task(void *param)
+{
+    ble_history_query_t query;
+
+    while (1) {
+        if (xQueueReceive(history_queue, &query, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        uint16_t max_len = use_ble_server_get_max_data_len();
+        history_frame_max = (max_len < sizeof(history_frame)) ? max_len : sizeof(history_frame);
+        history_frame_len = HIST_FRAME_HDR_LEN;
+        history_seq = 0;
+        history_total = 0;
+
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = history_handler ? history_handler(&query) : ESP_ERR_NOT_SUPPORTED;
+        if (err == ESP_OK) {
+            err = history_flush_frame();
+        }
+
+        uint8_t end[HIST_FRAME_HDR_LEN + 5] = {
+            HIST_FRAME_END, history_seq,
+            (uint8_t)history_total, (uint8_t)(history_total >> 8),
+            (uint8_t)(history_total >> 16), (uint8_t)(history_total >> 24),
+            (err == ESP_OK) ? 0 : 1,
+        };
+        history_notify(end, sizeof(end));
+
+        uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+        ESP_LOGI(TAG, "历史查询结束: %lu 条, %lu ms, 帧长 %d, 结果 %s",
+                 (unsigned long)history_total, (unsigned long)elapsed_ms,
+                 history_frame_max, esp_err_to_name(err));
+    }
+}
+
 /* 开始广播 */
 static void start_advertising(void)
 {
@@ -199,11 +717,57 @@ static void start_advertising(void)
     ESP_LOGI(TAG, "广播已启动");
 }
 
+/* 扫描事件处理 */
+static int scan_event(struct ble_gap_event *event, void *arg)
+{
+    switch (event->type) {
+    case BLE_GAP_EVENT_DISC: {
+        struct ble_hs_adv_fields fields;
+        if (adv_handler &&
+            ble_hs_adv_parse_fields(&fields, event->disc.data, event->disc.length_data) == 0 &&
+            fields.mfg_data_len > 0) {
+            adv_handler(event->disc.addr.val, event->disc.rssi, fields.mfg_data, fields.mfg_data_len);
+        }
+        return 0;
+    }
+
+    case BLE_GAP_EVENT_DISC_COMPLETE:
+        start_scan();
+        return 0;
+
+    default:
+        return 0;
+    }
+}
+
+/* 开始被动扫描，窗口为间隔的一半，给广播和已有连接留出空口时间 */
+static void start_scan(void)
+{
+    struct ble_gap_disc_params disc_params;
+
+    memset(&disc_params, 0, sizeof disc_params);
+    disc_params.passive = 1;
+    disc_params.filter_duplicates = 0;  // 子设备在同一地址上持续广播新读数
+    disc_params.itvl = 0x00A0;          // 100ms
+    disc_params.window = 0x0050;        // 50ms
+
+    int rc = ble_gap_disc(BLE_OWN_ADDR_PUBLIC, BLE_HS_FOREVER, &disc_params, scan_event, NULL);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "扫描启动失败: %d", rc);
+        return;
+    }
+    ESP_LOGI(TAG, "被动扫描已启动");
+}
+
 /* NimBLE 主机同步回调 */
 static void ble_app_on_sync(void)
 {
     ble_hs_util_ensure_addr(0);
+    host_synced = true;
     start_advertising();
+    if (adv_handler) {
+        start_scan();
+    }
 }
 
 /* NimBLE 主机任务 */
@@ -236,6 +800,8 @@ static int gatt_svr_init(void)
 
 /* 外部接口实现 */
 
+IOT_TASK_MEM(history_task_mem, 4096);
+
 esp_err_t use_ble_server_init(void)
 {
     ESP_LOGI(TAG, "初始化 NimBLE GATT 服务器");
@@ -244,6 +810,16 @@ esp_err_t use_ble_server_init(void)
 
     /* 配置主机栈 */
     ble_hs_cfg.sync_cb = ble_app_on_sync;
+    ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
+
+    /* 配对：固定passkey + LE安全连接，绑定信息保存在NVS，手机只需配对一次 */
+    ble_hs_cfg.sm_io_cap = BLE_HS_IO_DISPLAY_ONLY;
+    ble_hs_cfg.sm_bonding = 1;
+    ble_hs_cfg.sm_mitm = 1;
+    ble_hs_cfg.sm_sc = 1;
+    ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_store_config_init();
     
     /* 配置 ATT MTU 大小 */
     ble_att_set_preferred_mtu(512);  // 设置首选MTU为512字节，支持更大传输
@@ -255,6 +831,20 @@ esp_err_t use_ble_server_init(void)
         return ESP_FAIL;
     }
 
+    /* 数据点读缓存：先按当前状态编码，之后随状态变化更新 */
+    for (int dp = 0; dp < IOT_DP_MAX; dp++) {
+        dp_cache_update((iot_dp_id_t)dp);
+    }
+    if (common_register_state_listener(dp_state_listener, NULL) != 0) {
+        ESP_LOGW(TAG, "状态回调已满, 数据点特征值不会更新");
+    }
+
+    /* 历史查询任务 */
+    history_queue = xQueueCreate(1, sizeof(ble_history_query_t));
+    if (!history_queue || iot_task_create(history_task, "ble_hist", &history_task_mem, NULL, 3, NULL) != pdPASS) {
+        ESP_LOGW(TAG, "历史查询任务创建失败");
+    }
+
     /* 设置设备名称 */
     rc = ble_svc_gap_device_name_set("ESP32-C5");
     if (rc != 0) {
@@ -329,4 +919,101 @@ uint16_t use_ble_server_get_max_data_len(void)
     uint16_t mtu = use_ble_server_get_mtu();
     // ATT 写操作需要减去 3 字节开销 (操作码 + 句柄)
     return (mtu > 3) ? (mtu - 3) : 20;
-}
\ No newline at end of file
+}
+
+void use_ble_server_set_prov_handler(use_ble_prov_handler_t handler)
+{
+    prov_handler = handler;
+}
+
+esp_err_t use_ble_server_prov_notify_status(ble_prov_status_t status)
+{
+    prov_status = (uint8_t)status;
+
+    if (!connected || !prov_status_subscribed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(&prov_status, sizeof(prov_status));
+    if (!om) {
+        return ESP_ERR_NO_MEM;
+    }
+    int rc = ble_gatts_notify_custom(conn_handle, prov_status_handle, om);
+    return (rc == 0) ? ESP_OK : ESP_FAIL;
+}
+
+void use_ble_server_set_history_handler(use_ble_history_handler_t handler)
+{
+    history_handler = handler;
+}
+
+esp_err_t use_ble_server_history_put(uint8_t dp, int64_t t_ms, int32_t value)
+{
+    if (history_frame_len + HIST_RECORD_LEN > history_frame_max) {
+        esp_err_t err = history_flush_frame();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    uint8_t *p = &history_frame[history_frame_len];
+    uint64_t t = (uint64_t)t_ms;
+    uint32_t v = (uint32_t)value;
+    p[0] = dp;
+    for (int i = 0; i < 8; i++) {
+        p[1 + i] = (uint8_t)(t >> (8 * i));
+    }
+    for (int i = 0; i < 4; i++) {
+        p[9 + i] = (uint8_t)(v >> (8 * i));
+    }
+    history_frame_len += HIST_RECORD_LEN;
+    history_total++;
+    return ESP_OK;
+}
+
+esp_err_t use_ble_server_start_scan(use_ble_adv_handler_t handler)
+{
+    if (!handler) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    adv_handler = handler;
+    // 主机尚未同步时在同步回调中启动
+    if (host_synced && !ble_gap_disc_active()) {
+        start_scan();
+    }
+    return ESP_OK;
+}
+
+void use_ble_server_set_bridge_handler(use_ble_bridge_rx_t handler)
+{
+    bridge_handler = handler;
+}
+
+void use_ble_server_set_rules_handler(use_ble_rules_handler_t handler)
+{
+    rules_handler = handler;
+}
+
+bool use_ble_server_bridge_ready(void)
+{
+    return connected && bridge_subscribed;
+}
+
+esp_err_t use_ble_server_bridge_send(const uint8_t* data, uint16_t len)
+{
+    if (!data || len == 0 || len > use_ble_server_get_max_data_len()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return notify_retry(bridge_handle, &bridge_subscribed, data, len);
+}
+
+esp_err_t use_ble_server_get_dp_read_stats(ble_dp_read_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stats->reads = dp_read_count;
+    stats->avg_cycles = dp_read_count ? (uint32_t)(dp_read_total_cycles / dp_read_count) : 0;
+    stats->max_cycles = dp_read_max_cycles;
+    return ESP_OK;
+}
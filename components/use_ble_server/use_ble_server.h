@@ -13,6 +13,55 @@
 extern "C" {
 #endif
 
+/* 配网参数（由手机写入） */
+typedef struct {
+    char ssid[33];
+    char password[65];
+    uint8_t bssid[6];
+    uint8_t channel;        // 0表示未知
+    bool bssid_set;
+} ble_prov_config_t;
+
+/* 配网进度（通过状态特征值通知手机） */
+typedef enum {
+    BLE_PROV_STATUS_IDLE = 0,
+    BLE_PROV_STATUS_APPLYING,
+    BLE_PROV_STATUS_CONNECTING,
+    BLE_PROV_STATUS_WIFI_CONNECTED,
+    BLE_PROV_STATUS_TIME_SYNCED,
+    BLE_PROV_STATUS_CLOUD_CONNECTED,
+    BLE_PROV_STATUS_FAILED = 0xFF,
+} ble_prov_status_t;
+
+/* 配网处理函数，手机写入应用命令时在 NimBLE 主机任务中调用 */
+typedef esp_err_t (*use_ble_prov_handler_t)(const ble_prov_config_t* config);
+
+/* 历史数据查询（由手机写入历史特征值） */
+typedef struct {
+    uint8_t dp_mask;        // 数据点位掩码
+    uint32_t from_s;        // 起始Unix时间（秒）
+    uint32_t to_s;          // 结束Unix时间（秒），0表示到当前
+} ble_history_query_t;
+
+/* 历史查询处理函数，在BLE历史任务中调用，通过 use_ble_server_history_put 输出样本 */
+typedef esp_err_t (*use_ble_history_handler_t)(const ble_history_query_t* query);
+
+/* 手机写入云端桥接特征值时调用，在 NimBLE 主机任务中执行，须快速返回 */
+typedef void (*use_ble_bridge_rx_t)(const uint8_t* data, uint16_t len);
+
+/* 手机写入规则特征值时调用（一个规则集分片），在 NimBLE 主机任务中执行，返回错误时写入失败 */
+typedef esp_err_t (*use_ble_rules_handler_t)(const uint8_t* data, size_t len);
+
+/* 数据点特征值读回调统计 */
+typedef struct {
+    uint32_t reads;             // 读取次数（含通知取值）
+    uint32_t avg_cycles;        // 每次读回调的平均CPU周期
+    uint32_t max_cycles;        // 单次读回调的最大CPU周期
+} ble_dp_read_stats_t;
+
+/* 扫描到带厂商数据的广播时调用，在 NimBLE 主机任务中执行，须快速返回 */
+typedef void (*use_ble_adv_handler_t)(const uint8_t addr[6], int8_t rssi, const uint8_t* data, uint8_t len);
+
 /**
  * @brief 初始化 BLE 服务器
  * @return ESP_OK 成功，ESP_FAIL 失败
@@ -65,6 +114,73 @@ uint16_t use_ble_server_get_mtu(void);
  */
 uint16_t use_ble_server_get_max_data_len(void);
 
+/**
+ * @brief 设置配网处理函数
+ * @param handler 处理函数
+ */
+void use_ble_server_set_prov_handler(use_ble_prov_handler_t handler);
+
+/**
+ * @brief 更新配网进度并通知手机
+ * @param status 配网进度
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 未连接或未订阅
+ */
+esp_err_t use_ble_server_prov_notify_status(ble_prov_status_t status);
+
+/**
+ * @brief 设置历史查询处理函数
+ * @param handler 处理函数
+ */
+void use_ble_server_set_history_handler(use_ble_history_handler_t handler);
+
+/**
+ * @brief 输出一个历史样本，攒满一个MTU后通过历史特征值通知手机
+ * @param dp 数据点编号
+ * @param t_ms Unix时间（毫秒）
+ * @param value 数值
+ * @return ESP_OK 成功，其他值表示连接断开或发送失败，调用方应停止查询
+ */
+esp_err_t use_ble_server_history_put(uint8_t dp, int64_t t_ms, int32_t value);
+
+/**
+ * @brief 设置云端桥接下行帧处理函数
+ * @param handler 处理函数
+ */
+void use_ble_server_set_bridge_handler(use_ble_bridge_rx_t handler);
+
+/**
+ * @brief 设置本地联动规则分片处理函数
+ * @param handler 处理函数
+ */
+void use_ble_server_set_rules_handler(use_ble_rules_handler_t handler);
+
+/**
+ * @brief 手机是否已连接并订阅了云端桥接通知
+ */
+bool use_ble_server_bridge_ready(void);
+
+/**
+ * @brief 通过云端桥接特征值通知手机一帧数据
+ * @param data 帧
+ * @param len 帧长度，不超过 use_ble_server_get_max_data_len()
+ * @return ESP_OK 成功，ESP_ERR_INVALID_STATE 未连接或未订阅
+ */
+esp_err_t use_ble_server_bridge_send(const uint8_t* data, uint16_t len);
+
+/**
+ * @brief 获取数据点特征值读回调的耗时统计
+ * @param stats 输出统计数据
+ * @return ESP_OK 成功
+ */
+esp_err_t use_ble_server_get_dp_read_stats(ble_dp_read_stats_t* stats);
+
+/**
+ * @brief 在广播的同时被动扫描周边BLE设备（网关模式接收子设备广播）
+ * @param handler 厂商数据处理函数
+ * @return ESP_OK 成功
+ */
+esp_err_t use_ble_server_start_scan(use_ble_adv_handler_t handler);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
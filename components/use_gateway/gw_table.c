@@ -0,0 +1,158 @@
+#include "gw_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef bool (*gw_match_fn_t)(const gw_subdev_t *dev, const void *key, size_t len);
+
+static uint32_t fnv1a(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool match_addr(const gw_subdev_t *dev, const void *key, size_t len)
+{
+    return memcmp(dev->addr, key, 6) == 0;
+}
+
+static bool match_node(const gw_subdev_t *dev, const void *key, size_t len)
+{
+    return strncmp(dev->node_id, key, len) == 0 && dev->node_id[len] == '\0';
+}
+
+static bool match_device(const gw_subdev_t *dev, const void *key, size_t len)
+{
+    return strncmp(dev->device_id, key, len) == 0 && dev->device_id[len] == '\0';
+}
+
+/* 线性探测，返回匹配的槽或第一个空槽；条目不删除，遇到空槽即可结束 */
+static uint16_t *probe(gw_table_t *t, uint16_t *idx, const void *key, size_t len, gw_match_fn_t match)
+{
+    uint32_t slot = fnv1a(key, len) & t->slot_mask;
+    t->lookups++;
+    while (1) {
+        t->probes++;
+        uint16_t v = idx[slot];
+        if (v == 0 || match(&t->entries[v - 1], key, len)) {
+            return &idx[slot];
+        }
+        slot = (slot + 1) & t->slot_mask;
+    }
+}
+
+static gw_subdev_t *slot_entry(gw_table_t *t, const uint16_t *slot)
+{
+    return *slot ? &t->entries[*slot - 1] : NULL;
+}
+
+int gw_table_init(gw_table_t *table, uint16_t capacity)
+{
+    memset(table, 0, sizeof(*table));
+    if (capacity == 0 || capacity > 0x7FFF) {
+        return -1;
+    }
+
+    // 装载因子不超过0.5，保证平均探测次数接近1
+    uint32_t slots = 2;
+    while (slots < (uint32_t)capacity * 2) {
+        slots <<= 1;
+    }
+
+    table->entries = calloc(capacity, sizeof(gw_subdev_t));
+    table->idx_node = calloc(slots, sizeof(uint16_t));
+    table->idx_addr = calloc(slots, sizeof(uint16_t));
+    table->idx_dev = calloc(slots, sizeof(uint16_t));
+    if (!table->entries || !table->idx_node || !table->idx_addr || !table->idx_dev) {
+        gw_table_deinit(table);
+        return -1;
+    }
+    table->capacity = capacity;
+    table->slot_mask = (uint16_t)(slots - 1);
+    return 0;
+}
+
+void gw_table_deinit(gw_table_t *table)
+{
+    free(table->entries);
+    free(table->idx_node);
+    free(table->idx_addr);
+    free(table->idx_dev);
+    memset(table, 0, sizeof(*table));
+}
+
+gw_subdev_t *gw_table_find_addr(gw_table_t *table, const uint8_t addr[6])
+{
+    return slot_entry(table, probe(table, table->idx_addr, addr, 6, match_addr));
+}
+
+gw_subdev_t *gw_table_find_node(gw_table_t *table, const char *node_id)
+{
+    size_t len = strnlen(node_id, GW_NODE_ID_LEN);
+    return slot_entry(table, probe(table, table->idx_node, node_id, len, match_node));
+}
+
+gw_subdev_t *gw_table_find_device(gw_table_t *table, const char *device_id, size_t len)
+{
+    if (len == 0 || len >= GW_DEVICE_ID_LEN) {
+        return NULL;
+    }
+    return slot_entry(table, probe(table, table->idx_dev, device_id, len, match_device));
+}
+
+gw_subdev_t *gw_table_get_or_add(gw_table_t *table, const uint8_t addr[6])
+{
+    uint16_t *addr_slot = probe(table, table->idx_addr, addr, 6, match_addr);
+    if (*addr_slot) {
+        return &table->entries[*addr_slot - 1];
+    }
+    if (table->count >= table->capacity) {
+        return NULL;
+    }
+
+    gw_subdev_t *dev = &table->entries[table->count];
+    memset(dev, 0, sizeof(*dev));
+    memcpy(dev->addr, addr, 6);
+    snprintf(dev->node_id, sizeof(dev->node_id), "%02x%02x%02x%02x%02x%02x",
+             addr[5], addr[4], addr[3], addr[2], addr[1], addr[0]);
+    dev->conn_handle = GW_CONN_NONE;
+    dev->state = GW_SUBDEV_UNBOUND;
+
+    uint16_t *node_slot = probe(table, table->idx_node, dev->node_id,
+                                strlen(dev->node_id), match_node);
+    table->count++;
+    *addr_slot = table->count;
+    *node_slot = table->count;
+    return dev;
+}
+
+int gw_table_set_device_id(gw_table_t *table, gw_subdev_t *dev, const char *device_id)
+{
+    size_t len = strnlen(device_id, GW_DEVICE_ID_LEN);
+    if (dev->device_id[0] != '\0' || len == 0 || len >= GW_DEVICE_ID_LEN) {
+        return -1;
+    }
+
+    uint16_t *slot = probe(table, table->idx_dev, device_id, len, match_device);
+    if (*slot) {
+        return -1;
+    }
+    memcpy(dev->device_id, device_id, len);
+    dev->device_id[len] = '\0';
+    *slot = (uint16_t)(dev - table->entries) + 1;
+    return 0;
+}
+
+size_t gw_table_bytes_per_entry(const gw_table_t *table)
+{
+    if (table->capacity == 0) {
+        return 0;
+    }
+    size_t slots = (size_t)table->slot_mask + 1;
+    return sizeof(gw_subdev_t) + (3 * slots * sizeof(uint16_t)) / table->capacity;
+}
@@ -0,0 +1,94 @@
+/*
+ * 子设备路由表：按 nodeId / BLE地址 / 云端deviceId 三个索引查找同一个子设备
+ * 纯C实现，不依赖ESP-IDF
+ */
+#ifndef GW_TABLE_H
+#define GW_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GW_NODE_ID_LEN      13      // BLE地址的12位十六进制 + 结尾
+#define GW_DEVICE_ID_LEN    24      // 云端分配的子设备ID
+#define GW_SUBDEV_MAX_DP    4
+#define GW_CONN_NONE        0xFFFF  // 未建立BLE连接
+
+typedef enum {
+    GW_SUBDEV_UNBOUND = 0,          // 刚发现，尚未绑定到网关
+    GW_SUBDEV_BINDING,              // 已发送绑定请求
+    GW_SUBDEV_BOUND,                // 已绑定，未上线
+    GW_SUBDEV_ONLINE,               // 已上线，可上报
+} gw_subdev_state_t;
+
+typedef struct {
+    char node_id[GW_NODE_ID_LEN];
+    char device_id[GW_DEVICE_ID_LEN];
+    uint8_t addr[6];                // BLE地址
+    uint16_t conn_handle;           // BLE连接句柄，GW_CONN_NONE表示仅广播
+    uint8_t state;                  // gw_subdev_state_t
+    int8_t rssi;
+    uint8_t dirty_mask;             // 待上报的DP
+    uint32_t last_seen_s;           // 最近一次收到数据的时刻（开机后秒）
+    uint32_t state_s;               // 进入当前状态的时刻
+    int32_t values[GW_SUBDEV_MAX_DP];
+} gw_subdev_t;
+
+typedef struct {
+    gw_subdev_t *entries;
+    uint16_t capacity;
+    uint16_t count;
+    uint16_t slot_mask;             // 索引槽数-1，槽数为不小于2倍容量的2的幂
+    uint16_t *idx_node;             // 槽内存放 条目下标+1，0表示空
+    uint16_t *idx_addr;
+    uint16_t *idx_dev;
+    uint32_t lookups;               // 查找次数
+    uint32_t probes;                // 累计探测槽数，probes/lookups 为平均路由开销
+} gw_table_t;
+
+/**
+ * @brief 创建路由表
+ *
+ * @param table 路由表
+ * @param capacity 最大子设备数（不超过32767）
+ * @return int 0表示成功，-1表示参数错误或内存不足
+ */
+int gw_table_init(gw_table_t *table, uint16_t capacity);
+
+/**
+ * @brief 释放路由表
+ */
+void gw_table_deinit(gw_table_t *table);
+
+/**
+ * @brief 按BLE地址查找，不存在则新建（nodeId由地址生成）
+ *
+ * @return gw_subdev_t* 子设备，表满时返回NULL
+ */
+gw_subdev_t *gw_table_get_or_add(gw_table_t *table, const uint8_t addr[6]);
+
+gw_subdev_t *gw_table_find_addr(gw_table_t *table, const uint8_t addr[6]);
+gw_subdev_t *gw_table_find_node(gw_table_t *table, const char *node_id);
+gw_subdev_t *gw_table_find_device(gw_table_t *table, const char *device_id, size_t len);
+
+/**
+ * @brief 设置云端分配的deviceId并建立索引（每个子设备只能设置一次）
+ *
+ * @return int 0表示成功，-1表示已设置或参数错误
+ */
+int gw_table_set_device_id(gw_table_t *table, gw_subdev_t *dev, const char *device_id);
+
+/**
+ * @brief 每个子设备占用的内存（条目加三个索引槽）
+ */
+size_t gw_table_bytes_per_entry(const gw_table_t *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GW_TABLE_H */
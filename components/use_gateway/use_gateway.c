@@ -0,0 +1,423 @@
+/*
+ * 网关模式：扫描到的BLE子设备在路由表中登记，
+ * 由网关任务批量绑定、上线，并以子设备身份在网关的MQTT连接上上报
+ */
+
+#include "use_gateway.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "cjson.h"
+#include "common.h"
+#include "use_wifi.h"
+#include "iot_static.h"
+
+static const char *TAG = "gateway";
+
+#define GW_TASK_PERIOD_MS       1000
+#define GW_BATCH_MAX            4       // 每条绑定/上线/下线消息包含的最大子设备数，须放得进一条上行消息
+#define GW_REPORT_PER_TICK      16      // 每个周期最多上报的子设备数，避免突发
+#define GW_BIND_TIMEOUT_S       30      // 绑定无应答时重试
+#define GW_OFFLINE_S            300     // 超过该时间没有广播则下线
+#define GW_MSG_BUF_SIZE         TUYA_OUTBOX_DATA_LEN
+
+// 与子设备产品的功能点标识符一致，下标即广播中的dp
+static const char *const s_dp_codes[GW_SUBDEV_MAX_DP] = {
+    "temp_current", "humidity_value", "battery_percentage", "switch_1",
+};
+
+static gw_table_t s_table;
+static SemaphoreHandle_t s_lock = NULL;
+static use_gateway_downlink_t s_downlink = NULL;
+static gw_stats_t s_stats;
+static char s_msg[GW_MSG_BUF_SIZE];     // 仅网关任务使用
+
+static uint32_t uptime_s(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+static long long now_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void set_state(gw_subdev_t *dev, gw_subdev_state_t state)
+{
+    dev->state = state;
+    dev->state_s = uptime_s();
+}
+
+static int msg_header(char *buf, size_t size)
+{
+    static uint16_t seq = 0;
+    long long t = now_ms();
+    return snprintf(buf, size, "{\"msgId\":\"gw%lld%03u\",\"time\":%lld,", t, (unsigned)(seq++ % 1000), t);
+}
+
+/* 在s_msg的len处追加，并为结尾保留reserve字节；放不下时不追加（保持原内容）并返回-1 */
+static int msg_append(int len, int reserve, const char *fmt, ...)
+{
+    if (len < 0 || len + reserve >= (int)sizeof(s_msg)) {
+        return -1;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(s_msg + len, sizeof(s_msg) - len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || len + n + reserve >= (int)sizeof(s_msg)) {
+        s_msg[len] = '\0';
+        return -1;
+    }
+    return len + n;
+}
+
+static void publish_gateway(const char *topic, const char *data)
+{
+    use_wifi_mqtt_publish(topic, data, 1, TUYA_TX_ACK);
+}
+
+/* 批量发送绑定请求：data为 [{productId,nodeId,clientId}] */
+static void send_bind_batch(void)
+{
+    int n = 0;
+    int len = msg_append(msg_header(s_msg, sizeof(s_msg)), 0, "\"data\":[");
+    if (len < 0) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t now = uptime_s();
+    for (uint16_t i = 0; i < s_table.count && n < GW_BATCH_MAX; i++) {
+        gw_subdev_t *dev = &s_table.entries[i];
+        if (dev->state == GW_SUBDEV_BINDING && now - dev->state_s >= GW_BIND_TIMEOUT_S) {
+            set_state(dev, GW_SUBDEV_UNBOUND);
+        }
+        if (dev->state != GW_SUBDEV_UNBOUND) {
+            continue;
+        }
+        // 放不下的留到下个周期
+        int next = msg_append(len, sizeof("]}") - 1,
+                              "%s{\"productId\":\"%s\",\"nodeId\":\"%s\",\"clientId\":\"%s\"}",
+                              n ? "," : "", TUYA_SUBDEV_PRODUCT_ID, dev->node_id, dev->node_id);
+        if (next < 0) {
+            s_stats.truncated++;
+            break;
+        }
+        len = next;
+        set_state(dev, GW_SUBDEV_BINDING);
+        n++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (n > 0) {
+        msg_append(len, 0, "]}");
+        publish_gateway(TUYA_TOPIC("device/sub/bind"), s_msg);
+        ESP_LOGI(TAG, "绑定 %d 个子设备", n);
+    }
+}
+
+/* 批量上线或下线：data为 {deviceIds:[...]}，上线时同时订阅子设备的命令主题 */
+static void send_login_batch(bool login)
+{
+    char topics[GW_BATCH_MAX][64];
+    int n = 0;
+    int len = msg_append(msg_header(s_msg, sizeof(s_msg)), 0, "\"data\":{\"deviceIds\":[");
+    if (len < 0) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t now = uptime_s();
+    for (uint16_t i = 0; i < s_table.count && n < GW_BATCH_MAX; i++) {
+        gw_subdev_t *dev = &s_table.entries[i];
+        bool stale = now - dev->last_seen_s >= GW_OFFLINE_S;
+        if (login ? (dev->state != GW_SUBDEV_BOUND || stale)
+                  : (dev->state != GW_SUBDEV_ONLINE || !stale)) {
+            continue;
+        }
+        int next = msg_append(len, sizeof("]}}") - 1, "%s\"%s\"", n ? "," : "", dev->device_id);
+        if (next < 0) {
+            s_stats.truncated++;
+            break;
+        }
+        len = next;
+        snprintf(topics[n], sizeof(topics[n]), "tylink/%s/thing/property/set", dev->device_id);
+        set_state(dev, login ? GW_SUBDEV_ONLINE : GW_SUBDEV_BOUND);
+        n++;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (n == 0) {
+        return;
+    }
+    msg_append(len, 0, "]}}");
+    publish_gateway(login ? TUYA_TOPIC("device/sub/login") : TUYA_TOPIC("device/sub/logout"), s_msg);
+    if (login) {
+        for (int i = 0; i < n; i++) {
+            use_wifi_mqtt_subscribe(topics[i], 0);
+        }
+    }
+    ESP_LOGI(TAG, "子设备%s: %d 个", login ? "上线" : "下线", n);
+}
+
+/* 上报有新数据的在线子设备，主题为 tylink/<子设备ID>/thing/property/report */
+static void send_reports(void)
+{
+    static uint16_t cursor = 0;     // 轮转起点，避免总是先上报前面的子设备
+    int sent = 0;
+
+    for (uint16_t scanned = 0; sent < GW_REPORT_PER_TICK; scanned++) {
+        char topic[64];
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (scanned >= s_table.count) {
+            xSemaphoreGive(s_lock);
+            break;
+        }
+        gw_subdev_t *dev = &s_table.entries[(cursor + scanned) % s_table.count];
+        if (dev->state != GW_SUBDEV_ONLINE || dev->dirty_mask == 0) {
+            xSemaphoreGive(s_lock);
+            continue;
+        }
+
+        long long t = now_ms();
+        int len = msg_append(msg_header(s_msg, sizeof(s_msg)), 0, "\"data\":{");
+        uint8_t reported = 0;
+        for (int dp = 0; dp < GW_SUBDEV_MAX_DP && len >= 0; dp++) {
+            if (dev->dirty_mask & (1u << dp)) {
+                // 放不下的DP保留待报标记，下个周期再报
+                int next = msg_append(len, sizeof("}}") - 1, "%s\"%s\":{\"value\":%ld,\"time\":%lld}",
+                                      reported ? "," : "", s_dp_codes[dp], (long)dev->values[dp], t);
+                if (next < 0) {
+                    break;
+                }
+                len = next;
+                reported |= 1u << dp;
+            }
+        }
+        if (dev->dirty_mask != reported) {
+            s_stats.truncated++;
+        }
+        // 一个DP都放不下时重试也没有用，丢弃
+        dev->dirty_mask = reported ? (dev->dirty_mask & ~reported) : 0;
+        snprintf(topic, sizeof(topic), "tylink/%s/thing/property/report", dev->device_id);
+        xSemaphoreGive(s_lock);
+
+        if (!reported) {
+            ESP_LOGW(TAG, "%s 的上报放不进一条消息, 已丢弃", topic);
+            continue;
+        }
+        msg_append(len, 0, "}}");
+        if (use_wifi_mqtt_publish(topic, s_msg, 0, TUYA_TX_TELEMETRY) == ESP_OK) {
+            s_stats.reports++;
+        }
+        sent++;
+    }
+    if (s_table.count) {
+        cursor = (cursor + 1) % s_table.count;
+    }
+}
+
+static void gateway_task(void *arg)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(GW_TASK_PERIOD_MS));
+        if (!use_wifi_is_connected()) {
+            continue;
+        }
+        send_bind_batch();
+        send_login_batch(true);
+        send_login_batch(false);
+        send_reports();
+    }
+}
+
+/* MQTT重连后子设备需要重新上线和订阅，未完成的绑定重新发送 */
+static void on_mqtt_connected(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (uint16_t i = 0; i < s_table.count; i++) {
+        gw_subdev_t *dev = &s_table.entries[i];
+        if (dev->state == GW_SUBDEV_ONLINE) {
+            set_state(dev, GW_SUBDEV_BOUND);
+        } else if (dev->state == GW_SUBDEV_BINDING) {
+            set_state(dev, GW_SUBDEV_UNBOUND);
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static void handle_bind_response(const char *data, int data_len)
+{
+    cJSON *root = cJSON_ParseWithLength(data, data_len);
+    if (!root) {
+        return;
+    }
+
+    cJSON *list = cJSON_GetObjectItem(root, "data");
+    cJSON *item;
+    int bound = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    cJSON_ArrayForEach(item, list) {
+        cJSON *node = cJSON_GetObjectItem(item, "nodeId");
+        cJSON *dev_id = cJSON_GetObjectItem(item, "devId");
+        if (!cJSON_IsString(dev_id)) {
+            dev_id = cJSON_GetObjectItem(item, "deviceId");
+        }
+        if (!cJSON_IsString(node) || !cJSON_IsString(dev_id)) {
+            continue;
+        }
+        gw_subdev_t *dev = gw_table_find_node(&s_table, node->valuestring);
+        if (!dev) {
+            continue;
+        }
+        if (dev->device_id[0] == '\0' && gw_table_set_device_id(&s_table, dev, dev_id->valuestring) != 0) {
+            ESP_LOGW(TAG, "子设备 %s 的ID无效或重复", node->valuestring);
+            continue;
+        }
+        set_state(dev, GW_SUBDEV_BOUND);
+        bound++;
+    }
+    xSemaphoreGive(s_lock);
+    cJSON_Delete(root);
+    ESP_LOGI(TAG, "绑定应答: %d 个子设备已绑定", bound);
+}
+
+static bool on_bind_response(const char *topic, int topic_len, const char *data, int data_len, void *ctx)
+{
+    handle_bind_response(data, data_len);
+    return true;
+}
+
+/* 子设备命令 tylink/<子设备ID>/thing/property/set：按deviceId路由，复制一份条目后在锁外回调 */
+static bool on_subdev_set(const char *topic, int topic_len, const char *data, int data_len, void *ctx)
+{
+    const int prefix_len = strlen("tylink/");
+    const char *id = topic + prefix_len;
+    const char *slash = memchr(id, '/', topic_len - prefix_len);
+    if (!slash) {
+        return false;
+    }
+    int id_len = (int)(slash - id);
+
+    gw_subdev_t copy;
+    bool found = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    gw_subdev_t *dev = gw_table_find_device(&s_table, id, id_len);
+    if (dev) {
+        copy = *dev;
+        found = true;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (!found) {
+        ESP_LOGW(TAG, "未知子设备的命令: %.*s", id_len, id);
+    } else if (s_downlink) {
+        s_downlink(&copy, data, data_len);
+    }
+    return true;
+}
+
+static const use_wifi_mqtt_ext_t s_mqtt_ext = {
+    .on_connected = on_mqtt_connected,
+};
+
+IOT_TASK_MEM(s_gateway_task_mem, 4096);
+
+esp_err_t use_gateway_start(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+    if (gw_table_init(&s_table, GATEWAY_MAX_SUBDEVS) != 0) {
+        ESP_LOGE(TAG, "路由表创建失败");
+        return ESP_ERR_NO_MEM;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        gw_table_deinit(&s_table);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 网关自身的 property/set 精确匹配优先，其余ID的 property/set 为子设备命令
+    use_wifi_set_mqtt_ext(&s_mqtt_ext);
+    use_wifi_register_topic(TUYA_TOPIC("device/sub/bind_response"), 1, true, on_bind_response, NULL);
+    use_wifi_register_topic("tylink/+/thing/property/set", 0, false, on_subdev_set, NULL);
+    if (iot_task_create(gateway_task, "gateway", &s_gateway_task_mem, NULL, 3, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "网关已启动, 最多 %d 个子设备, 每个占用 %u 字节",
+             GATEWAY_MAX_SUBDEVS, (unsigned)gw_table_bytes_per_entry(&s_table));
+    return ESP_OK;
+}
+
+void use_gateway_on_adv(const uint8_t addr[6], int8_t rssi, const uint8_t* data, uint8_t len)
+{
+    if (!s_lock || len < 3 || data[0] != (GW_ADV_COMPANY_ID & 0xFF) ||
+        data[1] != (GW_ADV_COMPANY_ID >> 8) || data[2] != GW_ADV_VERSION) {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.adv_received++;
+    gw_subdev_t *dev = gw_table_get_or_add(&s_table, addr);
+    if (!dev) {
+        s_stats.table_full++;
+        xSemaphoreGive(s_lock);
+        return;
+    }
+
+    for (uint8_t pos = 3; pos + 5 <= len; pos += 5) {
+        uint8_t dp = data[pos];
+        if (dp >= GW_SUBDEV_MAX_DP) {
+            continue;
+        }
+        int32_t value = (int32_t)((uint32_t)data[pos + 1] | ((uint32_t)data[pos + 2] << 8) |
+                                  ((uint32_t)data[pos + 3] << 16) | ((uint32_t)data[pos + 4] << 24));
+        if (value != dev->values[dp] || dev->last_seen_s == 0) {
+            dev->values[dp] = value;
+            dev->dirty_mask |= 1u << dp;
+        }
+    }
+    dev->rssi = rssi;
+    dev->last_seen_s = uptime_s();
+    xSemaphoreGive(s_lock);
+}
+
+void use_gateway_set_downlink_handler(use_gateway_downlink_t handler)
+{
+    s_downlink = handler;
+}
+
+esp_err_t use_gateway_get_stats(gw_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    stats->subdevs = s_table.count;
+    stats->online = 0;
+    for (uint16_t i = 0; i < s_table.count; i++) {
+        if (s_table.entries[i].state == GW_SUBDEV_ONLINE) {
+            stats->online++;
+        }
+    }
+    stats->lookups = s_table.lookups;
+    stats->probes = s_table.probes;
+    stats->bytes_per_subdev = (uint32_t)gw_table_bytes_per_entry(&s_table);
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
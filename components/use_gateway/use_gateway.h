@@ -0,0 +1,71 @@
+/*
+ * 网关模式：BLE子设备通过网关的同一条涂鸦MQTT连接绑定、上线和上报
+ */
+#ifndef USE_GATEWAY_H
+#define USE_GATEWAY_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "gw_table.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 子设备广播格式（厂商数据）：
+ *   [0xE5 0x02] 公司ID（小端）
+ *   [0x01]      格式版本
+ *   [dp u8][value i32 小端] * N，dp 取值 0 ~ GW_SUBDEV_MAX_DP-1
+ */
+#define GW_ADV_COMPANY_ID   0x02E5
+#define GW_ADV_VERSION      0x01
+
+// 子设备下发命令处理函数，在MQTT任务中调用
+typedef void (*use_gateway_downlink_t)(const gw_subdev_t* dev, const char* data, int data_len);
+
+// 网关统计
+typedef struct {
+    uint16_t subdevs;               // 子设备总数
+    uint16_t online;                // 在线子设备数
+    uint32_t adv_received;          // 收到的子设备广播数
+    uint32_t reports;               // 子设备上报次数
+    uint32_t truncated;             // 消息放不下、部分子设备或DP推迟到下个周期的次数
+    uint32_t table_full;            // 路由表满丢弃的新设备数
+    uint32_t lookups;               // 路由查找次数
+    uint32_t probes;                // 路由查找累计探测槽数
+    uint32_t bytes_per_subdev;      // 每个子设备占用内存
+} gw_stats_t;
+
+/**
+ * @brief 启动网关：创建路由表，注册MQTT扩展和网关任务
+ *
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_gateway_start(void);
+
+/**
+ * @brief 处理一条BLE广播的厂商数据（在 NimBLE 主机任务中调用）
+ *
+ * @param addr BLE地址
+ * @param rssi 信号强度
+ * @param data 厂商数据
+ * @param len 数据长度
+ */
+void use_gateway_on_adv(const uint8_t addr[6], int8_t rssi, const uint8_t* data, uint8_t len);
+
+/**
+ * @brief 设置子设备下发命令处理函数
+ */
+void use_gateway_set_downlink_handler(use_gateway_downlink_t handler);
+
+/**
+ * @brief 获取网关统计
+ */
+esp_err_t use_gateway_get_stats(gw_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* USE_GATEWAY_H */
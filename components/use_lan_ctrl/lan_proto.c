@@ -0,0 +1,199 @@
+/*
+ * 局域网控制协议核心实现
+ */
+
+#include "lan_proto.h"
+#include <string.h>
+#include "mbedtls/md.h"
+
+static const char LAN_KEY_LABEL[] = "tuya-lan-v1";
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t len,
+                        uint8_t out[32])
+{
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), key, key_len, data, len, out);
+}
+
+/* 常量时间比较，避免通过时序猜测签名 */
+static bool tag_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+void lan_proto_derive_device_key(const char *secret, uint8_t key[LAN_PROTO_KEY_LEN])
+{
+    hmac_sha256((const uint8_t *)secret, strlen(secret),
+                (const uint8_t *)LAN_KEY_LABEL, sizeof(LAN_KEY_LABEL) - 1, key);
+}
+
+void lan_proto_derive_session_key(const uint8_t device_key[LAN_PROTO_KEY_LEN],
+                                  const uint8_t client_nonce[LAN_PROTO_NONCE_LEN],
+                                  const uint8_t device_nonce[LAN_PROTO_NONCE_LEN],
+                                  uint8_t session_key[LAN_PROTO_KEY_LEN])
+{
+    uint8_t nonces[LAN_PROTO_NONCE_LEN * 2];
+    memcpy(nonces, client_nonce, LAN_PROTO_NONCE_LEN);
+    memcpy(nonces + LAN_PROTO_NONCE_LEN, device_nonce, LAN_PROTO_NONCE_LEN);
+    hmac_sha256(device_key, LAN_PROTO_KEY_LEN, nonces, sizeof(nonces), session_key);
+}
+
+int lan_proto_encode(const uint8_t *key, uint8_t type, uint32_t seq,
+                     const uint8_t *payload, uint16_t len,
+                     uint8_t *out, size_t out_size)
+{
+    if (len > LAN_PROTO_MAX_PAYLOAD || out_size < (size_t)LAN_PROTO_OVERHEAD + len) {
+        return -1;
+    }
+
+    put_u16(out, LAN_PROTO_MAGIC);
+    out[2] = LAN_PROTO_VERSION;
+    out[3] = type;
+    put_u32(out + 4, seq);
+    put_u16(out + 8, len);
+    if (len > 0) {
+        memcpy(out + LAN_PROTO_HEADER_LEN, payload, len);
+    }
+
+    uint8_t *tag = out + LAN_PROTO_HEADER_LEN + len;
+    if (key) {
+        uint8_t mac[32];
+        hmac_sha256(key, LAN_PROTO_KEY_LEN, out, LAN_PROTO_HEADER_LEN + len, mac);
+        memcpy(tag, mac, LAN_PROTO_TAG_LEN);
+    } else {
+        memset(tag, 0, LAN_PROTO_TAG_LEN);
+    }
+    return LAN_PROTO_OVERHEAD + len;
+}
+
+int lan_proto_decode(const uint8_t *key, const uint8_t *buf, size_t len, lan_frame_t *frame)
+{
+    if (len < LAN_PROTO_HEADER_LEN) {
+        return 0;
+    }
+    if (get_u16(buf) != LAN_PROTO_MAGIC || buf[2] != LAN_PROTO_VERSION) {
+        return -LAN_ERR_BAD_FRAME;
+    }
+
+    uint16_t payload_len = get_u16(buf + 8);
+    if (payload_len > LAN_PROTO_MAX_PAYLOAD) {
+        return -LAN_ERR_BAD_FRAME;
+    }
+    size_t frame_len = (size_t)LAN_PROTO_OVERHEAD + payload_len;
+    if (len < frame_len) {
+        return 0;
+    }
+
+    if (key) {
+        uint8_t mac[32];
+        hmac_sha256(key, LAN_PROTO_KEY_LEN, buf, LAN_PROTO_HEADER_LEN + payload_len, mac);
+        if (!tag_equal(mac, buf + LAN_PROTO_HEADER_LEN + payload_len, LAN_PROTO_TAG_LEN)) {
+            return -LAN_ERR_AUTH;
+        }
+    }
+
+    frame->type = buf[3];
+    frame->seq = get_u32(buf + 4);
+    frame->len = payload_len;
+    frame->payload = buf + LAN_PROTO_HEADER_LEN;
+    return (int)frame_len;
+}
+
+int lan_session_recv(lan_session_t *session, const uint8_t *buf, size_t len, lan_frame_t *frame)
+{
+    int ret = lan_proto_decode(session->key, buf, len, frame);
+    if (ret <= 0) {
+        return ret;
+    }
+    if (frame->seq <= session->rx_seq) {
+        return -LAN_ERR_REPLAY;
+    }
+    session->rx_seq = frame->seq;
+    return ret;
+}
+
+int lan_session_send(lan_session_t *session, uint8_t type, const uint8_t *payload, uint16_t len,
+                     uint8_t *out, size_t out_size)
+{
+    int ret = lan_proto_encode(session->key, type, session->tx_seq + 1, payload, len, out, out_size);
+    if (ret > 0) {
+        session->tx_seq++;
+    }
+    return ret;
+}
+
+int lan_dp_put_int(uint8_t *buf, size_t size, int offset, uint8_t dp, int32_t value)
+{
+    if (offset < 0 || (size_t)offset + 3 + 4 > size) {
+        return -1;
+    }
+    buf[offset] = dp;
+    buf[offset + 1] = LAN_DP_TYPE_INT;
+    buf[offset + 2] = 4;
+    put_u32(buf + offset + 3, (uint32_t)value);
+    return offset + 7;
+}
+
+int lan_dp_put_str(uint8_t *buf, size_t size, int offset, uint8_t dp, const char *value)
+{
+    size_t len = strlen(value);
+    if (offset < 0 || len > 255 || (size_t)offset + 3 + len > size) {
+        return -1;
+    }
+    buf[offset] = dp;
+    buf[offset + 1] = LAN_DP_TYPE_STR;
+    buf[offset + 2] = (uint8_t)len;
+    memcpy(buf + offset + 3, value, len);
+    return offset + 3 + (int)len;
+}
+
+int lan_dp_parse(const uint8_t *payload, uint16_t len, lan_dp_cb_t cb, void *ctx)
+{
+    uint16_t pos = 0;
+    while (pos < len) {
+        if (pos + 3 > len) {
+            return -1;
+        }
+        uint8_t dp = payload[pos];
+        uint8_t type = payload[pos + 1];
+        uint8_t vlen = payload[pos + 2];
+        if (pos + 3 + vlen > len || (type == LAN_DP_TYPE_INT && vlen != 4)) {
+            return -1;
+        }
+        cb(dp, type, payload + pos + 3, vlen, ctx);
+        pos += 3 + vlen;
+    }
+    return 0;
+}
+
+int32_t lan_dp_get_int(const uint8_t *value)
+{
+    return (int32_t)get_u32(value);
+}
@@ -0,0 +1,160 @@
+/*
+ * 局域网控制协议核心（不依赖ESP-IDF，可在Linux上编译）
+ *
+ * 帧格式（大端）:
+ *   0  magic    2  0x55AA
+ *   2  version  1
+ *   3  type     1
+ *   4  seq      4  每个方向单调递增，防重放
+ *   8  len      2  负载长度
+ *   10 payload  len
+ *   .. tag      16 HMAC-SHA256(key, header+payload) 截断
+ */
+#ifndef LAN_PROTO_H
+#define LAN_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LAN_PROTO_MAGIC         0x55AA
+#define LAN_PROTO_VERSION       1
+#define LAN_PROTO_HEADER_LEN    10
+#define LAN_PROTO_TAG_LEN       16
+#define LAN_PROTO_OVERHEAD      (LAN_PROTO_HEADER_LEN + LAN_PROTO_TAG_LEN)
+#define LAN_PROTO_MAX_PAYLOAD   224
+#define LAN_PROTO_MAX_FRAME     (LAN_PROTO_OVERHEAD + LAN_PROTO_MAX_PAYLOAD)
+#define LAN_PROTO_KEY_LEN       32
+#define LAN_PROTO_NONCE_LEN     16
+
+/* 消息类型 */
+typedef enum {
+    LAN_MSG_DISCOVER = 0x01,        // UDP广播发现，无负载、无需认证
+    LAN_MSG_DISCOVER_RESP = 0x02,   // 设备ID + TCP端口，用设备密钥签名
+    LAN_MSG_HELLO = 0x10,           // 客户端随机数，用设备密钥签名
+    LAN_MSG_HELLO_ACK = 0x11,       // 设备随机数，用会话密钥签名
+    LAN_MSG_SET = 0x20,             // DP设置（TLV）
+    LAN_MSG_GET = 0x21,             // 查询全部DP
+    LAN_MSG_SUBSCRIBE = 0x22,       // 订阅状态推送
+    LAN_MSG_STATE = 0x30,           // DP状态（TLV），应答或推送
+    LAN_MSG_ERROR = 0x7F,           // 错误码（1字节）
+} lan_msg_type_t;
+
+/* 错误码 */
+typedef enum {
+    LAN_ERR_NONE = 0,
+    LAN_ERR_BAD_FRAME = 1,
+    LAN_ERR_AUTH = 2,
+    LAN_ERR_REPLAY = 3,
+    LAN_ERR_NOT_AUTHED = 4,
+    LAN_ERR_BAD_DP = 5,
+} lan_err_t;
+
+/* DP值类型 */
+typedef enum {
+    LAN_DP_TYPE_INT = 0,    // int32 大端
+    LAN_DP_TYPE_STR = 1,    // 字符串，不含'\0'
+} lan_dp_type_t;
+
+/* 解码后的帧，payload指向输入缓冲区 */
+typedef struct {
+    uint8_t type;
+    uint32_t seq;
+    uint16_t len;
+    const uint8_t *payload;
+} lan_frame_t;
+
+/* 会话状态 */
+typedef struct {
+    uint8_t key[LAN_PROTO_KEY_LEN];     // 认证前为设备密钥，认证后为会话密钥
+    uint32_t rx_seq;                    // 已接收的最大序号
+    uint32_t tx_seq;                    // 下一个发送序号
+    bool authed;
+    bool subscribed;
+} lan_session_t;
+
+/* DP解析回调 */
+typedef void (*lan_dp_cb_t)(uint8_t dp, uint8_t type, const uint8_t *value, uint8_t len, void *ctx);
+
+/**
+ * @brief 从设备密钥字符串派生局域网设备密钥
+ */
+void lan_proto_derive_device_key(const char *secret, uint8_t key[LAN_PROTO_KEY_LEN]);
+
+/**
+ * @brief 由双方随机数派生会话密钥
+ */
+void lan_proto_derive_session_key(const uint8_t device_key[LAN_PROTO_KEY_LEN],
+                                  const uint8_t client_nonce[LAN_PROTO_NONCE_LEN],
+                                  const uint8_t device_nonce[LAN_PROTO_NONCE_LEN],
+                                  uint8_t session_key[LAN_PROTO_KEY_LEN]);
+
+/**
+ * @brief 编码一帧
+ *
+ * @param key 签名密钥，NULL表示不签名（仅DISCOVER）
+ * @return int 帧长度，缓冲区不足或负载过长返回-1
+ */
+int lan_proto_encode(const uint8_t *key, uint8_t type, uint32_t seq,
+                     const uint8_t *payload, uint16_t len,
+                     uint8_t *out, size_t out_size);
+
+/**
+ * @brief 从流中解码一帧并校验签名
+ *
+ * @param key 校验密钥，NULL表示不校验（仅DISCOVER）
+ * @param frame 输出帧
+ * @return int >0 已消费字节数；0 数据不足；<0 为 -lan_err_t
+ */
+int lan_proto_decode(const uint8_t *key, const uint8_t *buf, size_t len, lan_frame_t *frame);
+
+/**
+ * @brief 会话收帧：解码、校验签名和序号
+ *
+ * @return int 同 lan_proto_decode
+ */
+int lan_session_recv(lan_session_t *session, const uint8_t *buf, size_t len, lan_frame_t *frame);
+
+/**
+ * @brief 会话发帧：使用会话密钥和递增序号编码
+ *
+ * @return int 帧长度，失败返回-1
+ */
+int lan_session_send(lan_session_t *session, uint8_t type, const uint8_t *payload, uint16_t len,
+                     uint8_t *out, size_t out_size);
+
+/**
+ * @brief 追加一个整型DP的TLV
+ *
+ * @return int 追加后的总长度，空间不足返回-1
+ */
+int lan_dp_put_int(uint8_t *buf, size_t size, int offset, uint8_t dp, int32_t value);
+
+/**
+ * @brief 追加一个字符串DP的TLV
+ *
+ * @return int 追加后的总长度，空间不足返回-1
+ */
+int lan_dp_put_str(uint8_t *buf, size_t size, int offset, uint8_t dp, const char *value);
+
+/**
+ * @brief 遍历负载中的DP TLV
+ *
+ * @return int 0表示成功，-1表示TLV格式错误
+ */
+int lan_dp_parse(const uint8_t *payload, uint16_t len, lan_dp_cb_t cb, void *ctx);
+
+/**
+ * @brief 读取大端int32 DP值
+ */
+int32_t lan_dp_get_int(const uint8_t *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAN_PROTO_H */
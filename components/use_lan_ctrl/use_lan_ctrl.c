@@ -0,0 +1,390 @@
+/*
+ * 局域网控制服务
+ * UDP广播发现 + 基于 TUYA_DEVICE_SECRET 认证的TCP命令通道，
+ * 命令直接调用公共状态setter，状态变化推送给已订阅的客户端
+ */
+
+#include "use_lan_ctrl.h"
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "lwip/sockets.h"
+#include "common.h"
+#include "lan_proto.h"
+#include "iot_static.h"
+
+static const char *TAG = "LAN_CTRL";
+
+#define LAN_SELECT_TIMEOUT_MS   20      // 同时也是状态推送的最大延迟
+
+typedef struct {
+    int fd;
+    lan_session_t session;
+    uint8_t rx_buf[LAN_PROTO_MAX_FRAME];
+    uint16_t rx_len;
+} lan_client_t;
+
+static uint8_t s_device_key[LAN_PROTO_KEY_LEN];
+static lan_client_t s_clients[LAN_CTRL_MAX_CLIENTS];
+static int s_udp_fd = -1;
+static int s_listen_fd = -1;
+static volatile uint32_t s_dirty_mask = 0;   // 待推送的DP
+static lan_ctrl_stats_t s_stats;
+static bool s_started = false;
+
+/* 状态变化回调（在调用setter的任务中执行），只做标记 */
+static void lan_state_listener(iot_dp_id_t dp, void *ctx)
+{
+    __atomic_fetch_or(&s_dirty_mask, IOT_DP_BIT(dp), __ATOMIC_RELAXED);
+}
+
+/* 按掩码编码DP状态 */
+static int encode_state(uint32_t mask, uint8_t *buf, size_t size)
+{
+    char status[32];
+    int32_t value;
+    int len = 0;
+
+    get_current_iot_state(status, sizeof(status), &value);
+    if (mask & IOT_DP_BIT(IOT_DP_DEVICE_STATUS)) {
+        len = lan_dp_put_str(buf, size, len, IOT_DP_DEVICE_STATUS, status);
+    }
+    if (len >= 0 && (mask & IOT_DP_BIT(IOT_DP_TEST_VALUE))) {
+        len = lan_dp_put_int(buf, size, len, IOT_DP_TEST_VALUE, value);
+    }
+    return len;
+}
+
+static void client_send(lan_client_t *c, uint8_t type, const uint8_t *payload, uint16_t len)
+{
+    uint8_t frame[LAN_PROTO_MAX_FRAME];
+    int n = lan_session_send(&c->session, type, payload, len, frame, sizeof(frame));
+    if (n > 0) {
+        send(c->fd, frame, n, 0);
+    }
+}
+
+static void client_send_error(lan_client_t *c, lan_err_t err)
+{
+    uint8_t code = (uint8_t)err;
+    client_send(c, LAN_MSG_ERROR, &code, 1);
+}
+
+static void client_close(lan_client_t *c)
+{
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    s_stats.clients--;
+}
+
+/* SET命令中的单个DP，直接调用公共setter */
+static void apply_dp(uint8_t dp, uint8_t type, const uint8_t *value, uint8_t len, void *ctx)
+{
+    uint32_t *applied = ctx;
+
+    if (dp == IOT_DP_DEVICE_STATUS && type == LAN_DP_TYPE_STR) {
+        char status[32];
+        uint8_t n = (len < sizeof(status) - 1) ? len : sizeof(status) - 1;
+        memcpy(status, value, n);
+        status[n] = '\0';
+        set_device_status(status);
+        *applied |= IOT_DP_BIT(IOT_DP_DEVICE_STATUS);
+    } else if (dp == IOT_DP_TEST_VALUE && type == LAN_DP_TYPE_INT) {
+        set_test_value(lan_dp_get_int(value));
+        *applied |= IOT_DP_BIT(IOT_DP_TEST_VALUE);
+    }
+}
+
+/* 处理握手 */
+static void handle_hello(lan_client_t *c, const lan_frame_t *frame)
+{
+    if (frame->len != LAN_PROTO_NONCE_LEN) {
+        client_send_error(c, LAN_ERR_BAD_FRAME);
+        return;
+    }
+
+    uint8_t device_nonce[LAN_PROTO_NONCE_LEN];
+    esp_fill_random(device_nonce, sizeof(device_nonce));
+    lan_proto_derive_session_key(s_device_key, frame->payload, device_nonce, c->session.key);
+    c->session.authed = true;
+    c->session.rx_seq = 0;
+    c->session.tx_seq = 0;
+    client_send(c, LAN_MSG_HELLO_ACK, device_nonce, sizeof(device_nonce));
+    ESP_LOGI(TAG, "客户端认证成功, fd=%d", c->fd);
+}
+
+/* 处理一帧已认证的命令 */
+static void handle_frame(lan_client_t *c, const lan_frame_t *frame, int64_t rx_time_us)
+{
+    uint8_t payload[LAN_PROTO_MAX_PAYLOAD];
+    int len;
+
+    switch (frame->type) {
+    case LAN_MSG_SET: {
+        uint32_t applied = 0;
+        if (lan_dp_parse(frame->payload, frame->len, apply_dp, &applied) != 0 || applied == 0) {
+            client_send_error(c, LAN_ERR_BAD_DP);
+            return;
+        }
+        len = encode_state(applied, payload, sizeof(payload));
+        if (len >= 0) {
+            client_send(c, LAN_MSG_STATE, payload, len);
+        }
+        s_stats.commands++;
+        iot_latency_record(&s_stats.cmd_latency, (uint32_t)(esp_timer_get_time() - rx_time_us));
+        break;
+    }
+    case LAN_MSG_GET:
+        len = encode_state(IOT_DP_ALL_MASK, payload, sizeof(payload));
+        if (len >= 0) {
+            client_send(c, LAN_MSG_STATE, payload, len);
+        }
+        break;
+    case LAN_MSG_SUBSCRIBE:
+        c->session.subscribed = true;
+        len = encode_state(IOT_DP_ALL_MASK, payload, sizeof(payload));
+        if (len >= 0) {
+            client_send(c, LAN_MSG_STATE, payload, len);
+        }
+        break;
+    default:
+        client_send_error(c, LAN_ERR_BAD_FRAME);
+        break;
+    }
+}
+
+/* 读取TCP数据并处理其中的完整帧 */
+static void client_receive(lan_client_t *c)
+{
+    int n = recv(c->fd, c->rx_buf + c->rx_len, sizeof(c->rx_buf) - c->rx_len, 0);
+    if (n <= 0) {
+        ESP_LOGI(TAG, "客户端断开, fd=%d", c->fd);
+        client_close(c);
+        return;
+    }
+    int64_t rx_time_us = esp_timer_get_time();
+    c->rx_len += n;
+
+    while (c->rx_len > 0) {
+        lan_frame_t frame;
+        int used = lan_session_recv(&c->session, c->rx_buf, c->rx_len, &frame);
+        if (used == 0) {
+            break;
+        }
+        if (used < 0) {
+            // 签名错误或重放：断开连接，不给对方试探的机会
+            s_stats.auth_failures++;
+            ESP_LOGW(TAG, "帧校验失败(%d), 断开 fd=%d", -used, c->fd);
+            client_close(c);
+            return;
+        }
+
+        if (frame.type == LAN_MSG_HELLO) {
+            handle_hello(c, &frame);
+        } else if (!c->session.authed) {
+            client_send_error(c, LAN_ERR_NOT_AUTHED);
+        } else {
+            handle_frame(c, &frame, rx_time_us);
+        }
+
+        c->rx_len -= used;
+        memmove(c->rx_buf, c->rx_buf + used, c->rx_len);
+    }
+}
+
+/* 应答UDP发现请求 */
+static void handle_discovery(void)
+{
+    uint8_t buf[LAN_PROTO_MAX_FRAME];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+
+    int n = recvfrom(s_udp_fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+    if (n <= 0) {
+        return;
+    }
+
+    lan_frame_t frame;
+    if (lan_proto_decode(NULL, buf, n, &frame) <= 0 || frame.type != LAN_MSG_DISCOVER) {
+        return;
+    }
+
+    uint8_t payload[64];
+    size_t id_len = strlen(TUYA_DEVICE_ID);
+    payload[0] = (uint8_t)id_len;
+    memcpy(payload + 1, TUYA_DEVICE_ID, id_len);
+    payload[1 + id_len] = (uint8_t)(LAN_CTRL_TCP_PORT >> 8);
+    payload[2 + id_len] = (uint8_t)LAN_CTRL_TCP_PORT;
+
+    int len = lan_proto_encode(s_device_key, LAN_MSG_DISCOVER_RESP, 0,
+                               payload, id_len + 3, buf, sizeof(buf));
+    if (len > 0) {
+        sendto(s_udp_fd, buf, len, 0, (struct sockaddr *)&from, from_len);
+    }
+}
+
+static void accept_client(void)
+{
+    int fd = accept(s_listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+
+    for (int i = 0; i < LAN_CTRL_MAX_CLIENTS; i++) {
+        if (s_clients[i].fd < 0) {
+            int nodelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+            memset(&s_clients[i], 0, sizeof(s_clients[i]));
+            s_clients[i].fd = fd;
+            // 认证前使用设备密钥校验HELLO
+            memcpy(s_clients[i].session.key, s_device_key, LAN_PROTO_KEY_LEN);
+            s_stats.clients++;
+            ESP_LOGI(TAG, "新客户端连接, fd=%d", fd);
+            return;
+        }
+    }
+
+    ESP_LOGW(TAG, "客户端已满, 拒绝连接");
+    close(fd);
+}
+
+/* 推送状态变化给已订阅的客户端 */
+static void push_dirty_state(void)
+{
+    uint32_t mask = __atomic_exchange_n(&s_dirty_mask, 0, __ATOMIC_RELAXED);
+    if (mask == 0) {
+        return;
+    }
+
+    uint8_t payload[LAN_PROTO_MAX_PAYLOAD];
+    int len = encode_state(mask, payload, sizeof(payload));
+    if (len < 0) {
+        return;
+    }
+    for (int i = 0; i < LAN_CTRL_MAX_CLIENTS; i++) {
+        lan_client_t *c = &s_clients[i];
+        if (c->fd >= 0 && c->session.authed && c->session.subscribed) {
+            client_send(c, LAN_MSG_STATE, payload, len);
+            s_stats.pushes++;
+        }
+    }
+}
+
+static int open_sockets(void)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int on = 1;
+
+    s_udp_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    addr.sin_port = htons(LAN_CTRL_DISCOVERY_PORT);
+    if (s_udp_fd < 0 || bind(s_udp_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "绑定发现端口失败");
+        return -1;
+    }
+
+    s_listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s_listen_fd < 0) {
+        return -1;
+    }
+    setsockopt(s_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    addr.sin_port = htons(LAN_CTRL_TCP_PORT);
+    if (bind(s_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(s_listen_fd, 2) != 0) {
+        ESP_LOGE(TAG, "绑定命令端口失败");
+        return -1;
+    }
+    return 0;
+}
+
+/* 服务任务 */
+static void lan_ctrl_task(void *arg)
+{
+    while (1) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(s_udp_fd, &rfds);
+        FD_SET(s_listen_fd, &rfds);
+        int max_fd = (s_udp_fd > s_listen_fd) ? s_udp_fd : s_listen_fd;
+        for (int i = 0; i < LAN_CTRL_MAX_CLIENTS; i++) {
+            if (s_clients[i].fd >= 0) {
+                FD_SET(s_clients[i].fd, &rfds);
+                if (s_clients[i].fd > max_fd) {
+                    max_fd = s_clients[i].fd;
+                }
+            }
+        }
+
+        struct timeval tv = { .tv_sec = 0, .tv_usec = LAN_SELECT_TIMEOUT_MS * 1000 };
+        int ready = select(max_fd + 1, &rfds, NULL, NULL, &tv);
+        if (ready > 0) {
+            if (FD_ISSET(s_udp_fd, &rfds)) {
+                handle_discovery();
+            }
+            if (FD_ISSET(s_listen_fd, &rfds)) {
+                accept_client();
+            }
+            for (int i = 0; i < LAN_CTRL_MAX_CLIENTS; i++) {
+                if (s_clients[i].fd >= 0 && FD_ISSET(s_clients[i].fd, &rfds)) {
+                    client_receive(&s_clients[i]);
+                }
+            }
+        }
+
+        push_dirty_state();
+    }
+}
+
+IOT_TASK_MEM(s_lan_task_mem, 4096);
+
+esp_err_t use_lan_ctrl_start(void)
+{
+    if (s_started) {
+        return ESP_OK;
+    }
+
+    lan_proto_derive_device_key(TUYA_DEVICE_SECRET, s_device_key);
+    for (int i = 0; i < LAN_CTRL_MAX_CLIENTS; i++) {
+        s_clients[i].fd = -1;
+    }
+
+    if (open_sockets() != 0) {
+        if (s_udp_fd >= 0) {
+            close(s_udp_fd);
+            s_udp_fd = -1;
+        }
+        if (s_listen_fd >= 0) {
+            close(s_listen_fd);
+            s_listen_fd = -1;
+        }
+        return ESP_FAIL;
+    }
+
+    common_register_state_listener(lan_state_listener, NULL);
+    if (iot_task_create(lan_ctrl_task, "lan_ctrl", &s_lan_task_mem, NULL, 6, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_started = true;
+    ESP_LOGI(TAG, "局域网控制已启动: 发现端口 %d, 命令端口 %d",
+             LAN_CTRL_DISCOVERY_PORT, LAN_CTRL_TCP_PORT);
+    return ESP_OK;
+}
+
+esp_err_t use_lan_ctrl_get_stats(lan_ctrl_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = s_stats;
+    return ESP_OK;
+}
@@ -0,0 +1,40 @@
+#ifndef USE_LAN_CTRL_H
+#define USE_LAN_CTRL_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "iot_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 局域网控制统计 */
+typedef struct {
+    iot_latency_stat_t cmd_latency;     // 收到SET到状态应答发出的处理时延
+    uint32_t commands;                  // 已执行的SET命令数
+    uint32_t pushes;                    // 状态推送帧数
+    uint32_t auth_failures;             // 签名或序号校验失败次数
+    uint8_t clients;                    // 当前TCP客户端数
+} lan_ctrl_stats_t;
+
+/**
+ * @brief 启动局域网控制服务（UDP发现 + TCP命令通道）
+ *
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_lan_ctrl_start(void);
+
+/**
+ * @brief 获取局域网控制统计
+ *
+ * @param stats 输出统计数据
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_lan_ctrl_get_stats(lan_ctrl_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* USE_LAN_CTRL_H */
@@ -0,0 +1,52 @@
+#include "tuya_backoff.h"
+
+static uint32_t next_random(tuya_backoff_t *b)
+{
+    uint32_t x = b->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    b->rng = x;
+    return x;
+}
+
+/* [lo, hi] 内均匀随机 */
+static uint32_t random_between(tuya_backoff_t *b, uint32_t lo, uint32_t hi)
+{
+    if (hi <= lo) {
+        return lo;
+    }
+    return lo + next_random(b) % (hi - lo + 1);
+}
+
+void tuya_backoff_init(tuya_backoff_t *b, uint32_t base_ms, uint32_t cap_ms,
+                       uint32_t first_window_ms, uint32_t seed)
+{
+    b->base_ms = base_ms;
+    b->cap_ms = (cap_ms > base_ms) ? cap_ms : base_ms;
+    b->first_window_ms = first_window_ms;
+    b->rng = seed ? seed : 0x9E3779B9u;     // xorshift 状态不能为0
+    tuya_backoff_reset(b);
+}
+
+uint32_t tuya_backoff_next(tuya_backoff_t *b)
+{
+    uint32_t delay;
+
+    if (b->attempts == 0) {
+        delay = random_between(b, 0, b->first_window_ms);
+        b->prev_ms = b->base_ms;
+    } else {
+        uint32_t hi = (b->prev_ms > b->cap_ms / 3) ? b->cap_ms : b->prev_ms * 3;
+        delay = random_between(b, b->base_ms, hi);
+        b->prev_ms = delay;
+    }
+    b->attempts++;
+    return delay;
+}
+
+void tuya_backoff_reset(tuya_backoff_t *b)
+{
+    b->prev_ms = b->base_ms;
+    b->attempts = 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * 重连退避策略：带随机抖动的指数退避，避免大量设备在同一时刻重连
+ * 纯C实现，不依赖ESP-IDF，随机种子由调用方提供
+ */
+#ifndef TUYA_BACKOFF_H
+#define TUYA_BACKOFF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t base_ms;           // 最小间隔
+    uint32_t cap_ms;            // 最大间隔
+    uint32_t first_window_ms;   // 首次重试在 [0, first_window_ms] 内随机，0表示立即
+    uint32_t prev_ms;           // 上一次的间隔
+    uint32_t attempts;          // 本轮已重试次数
+    uint32_t rng;               // xorshift32 状态
+} tuya_backoff_t;
+
+/**
+ * @brief 初始化退避策略
+ *
+ * @param b 策略对象
+ * @param base_ms 最小间隔
+ * @param cap_ms 最大间隔
+ * @param first_window_ms 首次重试的随机窗口
+ * @param seed 随机种子，不同设备应不同
+ */
+void tuya_backoff_init(tuya_backoff_t *b, uint32_t base_ms, uint32_t cap_ms,
+                       uint32_t first_window_ms, uint32_t seed);
+
+/**
+ * @brief 计算下一次重试前的等待时间
+ *
+ * 首次在首次窗口内均匀随机，之后为 [base, 3 * 上次间隔] 内均匀随机（不超过cap），
+ * 相邻设备的重试时刻逐轮错开而不是同步翻倍
+ *
+ * @return uint32_t 等待时间（毫秒）
+ */
+uint32_t tuya_backoff_next(tuya_backoff_t *b);
+
+/**
+ * @brief 连接成功后重置
+ */
+void tuya_backoff_reset(tuya_backoff_t *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_BACKOFF_H */
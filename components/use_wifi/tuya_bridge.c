@@ -0,0 +1,190 @@
+#include "tuya_bridge.h"
+#include <string.h>
+#include "mbedtls/md.h"
+
+static const char BRIDGE_KEY_LABEL[] = "tuya-bridge-v1";
+
+static void put_hdr(uint8_t* frame, uint8_t type, uint16_t seq, uint8_t frag)
+{
+    frame[0] = type;
+    frame[1] = (uint8_t)seq;
+    frame[2] = (uint8_t)(seq >> 8);
+    frame[3] = frag;
+}
+
+int tuya_bridge_encode(uint16_t seq, const char* topic, const char* data, uint16_t data_len,
+                       uint16_t max_frame, tuya_bridge_emit_t emit, void* ctx)
+{
+    uint8_t frame[TUYA_BRIDGE_HDR_LEN + TUYA_BRIDGE_MSG_MAX];
+    size_t topic_len = strlen(topic);
+    size_t total = topic_len + 1 + data_len;
+    if (total > TUYA_BRIDGE_MSG_MAX) {
+        return -1;
+    }
+    if (max_frame < TUYA_BRIDGE_FRAME_MIN) {
+        max_frame = TUYA_BRIDGE_FRAME_MIN;
+    }
+    if (max_frame > sizeof(frame)) {
+        max_frame = sizeof(frame);
+    }
+
+    // 按 "<topic>\n<data>" 的顺序逐段拷贝，不拼接整条消息
+    const size_t chunk = max_frame - TUYA_BRIDGE_HDR_LEN;
+    size_t pos = 0;
+    int frames = 0;
+    while (pos < total) {
+        size_t n = total - pos < chunk ? total - pos : chunk;
+        uint8_t* out = &frame[TUYA_BRIDGE_HDR_LEN];
+        for (size_t i = 0; i < n; i++) {
+            size_t k = pos + i;
+            out[i] = k < topic_len ? (uint8_t)topic[k] :
+                     k == topic_len ? '\n' : (uint8_t)data[k - topic_len - 1];
+        }
+        pos += n;
+        if (frames > 0x7F) {
+            return -1;
+        }
+        put_hdr(frame, TUYA_BRIDGE_UP_DATA, seq,
+                (uint8_t)frames | (pos == total ? TUYA_BRIDGE_FRAG_LAST : 0));
+        if (emit(frame, (uint16_t)(TUYA_BRIDGE_HDR_LEN + n), ctx) != 0) {
+            return -1;
+        }
+        frames++;
+    }
+    return frames;
+}
+
+void tuya_bridge_rx_reset(tuya_bridge_rx_t* rx)
+{
+    rx->len = 0;
+    rx->next_frag = 0;
+}
+
+tuya_bridge_rx_result_t tuya_bridge_rx_frame(tuya_bridge_rx_t* rx, const uint8_t* frame, uint16_t len,
+                                             uint16_t* seq)
+{
+    if (len < 3) {
+        return TUYA_BRIDGE_RX_ERROR;
+    }
+    *seq = (uint16_t)frame[1] | ((uint16_t)frame[2] << 8);
+
+    if (frame[0] == TUYA_BRIDGE_DOWN_ACK) {
+        return TUYA_BRIDGE_RX_ACK;
+    }
+    if (frame[0] == TUYA_BRIDGE_DOWN_HELLO) {
+        return TUYA_BRIDGE_RX_HELLO;
+    }
+    if (frame[0] != TUYA_BRIDGE_DOWN_DATA || len < TUYA_BRIDGE_HDR_LEN) {
+        return TUYA_BRIDGE_RX_ERROR;
+    }
+
+    uint8_t frag = frame[3] & ~TUYA_BRIDGE_FRAG_LAST;
+    if (frag == 0) {
+        tuya_bridge_rx_reset(rx);
+        rx->seq = *seq;
+    } else if (frag != rx->next_frag || *seq != rx->seq) {
+        // 分片丢失或乱序，丢弃整条消息，由手机重发
+        tuya_bridge_rx_reset(rx);
+        return TUYA_BRIDGE_RX_ERROR;
+    }
+
+    uint16_t n = len - TUYA_BRIDGE_HDR_LEN;
+    if (rx->len + n > sizeof(rx->buf) - 1) {
+        tuya_bridge_rx_reset(rx);
+        return TUYA_BRIDGE_RX_ERROR;
+    }
+    memcpy(&rx->buf[rx->len], &frame[TUYA_BRIDGE_HDR_LEN], n);
+    rx->len += n;
+    rx->next_frag = frag + 1;
+
+    if (!(frame[3] & TUYA_BRIDGE_FRAG_LAST)) {
+        return TUYA_BRIDGE_RX_NONE;
+    }
+    rx->buf[rx->len] = '\0';
+    rx->next_frag = 0;
+    return TUYA_BRIDGE_RX_MESSAGE;
+}
+
+void tuya_bridge_auth_init(tuya_bridge_auth_t* auth, const char* secret)
+{
+    memset(auth, 0, sizeof(*auth));
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t*)secret, strlen(secret),
+                    (const uint8_t*)BRIDGE_KEY_LABEL, sizeof(BRIDGE_KEY_LABEL) - 1, auth->key);
+}
+
+uint16_t tuya_bridge_auth_start(tuya_bridge_auth_t* auth, const uint8_t nonce[TUYA_BRIDGE_NONCE_LEN],
+                                uint8_t* frame)
+{
+    memcpy(auth->nonce, nonce, TUYA_BRIDGE_NONCE_LEN);
+    auth->rx_counter = 0;
+    auth->active = true;
+    frame[0] = TUYA_BRIDGE_UP_NONCE;
+    memcpy(&frame[1], nonce, TUYA_BRIDGE_NONCE_LEN);
+    return TUYA_BRIDGE_NONCE_FRAME;
+}
+
+void tuya_bridge_auth_stop(tuya_bridge_auth_t* auth)
+{
+    auth->active = false;
+    auth->rx_counter = 0;
+}
+
+tuya_bridge_auth_result_t tuya_bridge_auth_verify(tuya_bridge_auth_t* auth, tuya_bridge_rx_t* rx)
+{
+    if (!auth->active) {
+        return TUYA_BRIDGE_AUTH_NO_SESSION;
+    }
+    if (rx->len <= TUYA_BRIDGE_AUTH_LEN) {
+        return TUYA_BRIDGE_AUTH_BAD_TAG;
+    }
+    const uint8_t* msg = (const uint8_t*)rx->buf;
+    uint16_t signed_len = rx->len - TUYA_BRIDGE_TAG_LEN;
+
+    uint8_t tag[32];
+    mbedtls_md_context_t ctx;
+    mbedtls_md_init(&ctx);
+    if (mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) != 0) {
+        mbedtls_md_free(&ctx);
+        return TUYA_BRIDGE_AUTH_BAD_TAG;
+    }
+    mbedtls_md_hmac_starts(&ctx, auth->key, TUYA_BRIDGE_KEY_LEN);
+    mbedtls_md_hmac_update(&ctx, auth->nonce, TUYA_BRIDGE_NONCE_LEN);
+    mbedtls_md_hmac_update(&ctx, msg, signed_len);
+    mbedtls_md_hmac_finish(&ctx, tag);
+    mbedtls_md_free(&ctx);
+
+    // 常量时间比较，避免通过时序猜测签名
+    uint8_t diff = 0;
+    for (int i = 0; i < TUYA_BRIDGE_TAG_LEN; i++) {
+        diff |= tag[i] ^ msg[signed_len + i];
+    }
+    if (diff != 0) {
+        return TUYA_BRIDGE_AUTH_BAD_TAG;
+    }
+
+    uint32_t counter = (uint32_t)msg[0] | ((uint32_t)msg[1] << 8) | ((uint32_t)msg[2] << 16) |
+                       ((uint32_t)msg[3] << 24);
+    if (counter <= auth->rx_counter) {
+        return TUYA_BRIDGE_AUTH_REPLAY;
+    }
+    auth->rx_counter = counter;
+
+    rx->len = signed_len - 4;
+    memmove(rx->buf, &rx->buf[4], rx->len);
+    rx->buf[rx->len] = '\0';
+    return TUYA_BRIDGE_AUTH_OK;
+}
+
+bool tuya_bridge_split(const tuya_bridge_rx_t* rx, const char** topic, int* topic_len,
+                       const char** data, int* data_len)
+{
+    const char* nl = memchr(rx->buf, '\n', rx->len);
+    if (!nl || nl == rx->buf) {
+        return false;
+    }
+    *topic = rx->buf;
+    *topic_len = (int)(nl - rx->buf);
+    *data = nl + 1;
+    *data_len = (int)(rx->len - *topic_len - 1);
+    return true;
+}
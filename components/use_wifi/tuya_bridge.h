@@ -0,0 +1,147 @@
+/*
+ * BLE桥接帧格式：MQTT不可用时，上行消息经手机转发到云端，云端命令经手机下发
+ * 纯C实现，不依赖ESP-IDF
+ *
+ * 设备 -> 手机（通知）：
+ *   [0x01][seq u16][frag u8][内容分片]    frag低7位为分片序号，最高位表示最后一片
+ *   一条消息的内容为 "<topic>\n<data>"，手机按seq去重后发布，再回写ACK
+ *   [0x02][nonce 16]                      会话随机数，手机订阅通知后或请求时发出
+ * 手机 -> 设备（写）：
+ *   [0x81][seq u16]                       已转发seq对应的消息
+ *   [0x82][seq u16][frag u8][内容分片]    云端下发的消息，内容为 [counter u32]"<topic>\n<data>"[tag 16]
+ *   [0x83][seq u16]                       请求新的会话随机数（seq不使用）
+ * 多字节字段均为小端
+ *
+ * 下行消息须签名：tag = HMAC-SHA256(key, nonce + counter + 内容) 的前16字节，
+ * key = HMAC-SHA256(TUYA_DEVICE_SECRET, "tuya-bridge-v1")；counter在一次会话内严格递增，防重放
+ */
+#ifndef TUYA_BRIDGE_H
+#define TUYA_BRIDGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_BRIDGE_UP_DATA     0x01
+#define TUYA_BRIDGE_UP_NONCE    0x02
+#define TUYA_BRIDGE_DOWN_ACK    0x81
+#define TUYA_BRIDGE_DOWN_DATA   0x82
+#define TUYA_BRIDGE_DOWN_HELLO  0x83
+
+#define TUYA_BRIDGE_HDR_LEN     4
+#define TUYA_BRIDGE_FRAG_LAST   0x80
+#define TUYA_BRIDGE_MSG_MAX     600     // 主题 + 换行 + 数据
+#define TUYA_BRIDGE_FRAME_MIN   20      // 默认MTU下的最大负载
+
+#define TUYA_BRIDGE_KEY_LEN     32
+#define TUYA_BRIDGE_NONCE_LEN   16
+#define TUYA_BRIDGE_TAG_LEN     16
+#define TUYA_BRIDGE_AUTH_LEN    (4 + TUYA_BRIDGE_TAG_LEN)   // 下行消息的counter + tag
+#define TUYA_BRIDGE_NONCE_FRAME (1 + TUYA_BRIDGE_NONCE_LEN)
+
+// 逐帧输出，返回非0中止
+typedef int (*tuya_bridge_emit_t)(const uint8_t* frame, uint16_t len, void* ctx);
+
+typedef enum {
+    TUYA_BRIDGE_RX_NONE = 0,        // 帧已接收，消息未完整
+    TUYA_BRIDGE_RX_ACK,             // 收到ACK，seq有效
+    TUYA_BRIDGE_RX_MESSAGE,         // 收到完整的下行消息
+    TUYA_BRIDGE_RX_HELLO,           // 手机请求新的会话随机数
+    TUYA_BRIDGE_RX_ERROR,           // 格式错误或分片乱序，已丢弃
+} tuya_bridge_rx_result_t;
+
+typedef enum {
+    TUYA_BRIDGE_AUTH_OK = 0,
+    TUYA_BRIDGE_AUTH_NO_SESSION,    // 尚未发出会话随机数
+    TUYA_BRIDGE_AUTH_BAD_TAG,       // 签名错误或消息过短
+    TUYA_BRIDGE_AUTH_REPLAY,        // counter未递增
+} tuya_bridge_auth_result_t;
+
+// 下行消息认证状态，每次手机订阅通知时重新开始
+typedef struct {
+    uint8_t key[TUYA_BRIDGE_KEY_LEN];
+    uint8_t nonce[TUYA_BRIDGE_NONCE_LEN];
+    uint32_t rx_counter;            // 本次会话已接受的最大counter
+    bool active;
+} tuya_bridge_auth_t;
+
+// 下行消息重组状态
+typedef struct {
+    char buf[TUYA_BRIDGE_MSG_MAX + TUYA_BRIDGE_AUTH_LEN + 1];
+    uint16_t len;
+    uint16_t seq;
+    uint8_t next_frag;
+} tuya_bridge_rx_t;
+
+/**
+ * @brief 把一条上行消息切成不超过max_frame字节的帧
+ *
+ * @param seq 消息序号
+ * @param topic 主题
+ * @param data 消息内容
+ * @param data_len 消息长度
+ * @param max_frame 单帧最大长度（协商MTU-3）
+ * @param emit 帧输出函数
+ * @param ctx emit参数
+ * @return int 输出的帧数，-1表示消息过长或emit中止
+ */
+int tuya_bridge_encode(uint16_t seq, const char* topic, const char* data, uint16_t data_len,
+                       uint16_t max_frame, tuya_bridge_emit_t emit, void* ctx);
+
+void tuya_bridge_rx_reset(tuya_bridge_rx_t* rx);
+
+/**
+ * @brief 处理手机写入的一帧
+ *
+ * @param rx 重组状态
+ * @param frame 帧
+ * @param len 帧长度
+ * @param seq 输出ACK或消息的序号
+ * @return tuya_bridge_rx_result_t 处理结果；RX_MESSAGE时 rx->buf 为带counter和tag的消息，
+ *         须先经 tuya_bridge_auth_verify 校验
+ */
+tuya_bridge_rx_result_t tuya_bridge_rx_frame(tuya_bridge_rx_t* rx, const uint8_t* frame, uint16_t len,
+                                             uint16_t* seq);
+
+/**
+ * @brief 由设备密钥派生桥接签名密钥，并清除会话
+ */
+void tuya_bridge_auth_init(tuya_bridge_auth_t* auth, const char* secret);
+
+/**
+ * @brief 开始新会话：记录随机数、counter清零，并生成发给手机的随机数帧
+ *
+ * @param auth 认证状态
+ * @param nonce 随机数（调用方用硬件随机数生成）
+ * @param frame 输出帧，至少 TUYA_BRIDGE_NONCE_FRAME 字节
+ * @return uint16_t 帧长度
+ */
+uint16_t tuya_bridge_auth_start(tuya_bridge_auth_t* auth, const uint8_t nonce[TUYA_BRIDGE_NONCE_LEN],
+                                uint8_t* frame);
+
+/**
+ * @brief 结束会话（手机断开），之后的下行消息一律拒绝
+ */
+void tuya_bridge_auth_stop(tuya_bridge_auth_t* auth);
+
+/**
+ * @brief 校验重组好的下行消息；通过时原地去掉counter和tag，rx->buf 变为 "<topic>\n<data>"
+ */
+tuya_bridge_auth_result_t tuya_bridge_auth_verify(tuya_bridge_auth_t* auth, tuya_bridge_rx_t* rx);
+
+/**
+ * @brief 拆分重组好的消息
+ *
+ * @return bool false表示没有主题分隔符
+ */
+bool tuya_bridge_split(const tuya_bridge_rx_t* rx, const char** topic, int* topic_len,
+                       const char** data, int* data_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_BRIDGE_H */
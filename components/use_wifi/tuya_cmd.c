@@ -0,0 +1,112 @@
+#include "tuya_cmd.h"
+#include <string.h>
+
+void tuya_cmd_init(tuya_cmd_t* c, uint32_t window_ms)
+{
+    memset(c, 0, sizeof(*c));
+    c->window_us = (int64_t)window_ms * 1000;
+    iot_latency_reset(&c->stats.hold);
+    iot_latency_reset(&c->stats.delay);
+}
+
+bool tuya_cmd_seen(tuya_cmd_t* c, const char* msg_id)
+{
+    // 放不下的msgId无法逐字比较，宁可重复执行也不误丢命令
+    size_t len = msg_id ? strnlen(msg_id, TUYA_CMD_MSG_ID_MAX) : 0;
+    if (len == 0 || len >= TUYA_CMD_MSG_ID_MAX) {
+        c->stats.commands++;
+        return false;
+    }
+    for (int i = 0; i < TUYA_CMD_RECENT_NUM; i++) {
+        if (strcmp(c->recent[i], msg_id) == 0) {
+            c->stats.duplicates++;
+            return true;
+        }
+    }
+    memcpy(c->recent[c->recent_idx], msg_id, len + 1);
+    c->recent_idx = (c->recent_idx + 1) % TUYA_CMD_RECENT_NUM;
+    c->stats.commands++;
+    return false;
+}
+
+void tuya_cmd_put(tuya_cmd_t* c, iot_dp_id_t dp, const tuya_cmd_value_t* value, int64_t now_us)
+{
+    if (dp >= IOT_DP_MAX) {
+        return;
+    }
+    tuya_cmd_slot_t* slot = &c->slots[dp];
+    if (slot->pending) {
+        c->stats.coalesced++;
+    } else {
+        slot->pending = true;
+        slot->first_us = now_us;
+    }
+    slot->value = *value;
+    slot->value.s[TUYA_CMD_STR_MAX - 1] = '\0';
+    c->stats.values++;
+}
+
+bool tuya_cmd_add_ack(tuya_cmd_t* c, const char* msg_id, uint32_t dp_mask, int64_t rx_us)
+{
+    if (c->ack_count >= TUYA_CMD_MAX_ACKS) {
+        c->stats.acks_dropped++;
+        return false;
+    }
+    tuya_cmd_ack_t* ack = &c->acks[c->ack_count++];
+    strncpy(ack->msg_id, msg_id ? msg_id : "", sizeof(ack->msg_id) - 1);
+    ack->msg_id[sizeof(ack->msg_id) - 1] = '\0';
+    ack->dp_mask = dp_mask;
+    ack->rx_us = rx_us;
+    return true;
+}
+
+int64_t tuya_cmd_due_us(const tuya_cmd_t* c)
+{
+    bool pending = false;
+    for (int dp = 0; dp < IOT_DP_MAX && !pending; dp++) {
+        pending = c->slots[dp].pending;
+    }
+    if (!pending) {
+        // 只有应答（如规则分片）时立即发出
+        return c->ack_count > 0 ? 0 : INT64_MAX;
+    }
+    // 待应答已满时不再等待窗口，避免后续命令得不到应答
+    if (c->ack_count >= TUYA_CMD_MAX_ACKS || c->last_apply_us == 0) {
+        return 0;
+    }
+    return c->last_apply_us + c->window_us;
+}
+
+bool tuya_cmd_take(tuya_cmd_t* c, int64_t now_us, tuya_cmd_batch_t* out)
+{
+    out->dp_mask = 0;
+    for (int dp = 0; dp < IOT_DP_MAX; dp++) {
+        tuya_cmd_slot_t* slot = &c->slots[dp];
+        if (!slot->pending) {
+            continue;
+        }
+        out->dp_mask |= IOT_DP_BIT(dp);
+        out->values[dp] = slot->value;
+        slot->pending = false;
+        c->stats.actuations++;
+        int64_t delay = now_us - slot->first_us;
+        iot_latency_record(&c->stats.delay, delay < 0 ? 0 : delay > UINT32_MAX ? UINT32_MAX : (uint32_t)delay);
+    }
+    out->ack_count = c->ack_count;
+    memcpy(out->acks, c->acks, sizeof(c->acks[0]) * c->ack_count);
+    c->ack_count = 0;
+    if (out->dp_mask == 0 && out->ack_count == 0) {
+        return false;
+    }
+    // 只有应答（如规则分片）时不占用执行窗口
+    if (out->dp_mask) {
+        c->last_apply_us = now_us;
+        c->stats.applies++;
+    }
+    return true;
+}
+
+void tuya_cmd_record_hold(tuya_cmd_t* c, uint32_t hold_us)
+{
+    iot_latency_record(&c->stats.hold, hold_us);
+}
@@ -0,0 +1,123 @@
+/*
+ * 下行命令暂存：property/set在MQTT任务中只解析和暂存，由命令任务按执行窗口合并后执行
+ * 纯C实现，不依赖ESP-IDF，时间均由调用方传入（单调时钟微秒）
+ *
+ *   - 每个DP一个待执行槽位，窗口内的多次下发只保留最新值（滑条连续拖动只执行最终位置）
+ *   - 距上次执行超过一个窗口的命令立即执行，窗口内到达的在窗口结束时一起执行
+ *   - 按msgId去重：固定数量的最近msgId原文，逐字比较，QoS1重连后重发的命令不再执行但仍应答
+ *   - 每条命令都单独应答（带原始msgId），在执行后发出，应答中的值为合并后的结果
+ */
+#ifndef TUYA_CMD_H
+#define TUYA_CMD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "common.h"
+#include "iot_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_CMD_WINDOW_MS      100     // 两次执行的最小间隔，即每秒最多执行10次
+#define TUYA_CMD_RECENT_NUM     16      // 去重用的最近msgId数量
+#define TUYA_CMD_MAX_ACKS       16      // 待应答命令上限，满时立即执行
+#define TUYA_CMD_MSG_ID_MAX     40
+#define TUYA_CMD_STR_MAX        32
+
+// 一个DP的值，类型由 IOT_DP_SCHEMA 决定
+typedef struct {
+    int32_t i;
+    char s[TUYA_CMD_STR_MAX];
+} tuya_cmd_value_t;
+
+typedef struct {
+    bool pending;
+    tuya_cmd_value_t value;         // 最新下发的值
+    int64_t first_us;               // 本窗口第一次下发的时刻，用于统计执行时延
+} tuya_cmd_slot_t;
+
+typedef struct {
+    char msg_id[TUYA_CMD_MSG_ID_MAX];
+    uint32_t dp_mask;               // 这条命令修改的DP
+    int64_t rx_us;                  // 收到命令的时刻
+} tuya_cmd_ack_t;
+
+// 一次执行取出的内容
+typedef struct {
+    uint32_t dp_mask;               // 有新值的DP
+    tuya_cmd_value_t values[IOT_DP_MAX];
+    tuya_cmd_ack_t acks[TUYA_CMD_MAX_ACKS];
+    uint8_t ack_count;
+} tuya_cmd_batch_t;
+
+typedef struct {
+    uint32_t commands;              // 收到的命令（不含重复）
+    uint32_t duplicates;            // 按msgId丢弃的重复命令
+    uint32_t values;                // 暂存的DP值
+    uint32_t coalesced;             // 执行前被新值覆盖的DP值
+    uint32_t applies;               // 执行次数（一次可含多个DP）
+    uint32_t actuations;            // 实际执行的DP值
+    uint32_t acks_dropped;          // 待应答已满而没有应答的命令
+    iot_latency_stat_t hold;        // 每条命令占用MQTT任务的时间（解析+暂存）
+    iot_latency_stat_t delay;       // 收到到执行的时延（按每个DP本窗口第一次下发算）
+} tuya_cmd_stats_t;
+
+typedef struct {
+    tuya_cmd_slot_t slots[IOT_DP_MAX];
+    tuya_cmd_ack_t acks[TUYA_CMD_MAX_ACKS];
+    uint8_t ack_count;
+    char recent[TUYA_CMD_RECENT_NUM][TUYA_CMD_MSG_ID_MAX];  // 最近的msgId，空串表示空位
+    uint8_t recent_idx;
+    int64_t window_us;
+    int64_t last_apply_us;          // 上次执行的时刻，0表示还没有执行过
+    tuya_cmd_stats_t stats;
+} tuya_cmd_t;
+
+void tuya_cmd_init(tuya_cmd_t* c, uint32_t window_ms);
+
+/**
+ * @brief 检查msgId是否最近处理过，未处理过则记下
+ *
+ * 保存msgId原文并逐字比较，不同的msgId不会被误判为重复
+ *
+ * @return bool true表示重复命令，不再执行（空msgId和超过 TUYA_CMD_MSG_ID_MAX-1 字节的msgId不去重）
+ */
+bool tuya_cmd_seen(tuya_cmd_t* c, const char* msg_id);
+
+/**
+ * @brief 暂存一个DP的新值，覆盖尚未执行的旧值
+ */
+void tuya_cmd_put(tuya_cmd_t* c, iot_dp_id_t dp, const tuya_cmd_value_t* value, int64_t now_us);
+
+/**
+ * @brief 登记一条待应答的命令，执行后应答
+ *
+ * @return bool false表示待应答已满，这条命令不会被应答
+ */
+bool tuya_cmd_add_ack(tuya_cmd_t* c, const char* msg_id, uint32_t dp_mask, int64_t rx_us);
+
+/**
+ * @brief 下次应执行的时刻
+ *
+ * @return int64_t 没有待执行内容时为INT64_MAX；不大于当前时刻表示应立即执行
+ */
+int64_t tuya_cmd_due_us(const tuya_cmd_t* c);
+
+/**
+ * @brief 取出待执行的值和待应答的命令，记为一次执行
+ *
+ * @return bool false表示没有待执行内容
+ */
+bool tuya_cmd_take(tuya_cmd_t* c, int64_t now_us, tuya_cmd_batch_t* out);
+
+/**
+ * @brief 记录一条命令占用MQTT任务的时间
+ */
+void tuya_cmd_record_hold(tuya_cmd_t* c, uint32_t hold_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_CMD_H */
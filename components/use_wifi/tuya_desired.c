@@ -0,0 +1,93 @@
+#include "tuya_desired.h"
+#include <string.h>
+
+static void record_ms(iot_latency_stat_t* stat, int64_t ms)
+{
+    if (ms < 0) {
+        ms = 0;
+    }
+    // 超过uint32微秒范围（约71分钟）的按上限记录
+    iot_latency_record(stat, ms > UINT32_MAX / 1000 ? UINT32_MAX : (uint32_t)(ms * 1000));
+}
+
+void tuya_desired_init(tuya_desired_t* d)
+{
+    memset(d, 0, sizeof(*d));
+    iot_latency_reset(&d->converge);
+    iot_latency_reset(&d->outage_converge);
+}
+
+void tuya_desired_on_request(tuya_desired_t* d, int64_t now_ms, int64_t outage_start_ms)
+{
+    d->pending = true;
+    d->live_set_mask = 0;
+    d->connected_ms = now_ms;
+    d->outage_start_ms = outage_start_ms;
+    d->requests++;
+}
+
+void tuya_desired_on_local_change(tuya_desired_t* d, iot_dp_id_t dp, int64_t now_ms, bool online)
+{
+    if (dp >= IOT_DP_MAX) {
+        return;
+    }
+    // 在线时的修改已即时上报，云端不会再为它保留更旧的期望值
+    if (!online) {
+        d->local_ms[dp] = now_ms;
+    }
+}
+
+void tuya_desired_on_live_set(tuya_desired_t* d, uint32_t dp_mask)
+{
+    if (d->pending) {
+        d->live_set_mask |= dp_mask;
+    }
+}
+
+tuya_desired_verdict_t tuya_desired_check(tuya_desired_t* d, iot_dp_id_t dp, int64_t version, int64_t time_ms)
+{
+    if (dp >= IOT_DP_MAX || version <= d->version[dp]) {
+        d->stale++;
+        return TUYA_DESIRED_STALE;
+    }
+    // 版本仍然记下，之后重复下发的同一期望值直接丢弃
+    d->version[dp] = version;
+
+    if (d->live_set_mask & IOT_DP_BIT(dp)) {
+        d->superseded++;
+        return TUYA_DESIRED_SUPERSEDED;
+    }
+    if (time_ms > 0 && d->local_ms[dp] > time_ms) {
+        d->stale++;
+        return TUYA_DESIRED_STALE;
+    }
+    d->applied++;
+    return TUYA_DESIRED_APPLY;
+}
+
+bool tuya_desired_on_response(tuya_desired_t* d, int64_t now_ms)
+{
+    if (!d->pending) {
+        return false;
+    }
+    d->pending = false;
+    d->responses++;
+    record_ms(&d->converge, now_ms - d->connected_ms);
+    if (d->outage_start_ms > 0) {
+        record_ms(&d->outage_converge, now_ms - d->outage_start_ms);
+    }
+    // 对账完成，离线期间的本地修改已随上线上报同步到云端
+    memset(d->local_ms, 0, sizeof(d->local_ms));
+    d->live_set_mask = 0;
+    return true;
+}
+
+bool tuya_desired_tick(tuya_desired_t* d, int64_t now_ms)
+{
+    if (!d->pending || now_ms - d->connected_ms < TUYA_DESIRED_TIMEOUT_MS) {
+        return false;
+    }
+    d->pending = false;
+    d->timeouts++;
+    return true;
+}
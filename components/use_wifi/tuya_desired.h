@@ -0,0 +1,103 @@
+/*
+ * 期望属性同步：每次连上云端后拉取离线期间积压的期望值，按版本号与本地状态对账
+ * 纯C实现，不依赖ESP-IDF，时间均由调用方传入（毫秒）：
+ * 本地修改时刻和期望值时间戳为UTC，其余为单调时钟
+ *
+ * 对账规则（逐个DP）：
+ *   - 版本号不大于已应用的版本：STALE，丢弃
+ *   - 请求发出后又收到实时property/set：SUPERSEDED，实时命令更新
+ *   - 离线期间本地修改晚于期望值的时间戳：STALE，本地值随上线上报覆盖云端
+ *   - 其余：APPLY
+ */
+#ifndef TUYA_DESIRED_H
+#define TUYA_DESIRED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "common.h"
+#include "iot_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_DESIRED_TIMEOUT_MS     10000   // 等待get_response的超时
+
+typedef enum {
+    TUYA_DESIRED_APPLY = 0,
+    TUYA_DESIRED_STALE,             // 比已应用的版本或本地修改旧
+    TUYA_DESIRED_SUPERSEDED,        // 已被请求窗口内的实时命令取代
+} tuya_desired_verdict_t;
+
+typedef struct {
+    int64_t version[IOT_DP_MAX];    // 各DP已应用的最大期望版本
+    int64_t local_ms[IOT_DP_MAX];   // 各DP离线期间最近一次本地修改的时刻，0表示没有
+    uint32_t live_set_mask;         // 请求窗口内实时property/set修改过的DP
+    bool pending;                   // 已发出请求，等待响应
+    int64_t connected_ms;           // 本次连上云端的时刻
+    int64_t outage_start_ms;        // 本次断线开始的时刻，0表示不是断线恢复
+
+    // 统计
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t applied;
+    uint32_t stale;
+    uint32_t superseded;
+    uint32_t timeouts;
+    iot_latency_stat_t converge;            // 连上云端到期望值应用完成
+    iot_latency_stat_t outage_converge;     // 断线开始到期望值应用完成
+} tuya_desired_t;
+
+void tuya_desired_init(tuya_desired_t* d);
+
+/**
+ * @brief 连上云端并发出拉取请求
+ *
+ * @param d 同步状态
+ * @param now_ms 当前时刻（连上云端的时刻）
+ * @param outage_start_ms 断线开始时刻，0表示首次连接
+ */
+void tuya_desired_on_request(tuya_desired_t* d, int64_t now_ms, int64_t outage_start_ms);
+
+/**
+ * @brief 记录一次本地修改（非云端命令），只在离线期间的修改参与对账
+ *
+ * @param online 修改时是否在线
+ */
+void tuya_desired_on_local_change(tuya_desired_t* d, iot_dp_id_t dp, int64_t now_ms, bool online);
+
+/**
+ * @brief 记录实时property/set修改的DP
+ */
+void tuya_desired_on_live_set(tuya_desired_t* d, uint32_t dp_mask);
+
+/**
+ * @brief 判断一个期望值是否应用，APPLY时记下其版本
+ *
+ * @param d 同步状态
+ * @param dp DP
+ * @param version 期望值版本
+ * @param time_ms 期望值的设置时刻，0表示未知（不与本地修改比较）
+ * @return tuya_desired_verdict_t 对账结果
+ */
+tuya_desired_verdict_t tuya_desired_check(tuya_desired_t* d, iot_dp_id_t dp, int64_t version, int64_t time_ms);
+
+/**
+ * @brief 响应处理完成，统计收敛耗时并结束本次请求
+ *
+ * @return bool false表示没有待处理的请求（重复或迟到的响应）
+ */
+bool tuya_desired_on_response(tuya_desired_t* d, int64_t now_ms);
+
+/**
+ * @brief 检查请求是否超时，超时则结束本次请求
+ *
+ * @return bool true表示本次调用判定超时
+ */
+bool tuya_desired_tick(tuya_desired_t* d, int64_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_DESIRED_H */
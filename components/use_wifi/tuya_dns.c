@@ -0,0 +1,242 @@
+#include "tuya_dns.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TUYA_DNS_CACHE_VERSION  1
+#define DNS_HDR_LEN             12
+#define DNS_CLASS_IN            1
+
+static uint16_t get16(const uint8_t* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int tuya_dns_build_query(uint8_t* buf, size_t size, uint16_t id, const char* host, uint16_t qtype)
+{
+    size_t host_len = strlen(host);
+    // 头部 + 域名（首个长度字节 + 结尾0）+ 类型和类
+    if (host_len == 0 || host_len > 253 || size < DNS_HDR_LEN + host_len + 2 + 4) {
+        return -1;
+    }
+    memset(buf, 0, DNS_HDR_LEN);
+    buf[0] = (uint8_t)(id >> 8);
+    buf[1] = (uint8_t)id;
+    buf[2] = 0x01;                  // RD：请求递归
+    buf[5] = 1;                     // QDCOUNT
+
+    size_t pos = DNS_HDR_LEN;
+    const char* label = host;
+    while (*label) {
+        const char* dot = strchr(label, '.');
+        size_t n = dot ? (size_t)(dot - label) : strlen(label);
+        if (n == 0 || n > 63) {
+            return -1;
+        }
+        buf[pos++] = (uint8_t)n;
+        memcpy(&buf[pos], label, n);
+        pos += n;
+        label += n + (dot ? 1 : 0);
+    }
+    buf[pos++] = 0;
+    buf[pos++] = (uint8_t)(qtype >> 8);
+    buf[pos++] = (uint8_t)qtype;
+    buf[pos++] = 0;
+    buf[pos++] = DNS_CLASS_IN;
+    return (int)pos;
+}
+
+/* 跳过一个域名（可能以压缩指针结尾），返回其后的位置，-1表示越界 */
+static int skip_name(const uint8_t* buf, size_t len, size_t pos)
+{
+    while (pos < len) {
+        uint8_t n = buf[pos];
+        if (n == 0) {
+            return (int)pos + 1;
+        }
+        if ((n & 0xC0) == 0xC0) {
+            return pos + 2 <= len ? (int)pos + 2 : -1;
+        }
+        pos += 1 + n;
+    }
+    return -1;
+}
+
+int tuya_dns_parse_response(const uint8_t* buf, size_t len, uint16_t id,
+                            tuya_dns_addr_t* out, int* count, int max, uint32_t* ttl_s)
+{
+    if (len < DNS_HDR_LEN || get16(buf) != id || !(buf[2] & 0x80)) {
+        return -1;
+    }
+    if ((buf[3] & 0x0F) != 0) {
+        return -1;                  // RCODE非0（如NXDOMAIN）
+    }
+    uint16_t qdcount = get16(&buf[4]);
+    uint16_t ancount = get16(&buf[6]);
+
+    int pos = DNS_HDR_LEN;
+    for (uint16_t i = 0; i < qdcount; i++) {
+        pos = skip_name(buf, len, (size_t)pos);
+        if (pos < 0 || (size_t)pos + 4 > len) {
+            return -1;
+        }
+        pos += 4;
+    }
+
+    int added = 0;
+    for (uint16_t i = 0; i < ancount; i++) {
+        pos = skip_name(buf, len, (size_t)pos);
+        if (pos < 0 || (size_t)pos + 10 > len) {
+            return -1;
+        }
+        uint16_t type = get16(&buf[pos]);
+        uint16_t cls = get16(&buf[pos + 2]);
+        uint32_t ttl = get32(&buf[pos + 4]);
+        uint16_t rdlen = get16(&buf[pos + 8]);
+        pos += 10;
+        if ((size_t)pos + rdlen > len) {
+            return -1;
+        }
+
+        uint8_t family = 0;
+        if (cls == DNS_CLASS_IN && type == TUYA_DNS_TYPE_A && rdlen == 4) {
+            family = 4;
+        } else if (cls == DNS_CLASS_IN && type == TUYA_DNS_TYPE_AAAA && rdlen == 16) {
+            family = 6;
+        }
+        if (family && *count < max) {
+            tuya_dns_addr_t* a = &out[*count];
+            memset(a, 0, sizeof(*a));
+            a->family = family;
+            memcpy(a->addr, &buf[pos], rdlen);
+            (*count)++;
+            added++;
+            if (ttl < *ttl_s) {
+                *ttl_s = ttl;
+            }
+        }
+        pos += rdlen;
+    }
+    return added;
+}
+
+tuya_dns_state_t tuya_dns_cache_state(const tuya_dns_cache_t* c, const char* host, int64_t now_s)
+{
+    if (c->version != TUYA_DNS_CACHE_VERSION || c->count == 0 || strcmp(c->host, host) != 0) {
+        return TUYA_DNS_MISS;
+    }
+    int64_t age = now_s - c->resolved_s;
+    if (age < 0) {
+        return TUYA_DNS_STALE;      // 时钟回拨，地址仍可用但需要刷新
+    }
+    if (age < (int64_t)c->ttl_s) {
+        return TUYA_DNS_FRESH;
+    }
+    return age < (int64_t)c->ttl_s + TUYA_DNS_MAX_STALE_S ? TUYA_DNS_STALE : TUYA_DNS_MISS;
+}
+
+void tuya_dns_cache_store(tuya_dns_cache_t* c, const char* host, const tuya_dns_addr_t* addrs,
+                          int count, uint32_t ttl_s, int64_t now_s)
+{
+    tuya_dns_addr_t good;
+    bool had_good = c->version == TUYA_DNS_CACHE_VERSION && c->good < c->count &&
+                    strcmp(c->host, host) == 0;
+    bool last_failed = had_good && c->last_failed;
+    if (had_good) {
+        good = c->addrs[c->good];
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->version = TUYA_DNS_CACHE_VERSION;
+    strncpy(c->host, host, sizeof(c->host) - 1);
+    c->count = (uint8_t)(count > TUYA_DNS_MAX_ADDRS ? TUYA_DNS_MAX_ADDRS : count);
+    memcpy(c->addrs, addrs, c->count * sizeof(tuya_dns_addr_t));
+    c->ttl_s = ttl_s < TUYA_DNS_MIN_TTL_S ? TUYA_DNS_MIN_TTL_S :
+               ttl_s > TUYA_DNS_MAX_TTL_S ? TUYA_DNS_MAX_TTL_S : ttl_s;
+    c->resolved_s = now_s;
+    c->good = TUYA_DNS_NO_GOOD;
+
+    for (int i = 0; had_good && i < c->count; i++) {
+        if (memcmp(&c->addrs[i], &good, sizeof(good)) == 0) {
+            c->good = (uint8_t)i;
+            c->last_failed = last_failed;
+            break;
+        }
+    }
+}
+
+int tuya_dns_order(const tuya_dns_cache_t* c, bool have_v6, uint8_t* order)
+{
+    int n = 0;
+    bool good_ok = c->good < c->count && (c->addrs[c->good].family == 4 || have_v6);
+    if (good_ok && !c->last_failed) {
+        order[n++] = c->good;
+    }
+
+    // 其余地址按地址族交替，有IPv6时IPv6在前
+    uint8_t pref[TUYA_DNS_MAX_ADDRS], other[TUYA_DNS_MAX_ADDRS];
+    int np = 0, no = 0;
+    for (int i = 0; i < c->count; i++) {
+        if ((good_ok && i == c->good) || (c->addrs[i].family == 6 && !have_v6)) {
+            continue;
+        }
+        if (c->addrs[i].family == (have_v6 ? 6 : 4)) {
+            pref[np++] = (uint8_t)i;
+        } else {
+            other[no++] = (uint8_t)i;
+        }
+    }
+    for (int i = 0; i < np || i < no; i++) {
+        if (i < np) {
+            order[n++] = pref[i];
+        }
+        if (i < no) {
+            order[n++] = other[i];
+        }
+    }
+
+    // 上次失败的good地址排在最后再试
+    if (good_ok && c->last_failed) {
+        order[n++] = c->good;
+    }
+    return n;
+}
+
+bool tuya_dns_should_race(const tuya_dns_cache_t* c, bool have_v6)
+{
+    uint8_t order[TUYA_DNS_MAX_ADDRS];
+    if (tuya_dns_order(c, have_v6, order) < 2) {
+        return false;
+    }
+    return c->good >= c->count || c->last_failed;
+}
+
+void tuya_dns_cache_report(tuya_dns_cache_t* c, uint8_t idx, bool ok)
+{
+    if (idx >= c->count) {
+        return;
+    }
+    if (ok) {
+        c->good = idx;
+        c->last_failed = false;
+    } else if (idx == c->good) {
+        c->last_failed = true;
+    }
+}
+
+int tuya_dns_format(const tuya_dns_addr_t* a, char* buf, size_t size)
+{
+    int n;
+    if (a->family == 4) {
+        n = snprintf(buf, size, "%u.%u.%u.%u", a->addr[0], a->addr[1], a->addr[2], a->addr[3]);
+    } else {
+        n = snprintf(buf, size, "[%x:%x:%x:%x:%x:%x:%x:%x]",
+                     get16(&a->addr[0]), get16(&a->addr[2]), get16(&a->addr[4]), get16(&a->addr[6]),
+                     get16(&a->addr[8]), get16(&a->addr[10]), get16(&a->addr[12]), get16(&a->addr[14]));
+    }
+    return n < 0 || (size_t)n >= size ? -1 : n;
+}
@@ -0,0 +1,125 @@
+/*
+ * 云端地址解析缓存：DNS报文编解码（带TTL）和持久化缓存的到期、选址策略
+ * 纯C实现，不依赖ESP-IDF，时间均由调用方传入（UTC秒）
+ *
+ * 缓存过期后仍先用旧地址连接，同时在后台重新解析（stale-while-revalidate）；
+ * 过期超过 TUYA_DNS_MAX_STALE_S 才同步解析
+ */
+#ifndef TUYA_DNS_H
+#define TUYA_DNS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_DNS_MAX_ADDRS      4
+#define TUYA_DNS_HOST_MAX       64
+#define TUYA_DNS_MIN_TTL_S      60          // 过短的TTL按此值缓存，避免每次连接都解析
+#define TUYA_DNS_MAX_TTL_S      86400
+#define TUYA_DNS_MAX_STALE_S    (7 * 86400) // 过期后仍可先用的时长
+#define TUYA_DNS_NO_GOOD        0xFF
+
+#define TUYA_DNS_TYPE_A         1
+#define TUYA_DNS_TYPE_AAAA      28
+
+typedef struct {
+    uint8_t family;                 // 4 或 6
+    uint8_t addr[16];               // 网络字节序，IPv4只用前4字节
+} tuya_dns_addr_t;
+
+// 持久化到NVS的缓存记录
+typedef struct {
+    uint8_t version;
+    uint8_t count;
+    uint8_t good;                   // 最近一次连接成功的地址下标，TUYA_DNS_NO_GOOD表示未知
+    bool last_failed;               // 最近一次用good地址连接失败，下次需要竞速
+    uint32_t ttl_s;
+    int64_t resolved_s;             // 解析时刻（UTC秒）
+    char host[TUYA_DNS_HOST_MAX];
+    tuya_dns_addr_t addrs[TUYA_DNS_MAX_ADDRS];
+} tuya_dns_cache_t;
+
+typedef enum {
+    TUYA_DNS_MISS = 0,              // 没有可用地址，需要同步解析
+    TUYA_DNS_FRESH,                 // 在TTL内
+    TUYA_DNS_STALE,                 // 已过期但可先用，需要后台刷新
+} tuya_dns_state_t;
+
+/**
+ * @brief 生成查询报文
+ *
+ * @param buf 输出缓冲区
+ * @param size 缓冲区大小
+ * @param id 报文ID
+ * @param host 域名
+ * @param qtype TUYA_DNS_TYPE_A 或 TUYA_DNS_TYPE_AAAA
+ * @return int 报文长度，-1表示域名非法或缓冲区不足
+ */
+int tuya_dns_build_query(uint8_t* buf, size_t size, uint16_t id, const char* host, uint16_t qtype);
+
+/**
+ * @brief 解析响应报文中的A/AAAA记录，追加到out中（CNAME记录跳过）
+ *
+ * @param buf 响应报文
+ * @param len 报文长度
+ * @param id 查询时的报文ID
+ * @param out 地址数组
+ * @param count 输入为数组中已有的地址数，输出为追加后的地址数
+ * @param max 数组容量
+ * @param ttl_s 输入为已有的最小TTL（无则UINT32_MAX），输出为合并后的最小TTL
+ * @return int 本次追加的地址数，-1表示报文错误或ID不符
+ */
+int tuya_dns_parse_response(const uint8_t* buf, size_t len, uint16_t id,
+                            tuya_dns_addr_t* out, int* count, int max, uint32_t* ttl_s);
+
+/**
+ * @brief 查询缓存状态
+ */
+tuya_dns_state_t tuya_dns_cache_state(const tuya_dns_cache_t* c, const char* host, int64_t now_s);
+
+/**
+ * @brief 保存解析结果，新结果中仍包含原good地址时保留其下标
+ */
+void tuya_dns_cache_store(tuya_dns_cache_t* c, const char* host, const tuya_dns_addr_t* addrs,
+                          int count, uint32_t ttl_s, int64_t now_s);
+
+/**
+ * @brief 生成连接顺序：good地址在前，其余按地址族交替（首选族在前）
+ *
+ * @param c 缓存
+ * @param have_v6 本机是否有可路由的IPv6地址，没有时跳过IPv6地址
+ * @param order 输出地址下标
+ * @return int 可用地址数
+ */
+int tuya_dns_order(const tuya_dns_cache_t* c, bool have_v6, uint8_t* order);
+
+/**
+ * @brief 是否需要竞速连接：有多个地址，且没有已知可用地址或其上次连接失败
+ */
+bool tuya_dns_should_race(const tuya_dns_cache_t* c, bool have_v6);
+
+/**
+ * @brief 记录一次连接结果
+ *
+ * @param c 缓存
+ * @param idx 地址下标
+ * @param ok 是否连接成功
+ */
+void tuya_dns_cache_report(tuya_dns_cache_t* c, uint8_t idx, bool ok);
+
+/**
+ * @brief 格式化为URI中的主机部分，IPv6加方括号
+ *
+ * @return int 输出长度，-1表示缓冲区不足
+ */
+int tuya_dns_format(const tuya_dns_addr_t* a, char* buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_DNS_H */
@@ -0,0 +1,463 @@
+/*
+ * 云端地址选择
+ * 解析结果连同TTL缓存在NVS中，过期后先用旧地址连接、连接发起后再重新解析；
+ * 有多个地址且没有已知可用地址时，按固定间隔错开发起TCP连接竞速（happy eyeballs），
+ * 本机有全局IPv6地址时IPv6地址优先
+ */
+
+#include "tuya_endpoint.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "nvs.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "lwip/dns.h"
+#include "iot_trace.h"
+#include "tuya_dns.h"
+
+static const char *TAG = "TUYA_EP";
+
+#define EP_NVS_NAMESPACE        "tuya_ep"
+#define EP_NVS_KEY              "dns"
+#define EP_URI_MAX              80
+#define EP_DNS_PORT             53
+
+static SemaphoreHandle_t s_lock = NULL;
+static tuya_dns_cache_t s_cache;
+static const char *s_url = NULL;
+static char s_scheme[12];
+static char s_host[TUYA_DNS_HOST_MAX];
+static uint16_t s_port = 0;
+static char s_uri[EP_URI_MAX];
+static uint8_t s_picked = TUYA_DNS_NO_GOOD;     // 本次连接使用的地址下标
+static bool s_reported = false;                 // 本次选址的结果已记录
+static bool s_refresh_needed = false;
+static int64_t s_pick_start_us = 0;
+static tuya_endpoint_stats_t s_stats;
+
+static void save_cache(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(EP_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(nvs, EP_NVS_KEY, &s_cache, sizeof(s_cache)) == ESP_OK) {
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+
+static void load_cache(void)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(s_cache);
+    memset(&s_cache, 0, sizeof(s_cache));
+    if (nvs_open(EP_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(nvs, EP_NVS_KEY, &s_cache, &len) != ESP_OK || len != sizeof(s_cache)) {
+        memset(&s_cache, 0, sizeof(s_cache));
+    }
+    nvs_close(nvs);
+}
+
+static bool have_ipv6(void)
+{
+    esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    esp_ip6_addr_t ip6;
+    return netif && esp_netif_get_ip6_global(netif, &ip6) == ESP_OK;
+}
+
+/* 地址转成socket地址 */
+static socklen_t to_sockaddr(const tuya_dns_addr_t* a, uint16_t port, struct sockaddr_storage* sa)
+{
+    memset(sa, 0, sizeof(*sa));
+    if (a->family == 6) {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)sa;
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        memcpy(&in6->sin6_addr, a->addr, 16);
+        return sizeof(*in6);
+    }
+    struct sockaddr_in *in = (struct sockaddr_in *)sa;
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    memcpy(&in->sin_addr, a->addr, 4);
+    return sizeof(*in);
+}
+
+/* 向DHCP下发的DNS服务器查询A（和AAAA）记录，取得TTL */
+static int query_dns(tuya_dns_addr_t* addrs, uint32_t* ttl_s, bool want_v6)
+{
+    const ip_addr_t *server = dns_getserver(0);
+    if (server == NULL || ip_addr_isany(server)) {
+        return -1;
+    }
+    tuya_dns_addr_t srv = { 0 };
+    if (IP_IS_V6(server)) {
+        srv.family = 6;
+        memcpy(srv.addr, ip_2_ip6(server)->addr, 16);
+    } else {
+        srv.family = 4;
+        memcpy(srv.addr, &ip_2_ip4(server)->addr, 4);
+    }
+    struct sockaddr_storage sa;
+    socklen_t sa_len = to_sockaddr(&srv, EP_DNS_PORT, &sa);
+
+    int sock = socket(sa.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return -1;
+    }
+    struct timeval tv = { .tv_sec = TUYA_EP_DNS_TIMEOUT_MS / 1000,
+                          .tv_usec = (TUYA_EP_DNS_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // A和AAAA同时查询，按ID匹配响应
+    uint8_t buf[512];
+    uint16_t ids[2];
+    int queries = want_v6 ? 2 : 1;
+    for (int i = 0; i < queries; i++) {
+        ids[i] = (uint16_t)esp_random();
+        int len = tuya_dns_build_query(buf, sizeof(buf), ids[i], s_host,
+                                       i == 0 ? TUYA_DNS_TYPE_A : TUYA_DNS_TYPE_AAAA);
+        if (len < 0 || sendto(sock, buf, len, 0, (struct sockaddr *)&sa, sa_len) != len) {
+            close(sock);
+            return -1;
+        }
+    }
+
+    int count = 0;
+    int answered = 0;
+    *ttl_s = UINT32_MAX;
+    int64_t deadline = esp_timer_get_time() + (int64_t)TUYA_EP_DNS_TIMEOUT_MS * 1000;
+    while (answered < queries && esp_timer_get_time() < deadline) {
+        int len = recv(sock, buf, sizeof(buf), 0);
+        if (len <= 0) {
+            break;
+        }
+        for (int i = 0; i < queries; i++) {
+            if (tuya_dns_parse_response(buf, len, ids[i], addrs, &count, TUYA_DNS_MAX_ADDRS, ttl_s) >= 0) {
+                answered++;
+                break;
+            }
+        }
+    }
+    close(sock);
+    return count;
+}
+
+/* 自己查询失败时退回系统解析，TTL未知，按最小值缓存 */
+static int query_getaddrinfo(tuya_dns_addr_t* addrs, uint32_t* ttl_s)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(s_host, NULL, &hints, &res) != 0 || res == NULL) {
+        return -1;
+    }
+    int count = 0;
+    for (struct addrinfo *ai = res; ai && count < TUYA_DNS_MAX_ADDRS; ai = ai->ai_next) {
+        tuya_dns_addr_t *a = &addrs[count];
+        memset(a, 0, sizeof(*a));
+        if (ai->ai_family == AF_INET) {
+            a->family = 4;
+            memcpy(a->addr, &((struct sockaddr_in *)ai->ai_addr)->sin_addr, 4);
+            count++;
+        } else if (ai->ai_family == AF_INET6) {
+            a->family = 6;
+            memcpy(a->addr, &((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr, 16);
+            count++;
+        }
+    }
+    freeaddrinfo(res);
+    *ttl_s = TUYA_DNS_MIN_TTL_S;
+    return count;
+}
+
+/* 解析并更新缓存，返回是否得到地址 */
+static bool resolve(iot_latency_stat_t* stat)
+{
+    tuya_dns_addr_t addrs[TUYA_DNS_MAX_ADDRS];
+    uint32_t ttl_s = 0;
+    int64_t start = esp_timer_get_time();
+
+    IOT_TRACE_BEGIN("dns_resolve");
+    int count = query_dns(addrs, &ttl_s, have_ipv6());
+    if (count <= 0) {
+        count = query_getaddrinfo(addrs, &ttl_s);
+    }
+    IOT_TRACE_END("dns_resolve");
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+    if (count <= 0) {
+        s_stats.resolve_failures++;
+        ESP_LOGW(TAG, "解析 %s 失败, 耗时 %lu ms", s_host, (unsigned long)(us / 1000));
+        return false;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    iot_latency_record(stat, us);
+    // 新结果中的下标可能变化，重新定位本次连接使用的地址
+    tuya_dns_addr_t picked = { 0 };
+    bool had_picked = s_picked < s_cache.count;
+    if (had_picked) {
+        picked = s_cache.addrs[s_picked];
+    }
+    tuya_dns_cache_store(&s_cache, s_host, addrs, count, ttl_s, (int64_t)time(NULL));
+    s_picked = TUYA_DNS_NO_GOOD;
+    for (int i = 0; had_picked && i < s_cache.count; i++) {
+        if (memcmp(&s_cache.addrs[i], &picked, sizeof(picked)) == 0) {
+            s_picked = (uint8_t)i;
+            break;
+        }
+    }
+    s_stats.addr_count = s_cache.count;
+    save_cache();
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "解析 %s 得到 %d 个地址, TTL %lu s, 耗时 %lu ms", s_host, count,
+             (unsigned long)s_cache.ttl_s, (unsigned long)(us / 1000));
+    return true;
+}
+
+/* 错开启动TCP连接，返回最先连上的地址下标，-1表示全部失败 */
+static int race(const uint8_t* order, int n)
+{
+    int socks[TUYA_DNS_MAX_ADDRS];
+    int started = 0;
+    int winner = -1;
+    int64_t start = esp_timer_get_time();
+    int64_t next_start = start;
+    int64_t deadline = start + (int64_t)TUYA_EP_RACE_TIMEOUT_MS * 1000;
+
+    IOT_TRACE_BEGIN("tcp_race");
+    while (winner < 0) {
+        int64_t now = esp_timer_get_time();
+        if (now >= deadline) {
+            break;
+        }
+        if (started < n && now >= next_start) {
+            struct sockaddr_storage sa;
+            socklen_t sa_len = to_sockaddr(&s_cache.addrs[order[started]], s_port, &sa);
+            int sock = socket(sa.ss_family, SOCK_STREAM, IPPROTO_TCP);
+            if (sock >= 0) {
+                fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+                if (connect(sock, (struct sockaddr *)&sa, sa_len) != 0 && errno != EINPROGRESS) {
+                    close(sock);
+                    sock = -1;
+                }
+            }
+            socks[started++] = sock;
+            // 失败的尝试不占用间隔，立即启动下一个
+            next_start = sock >= 0 ? now + (int64_t)TUYA_EP_RACE_STAGGER_MS * 1000 : now;
+            continue;
+        }
+
+        fd_set wset;
+        FD_ZERO(&wset);
+        int maxfd = -1;
+        for (int i = 0; i < started; i++) {
+            if (socks[i] >= 0) {
+                FD_SET(socks[i], &wset);
+                maxfd = socks[i] > maxfd ? socks[i] : maxfd;
+            }
+        }
+        if (maxfd < 0) {
+            if (started == n) {
+                break;              // 全部失败
+            }
+            next_start = now;
+            continue;
+        }
+
+        int64_t wait_until = started < n && next_start < deadline ? next_start : deadline;
+        int64_t wait_us = wait_until > now ? wait_until - now : 0;
+        struct timeval tv = { .tv_sec = (long)(wait_us / 1000000), .tv_usec = (long)(wait_us % 1000000) };
+        if (select(maxfd + 1, NULL, &wset, NULL, &tv) <= 0) {
+            continue;
+        }
+        for (int i = 0; i < started; i++) {
+            if (socks[i] < 0 || !FD_ISSET(socks[i], &wset)) {
+                continue;
+            }
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(socks[i], SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err == 0) {
+                winner = i;
+                break;
+            }
+            close(socks[i]);
+            socks[i] = -1;
+            next_start = esp_timer_get_time();
+        }
+    }
+    IOT_TRACE_END("tcp_race");
+
+    // 只用于选址，连接交给MQTT客户端重新建立
+    for (int i = 0; i < started; i++) {
+        if (socks[i] >= 0) {
+            close(socks[i]);
+        }
+    }
+    if (winner < 0) {
+        return -1;
+    }
+    iot_latency_record(&s_stats.race, (uint32_t)(esp_timer_get_time() - start));
+    return order[winner];
+}
+
+static const char* format_uri(uint8_t idx)
+{
+    char host[48];
+    if (tuya_dns_format(&s_cache.addrs[idx], host, sizeof(host)) < 0) {
+        return s_url;
+    }
+    snprintf(s_uri, sizeof(s_uri), "%s://%s:%u", s_scheme, host, s_port);
+    s_stats.using_ipv6 = s_cache.addrs[idx].family == 6;
+    return s_uri;
+}
+
+esp_err_t tuya_endpoint_init(const char* url)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_url = url;
+
+    // 拆分 scheme://host:port
+    unsigned port = 0;
+    if (sscanf(url, "%11[^:]://%63[^:/]:%u", s_scheme, s_host, &port) < 2) {
+        ESP_LOGW(TAG, "无法解析地址 %s, 由MQTT客户端直接连接", url);
+        s_host[0] = '\0';
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_port = port ? (uint16_t)port : (strcmp(s_scheme, "mqtts") == 0 ? 8883 : 1883);
+
+    load_cache();
+    s_stats.addr_count = s_cache.count;
+    ESP_LOGI(TAG, "云端 %s:%u, 缓存地址 %u 个", s_host, s_port, s_cache.count);
+    return ESP_OK;
+}
+
+const char* tuya_endpoint_pick(void)
+{
+    s_pick_start_us = esp_timer_get_time();
+    s_reported = false;
+    s_picked = TUYA_DNS_NO_GOOD;
+    if (!s_lock || s_host[0] == '\0') {
+        return s_url;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    tuya_dns_state_t state = tuya_dns_cache_state(&s_cache, s_host, (int64_t)time(NULL));
+    xSemaphoreGive(s_lock);
+
+    if (state == TUYA_DNS_MISS) {
+        s_stats.misses++;
+        if (!resolve(&s_stats.dns)) {
+            return s_url;           // 由MQTT客户端自己解析域名
+        }
+    } else if (state == TUYA_DNS_STALE) {
+        s_stats.stale_hits++;
+        s_refresh_needed = true;
+    } else {
+        s_stats.fresh_hits++;
+    }
+
+    bool v6 = have_ipv6();
+    uint8_t order[TUYA_DNS_MAX_ADDRS];
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int n = tuya_dns_order(&s_cache, v6, order);
+    bool need_race = tuya_dns_should_race(&s_cache, v6);
+    xSemaphoreGive(s_lock);
+    if (n == 0) {
+        return s_url;
+    }
+
+    int idx = order[0];
+    if (need_race) {
+        s_stats.races++;
+        idx = race(order, n);
+        if (idx < 0) {
+            // 缓存的地址都连不上，可能已变更，下次连接前重新解析
+            s_stats.race_failures++;
+            s_refresh_needed = true;
+            ESP_LOGW(TAG, "%d 个缓存地址均无法连接", n);
+            return s_url;
+        }
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_picked = (uint8_t)idx;
+    const char *uri = format_uri(s_picked);
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "使用地址 %s%s", uri, need_race ? " (竞速)" : "");
+    return uri;
+}
+
+const char* tuya_endpoint_host(void)
+{
+    return s_host[0] ? s_host : NULL;
+}
+
+void tuya_endpoint_report(bool ok)
+{
+    if (!s_lock || s_reported) {
+        return;
+    }
+    s_reported = true;
+
+    uint32_t connect_us = (uint32_t)(esp_timer_get_time() - s_pick_start_us);
+    if (ok) {
+        ESP_LOGI(TAG, "选址到MQTT连接耗时 %lu ms", (unsigned long)(connect_us / 1000));
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (ok) {
+        iot_latency_record(&s_stats.connect, connect_us);
+    }
+    if (s_picked != TUYA_DNS_NO_GOOD) {
+        uint8_t good = s_cache.good;
+        bool failed = s_cache.last_failed;
+        tuya_dns_cache_report(&s_cache, s_picked, ok);
+        if (good != s_cache.good || failed != s_cache.last_failed) {
+            save_cache();
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void tuya_endpoint_refresh(void)
+{
+    if (!s_lock || !s_refresh_needed) {
+        return;
+    }
+    s_refresh_needed = false;
+    resolve(&s_stats.refresh);
+}
+
+esp_err_t tuya_endpoint_get_stats(tuya_endpoint_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,78 @@
+#ifndef TUYA_ENDPOINT_H
+#define TUYA_ENDPOINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "iot_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 云端地址选择参数 */
+#define TUYA_EP_RACE_STAGGER_MS     250         // 竞速时相邻地址的启动间隔
+#define TUYA_EP_RACE_TIMEOUT_MS     5000        // 竞速的总超时
+#define TUYA_EP_DNS_TIMEOUT_MS      2000        // 单次DNS查询超时
+
+// 连接阶段统计
+typedef struct {
+    iot_latency_stat_t dns;         // 缓存未命中时的同步解析耗时
+    iot_latency_stat_t refresh;     // 后台刷新的解析耗时
+    iot_latency_stat_t race;        // 竞速到首个TCP连接建立的耗时
+    iot_latency_stat_t connect;     // 开始选址到MQTT连接成功的耗时
+    uint32_t fresh_hits;            // 缓存在TTL内
+    uint32_t stale_hits;            // 缓存已过期，先用旧地址
+    uint32_t misses;                // 同步解析
+    uint32_t resolve_failures;      // 解析失败，退回由MQTT客户端解析域名
+    uint32_t races;
+    uint32_t race_failures;         // 所有地址都连不上
+    uint8_t addr_count;             // 当前缓存的地址数
+    bool using_ipv6;                // 当前选用的地址是否为IPv6
+} tuya_endpoint_stats_t;
+
+/**
+ * @brief 初始化并从NVS加载上次的解析结果
+ *
+ * @param url 云端地址，如 "mqtts://m1.tuyacn.com:8883"
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t tuya_endpoint_init(const char* url);
+
+/**
+ * @brief 选择本次连接使用的地址（可能阻塞：同步解析或竞速）
+ *
+ * @return const char* 以IP地址表示的URI，解析失败时为原始URL
+ */
+const char* tuya_endpoint_pick(void);
+
+/**
+ * @brief 云端域名，用于以IP地址连接时校验证书
+ */
+const char* tuya_endpoint_host(void);
+
+/**
+ * @brief 记录本次选址的连接结果，失败后下次连接改为竞速
+ *
+ * @param ok true表示MQTT连接成功
+ */
+void tuya_endpoint_report(bool ok);
+
+/**
+ * @brief 缓存过期时重新解析（在连接发起后调用，不影响本次连接）
+ */
+void tuya_endpoint_refresh(void);
+
+/**
+ * @brief 获取连接阶段统计
+ *
+ * @param stats 输出统计数据
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t tuya_endpoint_get_stats(tuya_endpoint_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_ENDPOINT_H */
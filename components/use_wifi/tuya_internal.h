@@ -0,0 +1,41 @@
+/*
+ * use_wifi 组件内部接口，仅供组件内其他源文件使用
+ */
+#ifndef TUYA_INTERNAL_H
+#define TUYA_INTERNAL_H
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 发布数据到设备命名空间下的主题
+ *
+ * @param topic 完整主题，如 TUYA_TOPIC("ota/progress/report")
+ * @param data 消息内容
+ * @param qos 服务质量等级
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t tuya_publish_topic(const char* topic, const char* data, int qos);
+
+/**
+ * @brief 生成设备端消息使用的msgId
+ *
+ * @param buf 输出缓冲区
+ * @param size 缓冲区大小
+ */
+void tuya_make_msg_id(char* buf, size_t size);
+
+/**
+ * @brief 获取当前Unix时间（毫秒）
+ */
+long long tuya_now_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_INTERNAL_H */
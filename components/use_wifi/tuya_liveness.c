@@ -0,0 +1,164 @@
+#include "tuya_liveness.h"
+#include <string.h>
+
+/* esp-mqtt 在连续 keepalive/2 无上行时发送 PINGREQ */
+static int64_t ping_gap_ms(const tuya_liveness_t *lv)
+{
+    return (int64_t)lv->keepalive_s * 500;
+}
+
+static void set_keepalive(tuya_liveness_t *lv, uint16_t keepalive_s)
+{
+    lv->keepalive_s = keepalive_s;
+    lv->idle_pings = 0;
+}
+
+void tuya_liveness_init(tuya_liveness_t *lv, const tuya_liveness_persist_t *saved)
+{
+    memset(lv, 0, sizeof(*lv));
+    lv->stable_s = TUYA_KEEPALIVE_MIN_S;
+    if (saved && saved->stable_s >= TUYA_KEEPALIVE_MIN_S && saved->stable_s <= TUYA_KEEPALIVE_MAX_S) {
+        lv->stable_s = saved->stable_s;
+        lv->ceiling_s = saved->ceiling_s;
+    }
+    lv->keepalive_s = lv->stable_s;
+}
+
+void tuya_liveness_export(const tuya_liveness_t *lv, tuya_liveness_persist_t *out)
+{
+    out->stable_s = lv->stable_s;
+    out->ceiling_s = lv->ceiling_s;
+}
+
+void tuya_liveness_on_connect(tuya_liveness_t *lv, int64_t now_ms)
+{
+    lv->connected = true;
+    lv->last_tx_ms = now_ms;
+    lv->heartbeat_pending = false;
+    set_keepalive(lv, lv->keepalive_s);
+}
+
+void tuya_liveness_set_report_interval(tuya_liveness_t *lv, uint32_t interval_ms)
+{
+    lv->report_interval_ms = interval_ms;
+}
+
+void tuya_liveness_on_tx(tuya_liveness_t *lv, int64_t now_ms, bool is_report)
+{
+    // 空闲期间每 keepalive/2 有一次PING，链路没断说明这些PING都成功了
+    int64_t gap = now_ms - lv->last_tx_ms;
+    if (lv->connected && gap >= ping_gap_ms(lv)) {
+        uint32_t pings = (uint32_t)(gap / ping_gap_ms(lv));
+        lv->pings_est += pings;
+        lv->idle_pings += pings;
+    }
+
+    lv->last_tx_ms = now_ms;
+    lv->publishes++;
+    if (is_report) {
+        lv->last_report_ms = now_ms;
+    }
+}
+
+bool tuya_liveness_on_disconnect(tuya_liveness_t *lv, int64_t now_ms, bool unexpected)
+{
+    bool was_idle = (now_ms - lv->last_tx_ms) >= ping_gap_ms(lv);
+    lv->connected = false;
+    lv->heartbeat_pending = false;
+
+    // 只有空闲等待PING期间被断开才怀疑是NAT映射过期，其他断线不影响探测结果
+    if (!unexpected || !was_idle) {
+        return false;
+    }
+
+    if (lv->keepalive_s > lv->stable_s) {
+        lv->ceiling_s = lv->keepalive_s;
+        set_keepalive(lv, lv->stable_s);
+    } else if (lv->keepalive_s > TUYA_KEEPALIVE_MIN_S) {
+        // 已验证的值也失效了（网络环境变化），再退一步
+        lv->ceiling_s = lv->keepalive_s;
+        lv->stable_s = lv->keepalive_s - TUYA_KEEPALIVE_STEP_S;
+        if (lv->stable_s < TUYA_KEEPALIVE_MIN_S) {
+            lv->stable_s = TUYA_KEEPALIVE_MIN_S;
+        }
+        set_keepalive(lv, lv->stable_s);
+    } else {
+        return false;
+    }
+    lv->backoffs++;
+    return true;
+}
+
+bool tuya_liveness_tick(tuya_liveness_t *lv, int64_t now_ms)
+{
+    if (!lv->connected) {
+        return false;
+    }
+
+    uint32_t pings = lv->idle_pings;
+    int64_t gap = now_ms - lv->last_tx_ms;
+    if (gap >= ping_gap_ms(lv)) {
+        pings += (uint32_t)(gap / ping_gap_ms(lv));
+    }
+    if (pings < TUYA_KEEPALIVE_CONFIRM_PERIODS) {
+        return false;
+    }
+
+    // 当前值验证通过；下一步不超过上限、不触及曾断线的值，且不超过已验证值的2倍，
+    // 保证新的PING间隔仍在服务端按旧CONNECT参数允许的1.5倍keepalive内
+    bool changed = lv->stable_s != lv->keepalive_s;
+    lv->stable_s = lv->keepalive_s;
+
+    uint32_t next = (uint32_t)lv->keepalive_s + TUYA_KEEPALIVE_STEP_S;
+    if (next > TUYA_KEEPALIVE_MAX_S) {
+        next = TUYA_KEEPALIVE_MAX_S;
+    }
+    if (next > (uint32_t)lv->stable_s * 2) {
+        next = (uint32_t)lv->stable_s * 2;
+    }
+    if (lv->ceiling_s && next >= lv->ceiling_s) {
+        next = lv->keepalive_s;
+    }
+    if (next != lv->keepalive_s) {
+        changed = true;
+    }
+    set_keepalive(lv, (uint16_t)next);
+    return changed;
+}
+
+tuya_hb_action_t tuya_liveness_heartbeat(tuya_liveness_t *lv, int64_t now_ms)
+{
+    if (!lv->connected) {
+        return TUYA_HB_NONE;
+    }
+
+    int64_t idle = now_ms - lv->last_tx_ms;
+    if (lv->heartbeat_pending) {
+        // 预期的上报没有到来，不再等待
+        if (idle < (int64_t)(TUYA_HEARTBEAT_INTERVAL_S + TUYA_HEARTBEAT_FOLD_SLACK_S) * 1000) {
+            return TUYA_HB_NONE;
+        }
+        lv->heartbeat_pending = false;
+    } else if (idle < (int64_t)TUYA_HEARTBEAT_INTERVAL_S * 1000) {
+        return TUYA_HB_NONE;
+    } else if (lv->report_interval_ms && lv->last_report_ms) {
+        int64_t next_report = lv->last_report_ms + lv->report_interval_ms;
+        if (next_report - now_ms <= (int64_t)TUYA_HEARTBEAT_FOLD_SLACK_S * 1000) {
+            lv->heartbeat_pending = true;
+            return TUYA_HB_FOLD;
+        }
+    }
+
+    lv->heartbeats_sent++;
+    return TUYA_HB_SEND;
+}
+
+bool tuya_liveness_take_heartbeat(tuya_liveness_t *lv)
+{
+    if (!lv->heartbeat_pending) {
+        return false;
+    }
+    lv->heartbeat_pending = false;
+    lv->heartbeats_folded++;
+    return true;
+}
@@ -0,0 +1,112 @@
+/*
+ * 链路保活策略：探测NAT允许的最长keepalive，并决定心跳何时发送、何时并入数据上报
+ * 纯C实现，不依赖ESP-IDF，时间均由调用方传入
+ */
+#ifndef TUYA_LIVENESS_H
+#define TUYA_LIVENESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_KEEPALIVE_MIN_S            60      // 起始值，与原先固定配置相同
+#define TUYA_KEEPALIVE_MAX_S            600
+#define TUYA_KEEPALIVE_STEP_S           60
+#define TUYA_KEEPALIVE_CONFIRM_PERIODS  3       // 连续保持多少个keepalive周期后上调
+#define TUYA_HEARTBEAT_INTERVAL_S       300     // 无任何上行数据时的心跳间隔
+#define TUYA_HEARTBEAT_FOLD_SLACK_S     60      // 下次上报在此时间内则并入上报
+
+// 需要持久化的探测结果
+typedef struct {
+    uint16_t stable_s;          // 已验证安全的keepalive
+    uint16_t ceiling_s;         // 曾导致断线的keepalive，0表示未知
+} tuya_liveness_persist_t;
+
+typedef struct {
+    uint16_t keepalive_s;       // 当前使用的keepalive
+    uint16_t stable_s;
+    uint16_t ceiling_s;
+    bool connected;
+    int64_t last_tx_ms;         // 最近一次上行（任何发布都算存活证明）
+    int64_t last_report_ms;     // 最近一次周期上报
+    uint32_t report_interval_ms;// 周期上报间隔，0表示没有周期上报
+    bool heartbeat_pending;     // 心跳已到期，等待并入下一次上报
+    uint32_t idle_pings;        // 当前keepalive下链路经受住的空闲PING次数
+
+    // 统计
+    uint32_t publishes;
+    uint32_t heartbeats_sent;
+    uint32_t heartbeats_folded;
+    uint32_t pings_est;         // 按空闲间隔估算的PINGREQ数
+    uint32_t backoffs;
+} tuya_liveness_t;
+
+// 心跳调度结果
+typedef enum {
+    TUYA_HB_NONE = 0,           // 不需要心跳
+    TUYA_HB_SEND,               // 立即单独发送
+    TUYA_HB_FOLD,               // 等待并入下一次上报
+} tuya_hb_action_t;
+
+/**
+ * @brief 初始化策略
+ *
+ * @param lv 策略对象
+ * @param saved 上次保存的探测结果，NULL表示从最小值开始
+ */
+void tuya_liveness_init(tuya_liveness_t *lv, const tuya_liveness_persist_t *saved);
+
+/**
+ * @brief 导出需要持久化的探测结果
+ */
+void tuya_liveness_export(const tuya_liveness_t *lv, tuya_liveness_persist_t *out);
+
+void tuya_liveness_on_connect(tuya_liveness_t *lv, int64_t now_ms);
+
+/**
+ * @brief 设置周期上报间隔，用于判断心跳能否并入上报
+ */
+void tuya_liveness_set_report_interval(tuya_liveness_t *lv, uint32_t interval_ms);
+
+/**
+ * @brief 记录一次上行发布
+ *
+ * @param is_report 是否为周期上报（用于预测下一次上报时间）
+ */
+void tuya_liveness_on_tx(tuya_liveness_t *lv, int64_t now_ms, bool is_report);
+
+/**
+ * @brief 连接断开
+ *
+ * @param unexpected 链路仍在但连接被中断（疑似NAT映射过期）
+ * @return true keepalive 已回退，需要应用并保存
+ */
+bool tuya_liveness_on_disconnect(tuya_liveness_t *lv, int64_t now_ms, bool unexpected);
+
+/**
+ * @brief 周期调用，当前keepalive验证通过后上调
+ *
+ * @return true keepalive 已变化，需要应用并保存
+ */
+bool tuya_liveness_tick(tuya_liveness_t *lv, int64_t now_ms);
+
+/**
+ * @brief 判断心跳动作
+ */
+tuya_hb_action_t tuya_liveness_heartbeat(tuya_liveness_t *lv, int64_t now_ms);
+
+/**
+ * @brief 上报前调用，若有待并入的心跳则取走
+ *
+ * @return true 本次上报应携带心跳字段
+ */
+bool tuya_liveness_take_heartbeat(tuya_liveness_t *lv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_LIVENESS_H */
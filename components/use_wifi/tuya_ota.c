@@ -0,0 +1,470 @@
+/*
+ * 涂鸦 OTA 流式升级
+ * 下载与 esp_ota_write 分成两级流水线（双缓冲），支持断线续传、
+ * SHA-256 增量校验和新固件回滚保护
+ */
+
+#include "tuya_ota.h"
+#include "tuya_ota_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "esp_app_desc.h"
+#include "esp_http_client.h"
+#include "esp_crt_bundle.h"
+#include "mbedtls/sha256.h"
+#include "cjson.h"
+#include "tuya_internal.h"
+#include "use_wifi.h"
+#include "common.h"
+
+static const char *TAG = "TUYA_OTA";
+
+#define OTA_URL_MAX_LEN         512
+#define OTA_VERSION_MAX_LEN     32
+#define OTA_SHA256_HEX_LEN      64
+
+/* 云端下发的升级任务 */
+typedef struct {
+    char url[OTA_URL_MAX_LEN];
+    char version[OTA_VERSION_MAX_LEN];
+    char sha256[OTA_SHA256_HEX_LEN + 1];    // 为空表示只依赖镜像自带校验
+    uint32_t size;
+    int channel;
+} ota_job_t;
+
+/* 流水线中传递的数据块，len为0表示下载结束 */
+typedef struct {
+    uint8_t idx;
+    uint16_t len;
+} ota_chunk_t;
+
+static ota_job_t *s_job = NULL;
+static uint8_t *s_buf[2] = { NULL, NULL };
+static QueueHandle_t s_free_q = NULL;       // 空闲缓冲区
+static QueueHandle_t s_full_q = NULL;       // 待写入缓冲区
+static SemaphoreHandle_t s_writer_done = NULL;
+static esp_ota_handle_t s_ota_handle = 0;
+static mbedtls_sha256_context s_sha_ctx;
+static volatile esp_err_t s_writer_err = ESP_OK;
+static tuya_ota_stats_t s_stats;
+static esp_timer_handle_t s_rollback_timer = NULL;
+
+/* 上报升级进度，progress<0 表示失败 */
+static void ota_report_progress(int channel, int progress)
+{
+    char msg_id[24];
+    char msg[160];
+    tuya_make_msg_id(msg_id, sizeof(msg_id));
+
+    if (progress >= 0) {
+        snprintf(msg, sizeof(msg),
+                 "{\"msgId\":\"%s\",\"time\":%lld,\"data\":{\"channel\":%d,\"progress\":%d}}",
+                 msg_id, tuya_now_ms(), channel, progress);
+    } else {
+        snprintf(msg, sizeof(msg),
+                 "{\"msgId\":\"%s\",\"time\":%lld,\"data\":{\"channel\":%d,\"errorCode\":%d}}",
+                 msg_id, tuya_now_ms(), channel, -progress);
+    }
+    tuya_publish_topic(TUYA_TOPIC("ota/progress/report"), msg, 1);
+}
+
+/* 写入级：SHA-256累加并写flash，写完把缓冲区还给下载级 */
+static void ota_writer_task(void *arg)
+{
+    ota_chunk_t chunk;
+
+    while (xQueueReceive(s_full_q, &chunk, portMAX_DELAY) == pdTRUE) {
+        if (chunk.len == 0) {
+            break;
+        }
+        if (s_writer_err == ESP_OK) {
+            mbedtls_sha256_update(&s_sha_ctx, s_buf[chunk.idx], chunk.len);
+            esp_err_t err = esp_ota_write(s_ota_handle, s_buf[chunk.idx], chunk.len);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "写入flash失败: %s", esp_err_to_name(err));
+                s_writer_err = err;
+            } else {
+                s_stats.written += chunk.len;
+            }
+        }
+        xQueueSend(s_free_q, &chunk.idx, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(s_writer_done);
+    vTaskDelete(NULL);
+}
+
+/* 打开HTTP连接，offset>0时使用Range续传 */
+static esp_http_client_handle_t ota_http_open(const char *url, uint32_t offset, bool *range_ok)
+{
+    esp_http_client_config_t cfg = {
+        .url = url,
+        .timeout_ms = 10000,
+        .buffer_size = 1536,
+        .keep_alive_enable = true,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&cfg);
+    if (!client) {
+        return NULL;
+    }
+
+    if (offset > 0) {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)offset);
+        esp_http_client_set_header(client, "Range", range);
+    }
+
+    if (esp_http_client_open(client, 0) != ESP_OK) {
+        esp_http_client_cleanup(client);
+        return NULL;
+    }
+    esp_http_client_fetch_headers(client);
+
+    int status = esp_http_client_get_status_code(client);
+    *range_ok = (status == 206);
+    if (status != 200 && status != 206) {
+        ESP_LOGE(TAG, "HTTP状态码异常: %d", status);
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+        return NULL;
+    }
+    return client;
+}
+
+static int ota_http_read(void *ctx, uint8_t *buf, int len)
+{
+    return esp_http_client_read((esp_http_client_handle_t)ctx, (char *)buf, len);
+}
+
+/* 下载级：填满一个缓冲区就交给写入级，断线后从已下载位置续传 */
+static esp_err_t ota_download(const ota_job_t *job, uint32_t *downloaded)
+{
+    int last_decile = -1;
+    uint32_t attempts = 0;
+    tuya_ota_stream_t stream;
+    tuya_ota_stream_init(&stream, job->size);
+
+    while (!tuya_ota_stream_done(&stream)) {
+        if (s_writer_err != ESP_OK) {
+            return s_writer_err;
+        }
+        if (attempts > TUYA_OTA_MAX_RESUME) {
+            ESP_LOGE(TAG, "续传次数过多, 放弃升级");
+            return ESP_ERR_TIMEOUT;
+        }
+        if (attempts > 0) {
+            s_stats.resumes++;
+            ESP_LOGW(TAG, "从偏移 %lu 处续传 (第%lu次)",
+                     (unsigned long)stream.downloaded, (unsigned long)attempts);
+            vTaskDelay(pdMS_TO_TICKS(1000 * attempts));
+        }
+        attempts++;
+
+        bool range_ok = false;
+        esp_http_client_handle_t client = ota_http_open(job->url, stream.downloaded, &range_ok);
+        if (!client) {
+            continue;
+        }
+        // 服务器不支持Range时，丢弃已写入的部分
+        tuya_ota_stream_reopen(&stream, range_ok);
+
+        while (!tuya_ota_stream_done(&stream)) {
+            uint8_t idx;
+            xQueueReceive(s_free_q, &idx, portMAX_DELAY);
+
+            uint32_t fill = tuya_ota_stream_fill(&stream, ota_http_read, client, s_buf[idx], TUYA_OTA_BUF_SIZE);
+            if (fill == 0) {
+                // 连接中断，归还缓冲区后续传
+                xQueueSend(s_free_q, &idx, portMAX_DELAY);
+                break;
+            }
+
+            ota_chunk_t chunk = { .idx = idx, .len = (uint16_t)fill };
+            xQueueSend(s_full_q, &chunk, portMAX_DELAY);
+            *downloaded = stream.downloaded;
+            attempts = 0;
+
+            int decile = (int)((uint64_t)stream.downloaded * 10 / job->size);
+            if (decile != last_decile) {
+                last_decile = decile;
+                ota_report_progress(job->channel, decile * 10);
+            }
+            uint32_t free_heap = esp_get_free_heap_size();
+            if (free_heap < s_stats.min_free_heap) {
+                s_stats.min_free_heap = free_heap;
+            }
+        }
+
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+    }
+    return ESP_OK;
+}
+
+/* 释放流水线资源 */
+static void ota_cleanup(void)
+{
+    for (int i = 0; i < 2; i++) {
+        free(s_buf[i]);
+        s_buf[i] = NULL;
+    }
+    if (s_free_q) {
+        vQueueDelete(s_free_q);
+        s_free_q = NULL;
+    }
+    if (s_full_q) {
+        vQueueDelete(s_full_q);
+        s_full_q = NULL;
+    }
+    if (s_writer_done) {
+        vSemaphoreDelete(s_writer_done);
+        s_writer_done = NULL;
+    }
+    free(s_job);
+    s_job = NULL;
+    s_stats.running = false;
+}
+
+/* OTA主任务 */
+static void tuya_ota_task(void *arg)
+{
+    const ota_job_t *job = s_job;
+    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+    esp_err_t err = ESP_FAIL;
+    uint32_t downloaded = 0;
+    int64_t start_us = esp_timer_get_time();
+
+    if (!update_partition || job->size > update_partition->size) {
+        ESP_LOGE(TAG, "没有可用的OTA分区或固件过大");
+        goto fail;
+    }
+    ESP_LOGI(TAG, "开始升级到 %s, 写入分区 %s, 大小 %lu 字节",
+             job->version, update_partition->label, (unsigned long)job->size);
+
+    // 双缓冲
+    s_buf[0] = malloc(TUYA_OTA_BUF_SIZE);
+    s_buf[1] = malloc(TUYA_OTA_BUF_SIZE);
+    s_free_q = xQueueCreate(2, sizeof(uint8_t));
+    s_full_q = xQueueCreate(2, sizeof(ota_chunk_t));
+    s_writer_done = xSemaphoreCreateBinary();
+    if (!s_buf[0] || !s_buf[1] || !s_free_q || !s_full_q || !s_writer_done) {
+        ESP_LOGE(TAG, "分配OTA缓冲区失败");
+        goto fail;
+    }
+    s_stats.buffer_ram = 2 * TUYA_OTA_BUF_SIZE;
+    for (uint8_t i = 0; i < 2; i++) {
+        xQueueSend(s_free_q, &i, 0);
+    }
+
+    // 顺序写入时按需擦除，避免一次性擦除整个分区阻塞
+    err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &s_ota_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin失败: %s", esp_err_to_name(err));
+        goto fail;
+    }
+
+    mbedtls_sha256_init(&s_sha_ctx);
+    mbedtls_sha256_starts(&s_sha_ctx, 0);
+    s_writer_err = ESP_OK;
+    if (xTaskCreate(ota_writer_task, "ota_writer", 3072, NULL, 6, NULL) != pdPASS) {
+        esp_ota_abort(s_ota_handle);
+        mbedtls_sha256_free(&s_sha_ctx);
+        err = ESP_ERR_NO_MEM;
+        goto fail;
+    }
+
+    err = ota_download(job, &downloaded);
+
+    // 通知写入级结束，并等待剩余数据写完
+    ota_chunk_t end = { .idx = 0, .len = 0 };
+    xQueueSend(s_full_q, &end, portMAX_DELAY);
+    xSemaphoreTake(s_writer_done, portMAX_DELAY);
+    if (err == ESP_OK) {
+        err = s_writer_err;
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&s_sha_ctx, digest);
+    mbedtls_sha256_free(&s_sha_ctx);
+
+    if (err == ESP_OK && job->sha256[0] != '\0' && !tuya_ota_sha256_match(digest, job->sha256)) {
+        ESP_LOGE(TAG, "SHA-256校验失败");
+        err = ESP_ERR_INVALID_CRC;
+    }
+    if (err != ESP_OK) {
+        esp_ota_abort(s_ota_handle);
+        goto fail;
+    }
+
+    // esp_ota_end 还会校验镜像自身的格式和摘要
+    err = esp_ota_end(s_ota_handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(update_partition);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "镜像校验或设置启动分区失败: %s", esp_err_to_name(err));
+        goto fail;
+    }
+
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    s_stats.throughput_bps = (elapsed_us > 0) ?
+                             (uint32_t)((uint64_t)downloaded * 1000000 / elapsed_us) : 0;
+    ESP_LOGI(TAG, "升级完成: %lu 字节, 吞吐 %lu B/s, 续传 %lu 次, 最低空闲堆 %lu",
+             (unsigned long)downloaded, (unsigned long)s_stats.throughput_bps,
+             (unsigned long)s_stats.resumes, (unsigned long)s_stats.min_free_heap);
+
+    ota_report_progress(job->channel, 100);
+    ota_cleanup();
+    ESP_LOGI(TAG, "3秒后重启进入新固件...");
+    vTaskDelay(3000 / portTICK_PERIOD_MS);
+    esp_restart();
+    return;
+
+fail:
+    ESP_LOGE(TAG, "升级失败: %s", esp_err_to_name(err));
+    ota_report_progress(job->channel, -1);
+    ota_cleanup();
+    vTaskDelete(NULL);
+}
+
+esp_err_t tuya_ota_handle_issue(const char* data, int data_len)
+{
+    if (s_stats.running) {
+        ESP_LOGW(TAG, "升级正在进行, 忽略新的升级任务");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    cJSON *root = cJSON_ParseWithLength(data, data_len);
+    if (!root) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ota_job_t *job = calloc(1, sizeof(ota_job_t));
+    if (!job) {
+        cJSON_Delete(root);
+        return ESP_ERR_NO_MEM;
+    }
+
+    cJSON *d = cJSON_GetObjectItem(root, "data");
+    cJSON *url = d ? cJSON_GetObjectItem(d, "url") : NULL;
+    cJSON *size = d ? cJSON_GetObjectItem(d, "size") : NULL;
+    cJSON *version = d ? cJSON_GetObjectItem(d, "version") : NULL;
+    cJSON *channel = d ? cJSON_GetObjectItem(d, "channel") : NULL;
+    cJSON *sha256 = d ? cJSON_GetObjectItem(d, "sha256") : NULL;
+
+    if (cJSON_IsString(url)) {
+        strncpy(job->url, cJSON_GetStringValue(url), sizeof(job->url) - 1);
+    }
+    if (cJSON_IsNumber(size)) {
+        job->size = (uint32_t)cJSON_GetNumberValue(size);
+    } else if (cJSON_IsString(size)) {
+        job->size = (uint32_t)strtoul(cJSON_GetStringValue(size), NULL, 10);
+    }
+    if (cJSON_IsString(version)) {
+        strncpy(job->version, cJSON_GetStringValue(version), sizeof(job->version) - 1);
+    }
+    if (cJSON_IsNumber(channel)) {
+        job->channel = (int)cJSON_GetNumberValue(channel);
+    }
+    if (cJSON_IsString(sha256) && strlen(cJSON_GetStringValue(sha256)) == OTA_SHA256_HEX_LEN) {
+        strcpy(job->sha256, cJSON_GetStringValue(sha256));
+    }
+    cJSON_Delete(root);
+
+    if (job->url[0] == '\0' || job->size == 0) {
+        ESP_LOGE(TAG, "升级消息缺少url或size");
+        free(job);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (job->sha256[0] == '\0') {
+        ESP_LOGW(TAG, "未提供sha256, 仅依赖镜像自带校验");
+    }
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.running = true;
+    s_stats.image_size = job->size;
+    s_stats.min_free_heap = esp_get_free_heap_size();
+    s_job = job;
+
+    // TLS握手需要较大的栈
+    if (xTaskCreate(tuya_ota_task, "tuya_ota", 6144, NULL, 5, NULL) != pdPASS) {
+        ota_cleanup();
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t tuya_ota_report_version(void)
+{
+    const esp_app_desc_t *app_desc = esp_app_get_description();
+    char msg_id[24];
+    char msg[192];
+
+    tuya_make_msg_id(msg_id, sizeof(msg_id));
+    snprintf(msg, sizeof(msg),
+             "{\"msgId\":\"%s\",\"time\":%lld,\"data\":{\"firmwares\":[{\"channel\":0,\"version\":\"%s\"}]}}",
+             msg_id, tuya_now_ms(), app_desc->version);
+    return tuya_publish_topic(TUYA_TOPIC("ota/firmware/report"), msg, 1);
+}
+
+/* 回滚保护超时：新固件未能连上云端，回滚到旧固件 */
+static void rollback_timeout_cb(void *arg)
+{
+    ESP_LOGE(TAG, "新固件在 %d 秒内未连上云端, 回滚到旧固件", TUYA_OTA_ROLLBACK_TIMEOUT_S);
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+void tuya_ota_rollback_guard_start(void)
+{
+    if (s_rollback_timer) {
+        return;     // WiFi组件停止后重新启动，保护已在计时
+    }
+    esp_ota_img_states_t state;
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    if (esp_ota_get_state_partition(running, &state) != ESP_OK ||
+        state != ESP_OTA_IMG_PENDING_VERIFY) {
+        return;
+    }
+
+    ESP_LOGW(TAG, "新固件待验证, 需在 %d 秒内连上云端", TUYA_OTA_ROLLBACK_TIMEOUT_S);
+    const esp_timer_create_args_t args = {
+        .callback = rollback_timeout_cb,
+        .name = "ota_rollback",
+    };
+    if (esp_timer_create(&args, &s_rollback_timer) == ESP_OK) {
+        esp_timer_start_once(s_rollback_timer, (uint64_t)TUYA_OTA_ROLLBACK_TIMEOUT_S * 1000000);
+    }
+}
+
+void tuya_ota_confirm_image(void)
+{
+    if (!s_rollback_timer) {
+        return;
+    }
+    esp_timer_stop(s_rollback_timer);
+    esp_timer_delete(s_rollback_timer);
+    s_rollback_timer = NULL;
+
+    if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK) {
+        ESP_LOGI(TAG, "新固件已确认可用, 取消回滚");
+    }
+}
+
+esp_err_t tuya_ota_get_stats(tuya_ota_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = s_stats;
+    return ESP_OK;
+}
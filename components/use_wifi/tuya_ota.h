@@ -0,0 +1,66 @@
+#ifndef TUYA_OTA_H
+#define TUYA_OTA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "tuya_ota_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* OTA参数 */
+#define TUYA_OTA_MAX_RESUME         8           // 断线后最多续传次数
+#define TUYA_OTA_ROLLBACK_TIMEOUT_S 300         // 新固件须在此时间内连上云端，否则回滚
+
+// OTA统计
+typedef struct {
+    bool running;                   // 是否正在升级
+    uint32_t image_size;            // 固件总大小
+    uint32_t written;               // 已写入flash的字节数
+    uint32_t resumes;               // 断点续传次数
+    uint32_t throughput_bps;        // 最近一次升级的平均吞吐（字节/秒）
+    uint32_t buffer_ram;            // 流水线占用的缓冲区内存
+    uint32_t min_free_heap;         // 升级过程中的最低空闲堆
+} tuya_ota_stats_t;
+
+/**
+ * @brief 处理云端下发的 ota/issue 消息，启动后台升级
+ *
+ * @param data 消息内容（JSON）
+ * @param data_len 消息长度
+ * @return esp_err_t ESP_OK表示升级已启动
+ */
+esp_err_t tuya_ota_handle_issue(const char* data, int data_len);
+
+/**
+ * @brief 上报当前固件版本（MQTT连接成功后调用）
+ *
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t tuya_ota_report_version(void);
+
+/**
+ * @brief 启动回滚保护：新固件首次启动时，超时未确认则回滚到旧固件
+ */
+void tuya_ota_rollback_guard_start(void);
+
+/**
+ * @brief 确认当前固件可用（连上云端后调用），取消回滚
+ */
+void tuya_ota_confirm_image(void);
+
+/**
+ * @brief 获取OTA统计
+ *
+ * @param stats 输出统计数据
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t tuya_ota_get_stats(tuya_ota_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_OTA_H */
@@ -0,0 +1,72 @@
+#include "tuya_ota_stream.h"
+#include <string.h>
+
+void tuya_ota_stream_init(tuya_ota_stream_t *s, uint32_t size)
+{
+    memset(s, 0, sizeof(*s));
+    s->size = size;
+}
+
+void tuya_ota_stream_reopen(tuya_ota_stream_t *s, bool range_ok)
+{
+    s->skip = range_ok ? 0 : s->downloaded;
+}
+
+uint32_t tuya_ota_stream_fill(tuya_ota_stream_t *s, tuya_ota_read_t read, void *ctx,
+                              uint8_t *buf, uint32_t cap)
+{
+    uint32_t fill = 0;
+    while (fill < cap && s->downloaded + fill < s->size) {
+        // 不超过缓冲区剩余空间和固件剩余长度，丢弃阶段不超过待丢弃的长度
+        uint32_t want = cap - fill;
+        if (want > s->size - s->downloaded - fill) {
+            want = s->size - s->downloaded - fill;
+        }
+        if (s->skip > 0 && want > s->skip) {
+            want = s->skip;
+        }
+        int n = read(ctx, buf + fill, (int)want);
+        if (n <= 0) {
+            break;
+        }
+        if ((uint32_t)n > want) {
+            n = (int)want;
+        }
+        if (s->skip > 0) {
+            s->skip -= (uint32_t)n;
+            continue;
+        }
+        fill += (uint32_t)n;
+    }
+    s->downloaded += fill;
+    return fill;
+}
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool tuya_ota_sha256_match(const uint8_t digest[32], const char *expected_hex)
+{
+    if (!expected_hex) {
+        return false;
+    }
+    for (int i = 0; i < 32; i++) {
+        int hi = hex_nibble(expected_hex[i * 2]);
+        int lo = hi < 0 ? -1 : hex_nibble(expected_hex[i * 2 + 1]);
+        if (lo < 0 || (uint8_t)((hi << 4) | lo) != digest[i]) {
+            return false;
+        }
+    }
+    return expected_hex[64] == '\0';
+}
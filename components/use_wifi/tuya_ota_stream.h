@@ -0,0 +1,63 @@
+/*
+ * OTA下载级：在一条HTTP连接上读满一个缓冲区，记录续传偏移
+ * 纯C实现，不依赖ESP-IDF，读取函数由调用方提供（设备上为 esp_http_client_read）
+ */
+#ifndef TUYA_OTA_STREAM_H
+#define TUYA_OTA_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_OTA_BUF_SIZE           4096        // 单个下载缓冲区大小（双缓冲）
+
+/**
+ * @brief 从连接读取数据
+ *
+ * @return int 读到的字节数，<=0 表示连接中断
+ */
+typedef int (*tuya_ota_read_t)(void *ctx, uint8_t *buf, int len);
+
+typedef struct {
+    uint32_t size;              // 固件总大小
+    uint32_t downloaded;        // 已交给写入级的字节数，即续传偏移
+    uint32_t skip;              // 本连接上还需丢弃的字节数（服务器不支持Range时）
+} tuya_ota_stream_t;
+
+void tuya_ota_stream_init(tuya_ota_stream_t *s, uint32_t size);
+
+/**
+ * @brief 新连接建立后调用
+ *
+ * @param range_ok 服务器是否按Range从续传偏移开始返回（206），否则从头返回并丢弃已写入的部分
+ */
+void tuya_ota_stream_reopen(tuya_ota_stream_t *s, bool range_ok);
+
+/**
+ * @brief 从当前连接读满一个缓冲区（最后一块可能不满）
+ *
+ * @param buf 缓冲区
+ * @param cap 缓冲区大小
+ * @return uint32_t 填入的字节数，已计入 downloaded；0表示连接中断或已下载完
+ */
+uint32_t tuya_ota_stream_fill(tuya_ota_stream_t *s, tuya_ota_read_t read, void *ctx,
+                              uint8_t *buf, uint32_t cap);
+
+static inline bool tuya_ota_stream_done(const tuya_ota_stream_t *s)
+{
+    return s->downloaded >= s->size;
+}
+
+/**
+ * @brief 比较计算出的SHA-256摘要和云端下发的十六进制摘要（不区分大小写）
+ */
+bool tuya_ota_sha256_match(const uint8_t digest[32], const char *expected_hex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_OTA_STREAM_H */
@@ -0,0 +1,157 @@
+#include "tuya_outbox.h"
+#include <string.h>
+
+uint32_t tuya_outbox_key(const char* str)
+{
+    uint32_t h = 2166136261u;
+    while (*str) {
+        h ^= (uint8_t)*str++;
+        h *= 16777619u;
+    }
+    return h ? h : 1;
+}
+
+void tuya_outbox_init(tuya_outbox_t* ob)
+{
+    memset(ob, 0, sizeof(*ob));
+}
+
+/* 排序：优先级高的在前，同级按入队序号 */
+static bool before(const tuya_outbox_msg_t* a, const tuya_outbox_msg_t* b)
+{
+    if (a->cls != b->cls) {
+        return a->cls < b->cls;
+    }
+    return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static tuya_outbox_msg_t* find_key(tuya_outbox_t* ob, uint8_t cls, uint32_t key)
+{
+    for (int i = 0; i < TUYA_OUTBOX_SLOTS; i++) {
+        tuya_outbox_msg_t* m = &ob->slots[i];
+        if (m->used && m->key == key && m->cls == cls) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+/* 找一个槽位：有空位直接用；否则挤掉排在最后的消息，但不能比新消息更重要 */
+static tuya_outbox_msg_t* take_slot(tuya_outbox_t* ob, uint8_t cls, bool* evicted)
+{
+    tuya_outbox_msg_t* victim = NULL;
+    for (int i = 0; i < TUYA_OUTBOX_SLOTS; i++) {
+        tuya_outbox_msg_t* m = &ob->slots[i];
+        if (!m->used) {
+            *evicted = false;
+            return m;
+        }
+        // 低优先级中最旧的先被挤掉：新数据比旧数据更有价值
+        if (!victim || m->cls > victim->cls ||
+            (m->cls == victim->cls && (int32_t)(m->seq - victim->seq) < 0)) {
+            victim = m;
+        }
+    }
+    if (!victim || victim->cls < cls) {
+        return NULL;
+    }
+    ob->stats[victim->cls].dropped++;
+    *evicted = true;
+    return victim;
+}
+
+static void fill(tuya_outbox_msg_t* m, const char* data, size_t len, int64_t t_origin)
+{
+    memcpy(m->data, data, len);
+    m->data[len] = '\0';
+    m->len = (uint16_t)len;
+    m->t_origin = t_origin;
+}
+
+tuya_outbox_result_t tuya_outbox_put(tuya_outbox_t* ob, tuya_tx_class_t cls, uint32_t key,
+                                     const char* topic, const char* data, int qos,
+                                     uint8_t flags, int64_t t_origin)
+{
+    if (cls >= TUYA_TX_CLASS_NUM || !topic || !data) {
+        return TUYA_OUTBOX_REJECTED;
+    }
+    size_t len = strlen(data);
+    size_t topic_len = strlen(topic);
+    if (len >= TUYA_OUTBOX_DATA_LEN || topic_len >= TUYA_OUTBOX_TOPIC_LEN) {
+        ob->stats[cls].dropped++;
+        return TUYA_OUTBOX_REJECTED;
+    }
+
+    tuya_outbox_msg_t* m = key ? find_key(ob, cls, key) : NULL;
+    if (m && strcmp(m->topic, topic) == 0) {
+        fill(m, data, len, t_origin);
+        m->qos = (uint8_t)qos;
+        m->flags = flags;
+        ob->stats[cls].coalesced++;
+        return TUYA_OUTBOX_COALESCED;
+    }
+
+    bool evicted = false;
+    m = take_slot(ob, cls, &evicted);
+    if (!m) {
+        ob->stats[cls].dropped++;
+        return TUYA_OUTBOX_REJECTED;
+    }
+    memcpy(m->topic, topic, topic_len + 1);
+    fill(m, data, len, t_origin);
+    m->key = key;
+    m->seq = ob->next_seq++;
+    m->cls = (uint8_t)cls;
+    m->qos = (uint8_t)qos;
+    m->flags = flags;
+    m->used = true;
+    ob->stats[cls].queued++;
+
+    if (!evicted) {
+        ob->depth++;
+        if (ob->depth > ob->max_depth) {
+            ob->max_depth = ob->depth;
+        }
+    }
+    return evicted ? TUYA_OUTBOX_EVICTED : TUYA_OUTBOX_QUEUED;
+}
+
+bool tuya_outbox_pop(tuya_outbox_t* ob, tuya_outbox_msg_t* out)
+{
+    tuya_outbox_msg_t* best = NULL;
+    for (int i = 0; i < TUYA_OUTBOX_SLOTS; i++) {
+        tuya_outbox_msg_t* m = &ob->slots[i];
+        if (m->used && (!best || before(m, best))) {
+            best = m;
+        }
+    }
+    if (!best) {
+        return false;
+    }
+    *out = *best;
+    best->used = false;
+    ob->depth--;
+    ob->stats[best->cls].sent++;
+    return true;
+}
+
+void tuya_outbox_requeue(tuya_outbox_t* ob, const tuya_outbox_msg_t* msg)
+{
+    ob->stats[msg->cls].sent--;
+    if (msg->key && find_key(ob, msg->cls, msg->key)) {
+        ob->stats[msg->cls].dropped++;
+        return;
+    }
+
+    bool evicted = false;
+    tuya_outbox_msg_t* m = take_slot(ob, msg->cls, &evicted);
+    if (!m) {
+        ob->stats[msg->cls].dropped++;
+        return;
+    }
+    *m = *msg;
+    m->used = true;
+    if (!evicted) {
+        ob->depth++;
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ * 上行发送队列：固定槽位，按优先级发送，同一键的未发送消息只保留最新值
+ * 纯C实现，不依赖ESP-IDF，调用方负责加锁，时间单位由调用方决定
+ */
+#ifndef TUYA_OUTBOX_H
+#define TUYA_OUTBOX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_OUTBOX_SLOTS           16
+#define TUYA_OUTBOX_TOPIC_LEN       64
+#define TUYA_OUTBOX_DATA_LEN        512     // 单条消息上限（含结尾）
+
+#define TUYA_OUTBOX_FLAG_REPORT     0x01    // 周期上报，发送时可代替心跳
+#define TUYA_OUTBOX_FLAG_ACK        0x02    // 命令应答，t_origin为收到命令的时刻
+
+// 优先级，数值越小越先发送
+typedef enum {
+    TUYA_TX_ACK = 0,            // 命令应答、事件
+    TUYA_TX_STATE,              // 状态变化
+    TUYA_TX_TELEMETRY,          // 周期遥测
+    TUYA_TX_DIAG,               // 诊断信息
+    TUYA_TX_CLASS_NUM,
+} tuya_tx_class_t;
+
+typedef enum {
+    TUYA_OUTBOX_QUEUED = 0,     // 新占用一个槽位
+    TUYA_OUTBOX_COALESCED,      // 替换了同一键的未发送消息
+    TUYA_OUTBOX_EVICTED,        // 队列满，挤掉了一条更低优先级（或同级更旧）的消息
+    TUYA_OUTBOX_REJECTED,       // 队列满且没有可挤掉的消息，或参数错误
+} tuya_outbox_result_t;
+
+typedef struct {
+    char topic[TUYA_OUTBOX_TOPIC_LEN];
+    char data[TUYA_OUTBOX_DATA_LEN];
+    int64_t t_origin;           // 消息产生时刻，合并时更新为最新值的时刻
+    uint32_t key;               // 合并键，0表示不合并
+    uint32_t seq;               // 首次入队序号，同级内按此先后发送，合并时不变
+    uint16_t len;
+    uint8_t cls;                // tuya_tx_class_t
+    uint8_t qos;
+    uint8_t flags;
+    bool used;
+} tuya_outbox_msg_t;
+
+typedef struct {
+    uint32_t queued;
+    uint32_t coalesced;
+    uint32_t dropped;           // 被挤掉或被拒绝
+    uint32_t sent;              // 已取出发送
+} tuya_outbox_class_stats_t;
+
+typedef struct {
+    tuya_outbox_msg_t slots[TUYA_OUTBOX_SLOTS];
+    tuya_outbox_class_stats_t stats[TUYA_TX_CLASS_NUM];
+    uint32_t next_seq;
+    uint16_t depth;
+    uint16_t max_depth;
+} tuya_outbox_t;
+
+/**
+ * @brief 由字符串生成合并键（FNV-1a，不会返回0）
+ */
+uint32_t tuya_outbox_key(const char* str);
+
+void tuya_outbox_init(tuya_outbox_t* ob);
+
+/**
+ * @brief 放入一条消息
+ *
+ * key非0且队列中有同级同键的未发送消息时，原地替换其内容，发送顺序不变
+ *
+ * @param ob 队列
+ * @param cls 优先级
+ * @param key 合并键，0表示不合并
+ * @param topic 主题
+ * @param data 消息内容
+ * @param qos 服务质量等级
+ * @param flags TUYA_OUTBOX_FLAG_*
+ * @param t_origin 消息产生时刻
+ * @return tuya_outbox_result_t 入队结果
+ */
+tuya_outbox_result_t tuya_outbox_put(tuya_outbox_t* ob, tuya_tx_class_t cls, uint32_t key,
+                                     const char* topic, const char* data, int qos,
+                                     uint8_t flags, int64_t t_origin);
+
+/**
+ * @brief 取出优先级最高、同级中最早入队的消息
+ *
+ * @param ob 队列
+ * @param out 输出消息
+ * @return true 取到消息
+ */
+bool tuya_outbox_pop(tuya_outbox_t* ob, tuya_outbox_msg_t* out);
+
+/**
+ * @brief 发送失败时放回队列，保持原来的发送顺序；
+ *        期间已有同键的新消息入队时直接丢弃旧消息
+ */
+void tuya_outbox_requeue(tuya_outbox_t* ob, const tuya_outbox_msg_t* msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_OUTBOX_H */
@@ -0,0 +1,106 @@
+#include "tuya_rate.h"
+#include <string.h>
+
+static uint32_t clamp_u32(uint32_t v, uint32_t lo, uint32_t hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+/* 打包数使每个窗口约为基础间隔 */
+static uint8_t batch_for(const tuya_rate_t* rc, uint32_t interval_ms)
+{
+    uint32_t base = rc->cfg.base_interval_ms;
+    uint32_t n = (interval_ms + base - 1) / base;
+    return (uint8_t)clamp_u32(n, 1, rc->cfg.max_batch);
+}
+
+void tuya_rate_init(tuya_rate_t* rc, const tuya_rate_config_t* cfg)
+{
+    memset(rc, 0, sizeof(*rc));
+    rc->cfg = *cfg;
+    if (rc->cfg.max_batch == 0 || rc->cfg.max_batch > TUYA_RATE_MAX_BATCH) {
+        rc->cfg.max_batch = TUYA_RATE_MAX_BATCH;
+    }
+    tuya_rate_set_base(rc, cfg->base_interval_ms);
+}
+
+void tuya_rate_set_base(tuya_rate_t* rc, uint32_t base_interval_ms)
+{
+    if (base_interval_ms == 0) {
+        return;
+    }
+    rc->cfg.base_interval_ms = base_interval_ms;
+    if (rc->cfg.max_interval_ms < base_interval_ms) {
+        rc->cfg.max_interval_ms = base_interval_ms;
+    }
+    rc->interval_ms = clamp_u32(rc->interval_ms, tuya_rate_floor_ms(rc), rc->cfg.max_interval_ms);
+    rc->batch = batch_for(rc, rc->interval_ms);
+}
+
+uint32_t tuya_rate_floor_ms(const tuya_rate_t* rc)
+{
+    uint32_t base = rc->cfg.base_interval_ms;
+    uint32_t floor = base;
+    if (rc->rssi != TUYA_RATE_RSSI_UNKNOWN && rc->rssi < TUYA_RATE_RSSI_WEAK) {
+        floor = base * 4;
+    } else if (rc->rssi != TUYA_RATE_RSSI_UNKNOWN && rc->rssi < TUYA_RATE_RSSI_FAIR) {
+        floor = base * 2;
+    }
+    return floor > rc->cfg.max_interval_ms ? rc->cfg.max_interval_ms : floor;
+}
+
+void tuya_rate_on_rssi(tuya_rate_t* rc, int8_t rssi)
+{
+    if (rssi >= 0) {
+        return;
+    }
+    // 平滑单次衰落，权重1/4
+    rc->rssi = rc->rssi == TUYA_RATE_RSSI_UNKNOWN ? rssi : (int8_t)((3 * rc->rssi + rssi - 2) / 4);
+}
+
+void tuya_rate_on_ack(tuya_rate_t* rc, uint32_t rtt_ms, uint32_t retransmits)
+{
+    rc->win_acks++;
+    rc->win_retx += retransmits;
+    rc->win_rtt_ms += rtt_ms;
+    rc->acks++;
+    rc->retransmits += retransmits;
+    if (rtt_ms > rc->max_rtt_ms) {
+        rc->max_rtt_ms = rtt_ms;
+    }
+}
+
+void tuya_rate_on_lost(tuya_rate_t* rc)
+{
+    rc->win_lost++;
+    rc->lost++;
+}
+
+bool tuya_rate_update(tuya_rate_t* rc)
+{
+    uint32_t old_interval = rc->interval_ms;
+    uint8_t old_batch = rc->batch;
+    uint32_t floor = tuya_rate_floor_ms(rc);
+    uint32_t interval = rc->interval_ms;
+
+    if (rc->win_acks > 0 || rc->win_lost > 0) {
+        bool congested = rc->win_lost > 0 ||
+                         rc->win_retx * 100 > (uint32_t)rc->cfg.retx_high_pct * rc->win_acks ||
+                         (rc->win_acks > 0 && rc->win_rtt_ms / rc->win_acks > rc->cfg.rtt_high_ms);
+        if (congested) {
+            interval = interval > rc->cfg.max_interval_ms / 2 ? rc->cfg.max_interval_ms : interval * 2;
+            rc->backoffs++;
+        } else if (interval > floor) {
+            interval = interval - floor < rc->cfg.step_ms ? floor : interval - rc->cfg.step_ms;
+            rc->recoveries++;
+        }
+    }
+
+    rc->interval_ms = clamp_u32(interval, floor, rc->cfg.max_interval_ms);
+    rc->batch = batch_for(rc, rc->interval_ms);
+    rc->win_acks = 0;
+    rc->win_retx = 0;
+    rc->win_lost = 0;
+    rc->win_rtt_ms = 0;
+    return rc->interval_ms != old_interval || rc->batch != old_batch;
+}
@@ -0,0 +1,109 @@
+/*
+ * 周期上报速率控制：按链路质量调整上报间隔和每次上报打包的窗口数（AIMD）
+ * 纯C实现，不依赖ESP-IDF，时间单位为毫秒
+ *
+ * 输入：RSSI、QoS1上报的PUBACK时延、重发次数和未确认丢弃的消息数
+ *   - 评估窗口内出现丢弃、重发比例或平均PUBACK时延超限：间隔乘性增大（上报速率减半）
+ *   - 否则间隔加性减小，最小不低于由RSSI决定的下限
+ * 打包数随间隔增大，保持每个采样窗口约为基础间隔，上限受单条消息长度限制；
+ * 弱信号下物理速率低、每个包的空口开销大，少发大包比多发小包更省空口时间
+ */
+#ifndef TUYA_RATE_H
+#define TUYA_RATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_RATE_MAX_BATCH         3       // 单条批量上报的窗口数上限，取值极端时也不超过 TUYA_OUTBOX_DATA_LEN
+#define TUYA_RATE_RSSI_FAIR         (-72)   // 低于此值间隔下限为基础间隔的2倍
+#define TUYA_RATE_RSSI_WEAK         (-80)   // 低于此值间隔下限为基础间隔的4倍
+#define TUYA_RATE_RSSI_UNKNOWN      0
+
+typedef struct {
+    uint32_t base_interval_ms;      // 链路良好时的上报间隔，也是采样窗口的目标长度
+    uint32_t max_interval_ms;       // 间隔上限
+    uint32_t step_ms;               // 每个健康评估窗口的加性减小量
+    uint32_t rtt_high_ms;           // 平均PUBACK时延超过此值视为拥塞
+    uint8_t retx_high_pct;          // 重发次数占确认数的百分比超过此值视为拥塞
+    uint8_t max_batch;              // 不超过 TUYA_RATE_MAX_BATCH
+} tuya_rate_config_t;
+
+#define TUYA_RATE_CONFIG_DEFAULT() {    \
+    .base_interval_ms = 10000,          \
+    .max_interval_ms = 120000,          \
+    .step_ms = 5000,                    \
+    .rtt_high_ms = 1500,                \
+    .retx_high_pct = 10,                \
+    .max_batch = TUYA_RATE_MAX_BATCH,   \
+}
+
+typedef struct {
+    tuya_rate_config_t cfg;
+    uint32_t interval_ms;           // 当前上报间隔
+    uint8_t batch;                  // 当前每次上报打包的窗口数
+    int8_t rssi;                    // RSSI平滑值，TUYA_RATE_RSSI_UNKNOWN表示尚无采样
+
+    // 当前评估窗口
+    uint32_t win_acks;
+    uint32_t win_retx;
+    uint32_t win_lost;
+    uint64_t win_rtt_ms;
+
+    // 统计
+    uint32_t acks;
+    uint32_t retransmits;           // 由PUBACK时延估算的重发次数
+    uint32_t lost;                  // 未收到PUBACK就被丢弃的消息
+    uint32_t backoffs;              // 乘性增大次数
+    uint32_t recoveries;            // 加性减小次数
+    uint32_t max_rtt_ms;
+} tuya_rate_t;
+
+void tuya_rate_init(tuya_rate_t* rc, const tuya_rate_config_t* cfg);
+
+/**
+ * @brief 修改基础间隔，当前间隔按新的上下限重新限定
+ */
+void tuya_rate_set_base(tuya_rate_t* rc, uint32_t base_interval_ms);
+
+/**
+ * @brief 记录一次RSSI采样
+ */
+void tuya_rate_on_rssi(tuya_rate_t* rc, int8_t rssi);
+
+/**
+ * @brief 记录一次PUBACK
+ *
+ * @param rc 控制器
+ * @param rtt_ms 发布到收到PUBACK的时延
+ * @param retransmits 期间的重发次数
+ */
+void tuya_rate_on_ack(tuya_rate_t* rc, uint32_t rtt_ms, uint32_t retransmits);
+
+/**
+ * @brief 记录一条未收到PUBACK就被丢弃的消息
+ */
+void tuya_rate_on_lost(tuya_rate_t* rc);
+
+/**
+ * @brief 结束一个评估窗口（约每个上报间隔调用一次），按窗口内的反馈调整间隔和打包数
+ *
+ * 窗口内没有任何反馈（未上报或未连接）时只按RSSI下限修正
+ *
+ * @return bool true表示间隔或打包数有变化
+ */
+bool tuya_rate_update(tuya_rate_t* rc);
+
+/**
+ * @brief 当前RSSI对应的间隔下限
+ */
+uint32_t tuya_rate_floor_ms(const tuya_rate_t* rc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_RATE_H */
@@ -0,0 +1,327 @@
+#include "tuya_roam.h"
+#include <stdio.h>
+#include <string.h>
+
+#define EID_NEIGHBOR_REPORT     52
+#define NR_FIXED_LEN            13      // BSSID(6) + BSSID信息(4) + 操作类(1) + 信道(1) + PHY类型(1)
+#define NR_SUB_CAND_PREF        3       // BSS切换候选优先级子元素
+
+static void set_state(tuya_roam_t* r, tuya_roam_state_t state, int64_t now_ms)
+{
+    r->state = state;
+    r->state_ms = now_ms;
+}
+
+static const tuya_roam_neighbor_t* find_neighbor(const tuya_roam_t* r, const uint8_t bssid[6])
+{
+    for (int i = 0; i < r->neighbor_count; i++) {
+        if (memcmp(r->neighbors[i].bssid, bssid, 6) == 0) {
+            return &r->neighbors[i];
+        }
+    }
+    return NULL;
+}
+
+static bool blacklisted(const tuya_roam_t* r, const uint8_t bssid[6], int64_t now_ms)
+{
+    for (int i = 0; i < TUYA_ROAM_BLACKLIST_NUM; i++) {
+        if (r->blacklist[i].until_ms > now_ms && memcmp(r->blacklist[i].bssid, bssid, 6) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* 拉黑目标，槽位满时替换最早到期的 */
+static void blacklist_add(tuya_roam_t* r, const uint8_t bssid[6], int64_t now_ms)
+{
+    int slot = 0;
+    for (int i = 1; i < TUYA_ROAM_BLACKLIST_NUM; i++) {
+        if (r->blacklist[i].until_ms < r->blacklist[slot].until_ms) {
+            slot = i;
+        }
+    }
+    memcpy(r->blacklist[slot].bssid, bssid, 6);
+    r->blacklist[slot].until_ms = now_ms + TUYA_ROAM_BLACKLIST_MS;
+}
+
+/* 信道对应的全局操作类，邻居报告中没有目标时用于BTM候选列表 */
+static uint8_t op_class_of(uint8_t channel)
+{
+    if (channel <= 13) {
+        return 81;
+    }
+    if (channel <= 48) {
+        return 115;
+    }
+    if (channel <= 64) {
+        return 118;
+    }
+    if (channel <= 144) {
+        return 121;
+    }
+    return 125;
+}
+
+void tuya_roam_init(tuya_roam_t* r)
+{
+    memset(r, 0, sizeof(*r));
+    iot_latency_reset(&r->gap);
+}
+
+int tuya_roam_parse_neighbors(const uint8_t* ie, size_t len, tuya_roam_neighbor_t* out, int max)
+{
+    int n = 0;
+    size_t pos = 0;
+    while (pos + 2 <= len && n < max) {
+        uint8_t id = ie[pos];
+        uint8_t elen = ie[pos + 1];
+        const uint8_t* body = &ie[pos + 2];
+        if (pos + 2 + elen > len) {
+            break;
+        }
+        pos += 2 + elen;
+        if (id != EID_NEIGHBOR_REPORT || elen < NR_FIXED_LEN) {
+            continue;
+        }
+
+        tuya_roam_neighbor_t* nb = &out[n++];
+        memset(nb, 0, sizeof(*nb));
+        memcpy(nb->bssid, body, 6);
+        nb->bssid_info = body[6] | ((uint32_t)body[7] << 8) | ((uint32_t)body[8] << 16) | ((uint32_t)body[9] << 24);
+        nb->op_class = body[10];
+        nb->channel = body[11];
+        nb->phy_type = body[12];
+
+        // 可选子元素，只关心候选优先级
+        size_t sub = NR_FIXED_LEN;
+        while (sub + 2 <= elen) {
+            uint8_t sid = body[sub];
+            uint8_t slen = body[sub + 1];
+            if (sub + 2 + slen > elen) {
+                break;
+            }
+            if (sid == NR_SUB_CAND_PREF && slen >= 1) {
+                nb->pref = body[sub + 2];
+                nb->pref_set = true;
+            }
+            sub += 2 + slen;
+        }
+    }
+    return n;
+}
+
+int tuya_roam_select(const tuya_roam_t* r, const tuya_roam_cand_t* cands, int n, int64_t now_ms)
+{
+    int best = -1;
+    int best_score = 0;
+    int best_pref = 0;
+
+    for (int i = 0; i < n; i++) {
+        const tuya_roam_cand_t* c = &cands[i];
+        if (memcmp(c->bssid, r->cur_bssid, 6) == 0 || blacklisted(r, c->bssid, now_ms)) {
+            continue;
+        }
+        const tuya_roam_neighbor_t* nb = find_neighbor(r, c->bssid);
+        if (nb && nb->pref_set && nb->pref == 0) {
+            continue;               // AP声明不作为切换目标
+        }
+        if (c->rssi < TUYA_ROAM_MIN_RSSI || c->rssi - r->cur_rssi < TUYA_ROAM_MIN_GAIN_DB) {
+            continue;
+        }
+
+        int score = c->rssi;
+        if (nb) {
+            score += TUYA_ROAM_NEIGHBOR_BONUS_DB;
+        }
+        if (c->channel > 14 && c->rssi >= TUYA_ROAM_5G_MIN_RSSI) {
+            score += TUYA_ROAM_5G_BONUS_DB;
+        }
+        int pref = nb && nb->pref_set ? nb->pref : 0;
+        if (best < 0 || score > best_score || (score == best_score && pref > best_pref)) {
+            best = i;
+            best_score = score;
+            best_pref = pref;
+        }
+    }
+    return best;
+}
+
+bool tuya_roam_on_connected(tuya_roam_t* r, const uint8_t bssid[6], bool rrm, bool btm, int64_t now_ms)
+{
+    // 漫游中关联到新AP，或未经断开事件直接换了AP（AP引导的重关联）
+    bool handoff = r->state == TUYA_ROAM_HANDOFF ||
+                   (r->connected && memcmp(r->cur_bssid, bssid, 6) != 0);
+    if (handoff) {
+        int64_t start = r->handoff_start_ms ? r->handoff_start_ms : now_ms;
+        int64_t gap_ms = now_ms - start;
+        iot_latency_record(&r->gap, gap_ms < 0 ? 0 : (uint32_t)(gap_ms * 1000));
+        r->roams++;
+    }
+
+    memcpy(r->cur_bssid, bssid, 6);
+    r->connected = true;
+    r->rrm = rrm;
+    r->btm = btm;
+    r->has_target = false;
+    r->neighbor_count = 0;
+    r->handoff_start_ms = 0;
+    set_state(r, TUYA_ROAM_IDLE, now_ms);
+    return handoff;
+}
+
+bool tuya_roam_on_disconnect(tuya_roam_t* r, bool roaming, int64_t now_ms)
+{
+    // 驱动报告的漫游，或本地已发出BTM查询/重关联后的断开
+    if (r->connected && (roaming || r->state == TUYA_ROAM_WAIT_BTM || r->state == TUYA_ROAM_HANDOFF)) {
+        if (r->state != TUYA_ROAM_HANDOFF) {
+            r->handoff_start_ms = now_ms;
+            set_state(r, TUYA_ROAM_HANDOFF, now_ms);
+        }
+        return true;
+    }
+
+    r->connected = false;
+    r->has_target = false;
+    r->handoff_start_ms = 0;
+    set_state(r, TUYA_ROAM_IDLE, now_ms);
+    return false;
+}
+
+tuya_roam_action_t tuya_roam_on_rssi_low(tuya_roam_t* r, int8_t rssi, int64_t now_ms)
+{
+    r->cur_rssi = rssi;
+    if (!r->connected || r->state != TUYA_ROAM_IDLE) {
+        return TUYA_ROAM_ACT_NONE;
+    }
+    if (r->last_attempt_ms && now_ms - r->last_attempt_ms < TUYA_ROAM_COOLDOWN_MS) {
+        return TUYA_ROAM_ACT_NONE;
+    }
+
+    r->last_attempt_ms = now_ms;
+    r->triggers++;
+    r->neighbor_count = 0;
+    r->has_target = false;
+    if (r->rrm) {
+        set_state(r, TUYA_ROAM_WAIT_NEIGHBORS, now_ms);
+        return TUYA_ROAM_ACT_NEIGHBOR_REQ;
+    }
+    set_state(r, TUYA_ROAM_SCANNING, now_ms);
+    return TUYA_ROAM_ACT_SCAN;
+}
+
+tuya_roam_action_t tuya_roam_on_neighbors(tuya_roam_t* r, const uint8_t* ie, size_t len, int64_t now_ms)
+{
+    if (r->state != TUYA_ROAM_WAIT_NEIGHBORS) {
+        return TUYA_ROAM_ACT_NONE;
+    }
+    r->neighbor_count = (uint8_t)tuya_roam_parse_neighbors(ie, len, r->neighbors, TUYA_ROAM_MAX_NEIGHBORS);
+    r->neighbor_reports++;
+    set_state(r, TUYA_ROAM_SCANNING, now_ms);
+    return TUYA_ROAM_ACT_SCAN;
+}
+
+tuya_roam_action_t tuya_roam_on_scan(tuya_roam_t* r, const tuya_roam_cand_t* cands, int n, int64_t now_ms)
+{
+    if (r->state != TUYA_ROAM_SCANNING) {
+        return TUYA_ROAM_ACT_NONE;
+    }
+    int idx = tuya_roam_select(r, cands, n, now_ms);
+    if (idx < 0) {
+        r->no_candidate++;
+        set_state(r, TUYA_ROAM_IDLE, now_ms);
+        return TUYA_ROAM_ACT_NONE;
+    }
+
+    r->target = cands[idx];
+    r->has_target = true;
+    if (r->btm) {
+        r->btm_queries++;
+        set_state(r, TUYA_ROAM_WAIT_BTM, now_ms);
+        return TUYA_ROAM_ACT_BTM_QUERY;
+    }
+    r->handoff_start_ms = now_ms;
+    set_state(r, TUYA_ROAM_HANDOFF, now_ms);
+    return TUYA_ROAM_ACT_REASSOC;
+}
+
+tuya_roam_action_t tuya_roam_tick(tuya_roam_t* r, int64_t now_ms)
+{
+    int64_t elapsed = now_ms - r->state_ms;
+    switch (r->state) {
+    case TUYA_ROAM_WAIT_NEIGHBORS:
+        if (elapsed >= TUYA_ROAM_NEIGHBOR_TIMEOUT_MS) {
+            set_state(r, TUYA_ROAM_SCANNING, now_ms);
+            return TUYA_ROAM_ACT_SCAN;
+        }
+        break;
+    case TUYA_ROAM_SCANNING:
+        if (elapsed >= TUYA_ROAM_SCAN_TIMEOUT_MS) {
+            set_state(r, TUYA_ROAM_IDLE, now_ms);
+        }
+        break;
+    case TUYA_ROAM_WAIT_BTM:
+        if (elapsed >= TUYA_ROAM_BTM_TIMEOUT_MS) {
+            r->handoff_start_ms = now_ms;
+            set_state(r, TUYA_ROAM_HANDOFF, now_ms);
+            return TUYA_ROAM_ACT_REASSOC;
+        }
+        break;
+    case TUYA_ROAM_HANDOFF:
+        if (now_ms - r->handoff_start_ms >= TUYA_ROAM_HANDOFF_TIMEOUT_MS) {
+            if (r->has_target) {
+                blacklist_add(r, r->target.bssid, now_ms);
+            }
+            r->failures++;
+            r->connected = false;
+            r->has_target = false;
+            r->handoff_start_ms = 0;
+            set_state(r, TUYA_ROAM_IDLE, now_ms);
+            return TUYA_ROAM_ACT_RESTORE;
+        }
+        break;
+    default:
+        break;
+    }
+    return TUYA_ROAM_ACT_NONE;
+}
+
+/* 追加一个候选项，pref>=0时附带优先级子元素 */
+static int append_cand(char* buf, size_t size, int len, const uint8_t bssid[6], uint32_t info,
+                       uint8_t op_class, uint8_t channel, uint8_t phy, int pref)
+{
+    int n = snprintf(buf + len, size - len, "%sneighbor=%02x:%02x:%02x:%02x:%02x:%02x,0x%04lx,%u,%u,%u",
+                     len ? " " : "", bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5],
+                     (unsigned long)info, op_class, channel, phy);
+    if (n >= 0 && pref >= 0 && len + n < (int)size) {
+        n += snprintf(buf + len + n, size - len - n, ",0301%02x", pref);
+    }
+    return n < 0 || len + n >= (int)size ? -1 : len + n;
+}
+
+int tuya_roam_format_btm(const tuya_roam_t* r, char* buf, size_t size)
+{
+    if (size == 0) {
+        return -1;
+    }
+    buf[0] = '\0';
+    int len = 0;
+
+    // 目标排首位并给最高优先级，其余邻居保留AP给出的优先级
+    if (r->has_target) {
+        const tuya_roam_neighbor_t* nb = find_neighbor(r, r->target.bssid);
+        len = append_cand(buf, size, len, r->target.bssid, nb ? nb->bssid_info : 0,
+                          nb ? nb->op_class : op_class_of(r->target.channel), r->target.channel,
+                          nb ? nb->phy_type : 0, 255);
+    }
+    for (int i = 0; i < r->neighbor_count && len >= 0; i++) {
+        const tuya_roam_neighbor_t* nb = &r->neighbors[i];
+        if ((r->has_target && memcmp(nb->bssid, r->target.bssid, 6) == 0) ||
+            memcmp(nb->bssid, r->cur_bssid, 6) == 0 || (nb->pref_set && nb->pref == 0)) {
+            continue;
+        }
+        len = append_cand(buf, size, len, nb->bssid, nb->bssid_info, nb->op_class, nb->channel,
+                          nb->phy_type, nb->pref_set ? nb->pref : -1);
+    }
+    return len;
+}
@@ -0,0 +1,180 @@
+/*
+ * 同一SSID多AP间的主动漫游：信号变弱时借助802.11k邻居报告和802.11v BSS切换管理，
+ * 在链路断开前换到更好的AP，IP地址和MQTT会话保持不变
+ * 纯C实现，不依赖ESP-IDF，时间均由调用方传入（单调时钟毫秒）
+ *
+ * 流程（每一步返回调用方需要执行的动作）：
+ *   RSSI低于门限 -> 支持11k时请求邻居报告 -> 扫描 -> 按规则选出目标AP
+ *   -> 支持11v时发送BTM查询（目标排在候选列表首位），由AP下发切换请求完成漫游；
+ *      AP超时未响应或不支持11v时直接重关联到目标
+ *   -> 关联完成记录切换间隙；超时未完成则目标拉黑一段时间，按普通断线处理
+ */
+#ifndef TUYA_ROAM_H
+#define TUYA_ROAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "iot_metrics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_ROAM_RSSI_TRIGGER          (-70)   // 当前AP低于此值开始寻找更好的AP
+#define TUYA_ROAM_MIN_RSSI              (-75)   // 目标AP至少达到此值
+#define TUYA_ROAM_MIN_GAIN_DB           8       // 目标AP至少比当前强这么多，避免在两个AP间来回切换
+#define TUYA_ROAM_NEIGHBOR_BONUS_DB     3       // 在邻居报告中的AP加分
+#define TUYA_ROAM_5G_BONUS_DB           3       // 信号足够时5GHz的AP加分
+#define TUYA_ROAM_5G_MIN_RSSI           (-70)
+#define TUYA_ROAM_COOLDOWN_MS           30000   // 两次漫游尝试的最小间隔
+#define TUYA_ROAM_NEIGHBOR_TIMEOUT_MS   1000    // 等待邻居报告，超时直接扫描
+#define TUYA_ROAM_SCAN_TIMEOUT_MS       6000
+#define TUYA_ROAM_BTM_TIMEOUT_MS        2000    // 等待AP下发切换请求，超时直接重关联
+#define TUYA_ROAM_HANDOFF_TIMEOUT_MS    3000    // 重关联超时，按普通断线处理
+#define TUYA_ROAM_BLACKLIST_MS          120000  // 切换失败的AP在此时间内不再作为目标
+#define TUYA_ROAM_BLACKLIST_NUM         4
+#define TUYA_ROAM_MAX_NEIGHBORS         8
+
+typedef enum {
+    TUYA_ROAM_IDLE = 0,
+    TUYA_ROAM_WAIT_NEIGHBORS,       // 已请求邻居报告
+    TUYA_ROAM_SCANNING,
+    TUYA_ROAM_WAIT_BTM,             // 已发送BTM查询，等待AP下发切换请求
+    TUYA_ROAM_HANDOFF,              // 正在重关联
+} tuya_roam_state_t;
+
+typedef enum {
+    TUYA_ROAM_ACT_NONE = 0,
+    TUYA_ROAM_ACT_NEIGHBOR_REQ,     // 发送邻居报告请求
+    TUYA_ROAM_ACT_SCAN,             // 扫描同SSID的AP
+    TUYA_ROAM_ACT_BTM_QUERY,        // 发送BTM查询，候选列表见 tuya_roam_format_btm
+    TUYA_ROAM_ACT_REASSOC,          // 直接重关联到 target
+    TUYA_ROAM_ACT_RESTORE,          // 切换失败：恢复原连接配置，按普通断线处理
+} tuya_roam_action_t;
+
+// 邻居报告中的一项
+typedef struct {
+    uint8_t bssid[6];
+    uint32_t bssid_info;
+    uint8_t op_class;
+    uint8_t channel;
+    uint8_t phy_type;
+    uint8_t pref;                   // BSS切换候选优先级（子元素3），pref_set为false时无效
+    bool pref_set;
+} tuya_roam_neighbor_t;
+
+// 扫描结果中的一个AP
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+} tuya_roam_cand_t;
+
+typedef struct {
+    uint8_t bssid[6];
+    int64_t until_ms;
+} tuya_roam_blacklist_t;
+
+typedef struct {
+    tuya_roam_state_t state;
+    int64_t state_ms;               // 进入当前状态的时刻
+    int64_t last_attempt_ms;        // 最近一次开始寻找的时刻，0表示没有
+    int64_t handoff_start_ms;       // 本次切换开始（发出重关联或收到漫游断开）的时刻
+    uint8_t cur_bssid[6];
+    int8_t cur_rssi;
+    bool connected;
+    bool rrm;                       // 当前AP支持11k
+    bool btm;                       // 当前AP支持11v
+    tuya_roam_neighbor_t neighbors[TUYA_ROAM_MAX_NEIGHBORS];
+    uint8_t neighbor_count;
+    tuya_roam_cand_t target;
+    bool has_target;
+    tuya_roam_blacklist_t blacklist[TUYA_ROAM_BLACKLIST_NUM];
+
+    // 统计
+    uint32_t triggers;              // 开始寻找的次数
+    uint32_t neighbor_reports;
+    uint32_t no_candidate;          // 没有满足条件的目标
+    uint32_t btm_queries;
+    uint32_t roams;                 // 成功切换次数（含AP主动引导）
+    uint32_t failures;              // 切换超时
+    iot_latency_stat_t gap;         // 断开旧AP到关联新AP的间隙
+} tuya_roam_t;
+
+void tuya_roam_init(tuya_roam_t* r);
+
+/**
+ * @brief 解析邻居报告元素（不含开头的对话令牌）
+ *
+ * @param ie 元素序列
+ * @param len 长度
+ * @param out 输出数组
+ * @param max 数组容量
+ * @return int 解析出的项数
+ */
+int tuya_roam_parse_neighbors(const uint8_t* ie, size_t len, tuya_roam_neighbor_t* out, int max);
+
+/**
+ * @brief 从扫描结果中选出目标AP
+ *
+ * 排除当前AP、拉黑的AP、AP声明不作为候选的邻居（优先级0）；
+ * 目标须达到 TUYA_ROAM_MIN_RSSI 且比当前强 TUYA_ROAM_MIN_GAIN_DB，
+ * 其余按RSSI加邻居、5GHz加分排序，同分时邻居优先级高者优先
+ *
+ * @return int 目标在cands中的下标，-1表示没有
+ */
+int tuya_roam_select(const tuya_roam_t* r, const tuya_roam_cand_t* cands, int n, int64_t now_ms);
+
+/**
+ * @brief 关联到AP（首次连接或漫游完成）
+ *
+ * @param r 漫游状态
+ * @param bssid 当前AP
+ * @param rrm 当前AP是否支持11k
+ * @param btm 当前AP是否支持11v
+ * @param now_ms 当前时刻
+ * @return bool true表示这是一次漫游切换的完成，IP和MQTT连接应保持
+ */
+bool tuya_roam_on_connected(tuya_roam_t* r, const uint8_t bssid[6], bool rrm, bool btm, int64_t now_ms);
+
+/**
+ * @brief 与AP断开
+ *
+ * @param roaming 断开原因是漫游（驱动或AP引导的重关联）
+ * @return bool true表示属于漫游切换，不要清除IP和MQTT状态，等待关联完成
+ */
+bool tuya_roam_on_disconnect(tuya_roam_t* r, bool roaming, int64_t now_ms);
+
+/**
+ * @brief 当前AP信号低于门限
+ */
+tuya_roam_action_t tuya_roam_on_rssi_low(tuya_roam_t* r, int8_t rssi, int64_t now_ms);
+
+/**
+ * @brief 收到邻居报告
+ */
+tuya_roam_action_t tuya_roam_on_neighbors(tuya_roam_t* r, const uint8_t* ie, size_t len, int64_t now_ms);
+
+/**
+ * @brief 扫描完成，选出目标
+ */
+tuya_roam_action_t tuya_roam_on_scan(tuya_roam_t* r, const tuya_roam_cand_t* cands, int n, int64_t now_ms);
+
+/**
+ * @brief 检查各阶段超时
+ */
+tuya_roam_action_t tuya_roam_tick(tuya_roam_t* r, int64_t now_ms);
+
+/**
+ * @brief 生成BTM查询的候选列表（wpa_supplicant的neighbor=格式，空格分隔），目标排在首位
+ *
+ * @return int 输出长度，-1表示缓冲区不足
+ */
+int tuya_roam_format_btm(const tuya_roam_t* r, char* buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_ROAM_H */
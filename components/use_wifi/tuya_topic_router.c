@@ -0,0 +1,215 @@
+#include "tuya_topic_router.h"
+#include <string.h>
+
+static bool seg_is(const tuya_trie_node_t* node, char wildcard)
+{
+    return node->seg_len == 1 && node->seg[0] == wildcard;
+}
+
+static bool node_is_wildcard(const tuya_trie_node_t* node)
+{
+    return seg_is(node, '+') || seg_is(node, '#');
+}
+
+/* 在parent下查找分段，不存在则新建；精确分段插在链表头，通配符追加在末尾 */
+static int child_get_or_add(tuya_router_t* r, uint8_t parent, const char* seg, uint8_t len)
+{
+    for (uint8_t c = r->nodes[parent].child; c; c = r->nodes[c].sibling) {
+        if (r->nodes[c].seg_len == len && memcmp(r->nodes[c].seg, seg, len) == 0) {
+            return c;
+        }
+    }
+    if (r->node_count >= TUYA_ROUTER_MAX_NODES) {
+        return -1;
+    }
+
+    uint8_t idx = r->node_count++;
+    tuya_trie_node_t* node = &r->nodes[idx];
+    node->seg = seg;
+    node->seg_len = len;
+    node->child = 0;
+    node->sibling = 0;
+    node->route = -1;
+
+    if (!node_is_wildcard(node)) {
+        node->sibling = r->nodes[parent].child;
+        r->nodes[parent].child = idx;
+    } else {
+        uint8_t* link = &r->nodes[parent].child;
+        while (*link) {
+            link = &r->nodes[*link].sibling;
+        }
+        *link = idx;
+    }
+    return idx;
+}
+
+/* 按分段走到过滤器的末节点，create为true时补齐缺失节点 */
+static int walk_filter(tuya_router_t* r, const char* filter, bool create)
+{
+    uint8_t node = 0;
+    const char* p = filter;
+    while (1) {
+        const char* slash = strchr(p, '/');
+        size_t len = slash ? (size_t)(slash - p) : strlen(p);
+        int next = -1;
+        if (create) {
+            next = child_get_or_add(r, node, p, (uint8_t)len);
+        } else {
+            for (uint8_t c = r->nodes[node].child; c; c = r->nodes[c].sibling) {
+                if (r->nodes[c].seg_len == len && memcmp(r->nodes[c].seg, p, len) == 0) {
+                    next = c;
+                    break;
+                }
+            }
+        }
+        if (next < 0) {
+            return -1;
+        }
+        node = (uint8_t)next;
+        if (!slash) {
+            return node;
+        }
+        p = slash + 1;
+    }
+}
+
+/* '#' 只能是最后一段，'+' 和 '#' 必须独占一段 */
+static bool filter_valid(const char* filter)
+{
+    size_t len = strnlen(filter, TUYA_ROUTER_FILTER_LEN);
+    if (len == 0 || len >= TUYA_ROUTER_FILTER_LEN) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (filter[i] != '+' && filter[i] != '#') {
+            continue;
+        }
+        bool alone = (i == 0 || filter[i - 1] == '/') && (i + 1 == len || filter[i + 1] == '/');
+        if (!alone || (filter[i] == '#' && i + 1 != len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void tuya_router_init(tuya_router_t* router)
+{
+    memset(router, 0, sizeof(*router));
+    router->nodes[0].route = -1;
+    router->node_count = 1;
+}
+
+int tuya_router_add(tuya_router_t* router, const char* filter, int qos, bool subscribe,
+                    tuya_topic_handler_t handler, void* ctx)
+{
+    if (!filter || !handler || !filter_valid(filter)) {
+        return -1;
+    }
+
+    // 已注册（或注销过）的过滤器复用原来的路由，分段仍指向原路由的filter
+    int node = walk_filter(router, filter, false);
+    int idx = node >= 0 ? router->nodes[node].route : -1;
+    if (idx < 0) {
+        if (router->route_count >= TUYA_ROUTER_MAX_ROUTES) {
+            return -1;
+        }
+        idx = router->route_count;
+        strcpy(router->routes[idx].filter, filter);
+        node = walk_filter(router, router->routes[idx].filter, true);
+        if (node < 0) {
+            return -1;
+        }
+        router->route_count++;
+        router->nodes[node].route = (int8_t)idx;
+    }
+
+    tuya_route_t* route = &router->routes[idx];
+    route->handler = handler;
+    route->ctx = ctx;
+    route->qos = (uint8_t)qos;
+    route->subscribe = subscribe;
+    return idx;
+}
+
+int tuya_router_remove(tuya_router_t* router, const char* filter)
+{
+    if (!filter) {
+        return -1;
+    }
+    int node = walk_filter(router, filter, false);
+    int idx = node >= 0 ? router->nodes[node].route : -1;
+    if (idx < 0 || !router->routes[idx].handler) {
+        return -1;
+    }
+    router->routes[idx].handler = NULL;
+    return idx;
+}
+
+static bool route_active(const tuya_router_t* r, int idx)
+{
+    return idx >= 0 && r->routes[idx].handler != NULL;
+}
+
+/* 主题在node处结束：取node自身的路由，否则取其下的 '#'（按MQTT规定 "a/#" 也匹配 "a"） */
+static int end_route(const tuya_router_t* r, uint8_t node)
+{
+    if (route_active(r, r->nodes[node].route)) {
+        return r->nodes[node].route;
+    }
+    for (uint8_t c = r->nodes[node].child; c; c = r->nodes[c].sibling) {
+        if (seg_is(&r->nodes[c], '#') && route_active(r, r->nodes[c].route)) {
+            return r->nodes[c].route;
+        }
+    }
+    return -1;
+}
+
+/* 从node的子节点开始匹配 [p, end) 中的剩余主题，先试精确分段，失败再回溯到通配符 */
+static int match_from(const tuya_router_t* r, uint8_t node, const char* p, const char* end)
+{
+    const char* slash = memchr(p, '/', (size_t)(end - p));
+    size_t len = (size_t)((slash ? slash : end) - p);
+
+    for (uint8_t c = r->nodes[node].child; c; c = r->nodes[c].sibling) {
+        const tuya_trie_node_t* child = &r->nodes[c];
+        if (seg_is(child, '#')) {
+            if (route_active(r, child->route)) {
+                return child->route;
+            }
+            continue;
+        }
+        if (!seg_is(child, '+') && (child->seg_len != len || memcmp(child->seg, p, len) != 0)) {
+            continue;
+        }
+        int idx = slash ? match_from(r, c, slash + 1, end) : end_route(r, c);
+        if (route_active(r, idx)) {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+int tuya_router_match(const tuya_router_t* router, const char* topic, int topic_len)
+{
+    if (!topic || topic_len <= 0) {
+        return -1;
+    }
+    return match_from(router, 0, topic, topic + topic_len);
+}
+
+bool tuya_router_dispatch(tuya_router_t* router, const char* topic, int topic_len,
+                          const char* data, int data_len)
+{
+    int idx = tuya_router_match(router, topic, topic_len);
+    if (idx >= 0) {
+        tuya_route_t* route = &router->routes[idx];
+        route->hits++;
+        if (route->handler(topic, topic_len, data, data_len, route->ctx)) {
+            router->dispatched++;
+            return true;
+        }
+    }
+    router->unmatched++;
+    return false;
+}
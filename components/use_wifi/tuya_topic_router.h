@@ -0,0 +1,95 @@
+/*
+ * MQTT主题路由：注册时把主题过滤器按 '/' 分段编入前缀树，收到消息时逐段查找处理函数
+ * 支持MQTT通配符 '+'（单层）和 '#'（剩余所有层，含父层本身："a/#" 匹配 "a"），精确匹配优先于通配符
+ * 纯C实现，不依赖ESP-IDF，调用方负责加锁
+ */
+#ifndef TUYA_TOPIC_ROUTER_H
+#define TUYA_TOPIC_ROUTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUYA_ROUTER_MAX_ROUTES      16
+#define TUYA_ROUTER_MAX_NODES       64      // 前缀树节点数（各路由共享公共前缀）
+#define TUYA_ROUTER_FILTER_LEN      80
+
+// 返回true表示消息已处理
+typedef bool (*tuya_topic_handler_t)(const char* topic, int topic_len,
+                                     const char* data, int data_len, void* ctx);
+
+typedef struct {
+    char filter[TUYA_ROUTER_FILTER_LEN];    // 前缀树节点的分段指向这里，注册后不再移动
+    tuya_topic_handler_t handler;           // NULL表示已注销
+    void* ctx;
+    uint8_t qos;
+    bool subscribe;                         // 连接后是否订阅该过滤器
+    uint32_t hits;
+} tuya_route_t;
+
+typedef struct {
+    const char* seg;
+    uint8_t seg_len;
+    uint8_t child;                          // 第一个子节点下标，0表示无（0号为根节点）
+    uint8_t sibling;                        // 下一个兄弟节点，精确分段在前、通配符在后
+    int8_t route;                           // 在此结束的路由下标，-1表示无
+} tuya_trie_node_t;
+
+typedef struct {
+    tuya_route_t routes[TUYA_ROUTER_MAX_ROUTES];
+    tuya_trie_node_t nodes[TUYA_ROUTER_MAX_NODES];
+    uint8_t route_count;
+    uint8_t node_count;
+    uint32_t dispatched;                    // 命中处理函数的消息数
+    uint32_t unmatched;                     // 无路由或处理函数未处理的消息数
+} tuya_router_t;
+
+/**
+ * @brief 初始化路由表
+ */
+void tuya_router_init(tuya_router_t* router);
+
+/**
+ * @brief 注册主题处理函数，同一过滤器重复注册时替换处理函数
+ *
+ * @param router 路由表
+ * @param filter 主题过滤器，如 "tylink/<id>/thing/property/set"、"tylink/+/thing/property/set"
+ * @param qos 订阅使用的服务质量等级
+ * @param subscribe 是否由连接流程订阅；为false时仅路由，订阅由调用方负责
+ * @param handler 处理函数
+ * @param ctx 处理函数参数
+ * @return int 路由下标，-1表示参数错误或路由表已满
+ */
+int tuya_router_add(tuya_router_t* router, const char* filter, int qos, bool subscribe,
+                    tuya_topic_handler_t handler, void* ctx);
+
+/**
+ * @brief 注销主题处理函数（保留前缀树节点，之后可重新注册）
+ *
+ * @return int 被注销的路由下标，-1表示未注册
+ */
+int tuya_router_remove(tuya_router_t* router, const char* filter);
+
+/**
+ * @brief 查找主题对应的路由
+ *
+ * @return int 路由下标，-1表示无匹配
+ */
+int tuya_router_match(const tuya_router_t* router, const char* topic, int topic_len);
+
+/**
+ * @brief 查找并调用处理函数
+ *
+ * @return true 消息已处理
+ */
+bool tuya_router_dispatch(tuya_router_t* router, const char* topic, int topic_len,
+                          const char* data, int data_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TUYA_TOPIC_ROUTER_H */
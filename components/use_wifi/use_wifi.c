@@ -7,18 +7,49 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "lwip/err.h"
 #include "lwip/sys.h"
 #include "esp_sntp.h"
 #include "mqtt_client.h"
 #include "mbedtls/md.h"
+#include "mbedtls/base64.h"
 #include "cjson.h"
 #include "common.h"
+#include "iot_metrics.h"
+#include "iot_sampler.h"
+#include "iot_static.h"
+#include "iot_trace.h"
+#include "iot_rule.h"
+#include "tuya_internal.h"
+#include "tuya_ota.h"
+#include "tuya_liveness.h"
+#include "tuya_backoff.h"
+#include "tuya_topic_router.h"
+#include "tuya_outbox.h"
+#include "tuya_bridge.h"
+#include "tuya_desired.h"
+#include "tuya_endpoint.h"
+#include "tuya_rate.h"
+#include "tuya_roam.h"
+#include "tuya_cmd.h"
+#include "esp_cpu.h"
+#include "esp_random.h"
+#include "esp_mac.h"
+#if CONFIG_ESP_WIFI_RRM_SUPPORT
+#include "esp_rrm.h"
+#endif
+#if CONFIG_ESP_WIFI_WNM_SUPPORT
+#include "esp_wnm.h"
+#endif
 
 /* 静态认证信息（备用，当前使用动态生成） */
 
@@ -58,6 +89,182 @@ static esp_mqtt_client_handle_t mqtt_client = NULL;
 static int s_retry_num = 0;
 static bool is_initialized = false;
 static bool mqtt_client_created = false;
+static esp_mqtt_client_config_t *s_mqtt_cfg = NULL;
+static char s_mqtt_username[128];      // 登录凭据含时间戳，每次连接前重新生成
+static char s_mqtt_password[128];
+
+/* 连接任务：每次WiFi获得IP后被唤醒，等待SNTP同步，再连接MQTT */
+static TaskHandle_t s_conn_task = NULL;
+static esp_netif_t *s_sta_netif = NULL;
+#define CONN_NOTIFY_START       (1UL << 0)  // WiFi已连接，同步时间后连接MQTT
+#define CONN_NOTIFY_RETRY       (1UL << 1)  // MQTT退避到期，重新选址后重连
+IOT_TASK_MEM(s_conn_task_mem, 4096);
+IOT_TASK_MEM(s_tx_task_mem, 4096);
+IOT_TASK_MEM(s_ack_task_mem, 3072);
+IOT_TASK_MEM(s_cmd_task_mem, 3072);
+IOT_TASK_MEM(s_link_task_mem, 3072);
+
+/*
+ * 停止：各常驻任务检查 s_stopping 后退出循环，挂起等待 use_wifi_stop 删除；
+ * 退避、时间同步和连接等待都等在 WIFI_STOP_BIT 上，停止时立即返回
+ */
+#define WIFI_TASK_NUM           5
+#define WIFI_STOP_TIMEOUT_MS    5000
+#define WIFI_STOP_BIT           (1UL << 5)  // 紧接 common.h 中的事件组位
+static volatile bool s_stopping = false;
+static SemaphoreHandle_t s_task_exit = NULL;    // 每个任务退出循环时给出一次
+static int s_tasks_exited = 0;                  // 停止超时后再次调用 use_wifi_stop 时接着等
+static TaskHandle_t s_tx_task = NULL;
+static TaskHandle_t s_ack_task = NULL;
+static TaskHandle_t s_link_task = NULL;
+static esp_event_handler_instance_t s_wifi_handlers[3];
+
+/* 命令应答快速通道 */
+#define TUYA_ACK_QUEUE_LEN      8       // 待发送应答队列深度
+#define TUYA_MSG_ID_MAX_LEN     TUYA_CMD_MSG_ID_MAX
+
+typedef struct {
+    char msg_id[TUYA_MSG_ID_MAX_LEN];   // 命令的原始msgId
+    uint32_t dp_mask;                   // 受影响的DP
+    int64_t rx_time_us;                 // 收到命令的时刻
+} tuya_ack_item_t;
+
+static QueueHandle_t s_ack_queue = NULL;
+static tuya_ack_stats_t s_ack_stats;     // 由MQTT、命令、应答、发送任务更新，经 s_ack_mux 访问
+static portMUX_TYPE s_ack_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* 下行命令：MQTT任务只解析和暂存，命令任务按执行窗口合并后执行 */
+static tuya_cmd_t s_cmd;
+static portMUX_TYPE s_cmd_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_cmd_task = NULL;
+static tuya_cmd_batch_t s_cmd_batch;    // 只在命令任务中使用
+
+/* 期望属性同步：连上云端后拉取离线期间的期望值并对账 */
+#define TUYA_PROPERTY_SET_QOS   (TUYA_PERSISTENT_SESSION ? 1 : 0)
+
+static tuya_desired_t s_desired;
+static portMUX_TYPE s_desired_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_cloud_apply_task = NULL;  // 正在应用云端下发值的任务，其引起的状态变化不算本地修改
+static const char *const s_dp_codes[IOT_DP_MAX] = {
+#define DP_CODE_ENTRY(name, code, type, field, chr_id, unit) [IOT_DP_##name] = code,
+    IOT_DP_SCHEMA(DP_CODE_ENTRY)
+#undef DP_CODE_ENTRY
+};
+static const iot_dp_type_t s_dp_types[IOT_DP_MAX] = {
+#define DP_TYPE_ENTRY(name, code, type, field, chr_id, unit) [IOT_DP_##name] = type,
+    IOT_DP_SCHEMA(DP_TYPE_ENTRY)
+#undef DP_TYPE_ENTRY
+};
+
+/* 上行发送队列：所有上行消息按优先级由 tuya_tx 任务发送，链路阻塞时过期的遥测只保留最新值 */
+#define TX_INFLIGHT_MAX_BYTES   2048    // esp-mqtt中未确认的数据超过此值时暂停取队列
+#define TX_RETRY_MS             1000
+
+static tuya_outbox_t s_outbox;
+static SemaphoreHandle_t s_tx_lock = NULL;
+static SemaphoreHandle_t s_tx_signal = NULL;    // 有新消息或发送窗口空出
+static iot_latency_stat_t s_tx_wait[TUYA_TX_CLASS_NUM];
+
+/* BLE桥接：MQTT断开且手机订阅了桥接通知时，上行消息经手机转发，同一时刻只有一条等待ACK */
+#define BRIDGE_ACK_TIMEOUT_MS   5000
+#define BRIDGE_MAX_TRIES        3       // 同一seq最多发送次数，之后放回发送队列
+#define BRIDGE_RX_QUEUE_LEN     4
+#define BRIDGE_FRAME_MAX        256
+
+typedef struct {
+    uint16_t len;
+    uint8_t data[BRIDGE_FRAME_MAX];
+} bridge_frame_t;
+
+static const use_wifi_bridge_ops_t *s_bridge = NULL;
+static QueueHandle_t s_bridge_rx_queue = NULL;
+static tuya_bridge_rx_t s_bridge_rx;                // 以下仅发送任务使用
+static tuya_outbox_msg_t s_bridge_inflight;         // 等待手机ACK的消息
+static bool s_bridge_pending = false;
+static uint16_t s_bridge_seq = 0;
+static uint8_t s_bridge_tries = 0;
+static int64_t s_bridge_first_tx_us = 0;
+static int64_t s_bridge_last_tx_us = 0;
+static tuya_bridge_auth_t s_bridge_auth;            // 下行消息签名校验，手机每次订阅通知时重新开始
+static use_wifi_bridge_stats_t s_bridge_stats;
+
+/* 经手机下发的消息只接受这些主题（tylink/<设备或子设备ID>/<后缀>），OTA等一律拒绝 */
+static const char *const s_bridge_down_topics[] = {
+    "thing/property/set",
+    "thing/property/desired/get_response",
+    "device/sub/bind_response",
+};
+
+/* WiFi凭据与配网 */
+#define WIFI_CRED_NVS_NAMESPACE "wifi_cfg"
+#define WIFI_CRED_NVS_KEY       "cred"
+
+static use_wifi_credentials_t s_credentials;
+static use_wifi_status_cb_t s_status_cb = NULL;
+static int64_t s_prov_start_us = 0;     // 本次配网写入时刻，0表示没有进行中的配网
+static iot_latency_stat_t s_prov_stats;
+
+/* 链路保活 */
+#define LIVENESS_NVS_KEY        "keepalive"
+#define LIVENESS_REPORT_PERIOD_MS (3600 * 1000)     // 每小时打印一次上行包统计
+
+static tuya_liveness_t s_liveness;
+static SemaphoreHandle_t s_link_lock = NULL;
+static bool s_transport_error = false;      // 本次断线前是否出现过传输层错误
+
+/* 上报速率控制：按RSSI、PUBACK时延和重发调整上报间隔和打包数，与保活共用 s_link_lock */
+#define MQTT_RETRANSMIT_MS      1000    // esp-mqtt的QoS1重发间隔，用于由PUBACK时延估算重发次数
+#define RATE_RSSI_PERIOD_MS     5000
+#define RATE_INFLIGHT_NUM       8       // 跟踪PUBACK时延的在途消息数，满时覆盖最旧的
+
+typedef struct {
+    int msg_id;                 // 0表示空闲
+    int64_t t_us;               // 交给esp-mqtt的时刻
+} rate_inflight_t;
+
+static tuya_rate_t s_rate;
+static rate_inflight_t s_rate_inflight[RATE_INFLIGHT_NUM];
+static int s_rate_inflight_idx = 0;
+static portMUX_TYPE s_rate_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* 重连退避：大量设备同时掉线后错开重连时间，避免冲击AP和服务端 */
+#define WIFI_BACKOFF_BASE_MS    500
+#define WIFI_BACKOFF_CAP_MS     30000
+#define MQTT_BACKOFF_BASE_MS    1000
+#define MQTT_BACKOFF_CAP_MS     120000
+#define MQTT_BACKOFF_WINDOW_MS  5000    // 恢复后的首次连接在该窗口内随机分散
+
+static tuya_backoff_t s_wifi_backoff;
+static tuya_backoff_t s_mqtt_backoff;
+static esp_timer_handle_t s_wifi_retry_timer = NULL;
+static esp_timer_handle_t s_mqtt_retry_timer = NULL;
+static int64_t s_outage_start_us = 0;       // 本次断线开始时刻，0表示在线
+static iot_latency_stat_t s_recover_stats;
+static uint32_t s_mqtt_connect_attempts = 0;
+static use_wifi_reconnect_stats_t s_reconnect_stats;
+static bool s_reconnect_pending = false;    // 已记录重连前的堆，等待连接成功后记录重连后的堆
+
+/* 漫游：同SSID多AP间信号变弱时提前换AP，切换期间不清除IP和MQTT状态
+ * 事件在默认事件循环中处理，超时在链路保活任务中检查，共用 s_roam_mux */
+#define ROAM_SCAN_MAX_APS       16
+#define ROAM_HOME_DWELL_MS      30      // 扫描时每个信道之间回到当前信道的时间，保持收发
+#define ROAM_BTM_LIST_LEN       512
+
+static tuya_roam_t s_roam;
+static portMUX_TYPE s_roam_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool s_roam_scanning = false;         // 正在进行漫游扫描
+static bool s_roam_armed = false;           // 已设置RSSI门限，等待低信号事件
+static bool s_roam_ip_pending = false;      // 漫游刚完成，随后的GOT_IP不重走同步和连接流程
+static bool s_roam_pinned = false;          // 直接重关联时把配置指定到了目标BSSID
+
+/* 下行主题路由：处理函数在MQTT任务中调用，查找时持锁，调用处理函数时不持锁 */
+static tuya_router_t s_router;
+static SemaphoreHandle_t s_router_lock = NULL;
+static uint64_t s_route_total_cycles = 0;
+static uint32_t s_route_max_cycles = 0;
+
+/* 其他组件的MQTT扩展（如网关子设备） */
+static const use_wifi_mqtt_ext_t *s_mqtt_ext = NULL;
 
 /* 内部函数声明 */
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
@@ -65,12 +272,52 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 static esp_err_t mqtt_app_start(void);
 static void initialize_sntp(void);
 static esp_err_t wifi_init_sta(void);
-static esp_err_t tuya_publish_custom_data(const char* data);
+static esp_err_t tx_enqueue(tuya_tx_class_t cls, uint32_t key, const char* topic, const char* data,
+                            int qos, uint8_t flags, int64_t t_origin);
+static esp_err_t queue_property_report(tuya_tx_class_t cls, const char* key, const char* data, uint8_t flags);
+static void tuya_tx_task(void *arg);
 static void generate_tuya_username(char* username, size_t size);
 static void generate_tuya_password(const char* username, char* password, size_t size);
-static esp_err_t parse_iot_command(const char* json_data, int data_len);
-static void sntp_sync_task(void *arg);
-static void mqtt_reconnect_task(void *arg);
+static esp_err_t parse_iot_command(const char* json_data, int data_len, int64_t rx_us);
+static void handle_property_set(const char* data, int data_len);
+static uint32_t stage_property(const char* code, const cJSON* value, int64_t rx_us);
+static void stage_commit(const char* msg_id, uint32_t dp_mask, int64_t rx_us);
+static void desired_request(int64_t outage_start_us);
+static void tuya_ack_task(void *arg);
+static void tuya_cmd_task(void *arg);
+static void router_subscribe_all(esp_mqtt_client_handle_t client);
+static void router_dispatch(const char* topic, int topic_len, const char* data, int data_len);
+static void tuya_conn_task(void *arg);
+static void load_credentials(use_wifi_credentials_t* cred);
+static void build_sta_config(const use_wifi_credentials_t* cred, wifi_config_t* wifi_config);
+static void notify_status(use_wifi_status_t status);
+static void link_note_tx(bool is_report);
+static void rate_track(int msg_id);
+static void rate_on_puback(int msg_id);
+static void rate_on_deleted(int msg_id);
+static void link_apply_keepalive(void);
+static void tuya_link_task(void *arg);
+static void mark_outage(void);
+static void mqtt_schedule_retry(void);
+static void wifi_link_lost(void);
+static void roam_execute(tuya_roam_action_t action);
+static void roam_on_connected(const wifi_event_sta_connected_t* event);
+static bool roam_on_disconnected(const wifi_event_sta_disconnected_t* event);
+static void roam_on_scan_done(void);
+static void roam_tick(void);
+
+/* 等待一段时间，停止时提前返回false */
+static bool wait_unless_stopping(TickType_t ticks)
+{
+    return !(xEventGroupWaitBits(s_wifi_event_group, WIFI_STOP_BIT, pdFALSE, pdFALSE, ticks) & WIFI_STOP_BIT);
+}
+
+/* 任务退出循环后调用：通知 use_wifi_stop，然后挂起，由它删除（静态任务内存须在删除后才能复用） */
+static void task_exit(void)
+{
+    xSemaphoreGive(s_task_exit);
+    vTaskSuspend(NULL);
+}
 
 /* 初始化SNTP时间同步 */
 static void initialize_sntp(void)
@@ -88,12 +335,12 @@ static void initialize_sntp(void)
     esp_sntp_setservername(1, "time.nist.gov");
     esp_sntp_init();
     
-    // 创建SNTP同步任务
-    xTaskCreate(sntp_sync_task, "sntp_sync", 4096, NULL, 5, NULL);
+    // 唤醒连接任务等待同步
+    xTaskNotify(s_conn_task, CONN_NOTIFY_START, eSetBits);
 }
 
-/* SNTP同步任务 */
-static void sntp_sync_task(void *arg)
+/* 等待SNTP同步，返回是否成功 */
+static bool sntp_sync_wait(void)
 {
     time_t now = 0;
     struct tm timeinfo = { 0 };
@@ -108,12 +355,13 @@ static void sntp_sync_task(void *arg)
         EventBits_t bits = xEventGroupGetBits(s_wifi_event_group);
         if (!(bits & WIFI_CONNECTED_BIT)) {
             ESP_LOGW(TAG, "WiFi断开, 取消时间同步");
-            vTaskDelete(NULL);
-            return;
+            return false;
         }
         
         ESP_LOGI(TAG, "等待系统时间同步... (%d/%d)", retry, retry_count);
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
+        if (!wait_unless_stopping(pdMS_TO_TICKS(2000))) {
+            return false;
+        }
     }
     
     time(&now);
@@ -129,9 +377,8 @@ static void sntp_sync_task(void *arg)
         
         // 设置SNTP同步成功标志位
         xEventGroupSetBits(s_wifi_event_group, SNTP_SYNCED_BIT);
-        
-        // 创建MQTT重连任务
-        xTaskCreate(mqtt_reconnect_task, "mqtt_reconnect", 4096, NULL, 5, NULL);
+        notify_status(USE_WIFI_STATUS_SNTP_SYNCED);
+        return true;
     } else {
         ESP_LOGE(TAG, "时间同步失败! (连续失败 %d 次)", ++sntp_fail_count);
         
@@ -145,40 +392,271 @@ static void sntp_sync_task(void *arg)
             // 不设置SNTP_SYNCED_BIT，让系统在下次WiFi重连时重试
         }
     }
-    
-    // 任务完成，删除自己
-    vTaskDelete(NULL);
+    return false;
 }
 
 /* WiFi事件处理器 */
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
+    IOT_TRACE_BEGIN("wifi_event");
+    IOT_TRACE_INSTANT(event_base == WIFI_EVENT ? "wifi_event_id" : "ip_event_id", (uint16_t)event_id);
     // 开始连接WiFi
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
+        notify_status(USE_WIFI_STATUS_CONNECTING);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        roam_on_connected((const wifi_event_sta_connected_t*)event_data);
     // wifi连接失败
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        // WiFi断开时清理所有连接状态
-        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | MQTT_CONNECTED_BIT | SNTP_SYNCED_BIT);
-        
-        if (s_retry_num < WIFI_MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "重试连接WiFi: 第%d次", s_retry_num);
-        } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-            ESP_LOGE(TAG, "WiFi连接失败: 已达到最大重试次数 rebooting...");
-            esp_restart();
+        if (!roam_on_disconnected((const wifi_event_sta_disconnected_t*)event_data)) {
+            wifi_link_lost();
+        }
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_BSS_RSSI_LOW) {
+        const wifi_event_bss_rssi_low_t* event = (const wifi_event_bss_rssi_low_t*)event_data;
+        s_roam_armed = false;
+        portENTER_CRITICAL(&s_roam_mux);
+        tuya_roam_action_t action = tuya_roam_on_rssi_low(&s_roam, (int8_t)event->rssi, esp_timer_get_time() / 1000);
+        portEXIT_CRITICAL(&s_roam_mux);
+        if (action != TUYA_ROAM_ACT_NONE) {
+            ESP_LOGI(TAG, "信号减弱 (%ld dBm), 寻找更好的AP", (long)event->rssi);
+        }
+        roam_execute(action);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_NEIGHBOR_REP) {
+        const wifi_event_neighbor_report_t* event = (const wifi_event_neighbor_report_t*)event_data;
+        tuya_roam_action_t action = TUYA_ROAM_ACT_NONE;
+        if (event->report_len > 1) {
+            // 首字节为对话令牌
+            portENTER_CRITICAL(&s_roam_mux);
+            action = tuya_roam_on_neighbors(&s_roam, event->report + 1, event->report_len - 1,
+                                            esp_timer_get_time() / 1000);
+            portEXIT_CRITICAL(&s_roam_mux);
         }
+        roam_execute(action);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE) {
+        roam_on_scan_done();
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-        ESP_LOGI(TAG, "WiFi连接成功: IP地址:" IPSTR, IP2STR(&event->ip_info.ip));
+        bool roamed = s_roam_ip_pending && !event->ip_changed;
+        s_roam_ip_pending = false;
+        if (roamed) {
+            // 漫游后地址未变，TCP连接仍然有效，不重新同步时间和连接MQTT
+            ESP_LOGI(TAG, "漫游后IP地址不变: " IPSTR, IP2STR(&event->ip_info.ip));
+            xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        } else {
+            ESP_LOGI(TAG, "WiFi连接成功: IP地址:" IPSTR, IP2STR(&event->ip_info.ip));
+            s_retry_num = 0;
+            tuya_backoff_reset(&s_wifi_backoff);
+            xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+            notify_status(USE_WIFI_STATUS_GOT_IP);
+            // WiFi连接成功后进行时间同步
+            ESP_LOGI(TAG, "WiFi连接成功, 开始时间同步...");
+            initialize_sntp();
+            // 注意：MQTT连接现在由SNTP同步完成后自动触发
+        }
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_GOT_IP6) {
+        ip_event_got_ip6_t* event = (ip_event_got_ip6_t*) event_data;
+        ESP_LOGI(TAG, "获得IPv6地址: " IPV6STR, IPV62STR(event->ip6_info.ip));
+    }
+    IOT_TRACE_END("wifi_event");
+}
+
+/* 与AP断开（不是漫游）：清理连接状态，按退避重连，重试次数用完时重启 */
+static void wifi_link_lost(void)
+{
+    // WiFi断开时清理所有连接状态
+    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | MQTT_CONNECTED_BIT | SNTP_SYNCED_BIT);
+    
+    notify_status(USE_WIFI_STATUS_DISCONNECTED);
+
+    mark_outage();
+    if (s_retry_num < WIFI_MAXIMUM_RETRY) {
+        uint32_t delay_ms = tuya_backoff_next(&s_wifi_backoff);
+        esp_timer_stop(s_wifi_retry_timer);
+        esp_timer_start_once(s_wifi_retry_timer, (uint64_t)delay_ms * 1000);
+        s_retry_num++;
+        ESP_LOGI(TAG, "%lu ms后重试连接WiFi: 第%d次", (unsigned long)delay_ms, s_retry_num);
+    } else if (s_bridge && s_bridge->ready()) {
+        // 手机在转发上行数据，重启会丢失发送队列，继续按退避间隔重试
         s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-        // WiFi连接成功后进行时间同步
-        ESP_LOGI(TAG, "WiFi连接成功, 开始时间同步...");
-        initialize_sntp();
-        // 注意：MQTT连接现在由SNTP同步完成后自动触发
+        uint32_t delay_ms = tuya_backoff_next(&s_wifi_backoff);
+        esp_timer_stop(s_wifi_retry_timer);
+        esp_timer_start_once(s_wifi_retry_timer, (uint64_t)delay_ms * 1000);
+        ESP_LOGW(TAG, "WiFi重试次数已满, BLE桥接中, 不重启");
+    } else {
+        xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+        ESP_LOGE(TAG, "WiFi连接失败: 已达到最大重试次数 rebooting...");
+        esp_restart();
+    }
+}
+
+/* 执行漫游状态机给出的动作 */
+static void roam_execute(tuya_roam_action_t action)
+{
+    switch (action) {
+    case TUYA_ROAM_ACT_NEIGHBOR_REQ:
+#if CONFIG_ESP_WIFI_RRM_SUPPORT
+        if (esp_rrm_send_neighbor_report_request() != 0) {
+            ESP_LOGW(TAG, "邻居报告请求发送失败, 超时后直接扫描");
+        }
+#endif
+        break;
+
+    case TUYA_ROAM_ACT_SCAN: {
+        wifi_scan_config_t scan_cfg = {
+            .ssid = (uint8_t*)s_credentials.ssid,
+            .show_hidden = false,
+            .home_chan_dwell_time = ROAM_HOME_DWELL_MS,
+        };
+        s_roam_scanning = esp_wifi_scan_start(&scan_cfg, false) == ESP_OK;
+        if (!s_roam_scanning) {
+            ESP_LOGW(TAG, "漫游扫描启动失败");
+        }
+        break;
+    }
+
+    case TUYA_ROAM_ACT_BTM_QUERY: {
+#if CONFIG_ESP_WIFI_WNM_SUPPORT
+        static char list[ROAM_BTM_LIST_LEN];    // 只在事件任务中使用
+        portENTER_CRITICAL(&s_roam_mux);
+        int len = tuya_roam_format_btm(&s_roam, list, sizeof(list));
+        portEXIT_CRITICAL(&s_roam_mux);
+        if (len > 0 && esp_wnm_send_bss_transition_mgmt_query(REASON_RSSI, list, 1) == 0) {
+            ESP_LOGI(TAG, "已发送BSS切换查询: %s", list);
+        } else {
+            ESP_LOGW(TAG, "BSS切换查询发送失败, 超时后直接重关联");
+        }
+#endif
+        break;
+    }
+
+    case TUYA_ROAM_ACT_REASSOC: {
+        // 在当前配置上指定目标AP，断开事件带漫游原因，IP和MQTT保持
+        wifi_config_t wifi_config;
+        esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+        portENTER_CRITICAL(&s_roam_mux);
+        memcpy(wifi_config.sta.bssid, s_roam.target.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = s_roam.target.channel;
+        int8_t rssi = s_roam.target.rssi;
+        portEXIT_CRITICAL(&s_roam_mux);
+        wifi_config.sta.bssid_set = true;
+        s_roam_pinned = true;
+        ESP_LOGI(TAG, "漫游到 " MACSTR " (信道 %u, %d dBm)", MAC2STR(wifi_config.sta.bssid),
+                 wifi_config.sta.channel, rssi);
+        if (esp_wifi_set_config(WIFI_IF_STA, &wifi_config) == ESP_OK) {
+            esp_wifi_connect();
+        }
+        break;
+    }
+
+    case TUYA_ROAM_ACT_RESTORE:
+        ESP_LOGW(TAG, "漫游切换超时, 按断线重连");
+        if (s_roam_pinned) {
+            wifi_config_t wifi_config;
+            build_sta_config(&s_credentials, &wifi_config);
+            esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+            s_roam_pinned = false;
+        }
+        s_roam_ip_pending = false;
+        wifi_link_lost();
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void roam_on_connected(const wifi_event_sta_connected_t* event)
+{
+    bool rrm = false;
+    bool btm = false;
+#if CONFIG_ESP_WIFI_RRM_SUPPORT
+    rrm = esp_rrm_is_rrm_supported_connection();
+#endif
+#if CONFIG_ESP_WIFI_WNM_SUPPORT
+    btm = esp_wnm_is_btm_supported_connection();
+#endif
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    portENTER_CRITICAL(&s_roam_mux);
+    bool handoff = tuya_roam_on_connected(&s_roam, event->bssid, rrm, btm, now_ms);
+    uint32_t gap_ms = s_roam.gap.last_us / 1000;
+    portEXIT_CRITICAL(&s_roam_mux);
+
+    s_roam_armed = false;   // 新关联后重新设置RSSI门限
+    if (handoff) {
+        s_roam_ip_pending = true;
+        ESP_LOGI(TAG, "漫游完成: " MACSTR ", 切换间隙 %lu ms", MAC2STR(event->bssid), (unsigned long)gap_ms);
+        return;
+    }
+    // 启用IPv6，路由器通告前缀后得到全局地址，云端有IPv6地址时优先使用
+    esp_netif_create_ip6_linklocal(s_sta_netif);
+}
+
+/* 返回true表示这次断开属于漫游切换 */
+static bool roam_on_disconnected(const wifi_event_sta_disconnected_t* event)
+{
+    portENTER_CRITICAL(&s_roam_mux);
+    bool handoff = tuya_roam_on_disconnect(&s_roam, event->reason == WIFI_REASON_ROAMING,
+                                           esp_timer_get_time() / 1000);
+    portEXIT_CRITICAL(&s_roam_mux);
+    if (handoff) {
+        ESP_LOGI(TAG, "漫游切换中, 保持IP和MQTT连接");
+        return true;
+    }
+
+    // 直接重关联时指定过目标AP，恢复为按SSID连接
+    if (s_roam_pinned) {
+        wifi_config_t wifi_config;
+        build_sta_config(&s_credentials, &wifi_config);
+        esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+        s_roam_pinned = false;
+    }
+    s_roam_scanning = false;
+    s_roam_ip_pending = false;
+    s_roam_armed = false;
+    return false;
+}
+
+static void roam_on_scan_done(void)
+{
+    if (!s_roam_scanning) {
+        return;
+    }
+    s_roam_scanning = false;
+
+    static wifi_ap_record_t records[ROAM_SCAN_MAX_APS];  // 只在事件任务中使用
+    static tuya_roam_cand_t cands[ROAM_SCAN_MAX_APS];
+    uint16_t num = ROAM_SCAN_MAX_APS;
+    if (esp_wifi_scan_get_ap_records(&num, records) != ESP_OK) {
+        num = 0;
+    }
+    for (int i = 0; i < num; i++) {
+        memcpy(cands[i].bssid, records[i].bssid, sizeof(cands[i].bssid));
+        cands[i].channel = records[i].primary;
+        cands[i].rssi = records[i].rssi;
+    }
+
+    portENTER_CRITICAL(&s_roam_mux);
+    tuya_roam_action_t action = tuya_roam_on_scan(&s_roam, cands, num, esp_timer_get_time() / 1000);
+    portEXIT_CRITICAL(&s_roam_mux);
+    if (action == TUYA_ROAM_ACT_NONE) {
+        ESP_LOGI(TAG, "扫描到 %u 个AP, 没有明显更好的", num);
+    }
+    roam_execute(action);
+}
+
+/* 检查漫游各阶段超时；空闲时重新设置RSSI门限（低信号事件每次设置只触发一次） */
+static void roam_tick(void)
+{
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    portENTER_CRITICAL(&s_roam_mux);
+    tuya_roam_action_t action = tuya_roam_tick(&s_roam, now_ms);
+    bool can_arm = s_roam.connected && s_roam.state == TUYA_ROAM_IDLE &&
+                   (s_roam.last_attempt_ms == 0 || now_ms - s_roam.last_attempt_ms >= TUYA_ROAM_COOLDOWN_MS);
+    portEXIT_CRITICAL(&s_roam_mux);
+
+    roam_execute(action);
+    if (can_arm && !s_roam_armed && esp_wifi_set_rssi_threshold(TUYA_ROAM_RSSI_TRIGGER) == ESP_OK) {
+        s_roam_armed = true;
     }
 }
 
@@ -187,39 +665,95 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 {
     esp_mqtt_event_handle_t event = event_data;
     esp_mqtt_client_handle_t client = event->client;
+    IOT_TRACE_BEGIN("mqtt_event");
+    IOT_TRACE_INSTANT("mqtt_event_id", (uint16_t)event_id);
     
     switch ((esp_mqtt_event_id_t)event_id) {
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(MQTT_TAG, "MQTT连接成功");
         xEventGroupSetBits(s_wifi_event_group, MQTT_CONNECTED_BIT);
-        
-        // 订阅涂鸦设备命令主题
-        char mc_cli_data_publish_topic[128] = {0};      // 发布主题用于发送控制消息
-        char mc_cli_data_subscribe_topic[128] = {0};    // 订阅主题用于接收平台下发的消息
+        xSemaphoreGive(s_tx_signal);    // 唤醒发送任务，从桥接切回MQTT
 
-        snprintf(mc_cli_data_subscribe_topic, sizeof(mc_cli_data_subscribe_topic), "tylink/%s/thing/property/set", TUYA_DEVICE_ID);
-        snprintf(mc_cli_data_publish_topic, sizeof(mc_cli_data_publish_topic), "tylink/%s/thing/property/report", TUYA_DEVICE_ID);
+        // 统计从配网写入到MQTT连接成功的耗时
+        if (s_prov_start_us > 0) {
+            uint32_t prov_us = (uint32_t)(esp_timer_get_time() - s_prov_start_us);
+            iot_latency_record(&s_prov_stats, prov_us);
+            s_prov_start_us = 0;
+            ESP_LOGI(MQTT_TAG, "配网到MQTT连接耗时 %lu ms", (unsigned long)(prov_us / 1000));
+        }
+        notify_status(USE_WIFI_STATUS_MQTT_CONNECTED);
 
-        printf("%s\n", mc_cli_data_subscribe_topic);
-        printf("%s\n", mc_cli_data_publish_topic);
+        // 统计从断线到重新连上云端的恢复时间
+        tuya_endpoint_report(true);
+        tuya_backoff_reset(&s_mqtt_backoff);
+        int64_t outage_start_us = s_outage_start_us;
+        if (s_outage_start_us > 0) {
+            uint32_t recover_us = (uint32_t)(esp_timer_get_time() - s_outage_start_us);
+            iot_latency_record(&s_recover_stats, recover_us);
+            s_outage_start_us = 0;
+            ESP_LOGI(MQTT_TAG, "断线恢复耗时 %lu ms", (unsigned long)(recover_us / 1000));
+        }
+        if (s_reconnect_pending) {
+            s_reconnect_pending = false;
+            s_reconnect_stats.free_after = esp_get_free_heap_size();
+            s_reconnect_stats.min_after = esp_get_minimum_free_heap_size();
+            ESP_LOGI(MQTT_TAG, "重连后空闲堆 %lu -> %lu, 最小 %lu -> %lu (复用 %lu 次, 重建 %lu 次)",
+                     (unsigned long)s_reconnect_stats.free_before, (unsigned long)s_reconnect_stats.free_after,
+                     (unsigned long)s_reconnect_stats.min_before, (unsigned long)s_reconnect_stats.min_after,
+                     (unsigned long)s_reconnect_stats.reuses, (unsigned long)s_reconnect_stats.rebuilds);
+        }
 
+        s_transport_error = false;
+        xSemaphoreTake(s_link_lock, portMAX_DELAY);
+        tuya_liveness_on_connect(&s_liveness, tuya_now_ms());
+        xSemaphoreGive(s_link_lock);
+        ESP_LOGI(MQTT_TAG, "keepalive=%u s", s_liveness.keepalive_s);
         
-        int msg_id = esp_mqtt_client_subscribe(client, mc_cli_data_subscribe_topic, 0); // 订阅消息 QoS为0
-        ESP_LOGI(MQTT_TAG, "订阅命令主题, msg_id=%d", msg_id);
+        // 一次性订阅所有已注册的下行主题
+        router_subscribe_all(client);
 
+        // 拉取离线期间积压的期望值，排在积压的遥测之前
+        desired_request(outage_start_us);
 
         // 发送设备在线状态
         char online_msg[] = "{\"properties\":{\"online\":true}}";
-        tuya_publish_custom_data(online_msg);
+        queue_property_report(TUYA_TX_STATE, "online", online_msg, 0);
+
+        // 能连上云端说明新固件可用，同时上报当前版本
+        tuya_ota_confirm_image();
+        tuya_ota_report_version();
+
+        if (s_mqtt_ext && s_mqtt_ext->on_connected) {
+            s_mqtt_ext->on_connected();
+        }
         break;
         
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(MQTT_TAG, "MQTT断开连接");
         xEventGroupClearBits(s_wifi_event_group, MQTT_CONNECTED_BIT);
         xEventGroupSetBits(s_wifi_event_group, MQTT_FAIL_BIT);
-        
-        // 不在这里直接重连MQTT，让WiFi重连流程来处理
-        // 这样可以确保时间同步和连接顺序的正确性
+
+        // WiFi仍连接却出现传输错误，可能是NAT映射在keepalive间隔内过期
+        {
+            bool unexpected = s_transport_error &&
+                              (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT);
+            xSemaphoreTake(s_link_lock, portMAX_DELAY);
+            bool changed = tuya_liveness_on_disconnect(&s_liveness, tuya_now_ms(), unexpected);
+            xSemaphoreGive(s_link_lock);
+            if (changed) {
+                ESP_LOGW(MQTT_TAG, "空闲时连接中断, keepalive回退到 %u s", s_liveness.keepalive_s);
+                link_apply_keepalive();
+            }
+        }
+
+        // 本次选用的地址没能连上，下次连接改为竞速
+        tuya_endpoint_report(false);
+
+        // WiFi仍连接时由退避定时器重连MQTT；WiFi断开时等WiFi重连后由连接任务处理
+        mark_outage();
+        if (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT) {
+            mqtt_schedule_retry();
+        }
         break;
         
     case MQTT_EVENT_SUBSCRIBED:
@@ -228,23 +762,27 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         
     case MQTT_EVENT_PUBLISHED:
         ESP_LOGI(MQTT_TAG, "MQTT发布成功, msg_id=%d", event->msg_id);
+        rate_on_puback(event->msg_id);
+        xSemaphoreGive(s_tx_signal);    // 发送窗口空出
+        break;
+
+    case MQTT_EVENT_DELETED:
+        ESP_LOGW(MQTT_TAG, "消息超时未确认, 已丢弃, msg_id=%d", event->msg_id);
+        rate_on_deleted(event->msg_id);
+        xSemaphoreGive(s_tx_signal);
         break;
         
     case MQTT_EVENT_DATA:
-        ESP_LOGI(MQTT_TAG, "收到MQTT命令:");
-        printf("mqtt received topic: %.*s \n", event->topic_len, event->topic);
-        printf("topic data: %.*s\r\n", event->data_len, event->data);
-        
-        // 解析并更新设备状态
-        esp_err_t parse_result = parse_iot_command(event->data, event->data_len);
-        if (parse_result != ESP_OK) {
-            ESP_LOGW(MQTT_TAG, "命令解析失败");
-        }
+        // 高频下发时逐条打印会拖慢MQTT任务，默认不输出
+        ESP_LOGD(MQTT_TAG, "收到 %.*s: %.*s", event->topic_len, event->topic, event->data_len, event->data);
+
+        router_dispatch(event->topic, event->topic_len, event->data, event->data_len);
         break;
         
     case MQTT_EVENT_ERROR:
         ESP_LOGE(MQTT_TAG, "MQTT错误");
         if (event->error_handle->error_type == MQTT_ERROR_TYPE_TCP_TRANSPORT) {
+            s_transport_error = true;
             ESP_LOGE(MQTT_TAG, "传输层错误: %s", strerror(event->error_handle->esp_transport_sock_errno));
         }
         break;
@@ -253,37 +791,107 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         ESP_LOGD(MQTT_TAG, "其他MQTT事件:%d", event->event_id);
         break;
     }
+    IOT_TRACE_END("mqtt_event");
 }
 
-/* MQTT重连任务 */
-static void mqtt_reconnect_task(void *arg)
+/* 生成带当前时间戳的登录凭据 */
+static void mqtt_refresh_credentials(void)
 {
-    // 等待WiFi和SNTP都准备好
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-            WIFI_CONNECTED_BIT | SNTP_SYNCED_BIT,
-            pdFALSE,
-            pdTRUE,  // 等待所有位都设置
-            pdMS_TO_TICKS(30000)); // 30秒超时
+    generate_tuya_username(s_mqtt_username, sizeof(s_mqtt_username));
+    generate_tuya_password(s_mqtt_username, s_mqtt_password, sizeof(s_mqtt_password));
+}
+
+/* 记录重连前的空闲堆，连接成功后在 MQTT_EVENT_CONNECTED 中记录重连后的 */
+static void reconnect_heap_before(void)
+{
+    s_reconnect_stats.free_before = esp_get_free_heap_size();
+    s_reconnect_stats.min_before = esp_get_minimum_free_heap_size();
+    s_reconnect_pending = true;
+}
+
+/* 复用已有客户端重连，只更新登录凭据和云端地址，不重建客户端、其任务和收发缓冲区
+ * 客户端断开后处于等待重连状态（见 mqtt_app_start 中的 reconnect_timeout_ms）才能复用 */
+static esp_err_t mqtt_reuse_client(void)
+{
+    mqtt_refresh_credentials();
+    s_mqtt_cfg->broker.address.uri = tuya_endpoint_pick();
+    esp_mqtt_set_config(mqtt_client, s_mqtt_cfg);
+    s_mqtt_connect_attempts++;
+    esp_err_t ret = esp_mqtt_client_reconnect(mqtt_client);
+    if (ret == ESP_OK) {
+        s_reconnect_stats.reuses++;
+        reconnect_heap_before();
+        ESP_LOGI(MQTT_TAG, "复用MQTT客户端重连, 空闲堆 %lu (最小 %lu)",
+                 (unsigned long)s_reconnect_stats.free_before, (unsigned long)s_reconnect_stats.min_before);
+    }
+    return ret;
+}
+
+/* 按退避间隔安排下一次MQTT重连 */
+static void mqtt_schedule_retry(void)
+{
+    if (s_stopping) {
+        return;
+    }
+    uint32_t delay_ms = tuya_backoff_next(&s_mqtt_backoff);
+    esp_timer_stop(s_mqtt_retry_timer);
+    esp_timer_start_once(s_mqtt_retry_timer, (uint64_t)delay_ms * 1000);
+    ESP_LOGI(MQTT_TAG, "%lu ms后重连MQTT", (unsigned long)delay_ms);
+}
+
+/* 已有客户端无法复用（不处于等待重连状态）时销毁并重新创建 */
+static esp_err_t mqtt_rebuild_client(void)
+{
+    if (mqtt_client) {
+        s_reconnect_stats.rebuilds++;
+        reconnect_heap_before();
+        ESP_LOGW(MQTT_TAG, "MQTT客户端无法复用, 重新创建, 空闲堆 %lu (最小 %lu)",
+                 (unsigned long)s_reconnect_stats.free_before, (unsigned long)s_reconnect_stats.min_before);
+        esp_mqtt_client_stop(mqtt_client);
+        esp_mqtt_client_destroy(mqtt_client);
+        mqtt_client = NULL;
+        mqtt_client_created = false;
+    }
+
+    esp_err_t ret = mqtt_app_start();
+    if (ret != ESP_OK) {
+        ESP_LOGE(MQTT_TAG, "MQTT启动失败: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/* MQTT连接 */
+static void mqtt_connect(void)
+{
+    // 依次等待WiFi和SNTP准备好，共30秒；事件组不能同时等"全部"和"任一"，逐位等待以便停止时立即返回
+    const EventBits_t ready[] = { WIFI_CONNECTED_BIT, SNTP_SYNCED_BIT };
+    const TickType_t timeout = pdMS_TO_TICKS(30000);
+    TickType_t start = xTaskGetTickCount();
+    EventBits_t bits = 0;
+    for (int i = 0; i < 2; i++) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        bits = xEventGroupWaitBits(s_wifi_event_group, ready[i] | WIFI_STOP_BIT, pdFALSE, pdFALSE,
+                                   elapsed < timeout ? timeout - elapsed : 0);
+        if (bits & WIFI_STOP_BIT) {
+            return;
+        }
+    }
     
     // 再次确认WiFi状态（防止在等待期间WiFi断开）
     EventBits_t current_bits = xEventGroupGetBits(s_wifi_event_group);
     if ((bits & WIFI_CONNECTED_BIT) && (bits & SNTP_SYNCED_BIT) && 
         (current_bits & WIFI_CONNECTED_BIT)) {
-        ESP_LOGI(MQTT_TAG, "开始连接MQTT");
-        
-        // 如果MQTT客户端已存在，先断开
-        if (mqtt_client && mqtt_client_created) {
-            esp_mqtt_client_stop(mqtt_client);
-            esp_mqtt_client_destroy(mqtt_client);
-            mqtt_client = NULL;
-            mqtt_client_created = false;
+        // 网络恢复后各设备随机错开首次连接
+        uint32_t delay_ms = tuya_backoff_next(&s_mqtt_backoff);
+        ESP_LOGI(MQTT_TAG, "%lu ms后开始连接MQTT", (unsigned long)delay_ms);
+        if (!wait_unless_stopping(pdMS_TO_TICKS(delay_ms))) {
+            return;
         }
         
-        // 启动新的MQTT连接
-        esp_err_t ret = mqtt_app_start();
-        if (ret != ESP_OK) {
-            ESP_LOGE(MQTT_TAG, "MQTT启动失败: %s", esp_err_to_name(ret));
+        if (mqtt_client && mqtt_client_created && mqtt_reuse_client() == ESP_OK) {
+            return;
         }
+        mqtt_rebuild_client();
     } else {
         if (!(current_bits & WIFI_CONNECTED_BIT)) {
             ESP_LOGW(MQTT_TAG, "WiFi已断开, 取消连接");
@@ -291,9 +899,32 @@ static void mqtt_reconnect_task(void *arg)
             ESP_LOGW(MQTT_TAG, "等待超时, 取消连接");
         }
     }
-    
-    // 任务完成，删除自己
-    vTaskDelete(NULL);
+}
+
+/* 连接任务常驻，WiFi频繁重连时合并为一次同步和连接 */
+static void tuya_conn_task(void *arg)
+{
+    uint32_t bits;
+    while (!s_stopping) {
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+        if (s_stopping) {
+            break;
+        }
+        if (bits & CONN_NOTIFY_START) {
+            if (sntp_sync_wait()) {
+                mqtt_connect();
+            }
+        } else if ((bits & CONN_NOTIFY_RETRY) && mqtt_client &&
+                   (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT)) {
+            // 复用失败时重建；重建也失败则按退避间隔再试，不能就此停止重连
+            if (mqtt_reuse_client() != ESP_OK && mqtt_rebuild_client() != ESP_OK) {
+                mqtt_schedule_retry();
+            }
+        }
+        // 连接已交给MQTT任务，在这里刷新过期的解析结果，不推迟本次连接
+        tuya_endpoint_refresh();
+    }
+    task_exit();
 }
 
 /* 启动MQTT客户端 */
@@ -304,29 +935,36 @@ static esp_err_t mqtt_app_start(void)
     snprintf(client_id, sizeof(client_id), "tuyalink_%s", TUYA_DEVICE_ID);
 
     // 动态生成用户名和密码
-    static char username[128];
-    static char password[128];
-    generate_tuya_username(username, sizeof(username));
-    generate_tuya_password(username, password, sizeof(password));
+    mqtt_refresh_credentials();
     
     
-    const esp_mqtt_client_config_t mqtt_cfg = {
+    // 保存为静态变量，调整keepalive时以完整配置调用 esp_mqtt_set_config
+    static esp_mqtt_client_config_t mqtt_cfg;
+    mqtt_cfg = (esp_mqtt_client_config_t){
         .broker = {
-            .address.uri = TUYA_MQTT_URL,
+            .address.uri = tuya_endpoint_pick(),   // 缓存或竞速选出的IP地址
             .verification.certificate = (const char *)tuya_cacert_pem,
             .verification.certificate_len = sizeof(tuya_cacert_pem),
+            .verification.common_name = tuya_endpoint_host(),  // 以IP连接时仍按域名校验证书
         },
         .credentials = {
             .client_id = client_id,
-            .username = username,
-            .authentication.password = password,
+            .username = s_mqtt_username,
+            .authentication.password = s_mqtt_password,
         },
         .session = {
-            .keepalive = 60,
-            .disable_clean_session = false,
+            .keepalive = s_liveness.keepalive_s,    // 由保活策略探测得到
+            .disable_clean_session = TUYA_PERSISTENT_SESSION,    // 持久会话下服务端保留断线期间的QoS1命令
+            .message_retransmit_timeout = MQTT_RETRANSMIT_MS,
+        },
+        .network = {
+            // 保留自动重连，断开后客户端停在等待重连状态，退避定时器才能用 esp_mqtt_client_reconnect 复用它；
+            // 等待时间长于最大退避间隔，正常情况下总是由退避定时器先发起重连，避免固定间隔同步重连
+            .reconnect_timeout_ms = 2 * MQTT_BACKOFF_CAP_MS,
         }
     };
 
+    s_mqtt_cfg = &mqtt_cfg;
     mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
     if (mqtt_client == NULL) {
         ESP_LOGE(MQTT_TAG, "MQTT客户端初始化失败");
@@ -336,6 +974,7 @@ static esp_err_t mqtt_app_start(void)
     mqtt_client_created = true;
     esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
     
+    s_mqtt_connect_attempts++;
     esp_err_t ret = esp_mqtt_client_start(mqtt_client);
     if (ret != ESP_OK) {
         ESP_LOGE(MQTT_TAG, "MQTT客户端启动失败");
@@ -350,145 +989,1096 @@ static esp_err_t mqtt_app_start(void)
 /* 初始化WiFi */
 static esp_err_t wifi_init_sta(void)
 {
-    // 创建事件组
-    s_wifi_event_group = xEventGroupCreate();
-    if (!s_wifi_event_group) {
-        ESP_LOGE(TAG, "创建事件组失败");
-        return ESP_FAIL;
-    }
-    
-    // 初始化网络接口
+    // 初始化网络接口；网络协议栈和默认事件循环与其他组件共用，停止时保留，重新启动时已存在
     ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    esp_err_t err = esp_event_loop_create_default();
+    if (err != ESP_ERR_INVALID_STATE) {
+        ESP_ERROR_CHECK(err);
+    }
+    s_sta_netif = esp_netif_create_default_wifi_sta();
 
     // 初始化WiFi
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
-    // 注册WiFi事件处理器
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
+    // 注册WiFi事件处理器，停止时注销
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
                                                         ESP_EVENT_ANY_ID,
                                                         &wifi_event_handler,
                                                         NULL,
-                                                        &instance_any_id));
+                                                        &s_wifi_handlers[0]));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
                                                         IP_EVENT_STA_GOT_IP,
                                                         &wifi_event_handler,
                                                         NULL,
-                                                        &instance_got_ip));
-
-    // 配置WiFi
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .password = WIFI_PASSWORD,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-            .sae_pwe_h2e = WPA3_SAE_PWE_BOTH,
-        },
-    };
+                                                        &s_wifi_handlers[1]));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_GOT_IP6,
+                                                        &wifi_event_handler,
+                                                        NULL,
+                                                        &s_wifi_handlers[2]));
+
+    // 配置WiFi：优先使用配网保存的凭据
+    load_credentials(&s_credentials);
+    wifi_config_t wifi_config;
+    build_sta_config(&s_credentials, &wifi_config);
     
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
 
-    ESP_LOGI(TAG, "WiFi初始化完成, 开始连接到: %s", WIFI_SSID);
+    ESP_LOGI(TAG, "WiFi初始化完成, 开始连接到: %s", s_credentials.ssid);
     return ESP_OK;
 }
 
-/* 发布自定义数据到涂鸦平台 */
-static esp_err_t tuya_publish_custom_data(const char* data)
+/* 从NVS读取配网凭据，没有则使用编译时配置 */
+static void load_credentials(use_wifi_credentials_t* cred)
 {
-    if (!mqtt_client || !data) {
-        return ESP_ERR_INVALID_ARG;
+    nvs_handle_t nvs;
+    size_t len = sizeof(*cred);
+
+    if (nvs_open(WIFI_CRED_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        esp_err_t err = nvs_get_blob(nvs, WIFI_CRED_NVS_KEY, cred, &len);
+        nvs_close(nvs);
+        if (err == ESP_OK && len == sizeof(*cred) && cred->ssid[0] != '\0') {
+            ESP_LOGI(TAG, "使用配网保存的WiFi凭据: %s", cred->ssid);
+            return;
+        }
     }
-    
-    char topic[128];
-    snprintf(topic, sizeof(topic), "tylink/%s/thing/property/report", TUYA_DEVICE_ID);
-    
-    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, data, 0, 1, 0);
-    if (msg_id == -1) {
-        ESP_LOGE(MQTT_TAG, "发布数据失败");
-        return ESP_FAIL;
+
+    memset(cred, 0, sizeof(*cred));
+    strncpy(cred->ssid, WIFI_SSID, sizeof(cred->ssid) - 1);
+    strncpy(cred->password, WIFI_PASSWORD, sizeof(cred->password) - 1);
+}
+
+/* 保存配网凭据到NVS */
+static esp_err_t save_credentials(const use_wifi_credentials_t* cred)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(WIFI_CRED_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
     }
-    
-    ESP_LOGI(MQTT_TAG, "发布数据成功, msg_id=%d", msg_id);
-    return ESP_OK;
+    err = nvs_set_blob(nvs, WIFI_CRED_NVS_KEY, cred, sizeof(*cred));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
 }
 
-/* 生成涂鸦MQTT用户名 */
-static void generate_tuya_username(char* username, size_t size)
+/* 由凭据生成STA配置，已知BSSID和信道时跳过全信道扫描直接连接 */
+static void build_sta_config(const use_wifi_credentials_t* cred, wifi_config_t* wifi_config)
 {
-    time_t now;
-    time(&now);
+    memset(wifi_config, 0, sizeof(*wifi_config));
+    memcpy(wifi_config->sta.ssid, cred->ssid, strnlen(cred->ssid, sizeof(wifi_config->sta.ssid)));
+    memcpy(wifi_config->sta.password, cred->password,
+           strnlen(cred->password, sizeof(wifi_config->sta.password)));
+    wifi_config->sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+    wifi_config->sta.sae_pwe_h2e = WPA3_SAE_PWE_BOTH;
+    wifi_config->sta.rm_enabled = 1;    // 802.11k邻居报告，AP支持时用于漫游
+    wifi_config->sta.btm_enabled = 1;   // 802.11v BSS切换管理
 
-    // username = deviceId|signMethod=hmacSha256,timestamp=xxxx,secureMode=1,accessType=1
-    snprintf(username, size,
-             "%s|signMethod=hmacSha256,timestamp=%ld,secureMode=1,accessType=1",
-             TUYA_DEVICE_ID, (long)now);
+    if (cred->bssid_set) {
+        wifi_config->sta.bssid_set = true;
+        memcpy(wifi_config->sta.bssid, cred->bssid, sizeof(wifi_config->sta.bssid));
+    }
+    if (cred->channel > 0) {
+        wifi_config->sta.channel = cred->channel;
+        wifi_config->sta.scan_method = WIFI_FAST_SCAN;
+    }
 }
 
-/* 生成涂鸦MQTT密码 */
-static void generate_tuya_password(const char* username, char* password, size_t size)
+/* 通知连接进度 */
+static void notify_status(use_wifi_status_t status)
 {
-    char timestamp_str[20] = {0};  
-    const char* timestamp_start = strstr(username, "timestamp=");
-    if (timestamp_start) {
-        timestamp_start += strlen("timestamp="); // 跳过 "timestamp="
-        const char* timestamp_end = strchr(timestamp_start, ',');
-        if (timestamp_end) {
-            size_t len = timestamp_end - timestamp_start;
-            if (len < sizeof(timestamp_str)) {
-                strncpy(timestamp_str, timestamp_start, len);
-                timestamp_str[len] = '\0';
-            }
-        }
+    if (s_status_cb) {
+        s_status_cb(status);
     }
+}
 
-    // 如果没取到时间戳，用当前时间
-    if (strlen(timestamp_str) == 0) {
-        time_t now;
-        time(&now);
-        snprintf(timestamp_str, sizeof(timestamp_str), "%ld", (long)now);
+/* 放入上行发送队列，t_origin为消息产生时刻（esp_timer时钟） */
+static esp_err_t tx_enqueue(tuya_tx_class_t cls, uint32_t key, const char* topic, const char* data,
+                            int qos, uint8_t flags, int64_t t_origin)
+{
+    if (!topic || !data) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_tx_lock) {
+        return ESP_ERR_INVALID_STATE;
     }
 
-    // 生成待签名字符串
-    char content[256];
-    snprintf(content, sizeof(content),
-             "deviceId=%s,timestamp=%s,secureMode=1,accessType=1",
-             TUYA_DEVICE_ID, timestamp_str);
-
-    // HMAC-SHA256 签名
-    unsigned char hmac_result[32];
-    mbedtls_md_context_t ctx;
-    mbedtls_md_init(&ctx);
+    xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+    tuya_outbox_result_t result = tuya_outbox_put(&s_outbox, cls, key, topic, data, qos, flags, t_origin);
+    xSemaphoreGive(s_tx_lock);
 
-    if (mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) == 0) {
-        mbedtls_md_hmac_starts(&ctx, (const unsigned char*)TUYA_DEVICE_SECRET,
-                               strlen(TUYA_DEVICE_SECRET));
-        mbedtls_md_hmac_update(&ctx, (const unsigned char*)content, strlen(content));
-        mbedtls_md_hmac_finish(&ctx, hmac_result);
+    if (result == TUYA_OUTBOX_REJECTED) {
+        ESP_LOGW(MQTT_TAG, "发送队列已满或消息过长, 丢弃: %s", topic);
+        return ESP_ERR_NO_MEM;
     }
-    mbedtls_md_free(&ctx);
-
-    // 转成 hex 字符串
-    if (size > 64) { // 32字节 HMAC -> 64字符 HEX
-        for (int i = 0; i < 32; i++) {
-            sprintf(&password[i * 2], "%02x", hmac_result[i]);
-        }
-        password[64] = '\0'; // 确保字符串结尾
+    if (result == TUYA_OUTBOX_EVICTED) {
+        ESP_LOGW(MQTT_TAG, "发送队列已满, 挤掉一条低优先级消息");
     }
+    xSemaphoreGive(s_tx_signal);
+    return ESP_OK;
+}
 
-    ESP_LOGI(MQTT_TAG, "MQTT密码生成完成");
+/* 属性上报进入发送队列，key非NULL时同一key的未发送上报只保留最新一条 */
+static esp_err_t queue_property_report(tuya_tx_class_t cls, const char* key, const char* data, uint8_t flags)
+{
+    return tx_enqueue(cls, key ? tuya_outbox_key(key) : 0, TUYA_TOPIC("thing/property/report"),
+                      data, 1, flags, esp_timer_get_time());
 }
 
+/* 发布数据到设备命名空间下的主题，同一主题只保留最新一条（如OTA进度） */
+esp_err_t tuya_publish_topic(const char* topic, const char* data, int qos)
+{
+    if (!topic) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return tx_enqueue(TUYA_TX_STATE, tuya_outbox_key(topic), topic, data, qos, 0, esp_timer_get_time());
+}
+
+static bool bridge_ready(void)
+{
+    return s_bridge && s_bridge->ready();
+}
+
+static int bridge_emit(const uint8_t* frame, uint16_t len, void* ctx)
+{
+    if (s_bridge->send(frame, len) != ESP_OK) {
+        return -1;
+    }
+    s_bridge_stats.frames++;
+    return 0;
+}
+
+/* 发送（或重发）等待ACK的消息，seq不变，手机按seq去重 */
+static bool bridge_transmit(void)
+{
+    uint16_t max_frame = s_bridge->max_frame();
+    if (max_frame > BRIDGE_FRAME_MAX) {
+        max_frame = BRIDGE_FRAME_MAX;
+    }
+    s_bridge_stats.max_frame = max_frame;
+    s_bridge_last_tx_us = esp_timer_get_time();
+    s_bridge_tries++;
+    return tuya_bridge_encode(s_bridge_seq, s_bridge_inflight.topic, s_bridge_inflight.data,
+                              s_bridge_inflight.len, max_frame, bridge_emit, NULL) > 0;
+}
+
+/* 未确认的消息放回发送队列，改由MQTT或下一次桥接发送 */
+static void bridge_requeue(void)
+{
+    xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+    tuya_outbox_requeue(&s_outbox, &s_bridge_inflight);
+    xSemaphoreGive(s_tx_lock);
+    s_bridge_pending = false;
+    s_bridge_stats.requeued++;
+}
+
+static void bridge_on_ack(uint16_t seq)
+{
+    if (!s_bridge_pending || seq != s_bridge_seq) {
+        return;     // 重发后迟到的ACK
+    }
+    uint32_t rtt_us = (uint32_t)(esp_timer_get_time() - s_bridge_first_tx_us);
+    s_bridge_pending = false;
+    s_bridge_stats.messages++;
+    s_bridge_stats.bytes_acked += s_bridge_inflight.len;
+    iot_latency_record(&s_bridge_stats.ack_rtt, rtt_us);
+    if (s_bridge_stats.ack_rtt.total_us > 0) {
+        s_bridge_stats.bytes_per_s = (uint32_t)((uint64_t)s_bridge_stats.bytes_acked * 1000000 /
+                                                s_bridge_stats.ack_rtt.total_us);
+    }
+    if (s_bridge_inflight.flags & TUYA_OUTBOX_FLAG_ACK) {
+        portENTER_CRITICAL(&s_ack_mux);
+        iot_latency_record(&s_ack_stats.cmd_to_ack, (uint32_t)(esp_timer_get_time() - s_bridge_inflight.t_origin));
+        portEXIT_CRITICAL(&s_ack_mux);
+    }
+}
+
+/* 开始新的桥接会话：发出新的随机数，此后的下行消息按它签名 */
+static void bridge_start_session(void)
+{
+    uint8_t nonce[TUYA_BRIDGE_NONCE_LEN];
+    uint8_t frame[TUYA_BRIDGE_NONCE_FRAME];
+    esp_fill_random(nonce, sizeof(nonce));
+    uint16_t len = tuya_bridge_auth_start(&s_bridge_auth, nonce, frame);
+    tuya_bridge_rx_reset(&s_bridge_rx);
+    if (s_bridge->send(frame, len) != ESP_OK) {
+        tuya_bridge_auth_stop(&s_bridge_auth);      // 下一轮重试
+    }
+}
+
+/* 手机订阅桥接通知后开始会话，断开则结束会话 */
+static void bridge_session(bool ready)
+{
+    if (ready && !s_bridge_auth.active) {
+        bridge_start_session();
+    } else if (!ready && s_bridge_auth.active) {
+        tuya_bridge_auth_stop(&s_bridge_auth);
+        tuya_bridge_rx_reset(&s_bridge_rx);
+    }
+}
+
+/* 桥接下行主题是否在允许列表中 */
+static bool bridge_topic_allowed(const char* topic, int topic_len)
+{
+    static const char prefix[] = "tylink/";
+    const int prefix_len = sizeof(prefix) - 1;
+    if (topic_len <= prefix_len || memcmp(topic, prefix, prefix_len) != 0) {
+        return false;
+    }
+    const char* id_end = memchr(topic + prefix_len, '/', topic_len - prefix_len);
+    if (!id_end || id_end == topic + prefix_len) {
+        return false;
+    }
+    const char* suffix = id_end + 1;
+    int suffix_len = (int)(topic + topic_len - suffix);
+    for (size_t i = 0; i < sizeof(s_bridge_down_topics) / sizeof(s_bridge_down_topics[0]); i++) {
+        if ((int)strlen(s_bridge_down_topics[i]) == suffix_len &&
+            memcmp(suffix, s_bridge_down_topics[i], suffix_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* 校验并分发一条经手机下发的消息：须带本次会话的签名，且主题在允许列表中 */
+static void bridge_on_message(void)
+{
+    tuya_bridge_auth_result_t auth = tuya_bridge_auth_verify(&s_bridge_auth, &s_bridge_rx);
+    if (auth != TUYA_BRIDGE_AUTH_OK) {
+        s_bridge_stats.rejected++;
+        ESP_LOGW(MQTT_TAG, "BLE桥接下行消息校验失败(%d), 丢弃", auth);
+        return;
+    }
+
+    const char *topic, *data;
+    int topic_len, data_len;
+    if (!tuya_bridge_split(&s_bridge_rx, &topic, &topic_len, &data, &data_len)) {
+        return;
+    }
+    if (!bridge_topic_allowed(topic, topic_len)) {
+        s_bridge_stats.rejected++;
+        ESP_LOGW(MQTT_TAG, "BLE桥接不接受主题: %.*s", topic_len, topic);
+        return;
+    }
+    s_bridge_stats.commands++;
+    ESP_LOGI(MQTT_TAG, "经BLE桥接收到: %.*s", topic_len, topic);
+    router_dispatch(topic, topic_len, data, data_len);
+}
+
+/* 处理手机写入的帧：ACK，或云端下发的消息（校验后走与MQTT相同的主题路由） */
+static void bridge_poll_input(void)
+{
+    bridge_frame_t frame;
+    while (s_bridge_rx_queue && xQueueReceive(s_bridge_rx_queue, &frame, 0) == pdTRUE) {
+        uint16_t seq;
+        switch (tuya_bridge_rx_frame(&s_bridge_rx, frame.data, frame.len, &seq)) {
+        case TUYA_BRIDGE_RX_ACK:
+            bridge_on_ack(seq);
+            break;
+        case TUYA_BRIDGE_RX_MESSAGE:
+            bridge_on_message();
+            break;
+        case TUYA_BRIDGE_RX_HELLO:
+            if (bridge_ready()) {
+                bridge_start_session();
+            }
+            break;
+        case TUYA_BRIDGE_RX_ERROR:
+            ESP_LOGW(MQTT_TAG, "BLE桥接帧错误, seq=%u", seq);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/* 桥接状态机：ACK超时则重发，重发次数用完、MQTT恢复或手机断开则放回队列；空闲时取下一条 */
+static void bridge_service(bool mqtt_up)
+{
+    bool ready = bridge_ready();
+    bridge_session(ready);
+    if (s_bridge_pending &&
+        esp_timer_get_time() - s_bridge_last_tx_us >= (int64_t)BRIDGE_ACK_TIMEOUT_MS * 1000) {
+        if (!mqtt_up && ready && s_bridge_tries < BRIDGE_MAX_TRIES) {
+            s_bridge_stats.retransmits++;
+            if (!bridge_transmit()) {
+                bridge_requeue();
+            }
+        } else {
+            bridge_requeue();
+        }
+    }
+    if (s_bridge_pending || mqtt_up || !ready) {
+        return;
+    }
+
+    xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+    bool got = tuya_outbox_pop(&s_outbox, &s_bridge_inflight);
+    xSemaphoreGive(s_tx_lock);
+    if (!got) {
+        return;
+    }
+    s_bridge_seq++;
+    s_bridge_tries = 0;
+    s_bridge_pending = true;
+    s_bridge_first_tx_us = esp_timer_get_time();
+    if (!bridge_transmit()) {
+        bridge_requeue();
+    }
+}
+
+/* 发送任务：MQTT连接期间按优先级逐条交给esp-mqtt，发送失败的消息放回原位；
+ * MQTT断开时若手机订阅了桥接通知，则经手机转发 */
+static void tuya_tx_task(void *arg)
+{
+    static tuya_outbox_msg_t msg;   // 单条消息约600字节，不放在任务栈上
+
+    while (!s_stopping) {
+        bridge_poll_input();
+        bool mqtt_up = xEventGroupGetBits(s_wifi_event_group) & MQTT_CONNECTED_BIT;
+        bridge_service(mqtt_up);
+
+        // 有等待ACK的桥接消息时定时醒来检查超时
+        TickType_t idle_wait = s_bridge_pending ? pdMS_TO_TICKS(TX_RETRY_MS) : portMAX_DELAY;
+        if (!mqtt_up) {
+            xSemaphoreTake(s_tx_signal, bridge_ready() ? pdMS_TO_TICKS(TX_RETRY_MS) : idle_wait);
+            continue;
+        }
+
+        // 链路慢时让消息停留在可合并、可按优先级调度的队列里，而不是esp-mqtt的FIFO中
+        if (esp_mqtt_client_get_outbox_size(mqtt_client) > TX_INFLIGHT_MAX_BYTES) {
+            xSemaphoreTake(s_tx_signal, pdMS_TO_TICKS(TX_RETRY_MS));
+            continue;
+        }
+
+        xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+        bool got = tuya_outbox_pop(&s_outbox, &msg);
+        xSemaphoreGive(s_tx_lock);
+        if (!got) {
+            xSemaphoreTake(s_tx_signal, idle_wait);
+            continue;
+        }
+
+        IOT_TRACE_BEGIN("mqtt_publish");
+        int msg_id = esp_mqtt_client_publish(mqtt_client, msg.topic, msg.data, msg.len, msg.qos, 0);
+        IOT_TRACE_END("mqtt_publish");
+        if (msg_id == -1) {
+            ESP_LOGE(MQTT_TAG, "发布到 %s 失败, 稍后重试", msg.topic);
+            xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+            tuya_outbox_requeue(&s_outbox, &msg);
+            xSemaphoreGive(s_tx_lock);
+            vTaskDelay(pdMS_TO_TICKS(TX_RETRY_MS));
+            continue;
+        }
+
+        uint32_t wait_us = (uint32_t)(esp_timer_get_time() - msg.t_origin);
+        xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+        iot_latency_record(&s_tx_wait[msg.cls], wait_us);
+        xSemaphoreGive(s_tx_lock);
+        if (msg.flags & TUYA_OUTBOX_FLAG_ACK) {
+            portENTER_CRITICAL(&s_ack_mux);
+            iot_latency_record(&s_ack_stats.cmd_to_ack, wait_us);
+            portEXIT_CRITICAL(&s_ack_mux);
+        }
+
+        ESP_LOGI(MQTT_TAG, "发布数据成功, msg_id=%d, 排队 %lu us", msg_id, (unsigned long)wait_us);
+        link_note_tx(msg.flags & TUYA_OUTBOX_FLAG_REPORT);
+        if (msg.qos > 0) {
+            rate_track(msg_id);
+        }
+    }
+    task_exit();
+}
+
+/* 获取当前Unix时间（毫秒） */
+long long tuya_now_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/* 生成设备端msgId：毫秒时间戳加自增序号 */
+void tuya_make_msg_id(char* buf, size_t size)
+{
+    static uint16_t seq = 0;
+    snprintf(buf, size, "%lld%03u", tuya_now_ms(), (unsigned)(seq++ % 1000));
+}
+
+/* 订阅所有需要订阅的路由，一个SUBSCRIBE报文完成 */
+static void router_subscribe_all(esp_mqtt_client_handle_t client)
+{
+    esp_mqtt_topic_t list[TUYA_ROUTER_MAX_ROUTES];
+    int n = 0;
+
+    // 路由槽位不回收，filter地址固定，解锁后仍可使用
+    xSemaphoreTake(s_router_lock, portMAX_DELAY);
+    for (int i = 0; i < s_router.route_count; i++) {
+        const tuya_route_t* route = &s_router.routes[i];
+        if (route->handler && route->subscribe) {
+            list[n].filter = route->filter;
+            list[n].qos = route->qos;
+            n++;
+        }
+    }
+    xSemaphoreGive(s_router_lock);
+
+    if (n > 0) {
+        int msg_id = esp_mqtt_client_subscribe_multiple(client, list, n);
+        ESP_LOGI(MQTT_TAG, "订阅 %d 个主题, msg_id=%d", n, msg_id);
+    }
+}
+
+/* 按主题分发下行消息，未注册的主题交给MQTT扩展 */
+static void router_dispatch(const char* topic, int topic_len, const char* data, int data_len)
+{
+    uint32_t start = esp_cpu_get_cycle_count();
+    tuya_topic_handler_t handler = NULL;
+    void* ctx = NULL;
+
+    xSemaphoreTake(s_router_lock, portMAX_DELAY);
+    int idx = tuya_router_match(&s_router, topic, topic_len);
+    if (idx >= 0) {
+        s_router.routes[idx].hits++;
+        handler = s_router.routes[idx].handler;
+        ctx = s_router.routes[idx].ctx;
+    }
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    s_route_total_cycles += cycles;
+    if (cycles > s_route_max_cycles) {
+        s_route_max_cycles = cycles;
+    }
+    xSemaphoreGive(s_router_lock);
+
+    bool handled = handler && handler(topic, topic_len, data, data_len, ctx);
+    if (!handled && s_mqtt_ext && s_mqtt_ext->on_message) {
+        handled = s_mqtt_ext->on_message(topic, topic_len, data, data_len);
+    }
+
+    xSemaphoreTake(s_router_lock, portMAX_DELAY);
+    if (handled) {
+        s_router.dispatched++;
+    } else {
+        s_router.unmatched++;
+    }
+    xSemaphoreGive(s_router_lock);
+
+    if (!handled) {
+        ESP_LOGW(MQTT_TAG, "未处理的主题: %.*s", topic_len, topic);
+    }
+}
+
+static bool on_property_set(const char* topic, int topic_len, const char* data, int data_len, void* ctx)
+{
+    // 解析并更新设备状态，应答交给应答任务发送
+    handle_property_set(data, data_len);
+    return true;
+}
+
+/* 期望值查询响应：data.properties 为 code -> {value, version, time} */
+static bool on_desired_response(const char* topic, int topic_len, const char* data, int data_len, void* ctx)
+{
+    cJSON *root = cJSON_ParseWithLength(data, data_len);
+    if (root == NULL) {
+        ESP_LOGW(MQTT_TAG, "期望值响应解析失败");
+        return true;
+    }
+    cJSON *data_obj = cJSON_GetObjectItem(root, "data");
+    cJSON *props = data_obj ? cJSON_GetObjectItem(data_obj, "properties") : NULL;
+    if (!cJSON_IsObject(props)) {
+        props = NULL;
+    }
+
+    tuya_ack_item_t item = { 0 };
+    item.rx_time_us = esp_timer_get_time();
+    cJSON *msg_id_item = cJSON_GetObjectItem(root, "msgId");
+    if (cJSON_IsString(msg_id_item)) {
+        strncpy(item.msg_id, cJSON_GetStringValue(msg_id_item), sizeof(item.msg_id) - 1);
+    }
+
+    // 处理过的版本（无论是否应用）都从云端删除，下次连接不再下发
+    char del_msg[256];
+    char del_id[TUYA_MSG_ID_MAX_LEN];
+    tuya_make_msg_id(del_id, sizeof(del_id));
+    int len = snprintf(del_msg, sizeof(del_msg), "{\"msgId\":\"%s\",\"time\":%lld,\"data\":{\"properties\":{",
+                       del_id, tuya_now_ms());
+    const char *sep = "";
+    int deleted = 0;
+
+    cJSON *entry = NULL;
+    cJSON_ArrayForEach(entry, props) {
+        cJSON *value = cJSON_GetObjectItem(entry, "value");
+        cJSON *version = cJSON_GetObjectItem(entry, "version");
+        cJSON *time_item = cJSON_GetObjectItem(entry, "time");
+        int dp = 0;
+        while (dp < IOT_DP_MAX && strcmp(entry->string, s_dp_codes[dp]) != 0) {
+            dp++;
+        }
+        if (dp == IOT_DP_MAX || value == NULL || !cJSON_IsNumber(version)) {
+            continue;
+        }
+
+        int64_t ver = (int64_t)cJSON_GetNumberValue(version);
+        int64_t set_ms = cJSON_IsNumber(time_item) ? (int64_t)cJSON_GetNumberValue(time_item) : 0;
+        portENTER_CRITICAL(&s_desired_mux);
+        tuya_desired_verdict_t verdict = tuya_desired_check(&s_desired, (iot_dp_id_t)dp, ver, set_ms);
+        portEXIT_CRITICAL(&s_desired_mux);
+
+        if (verdict == TUYA_DESIRED_APPLY) {
+            item.dp_mask |= stage_property(entry->string, value, item.rx_time_us);
+        } else {
+            ESP_LOGI(MQTT_TAG, "期望值 %s 版本 %lld 未应用: %s", entry->string, (long long)ver,
+                     verdict == TUYA_DESIRED_STALE ? "已过期" : "已被实时命令取代");
+        }
+        // 放不下的留到下次连接再删除，云端会再次下发，版本号相同时直接丢弃
+        if (len < (int)sizeof(del_msg)) {
+            int n = snprintf(del_msg + len, sizeof(del_msg) - len, "%s\"%s\":{\"version\":%lld}",
+                             sep, entry->string, (long long)ver);
+            if (n > 0 && len + n < (int)sizeof(del_msg) - 3) {
+                len += n;
+                sep = ",";
+                deleted++;
+            } else {
+                del_msg[len] = '\0';
+            }
+        }
+    }
+    cJSON_Delete(root);
+
+    portENTER_CRITICAL(&s_desired_mux);
+    bool pending = tuya_desired_on_response(&s_desired, esp_timer_get_time() / 1000);
+    uint32_t converge_ms = s_desired.converge.last_us / 1000;
+    portEXIT_CRITICAL(&s_desired_mux);
+    if (pending) {
+        ESP_LOGI(MQTT_TAG, "期望值同步完成, 应用DP掩码 0x%lx, 收敛耗时 %lu ms",
+                 (unsigned long)item.dp_mask, (unsigned long)converge_ms);
+    }
+
+    if (item.dp_mask) {
+        stage_commit(item.msg_id, item.dp_mask, item.rx_time_us);
+    }
+    if (deleted > 0 && len < (int)sizeof(del_msg) - 3) {
+        snprintf(del_msg + len, sizeof(del_msg) - len, "}}}");
+        tx_enqueue(TUYA_TX_ACK, 0, TUYA_TOPIC("thing/property/desired/delete"), del_msg, 1, 0,
+                   esp_timer_get_time());
+    }
+    return true;
+}
+
+/* 拉取的DP列表由DP定义表生成：,"device_status","test_value"（跳过开头的逗号） */
+#define DESIRED_CODE_ENTRY(name, code, type, field, chr_id, unit) ",\"" code "\""
+static const char s_desired_codes[] = IOT_DP_SCHEMA(DESIRED_CODE_ENTRY);
+#undef DESIRED_CODE_ENTRY
+
+/* 连上云端后拉取期望值 */
+static void desired_request(int64_t outage_start_us)
+{
+    char msg_id[TUYA_MSG_ID_MAX_LEN];
+    char msg[96 + sizeof(s_desired_codes)];
+    tuya_make_msg_id(msg_id, sizeof(msg_id));
+    snprintf(msg, sizeof(msg), "{\"msgId\":\"%s\",\"time\":%lld,\"data\":{\"properties\":[%s]}}",
+             msg_id, tuya_now_ms(), s_desired_codes + 1);
+
+    portENTER_CRITICAL(&s_desired_mux);
+    tuya_desired_on_request(&s_desired, esp_timer_get_time() / 1000, outage_start_us / 1000);
+    portEXIT_CRITICAL(&s_desired_mux);
+
+    if (tx_enqueue(TUYA_TX_ACK, 0, TUYA_TOPIC("thing/property/desired/get"), msg, 1, 0,
+                   esp_timer_get_time()) != ESP_OK) {
+        ESP_LOGW(MQTT_TAG, "期望值查询入队失败");
+    }
+}
+
+/* 非云端引起的状态变化（本地按键、BLE、局域网），离线期间的修改参与期望值对账 */
+static void desired_state_listener(iot_dp_id_t dp, void* ctx)
+{
+    if (s_cloud_apply_task != NULL && s_cloud_apply_task == xTaskGetCurrentTaskHandle()) {
+        return;
+    }
+    bool online = s_wifi_event_group && (xEventGroupGetBits(s_wifi_event_group) & MQTT_CONNECTED_BIT);
+    int64_t now = tuya_now_ms();
+    portENTER_CRITICAL(&s_desired_mux);
+    tuya_desired_on_local_change(&s_desired, dp, now, online);
+    portEXIT_CRITICAL(&s_desired_mux);
+}
+
+static bool on_ota_issue(const char* topic, int topic_len, const char* data, int data_len, void* ctx)
+{
+    if (tuya_ota_handle_issue(data, data_len) != ESP_OK) {
+        ESP_LOGW(MQTT_TAG, "OTA任务启动失败");
+    }
+    return true;
+}
+
+/* 生成涂鸦MQTT用户名 */
+static void generate_tuya_username(char* username, size_t size)
+{
+    time_t now;
+    time(&now);
+
+    // username = deviceId|signMethod=hmacSha256,timestamp=xxxx,secureMode=1,accessType=1
+    snprintf(username, size,
+             "%s|signMethod=hmacSha256,timestamp=%ld,secureMode=1,accessType=1",
+             TUYA_DEVICE_ID, (long)now);
+}
+
+/* 生成涂鸦MQTT密码 */
+static void generate_tuya_password(const char* username, char* password, size_t size)
+{
+    char timestamp_str[20] = {0};  
+    const char* timestamp_start = strstr(username, "timestamp=");
+    if (timestamp_start) {
+        timestamp_start += strlen("timestamp="); // 跳过 "timestamp="
+        const char* timestamp_end = strchr(timestamp_start, ',');
+        if (timestamp_end) {
+            size_t len = timestamp_end - timestamp_start;
+            if (len < sizeof(timestamp_str)) {
+                strncpy(timestamp_str, timestamp_start, len);
+                timestamp_str[len] = '\0';
+            }
+        }
+    }
+
+    // 如果没取到时间戳，用当前时间
+    if (strlen(timestamp_str) == 0) {
+        time_t now;
+        time(&now);
+        snprintf(timestamp_str, sizeof(timestamp_str), "%ld", (long)now);
+    }
+
+    // 生成待签名字符串
+    char content[256];
+    snprintf(content, sizeof(content),
+             "deviceId=%s,timestamp=%s,secureMode=1,accessType=1",
+             TUYA_DEVICE_ID, timestamp_str);
+
+    // HMAC-SHA256 签名
+    unsigned char hmac_result[32];
+    mbedtls_md_context_t ctx;
+    mbedtls_md_init(&ctx);
+
+    if (mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) == 0) {
+        mbedtls_md_hmac_starts(&ctx, (const unsigned char*)TUYA_DEVICE_SECRET,
+                               strlen(TUYA_DEVICE_SECRET));
+        mbedtls_md_hmac_update(&ctx, (const unsigned char*)content, strlen(content));
+        mbedtls_md_hmac_finish(&ctx, hmac_result);
+    }
+    mbedtls_md_free(&ctx);
+
+    // 转成 hex 字符串
+    if (size > 64) { // 32字节 HMAC -> 64字符 HEX
+        for (int i = 0; i < 32; i++) {
+            sprintf(&password[i * 2], "%02x", hmac_result[i]);
+        }
+        password[64] = '\0'; // 确保字符串结尾
+    }
+
+    ESP_LOGI(MQTT_TAG, "MQTT密码生成完成");
+}
+
+/* 处理property/set命令：只解析和暂存，执行和应答交给命令任务 */
+static void handle_property_set(const char* data, int data_len)
+{
+    int64_t rx_us = esp_timer_get_time();
+
+    IOT_TRACE_BEGIN("parse_command");
+    esp_err_t parse_result = parse_iot_command(data, data_len, rx_us);
+    IOT_TRACE_END("parse_command");
+    if (parse_result != ESP_OK && parse_result != ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(MQTT_TAG, "命令解析失败");
+    }
+
+    uint32_t hold_us = (uint32_t)(esp_timer_get_time() - rx_us);
+    portENTER_CRITICAL(&s_cmd_mux);
+    tuya_cmd_record_hold(&s_cmd, hold_us);
+    portEXIT_CRITICAL(&s_cmd_mux);
+}
+
+/* 按DP类型输出应答中的值 */
+static int dp_ack_IOT_DP_TYPE_INT(char* buf, size_t size, const char* code, int32_t value)
+{
+    return snprintf(buf, size, "\"%s\":%ld", code, (long)value);
+}
+
+static int dp_ack_IOT_DP_TYPE_STR(char* buf, size_t size, const char* code, const char* value)
+{
+    return snprintf(buf, size, "\"%s\":\"%s\"", code, value);
+}
+
+/* 应答任务：带原始msgId回报受影响的DP */
+static void tuya_ack_task(void *arg)
+{
+    tuya_ack_item_t item;
+    char ack_msg[256];
+
+    while (!s_stopping) {
+        if (xQueueReceive(s_ack_queue, &item, portMAX_DELAY) != pdTRUE || s_stopping) {
+            continue;
+        }
+
+        iot_device_state_t state;
+        get_current_iot_snapshot(&state);
+        int len = snprintf(ack_msg, sizeof(ack_msg), "{\"msgId\":\"%s\",\"time\":%lld,\"data\":{",
+                           item.msg_id, tuya_now_ms());
+        // 各DP由 IOT_DP_SCHEMA 生成，放不下的DP不再追加，保证结尾完整
+#define DP_ACK_ENTRY(name, code, type, field, chr_id, unit) \
+        if (item.dp_mask & IOT_DP_BIT(IOT_DP_##name)) { \
+            int sep = ack_msg[len - 1] != '{'; \
+            int n = dp_ack_##type(ack_msg + len + sep, sizeof(ack_msg) - len - sep, code, state.field); \
+            if (n >= 0 && len + sep + n + (int)sizeof("}}") <= (int)sizeof(ack_msg)) { \
+                if (sep) { \
+                    ack_msg[len] = ','; \
+                } \
+                len += sep + n; \
+            } \
+        }
+        IOT_DP_SCHEMA(DP_ACK_ENTRY)
+#undef DP_ACK_ENTRY
+        snprintf(ack_msg + len, sizeof(ack_msg) - len, "}}");
+
+        // 应答优先级最高，排在积压的遥测之前；时延从收到命令算起，在发送时统计
+        if (tx_enqueue(TUYA_TX_ACK, 0, TUYA_TOPIC("thing/property/report"), ack_msg, 1,
+                       TUYA_OUTBOX_FLAG_ACK, item.rx_time_us) == ESP_OK) {
+            ESP_LOGI(MQTT_TAG, "命令应答已入队, msgId=%s", item.msg_id);
+        } else {
+            portENTER_CRITICAL(&s_ack_mux);
+            s_ack_stats.failed++;
+            portEXIT_CRITICAL(&s_ack_mux);
+            ESP_LOGW(MQTT_TAG, "命令应答发送失败, msgId=%s", item.msg_id);
+        }
+    }
+    task_exit();
+}
+
+/* 按DP类型取命令值中的对应字段调用setter */
+static void dp_apply_IOT_DP_TYPE_INT(void (*setter)(int32_t), const tuya_cmd_value_t* v)
+{
+    setter(v->i);
+}
+
+static void dp_apply_IOT_DP_TYPE_STR(void (*setter)(const char*), const tuya_cmd_value_t* v)
+{
+    setter(v->s);
+}
+
+/* 命令任务：按执行窗口执行暂存的DP值，再为每条命令投递应答 */
+static void tuya_cmd_task(void *arg)
+{
+    while (!s_stopping) {
+        portENTER_CRITICAL(&s_cmd_mux);
+        int64_t due = tuya_cmd_due_us(&s_cmd);
+        portEXIT_CRITICAL(&s_cmd_mux);
+        int64_t now = esp_timer_get_time();
+        if (due > now) {
+            TickType_t wait = portMAX_DELAY;
+            if (due != INT64_MAX) {
+                wait = pdMS_TO_TICKS((due - now + 999) / 1000);
+                wait = wait > 0 ? wait : 1;
+            }
+            ulTaskNotifyTake(pdTRUE, wait);
+            continue;
+        }
+
+        portENTER_CRITICAL(&s_cmd_mux);
+        bool got = tuya_cmd_take(&s_cmd, now, &s_cmd_batch);
+        portEXIT_CRITICAL(&s_cmd_mux);
+        if (!got) {
+            continue;
+        }
+
+        IOT_TRACE_BEGIN("cmd_apply");
+        s_cloud_apply_task = xTaskGetCurrentTaskHandle();
+        for (int dp = 0; dp < IOT_DP_MAX; dp++) {
+            if (!(s_cmd_batch.dp_mask & IOT_DP_BIT(dp))) {
+                continue;
+            }
+            const tuya_cmd_value_t *v = &s_cmd_batch.values[dp];
+            switch (dp) {
+#define DP_APPLY_ENTRY(name, code, type, field, chr_id, unit) \
+            case IOT_DP_##name: \
+                dp_apply_##type(set_##field, v); \
+                break;
+            IOT_DP_SCHEMA(DP_APPLY_ENTRY)
+#undef DP_APPLY_ENTRY
+            default:
+                break;
+            }
+        }
+        s_cloud_apply_task = NULL;
+        IOT_TRACE_END("cmd_apply");
+        if (s_cmd_batch.dp_mask) {
+            ESP_LOGI(MQTT_TAG, "执行命令: DP掩码 0x%lx, 合并 %u 条命令",
+                     (unsigned long)s_cmd_batch.dp_mask, s_cmd_batch.ack_count);
+        }
+
+        // 只入队，由应答任务发布
+        for (int i = 0; i < s_cmd_batch.ack_count; i++) {
+            const tuya_cmd_ack_t *ack = &s_cmd_batch.acks[i];
+            tuya_ack_item_t item = {
+                .dp_mask = ack->dp_mask,
+                .rx_time_us = ack->rx_us,
+            };
+            memcpy(item.msg_id, ack->msg_id, sizeof(item.msg_id));
+            // 一次最多投递 TUYA_CMD_MAX_ACKS 条，可能超过队列深度，等待应答任务取走
+            if (!s_ack_queue || xQueueSend(s_ack_queue, &item, pdMS_TO_TICKS(TUYA_CMD_WINDOW_MS)) != pdTRUE) {
+                portENTER_CRITICAL(&s_ack_mux);
+                s_ack_stats.dropped++;
+                portEXIT_CRITICAL(&s_ack_mux);
+                ESP_LOGW(MQTT_TAG, "应答队列已满, msgId=%s", item.msg_id);
+            }
+        }
+    }
+    task_exit();
+}
+
+/* 记录断线开始时刻，连续的断线事件只记第一次 */
+static void mark_outage(void)
+{
+    if (s_outage_start_us == 0) {
+        s_outage_start_us = esp_timer_get_time();
+    }
+}
+
+static void wifi_retry_timer_cb(void *arg)
+{
+    esp_wifi_connect();
+}
+
+static void mqtt_retry_timer_cb(void *arg)
+{
+    // 选址可能阻塞（解析、竞速），交给连接任务
+    xTaskNotify(s_conn_task, CONN_NOTIFY_RETRY, eSetBits);
+}
+
+/* 记录一次上行，任何发布都可以代替PING和心跳证明设备在线 */
+static void link_note_tx(bool is_report)
+{
+    if (!s_link_lock) {
+        return;
+    }
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    tuya_liveness_on_tx(&s_liveness, tuya_now_ms(), is_report);
+    xSemaphoreGive(s_link_lock);
+}
+
+/* 记录QoS1消息交给esp-mqtt的时刻
+ * PUBACK可能在publish返回前已由MQTT任务处理，此时查不到记录，只少一个时延样本 */
+static void rate_track(int msg_id)
+{
+    portENTER_CRITICAL(&s_rate_mux);
+    s_rate_inflight[s_rate_inflight_idx].msg_id = msg_id;
+    s_rate_inflight[s_rate_inflight_idx].t_us = esp_timer_get_time();
+    s_rate_inflight_idx = (s_rate_inflight_idx + 1) % RATE_INFLIGHT_NUM;
+    portEXIT_CRITICAL(&s_rate_mux);
+}
+
+/* 取出在途记录，返回交给esp-mqtt的时刻，0表示没有记录 */
+static int64_t rate_untrack(int msg_id)
+{
+    int64_t t_us = 0;
+    portENTER_CRITICAL(&s_rate_mux);
+    for (int i = 0; i < RATE_INFLIGHT_NUM; i++) {
+        if (s_rate_inflight[i].msg_id == msg_id && msg_id != 0) {
+            t_us = s_rate_inflight[i].t_us;
+            s_rate_inflight[i].msg_id = 0;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_rate_mux);
+    return t_us;
+}
+
+/* 收到PUBACK：时延超过重发间隔的部分按esp-mqtt的重发次数计 */
+static void rate_on_puback(int msg_id)
+{
+    int64_t t_us = rate_untrack(msg_id);
+    if (t_us == 0 || !s_link_lock) {
+        return;
+    }
+    uint32_t rtt_ms = (uint32_t)((esp_timer_get_time() - t_us) / 1000);
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    tuya_rate_on_ack(&s_rate, rtt_ms, rtt_ms / MQTT_RETRANSMIT_MS);
+    xSemaphoreGive(s_link_lock);
+}
+
+static void rate_on_deleted(int msg_id)
+{
+    if (rate_untrack(msg_id) == 0 || !s_link_lock) {
+        return;
+    }
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    tuya_rate_on_lost(&s_rate);
+    xSemaphoreGive(s_link_lock);
+}
+
+/* 采样RSSI，并在一个上报间隔结束时调整上报速率，间隔变化时同步给保活策略 */
+static void rate_tick(int64_t now_ms)
+{
+    static int64_t last_rssi_ms = 0;
+    static int64_t last_eval_ms = 0;
+
+    if (now_ms - last_rssi_ms >= RATE_RSSI_PERIOD_MS &&
+        (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT)) {
+        wifi_ap_record_t ap;
+        if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+            xSemaphoreTake(s_link_lock, portMAX_DELAY);
+            tuya_rate_on_rssi(&s_rate, ap.rssi);
+            xSemaphoreGive(s_link_lock);
+        }
+        last_rssi_ms = now_ms;
+    }
+
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    bool changed = false;
+    if (now_ms - last_eval_ms >= s_rate.interval_ms) {
+        changed = tuya_rate_update(&s_rate);
+        last_eval_ms = now_ms;
+        if (changed) {
+            tuya_liveness_set_report_interval(&s_liveness, s_rate.interval_ms);
+        }
+    }
+    uint32_t interval_ms = s_rate.interval_ms;
+    uint8_t batch = s_rate.batch;
+    int rssi = s_rate.rssi;
+    xSemaphoreGive(s_link_lock);
+
+    if (changed) {
+        ESP_LOGI(MQTT_TAG, "上报间隔调整为 %lu ms, 每次 %u 个窗口 (RSSI %d dBm)",
+                 (unsigned long)interval_ms, batch, rssi);
+    }
+}
+
+/* 应用新的keepalive并保存探测结果
+ * esp-mqtt 立即按新值调度PING，CONNECT中的值在下次重连时更新 */
+static void link_apply_keepalive(void)
+{
+    tuya_liveness_persist_t persist;
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    tuya_liveness_export(&s_liveness, &persist);
+    uint16_t keepalive_s = s_liveness.keepalive_s;
+    xSemaphoreGive(s_link_lock);
+
+    if (mqtt_client && s_mqtt_cfg) {
+        s_mqtt_cfg->session.keepalive = keepalive_s;
+        esp_mqtt_set_config(mqtt_client, s_mqtt_cfg);
+    }
+
+    nvs_handle_t nvs;
+    if (nvs_open(WIFI_CRED_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        if (nvs_set_blob(nvs, LIVENESS_NVS_KEY, &persist, sizeof(persist)) == ESP_OK) {
+            nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+}
+
+static void load_liveness(void)
+{
+    tuya_liveness_persist_t persist;
+    size_t len = sizeof(persist);
+    nvs_handle_t nvs;
+    bool loaded = false;
+
+    if (nvs_open(WIFI_CRED_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        loaded = nvs_get_blob(nvs, LIVENESS_NVS_KEY, &persist, &len) == ESP_OK && len == sizeof(persist);
+        nvs_close(nvs);
+    }
+    tuya_liveness_init(&s_liveness, loaded ? &persist : NULL);
+    ESP_LOGI(TAG, "keepalive 初始值 %u s (上限 %u s)", s_liveness.keepalive_s, s_liveness.ceiling_s);
+}
+
+/* 链路保活任务：探测keepalive、按需发送心跳、统计每小时上行包数 */
+static void tuya_link_task(void *arg)
+{
+    int64_t window_start = tuya_now_ms();
+    tuya_link_stats_t last = { 0 };
+
+    while (!s_stopping) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        if (s_stopping) {
+            break;
+        }
+        int64_t now = tuya_now_ms();
+
+        xSemaphoreTake(s_link_lock, portMAX_DELAY);
+        bool changed = tuya_liveness_tick(&s_liveness, now);
+        tuya_hb_action_t hb = tuya_liveness_heartbeat(&s_liveness, now);
+        xSemaphoreGive(s_link_lock);
+
+        if (changed) {
+            ESP_LOGI(MQTT_TAG, "keepalive验证通过, 调整为 %u s", s_liveness.keepalive_s);
+            link_apply_keepalive();
+        }
+        if (hb == TUYA_HB_SEND) {
+            tuya_send_heartbeat();
+        }
+        rate_tick(esp_timer_get_time() / 1000);
+        roam_tick();
+
+        portENTER_CRITICAL(&s_desired_mux);
+        bool desired_timeout = tuya_desired_tick(&s_desired, esp_timer_get_time() / 1000);
+        portEXIT_CRITICAL(&s_desired_mux);
+        if (desired_timeout) {
+            ESP_LOGW(MQTT_TAG, "期望值查询超时, 下次连接时重新拉取");
+        }
+
+        if (now - window_start >= LIVENESS_REPORT_PERIOD_MS) {
+            tuya_link_stats_t cur;
+            use_wifi_get_link_stats(&cur);
+            ESP_LOGI(MQTT_TAG, "近1小时上行: 发布 %lu, PING约 %lu, 心跳 %lu (并入上报 %lu), keepalive %u s",
+                     (unsigned long)(cur.publishes - last.publishes),
+                     (unsigned long)(cur.pings_est - last.pings_est),
+                     (unsigned long)(cur.heartbeats_sent - last.heartbeats_sent),
+                     (unsigned long)(cur.heartbeats_folded - last.heartbeats_folded),
+                     cur.keepalive_s);
+            last = cur;
+            window_start = now;
+        }
+    }
+    task_exit();
+}
+
+/*
+ * 创建常驻任务。C5为单核，发送、命令、应答和连接任务的优先级高于启动阶段，创建后立即抢占调用者运行，
+ * 所以先检查它们用到的对象都已创建，缺一个就不创建任何任务
+ */
+static esp_err_t start_tasks(void)
+{
+    const void *deps[] = {
+        s_wifi_event_group, s_tx_lock, s_tx_signal, s_task_exit, s_bridge_rx_queue,
+        s_ack_queue, s_link_lock, s_router_lock, s_wifi_retry_timer, s_mqtt_retry_timer,
+    };
+    for (size_t i = 0; i < sizeof(deps) / sizeof(deps[0]); i++) {
+        if (!deps[i]) {
+            ESP_LOGE(TAG, "任务依赖的第%u个对象尚未创建, 不启动任务", (unsigned)i);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    if (iot_task_create(tuya_tx_task, "tuya_tx", &s_tx_task_mem, NULL, 5, &s_tx_task) != pdPASS ||
+        iot_task_create(tuya_ack_task, "tuya_ack", &s_ack_task_mem, NULL, 6, &s_ack_task) != pdPASS ||
+        iot_task_create(tuya_cmd_task, "tuya_cmd", &s_cmd_task_mem, NULL, 6, &s_cmd_task) != pdPASS ||
+        iot_task_create(tuya_link_task, "tuya_link", &s_link_task_mem, NULL, 2, &s_link_task) != pdPASS ||
+        iot_task_create(tuya_conn_task, "tuya_conn", &s_conn_task_mem, NULL, 5, &s_conn_task) != pdPASS) {
+        ESP_LOGE(TAG, "创建常驻任务失败");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
 
 /* 公共API实现 */
 
 esp_err_t use_wifi_start(void)
 {
+    if (s_stopping) {
+        ESP_LOGE(TAG, "上次停止未完成, 需先再次调用 use_wifi_stop");
+        return ESP_ERR_INVALID_STATE;
+    }
     if (is_initialized) {
         ESP_LOGW(TAG, "WiFi组件已经初始化");
         return ESP_OK;
@@ -496,7 +2086,101 @@ esp_err_t use_wifi_start(void)
     
     ESP_LOGI(TAG, "启动WiFi和MQTT组件");
     
-    esp_err_t ret = wifi_init_sta();
+#if CONFIG_IOT_STATIC_MEMORY
+    // 下行命令的JSON解析使用定长块内存池
+    cJSON_Hooks json_hooks = {
+        .malloc_fn = iot_static_alloc,
+        .free_fn = iot_static_free,
+    };
+    cJSON_InitHooks(&json_hooks);
+#endif
+
+    // 常驻任务用到的事件组、队列和锁须在创建任何任务之前建好，见 start_tasks
+    s_wifi_event_group = xEventGroupCreate();
+    if (!s_wifi_event_group) {
+        ESP_LOGE(TAG, "创建事件组失败");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 上行发送队列
+    tuya_outbox_init(&s_outbox);
+    s_tx_lock = xSemaphoreCreateMutex();
+    s_tx_signal = xSemaphoreCreateBinary();
+    s_task_exit = xSemaphoreCreateCounting(WIFI_TASK_NUM, 0);
+    if (!s_tx_lock || !s_tx_signal || !s_task_exit) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_bridge_rx_queue = xQueueCreate(BRIDGE_RX_QUEUE_LEN, sizeof(bridge_frame_t));
+    if (!s_bridge_rx_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    tuya_bridge_auth_init(&s_bridge_auth, TUYA_DEVICE_SECRET);
+
+    // 命令应答队列
+    s_ack_queue = xQueueCreate(TUYA_ACK_QUEUE_LEN, sizeof(tuya_ack_item_t));
+    if (!s_ack_queue) {
+        ESP_LOGE(TAG, "创建应答队列失败");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 下行命令在命令任务中执行，MQTT任务只解析和暂存
+    tuya_cmd_init(&s_cmd, TUYA_CMD_WINDOW_MS);
+
+    // 链路保活：恢复上次探测到的keepalive
+    s_link_lock = xSemaphoreCreateMutex();
+    if (!s_link_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    load_liveness();
+    tuya_rate_config_t rate_cfg = TUYA_RATE_CONFIG_DEFAULT();
+    tuya_rate_init(&s_rate, &rate_cfg);
+    tuya_roam_init(&s_roam);
+
+    // 云端地址：加载上次的解析结果
+    tuya_endpoint_init(TUYA_MQTT_URL);
+
+    // 下行主题路由，连接后统一订阅；路由表在停止后保留，其他组件注册的主题重新启动后仍然有效
+    if (!s_router_lock) {
+        s_router_lock = xSemaphoreCreateMutex();
+        if (!s_router_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+        tuya_router_init(&s_router);
+    }
+    use_wifi_register_topic(TUYA_TOPIC("thing/property/set"), TUYA_PROPERTY_SET_QOS, true, on_property_set, NULL);
+    use_wifi_register_topic(TUYA_TOPIC("thing/property/desired/get_response"), 1, true,
+                            on_desired_response, NULL);
+    tuya_desired_init(&s_desired);
+    common_register_state_listener(desired_state_listener, NULL);
+    use_wifi_register_topic(TUYA_TOPIC("ota/issue"), 1, true, on_ota_issue, NULL);
+
+    // 重连退避，随机种子来自硬件随机数，保证各设备的重连时刻不同
+    tuya_backoff_init(&s_wifi_backoff, WIFI_BACKOFF_BASE_MS, WIFI_BACKOFF_CAP_MS, 0, esp_random());
+    tuya_backoff_init(&s_mqtt_backoff, MQTT_BACKOFF_BASE_MS, MQTT_BACKOFF_CAP_MS,
+                      MQTT_BACKOFF_WINDOW_MS, esp_random());
+    const esp_timer_create_args_t wifi_timer_args = {
+        .callback = wifi_retry_timer_cb,
+        .name = "wifi_retry",
+    };
+    const esp_timer_create_args_t mqtt_timer_args = {
+        .callback = mqtt_retry_timer_cb,
+        .name = "mqtt_retry",
+    };
+    if (esp_timer_create(&wifi_timer_args, &s_wifi_retry_timer) != ESP_OK ||
+        esp_timer_create(&mqtt_timer_args, &s_mqtt_retry_timer) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 任务在WiFi事件之前就绪：事件处理函数会通知连接任务
+    esp_err_t ret = start_tasks();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // 新固件首次启动时开启回滚保护
+    tuya_ota_rollback_guard_start();
+
+    ret = wifi_init_sta();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "WiFi初始化失败");
         return ret;
@@ -506,12 +2190,70 @@ esp_err_t use_wifi_start(void)
     return ESP_OK;
 }
 
+/* 删除信号量或队列并清空句柄 */
+static void delete_handle(SemaphoreHandle_t* handle)
+{
+    if (*handle) {
+        vSemaphoreDelete(*handle);
+        *handle = NULL;
+    }
+}
+
+/* 唤醒各常驻任务并等待它们退出循环；超时后再次调用时接着等还没退出的任务 */
+static esp_err_t stop_tasks(void)
+{
+    s_stopping = true;
+    // 退避、时间同步和连接等待立即返回
+    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | MQTT_CONNECTED_BIT);
+    xEventGroupSetBits(s_wifi_event_group, WIFI_STOP_BIT);
+
+    tuya_ack_item_t wake = { 0 };
+    xSemaphoreGive(s_tx_signal);
+    xQueueSendToFront(s_ack_queue, &wake, 0);   // 队列满时应答任务本就不在等待
+    xTaskNotifyGive(s_cmd_task);
+    xTaskNotify(s_conn_task, 0, eNoAction);
+
+    while (s_tasks_exited < WIFI_TASK_NUM) {
+        if (xSemaphoreTake(s_task_exit, pdMS_TO_TICKS(WIFI_STOP_TIMEOUT_MS)) != pdTRUE) {
+            ESP_LOGE(TAG, "等待任务退出超时, 已退出 %d/%d", s_tasks_exited, WIFI_TASK_NUM);
+            return ESP_ERR_TIMEOUT;
+        }
+        s_tasks_exited++;
+    }
+    return ESP_OK;
+}
+
 esp_err_t use_wifi_stop(void)
 {
     if (!is_initialized) {
         return ESP_OK;
     }
-    
+
+    // 先注销状态回调和事件、停止退避定时器，停止过程中不再触发上报和重连
+    common_unregister_state_listener(desired_state_listener, NULL);
+    const struct {
+        esp_event_base_t base;
+        int32_t id;
+    } events[] = { { WIFI_EVENT, ESP_EVENT_ANY_ID }, { IP_EVENT, IP_EVENT_STA_GOT_IP }, { IP_EVENT, IP_EVENT_GOT_IP6 } };
+    for (int i = 0; i < 3; i++) {
+        if (s_wifi_handlers[i]) {
+            esp_event_handler_instance_unregister(events[i].base, events[i].id, s_wifi_handlers[i]);
+            s_wifi_handlers[i] = NULL;
+        }
+    }
+    esp_timer_stop(s_wifi_retry_timer);
+    esp_timer_stop(s_mqtt_retry_timer);
+
+    // 任务退出后才能释放它们使用的定时器、MQTT客户端、队列和锁；超时则什么都不释放，可再次调用
+    esp_err_t ret = stop_tasks();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    esp_timer_delete(s_wifi_retry_timer);
+    esp_timer_delete(s_mqtt_retry_timer);
+    s_wifi_retry_timer = NULL;
+    s_mqtt_retry_timer = NULL;
+
     // 停止SNTP
     if (esp_sntp_enabled()) {
         esp_sntp_stop();
@@ -525,8 +2267,44 @@ esp_err_t use_wifi_stop(void)
         mqtt_client_created = false;
     }
     
-    // 停止WiFi
+    // 停止WiFi，与 wifi_init_sta 对称地释放驱动和网络接口
     esp_wifi_stop();
+    esp_wifi_deinit();
+    if (s_sta_netif) {
+        esp_netif_destroy_default_wifi(s_sta_netif);
+        s_sta_netif = NULL;
+    }
+
+    // MQTT任务已停止，不会再唤醒这些任务
+    TaskHandle_t *tasks[WIFI_TASK_NUM] = { &s_tx_task, &s_ack_task, &s_cmd_task, &s_conn_task, &s_link_task };
+    for (int i = 0; i < WIFI_TASK_NUM; i++) {
+        vTaskDelete(*tasks[i]);
+        *tasks[i] = NULL;
+    }
+
+    // 注销本组件的主题和状态回调，其他组件注册的主题保留
+    use_wifi_unregister_topic(TUYA_TOPIC("thing/property/set"));
+    use_wifi_unregister_topic(TUYA_TOPIC("thing/property/desired/get_response"));
+    use_wifi_unregister_topic(TUYA_TOPIC("ota/issue"));
+
+    // 桥接：未确认的消息随发送队列一起丢弃，会话结束
+    s_bridge_pending = false;
+    s_bridge_tries = 0;
+    tuya_bridge_auth_stop(&s_bridge_auth);
+    tuya_bridge_rx_reset(&s_bridge_rx);
+    if (s_bridge_rx_queue) {
+        vQueueDelete(s_bridge_rx_queue);
+        s_bridge_rx_queue = NULL;
+    }
+    if (s_ack_queue) {
+        vQueueDelete(s_ack_queue);
+        s_ack_queue = NULL;
+    }
+    delete_handle(&s_tx_lock);
+    delete_handle(&s_tx_signal);
+    delete_handle(&s_link_lock);
+    delete_handle(&s_task_exit);
+    s_tasks_exited = 0;
     
     // 清理事件组
     if (s_wifi_event_group) {
@@ -534,6 +2312,7 @@ esp_err_t use_wifi_stop(void)
         s_wifi_event_group = NULL;
     }
     
+    s_stopping = false;
     is_initialized = false;
     ESP_LOGI(TAG, "WiFi和MQTT已停止");
     return ESP_OK;
@@ -573,12 +2352,119 @@ esp_err_t tuya_publish_sensor_data(uint8_t test_value, char* device_status)
     char sensor_data[256];
     time_t now;
     time(&now);
-    
-    snprintf(sensor_data, sizeof(sensor_data), 
-             "{\"data\":{\"test_value\":%d,\"device_status\":\"%s\"}}", 
-             test_value, device_status);
-    
-    return tuya_publish_custom_data(sensor_data);
+
+    // 心跳到期且本次上报在等待窗口内，心跳字段并入上报，省去单独的心跳包
+    bool with_heartbeat = false;
+    if (s_link_lock) {
+        xSemaphoreTake(s_link_lock, portMAX_DELAY);
+        with_heartbeat = tuya_liveness_take_heartbeat(&s_liveness);
+        xSemaphoreGive(s_link_lock);
+    }
+
+    if (with_heartbeat) {
+        snprintf(sensor_data, sizeof(sensor_data),
+                 "{\"data\":{\"test_value\":%d,\"device_status\":\"%s\",\"heartbeat\":true,\"timestamp\":%lld}}",
+                 test_value, device_status, (long long)now);
+    } else {
+        snprintf(sensor_data, sizeof(sensor_data),
+                 "{\"data\":{\"test_value\":%d,\"device_status\":\"%s\"}}",
+                 test_value, device_status);
+    }
+
+    return queue_property_report(TUYA_TX_TELEMETRY, "sensor", sensor_data, TUYA_OUTBOX_FLAG_REPORT);
+}
+
+esp_err_t tuya_publish_aggregate(const char* code, const iot_agg_result_t* agg)
+{
+    if (!code || !agg) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (agg->count == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // 每个属性带各自的采样时刻，云端按真实时间入库而不是按到达时间
+    char msg_id[24];
+    char report[384];
+    tuya_make_msg_id(msg_id, sizeof(msg_id));
+    snprintf(report, sizeof(report),
+             "{\"msgId\":\"%s\",\"time\":%lld,\"data\":{"
+             "\"%s\":{\"value\":%ld,\"time\":%lld},"
+             "\"%s_min\":{\"value\":%ld,\"time\":%lld},"
+             "\"%s_max\":{\"value\":%ld,\"time\":%lld},"
+             "\"%s_mean\":{\"value\":%ld,\"time\":%lld}}}",
+             msg_id, tuya_now_ms(),
+             code, (long)agg->last, (long long)iot_sampler_to_epoch_ms(agg->t_end_us),
+             code, (long)agg->min, (long long)iot_sampler_to_epoch_ms(agg->t_min_us),
+             code, (long)agg->max, (long long)iot_sampler_to_epoch_ms(agg->t_max_us),
+             code, (long)agg->mean, (long long)iot_sampler_to_epoch_ms(agg->t_end_us));
+
+    return queue_property_report(TUYA_TX_TELEMETRY, code, report, 0);
+}
+
+esp_err_t tuya_publish_aggregate_batch(const char* code, const iot_agg_result_t* aggs, int count)
+{
+    if (!code || !aggs || count <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (count == 1) {
+        return tuya_publish_aggregate(code, &aggs[0]);
+    }
+
+    // 各窗口的last按各自时刻组成时间序列，min/max/mean合并为整批的一组
+    iot_agg_result_t all = { 0 };
+    int64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        const iot_agg_result_t* a = &aggs[i];
+        if (a->count == 0) {
+            continue;
+        }
+        if (all.count == 0 || a->min < all.min) {
+            all.min = a->min;
+            all.t_min_us = a->t_min_us;
+        }
+        if (all.count == 0 || a->max > all.max) {
+            all.max = a->max;
+            all.t_max_us = a->t_max_us;
+        }
+        all.t_end_us = a->t_end_us;
+        all.count += a->count;
+        sum += (int64_t)a->mean * a->count;
+    }
+    if (all.count == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    all.mean = (int32_t)(sum / (int64_t)all.count);
+
+    char msg_id[24];
+    char report[TUYA_OUTBOX_DATA_LEN];
+    tuya_make_msg_id(msg_id, sizeof(msg_id));
+    int len = snprintf(report, sizeof(report), "{\"msgId\":\"%s\",\"time\":%lld,\"data\":{\"properties\":[",
+                       msg_id, tuya_now_ms());
+    for (int i = 0; i < count && len < (int)sizeof(report); i++) {
+        if (aggs[i].count == 0) {
+            continue;
+        }
+        len += snprintf(report + len, sizeof(report) - len, "{\"code\":\"%s\",\"value\":%ld,\"time\":%lld},",
+                        code, (long)aggs[i].last, (long long)iot_sampler_to_epoch_ms(aggs[i].t_end_us));
+    }
+    if (len < (int)sizeof(report)) {
+        len += snprintf(report + len, sizeof(report) - len,
+                        "{\"code\":\"%s_min\",\"value\":%ld,\"time\":%lld},"
+                        "{\"code\":\"%s_max\",\"value\":%ld,\"time\":%lld},"
+                        "{\"code\":\"%s_mean\",\"value\":%ld,\"time\":%lld}]}}",
+                        code, (long)all.min, (long long)iot_sampler_to_epoch_ms(all.t_min_us),
+                        code, (long)all.max, (long long)iot_sampler_to_epoch_ms(all.t_max_us),
+                        code, (long)all.mean, (long long)iot_sampler_to_epoch_ms(all.t_end_us));
+    }
+    if (len >= (int)sizeof(report)) {
+        ESP_LOGW(MQTT_TAG, "批量上报超长: %d 个窗口", count);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // 不合并：每批是不同时间段的数据
+    return tx_enqueue(TUYA_TX_TELEMETRY, 0, TUYA_TOPIC("thing/data/batch_report"),
+                      report, 1, 0, esp_timer_get_time());
 }
 
 esp_err_t tuya_send_heartbeat(void)
@@ -590,7 +2476,91 @@ esp_err_t tuya_send_heartbeat(void)
     snprintf(heartbeat_msg, sizeof(heartbeat_msg), 
              "{\"properties\":{\"heartbeat\":true,\"timestamp\":%lld}}", (long long)now);
     
-    return tuya_publish_custom_data(heartbeat_msg);
+    return queue_property_report(TUYA_TX_DIAG, "heartbeat", heartbeat_msg, 0);
+}
+
+esp_err_t use_wifi_apply_credentials(const use_wifi_credentials_t* cred)
+{
+    if (!cred || cred->ssid[0] == '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!is_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_prov_start_us = esp_timer_get_time();
+
+    esp_err_t err = save_credentials(cred);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "保存WiFi凭据失败: %s", esp_err_to_name(err));
+    }
+    s_credentials = *cred;
+
+    wifi_config_t wifi_config;
+    build_sta_config(cred, &wifi_config);
+    err = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "设置WiFi配置失败: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "应用新WiFi凭据: %s%s", cred->ssid, cred->channel ? " (定向连接)" : "");
+    s_retry_num = 0;
+    tuya_backoff_reset(&s_wifi_backoff);    // 配网后的首次重连不等待
+    notify_status(USE_WIFI_STATUS_CONNECTING);
+
+    // 已连接时断开，由断开事件重新连接；未连接时直接连接
+    if (esp_wifi_disconnect() != ESP_OK) {
+        esp_wifi_connect();
+    }
+    return ESP_OK;
+}
+
+void use_wifi_set_status_callback(use_wifi_status_cb_t cb)
+{
+    s_status_cb = cb;
+}
+
+esp_err_t use_wifi_get_prov_stats(iot_latency_stat_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = s_prov_stats;
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_get_ack_stats(tuya_ack_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_ack_mux);
+    *stats = s_ack_stats;
+    portEXIT_CRITICAL(&s_ack_mux);
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_get_cmd_stats(tuya_cmd_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_cmd_mux);
+    *stats = s_cmd.stats;
+    portEXIT_CRITICAL(&s_cmd_mux);
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_get_desired_stats(tuya_desired_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_desired_mux);
+    *stats = s_desired;
+    portEXIT_CRITICAL(&s_desired_mux);
+    return ESP_OK;
 }
 
 bool use_wifi_is_connected(void)
@@ -603,70 +2573,356 @@ bool use_wifi_is_connected(void)
     return (bits & WIFI_CONNECTED_BIT) && (bits & SNTP_SYNCED_BIT) && (bits & MQTT_CONNECTED_BIT);
 }
 
+/* 按云端标识符查找DP，找不到返回 IOT_DP_MAX */
+static int dp_find(const char* code)
+{
+    int dp = 0;
+    while (code && dp < IOT_DP_MAX && strcmp(code, s_dp_codes[dp]) != 0) {
+        dp++;
+    }
+    return code ? dp : IOT_DP_MAX;
+}
+
 /**
- * @brief 解析IOT下发的JSON命令
+ * @brief 暂存一个云端下发的属性值，由命令任务执行
+ *
+ * @return uint32_t 受影响的DP位，0表示无法识别的字段或类型不符
  */
-static esp_err_t parse_iot_command(const char* json_data, int data_len)
+static uint32_t stage_property(const char* code, const cJSON* value, int64_t rx_us)
 {
-    // 创建null结尾的字符串
-    char *json_str = malloc(data_len + 1);
-    if (json_str == NULL) {
-        ESP_LOGE(MQTT_TAG, "内存分配失败");
-        return ESP_ERR_NO_MEM;
+    int dp = dp_find(code);
+    if (dp == IOT_DP_MAX) {
+        return 0;
     }
-    
-    memcpy(json_str, json_data, data_len);
-    json_str[data_len] = '\0';
 
-    ESP_LOGI(MQTT_TAG, "开始解析JSON: %s", json_str);
+    tuya_cmd_value_t v = { 0 };
+    if (s_dp_types[dp] == IOT_DP_TYPE_STR) {
+        if (!cJSON_IsString(value)) {
+            return 0;
+        }
+        strncpy(v.s, cJSON_GetStringValue(value), sizeof(v.s) - 1);
+    } else {
+        if (!cJSON_IsNumber(value)) {
+            return 0;
+        }
+        v.i = (int32_t)cJSON_GetNumberValue(value);
+    }
+    portENTER_CRITICAL(&s_cmd_mux);
+    tuya_cmd_put(&s_cmd, (iot_dp_id_t)dp, &v, rx_us);
+    portEXIT_CRITICAL(&s_cmd_mux);
+    return IOT_DP_BIT(dp);
+}
+
+/* 登记应答并唤醒命令任务，执行后由命令任务投递应答 */
+static void stage_commit(const char* msg_id, uint32_t dp_mask, int64_t rx_us)
+{
+    portENTER_CRITICAL(&s_cmd_mux);
+    bool queued = tuya_cmd_add_ack(&s_cmd, msg_id, dp_mask, rx_us);
+    portEXIT_CRITICAL(&s_cmd_mux);
+    if (!queued) {
+        portENTER_CRITICAL(&s_ack_mux);
+        s_ack_stats.dropped++;
+        portEXIT_CRITICAL(&s_ack_mux);
+        ESP_LOGW(MQTT_TAG, "待应答命令已满, msgId=%s", msg_id);
+    }
+    if (s_cmd_task) {
+        xTaskNotifyGive(s_cmd_task);
+    }
+}
+
+/**
+ * @brief 接收一个本地联动规则集分片（base64），收齐后由规则引擎校验并替换
+ */
+static esp_err_t apply_local_rules(const cJSON* value)
+{
+    const char *b64 = cJSON_GetStringValue(value);
+    if (b64 == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t frame[IOT_RULE_CHUNK_MAX];
+    size_t len = 0;
+    if (mbedtls_base64_decode(frame, sizeof(frame), &len, (const unsigned char *)b64, strlen(b64)) != 0) {
+        ESP_LOGW(MQTT_TAG, "规则分片解码失败");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return iot_rule_put_chunk(frame, len);
+}
+
+/**
+ * @brief 解析IOT下发的JSON命令，暂存其中的DP值
+ *
+ * @return esp_err_t ESP_ERR_INVALID_STATE表示重复命令（不执行，只应答）
+ */
+static esp_err_t parse_iot_command(const char* json_data, int data_len, int64_t rx_us)
+{
+    ESP_LOGD(MQTT_TAG, "开始解析JSON: %.*s", data_len, json_data);
+
+    // 按长度解析，不复制成null结尾的字符串
+    cJSON *root = cJSON_ParseWithLength(json_data, data_len);
 
-    // 解析JSON
-    cJSON *root = cJSON_Parse(json_str);
-    free(json_str);
-    
     if (root == NULL) {
         ESP_LOGE(MQTT_TAG, "JSON解析失败");
         return ESP_ERR_INVALID_ARG;
     }
 
-    bool updated = false;
+    // 记录msgId（按完整原文去重），重复下发的命令不再执行
+    char msg_id[TUYA_MSG_ID_MAX_LEN] = "";
+    cJSON *msg_id_item = cJSON_GetObjectItem(root, "msgId");
+    const char *msg_id_full = cJSON_IsString(msg_id_item) ? cJSON_GetStringValue(msg_id_item) : "";
+    strncpy(msg_id, msg_id_full, sizeof(msg_id) - 1);
+    portENTER_CRITICAL(&s_cmd_mux);
+    bool duplicate = tuya_cmd_seen(&s_cmd, msg_id_full);
+    portEXIT_CRITICAL(&s_cmd_mux);
+
+    uint32_t dp_mask = 0;
+    bool rules = false;
 
     // 获取data字段
     cJSON *data_obj = cJSON_GetObjectItem(root, "data");
-    if (data_obj != NULL && cJSON_IsObject(data_obj)) 
-    {
-        // 解析device_status
-        cJSON *device_status_item = cJSON_GetObjectItem(data_obj, "device_status");
-        if (device_status_item != NULL && cJSON_IsString(device_status_item)) {
-            const char *new_status = cJSON_GetStringValue(device_status_item);
-            if (new_status != NULL) {
-                set_device_status(new_status);
-                printf("更新device_status: %s", new_status);
-                updated = true;
+    if (duplicate) {
+        // 不再执行，但照常应答命令涉及的DP（排在尚未执行的原命令之后），云端能区分重复与丢失
+        if (cJSON_IsObject(data_obj)) {
+            cJSON *field = NULL;
+            cJSON_ArrayForEach(field, data_obj) {
+                int dp = dp_find(field->string);
+                dp_mask |= dp < IOT_DP_MAX ? IOT_DP_BIT(dp) : 0;
             }
         }
+        cJSON_Delete(root);
+        ESP_LOGW(MQTT_TAG, "重复命令不再执行, 仅应答, msgId=%s", msg_id);
+        stage_commit(msg_id, dp_mask, rx_us);
+        return ESP_ERR_INVALID_STATE;
+    }
 
-        // 解析test_value
-        cJSON *test_value_item = cJSON_GetObjectItem(data_obj, "test_value");
-        if (test_value_item != NULL && cJSON_IsNumber(test_value_item)) {
-            int32_t new_value = (int32_t)cJSON_GetNumberValue(test_value_item);
-            set_test_value(new_value);
-            printf("更新test_value: %ld", (long)new_value);
-            updated = true;
+    if (data_obj != NULL && cJSON_IsObject(data_obj)) 
+    {
+        cJSON *field = NULL;
+        cJSON_ArrayForEach(field, data_obj) {
+            if (field->string && strcmp(field->string, IOT_RULE_PROPERTY_CODE) == 0) {
+                rules |= apply_local_rules(field) == ESP_OK;
+                continue;
+            }
+            dp_mask |= stage_property(field->string, field, rx_us);
         }
     }
 
     cJSON_Delete(root);
 
-    if (updated) {
-        char current_status[32];
-        int32_t current_value;
-        get_current_iot_state(current_status, sizeof(current_status), &current_value);
-        ESP_LOGI(MQTT_TAG, "当前状态 - device_status: %s, test_value: %ld", 
-                 current_status, (long)current_value);
-        return ESP_OK;
-    } else {
+    if (dp_mask == 0 && !rules) {
         ESP_LOGW(MQTT_TAG, "没有找到可识别的状态字段");
         return ESP_ERR_NOT_FOUND;
     }
-} 
\ No newline at end of file
+    portENTER_CRITICAL(&s_desired_mux);
+    tuya_desired_on_live_set(&s_desired, dp_mask);
+    portEXIT_CRITICAL(&s_desired_mux);
+    // 只有规则分片时应答不带DP，云端收到应答后再下发下一个分片
+    stage_commit(msg_id, dp_mask, rx_us);
+    return ESP_OK;
+} 
+
+void use_wifi_set_report_interval(uint32_t interval_ms)
+{
+    if (!s_link_lock) {
+        return;
+    }
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    if (interval_ms > 0) {
+        tuya_rate_set_base(&s_rate, interval_ms);
+        interval_ms = s_rate.interval_ms;
+    }
+    tuya_liveness_set_report_interval(&s_liveness, interval_ms);
+    xSemaphoreGive(s_link_lock);
+}
+
+esp_err_t use_wifi_get_report_plan(uint32_t* interval_ms, uint8_t* batch)
+{
+    if (!interval_ms || !batch || !s_link_lock) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    *interval_ms = s_rate.interval_ms;
+    *batch = s_rate.batch;
+    xSemaphoreGive(s_link_lock);
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_get_rate_stats(tuya_rate_t* stats)
+{
+    if (!stats || !s_link_lock) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    *stats = s_rate;
+    xSemaphoreGive(s_link_lock);
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_get_roam_stats(tuya_roam_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&s_roam_mux);
+    *stats = s_roam;
+    portEXIT_CRITICAL(&s_roam_mux);
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_get_link_stats(tuya_link_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_link_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_link_lock, portMAX_DELAY);
+    stats->keepalive_s = s_liveness.keepalive_s;
+    stats->stable_s = s_liveness.stable_s;
+    stats->ceiling_s = s_liveness.ceiling_s;
+    stats->publishes = s_liveness.publishes;
+    stats->pings_est = s_liveness.pings_est;
+    stats->heartbeats_sent = s_liveness.heartbeats_sent;
+    stats->heartbeats_folded = s_liveness.heartbeats_folded;
+    stats->backoffs = s_liveness.backoffs;
+    xSemaphoreGive(s_link_lock);
+    return ESP_OK;
+}
+
+void use_wifi_set_mqtt_ext(const use_wifi_mqtt_ext_t* ext)
+{
+    s_mqtt_ext = ext;
+}
+
+esp_err_t use_wifi_mqtt_publish(const char* topic, const char* data, int qos, tuya_tx_class_t cls)
+{
+    return tx_enqueue(cls, 0, topic, data, qos, 0, esp_timer_get_time());
+}
+
+esp_err_t use_wifi_mqtt_subscribe(const char* topic, int qos)
+{
+    if (!mqtt_client || !topic) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return esp_mqtt_client_subscribe(mqtt_client, topic, qos) == -1 ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t use_wifi_get_recover_stats(iot_latency_stat_t* stats, uint32_t* connect_attempts)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = s_recover_stats;
+    if (connect_attempts) {
+        *connect_attempts = s_mqtt_connect_attempts;
+    }
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_get_reconnect_stats(use_wifi_reconnect_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = s_reconnect_stats;
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_register_topic(const char* filter, int qos, bool subscribe,
+                                  use_wifi_topic_handler_t handler, void* ctx)
+{
+    if (!s_router_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_router_lock, portMAX_DELAY);
+    int idx = tuya_router_add(&s_router, filter, qos, subscribe, handler, ctx);
+    xSemaphoreGive(s_router_lock);
+    if (idx < 0) {
+        ESP_LOGE(MQTT_TAG, "注册主题失败: %s", filter ? filter : "");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // 已连接时立即订阅，否则等连接后统一订阅
+    if (subscribe && mqtt_client && (xEventGroupGetBits(s_wifi_event_group) & MQTT_CONNECTED_BIT)) {
+        esp_mqtt_client_subscribe(mqtt_client, filter, qos);
+    }
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_unregister_topic(const char* filter)
+{
+    if (!s_router_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_router_lock, portMAX_DELAY);
+    int idx = tuya_router_remove(&s_router, filter);
+    bool subscribed = idx >= 0 && s_router.routes[idx].subscribe;
+    xSemaphoreGive(s_router_lock);
+    if (idx < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (subscribed && mqtt_client && (xEventGroupGetBits(s_wifi_event_group) & MQTT_CONNECTED_BIT)) {
+        esp_mqtt_client_unsubscribe(mqtt_client, filter);
+    }
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_get_router_stats(tuya_router_stats_t* stats)
+{
+    if (!stats || !s_router_lock) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_router_lock, portMAX_DELAY);
+    stats->routes = s_router.route_count;
+    stats->nodes = s_router.node_count;
+    stats->dispatched = s_router.dispatched;
+    stats->unmatched = s_router.unmatched;
+    uint32_t messages = s_router.dispatched + s_router.unmatched;
+    stats->avg_cycles = messages ? (uint32_t)(s_route_total_cycles / messages) : 0;
+    stats->max_cycles = s_route_max_cycles;
+    xSemaphoreGive(s_router_lock);
+    return ESP_OK;
+}
+
+esp_err_t use_wifi_get_tx_stats(tuya_tx_stats_t* stats)
+{
+    if (!stats || !s_tx_lock) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_tx_lock, portMAX_DELAY);
+    memcpy(stats->cls, s_outbox.stats, sizeof(stats->cls));
+    memcpy(stats->wait, s_tx_wait, sizeof(stats->wait));
+    stats->depth = s_outbox.depth;
+    stats->max_depth = s_outbox.max_depth;
+    xSemaphoreGive(s_tx_lock);
+    return ESP_OK;
+}
+
+void use_wifi_set_bridge(const use_wifi_bridge_ops_t* ops)
+{
+    s_bridge = ops;
+}
+
+void use_wifi_bridge_input(const uint8_t* frame, uint16_t len)
+{
+    if (!s_bridge_rx_queue || !frame || len == 0 || len > BRIDGE_FRAME_MAX) {
+        return;
+    }
+    bridge_frame_t item = { .len = len };
+    memcpy(item.data, frame, len);
+    if (xQueueSend(s_bridge_rx_queue, &item, 0) != pdTRUE) {
+        ESP_LOGW(MQTT_TAG, "BLE桥接接收队列已满");
+        return;
+    }
+    xSemaphoreGive(s_tx_signal);
+}
+
+esp_err_t use_wifi_get_bridge_stats(use_wifi_bridge_stats_t* stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = s_bridge_stats;
+    return ESP_OK;
+}
@@ -2,12 +2,47 @@
 #define USE_WIFI_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
+#include "iot_metrics.h"
+#include "iot_aggregator.h"
+#include "tuya_outbox.h"
+#include "tuya_desired.h"
+#include "tuya_rate.h"
+#include "tuya_roam.h"
+#include "tuya_cmd.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* 命令应答统计 */
+typedef struct {
+    iot_latency_stat_t cmd_to_ack;  // 收到property/set到应答发出的时延
+    uint32_t dropped;               // 应答队列满而丢弃的应答数
+    uint32_t failed;                // 应答发布失败次数
+} tuya_ack_stats_t;
+
+/* WiFi凭据（配网写入，保存在NVS） */
+typedef struct {
+    char ssid[33];
+    char password[65];
+    uint8_t bssid[6];       // 手机已扫描到的AP，可选
+    uint8_t channel;        // AP所在信道，0表示未知
+    bool bssid_set;
+} use_wifi_credentials_t;
+
+/* 连接进度 */
+typedef enum {
+    USE_WIFI_STATUS_CONNECTING = 1,
+    USE_WIFI_STATUS_DISCONNECTED,
+    USE_WIFI_STATUS_GOT_IP,
+    USE_WIFI_STATUS_SNTP_SYNCED,
+    USE_WIFI_STATUS_MQTT_CONNECTED,
+} use_wifi_status_t;
+
+typedef void (*use_wifi_status_cb_t)(use_wifi_status_t status);
+
 /**
  * @brief 初始化并启动WiFi和MQTT连接
  * 
@@ -17,8 +52,13 @@ esp_err_t use_wifi_start(void);
 
 /**
  * @brief 停止WiFi和MQTT连接
+ *
+ * 注销事件、删除退避定时器，等待并删除组件的常驻任务（tuya_tx、tuya_ack、tuya_cmd、tuya_conn、tuya_link），
+ * 丢弃未发送的消息并结束BLE桥接会话，释放WiFi驱动和网络接口，注销本组件的主题和状态回调。
+ * 成功后可再次调用 use_wifi_start；其他组件注册的主题保留，网络协议栈和默认事件循环不释放
  * 
- * @return esp_err_t 
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_TIMEOUT表示有任务未在5 s内退出，此时不释放任何资源，
+ *         须再次调用本函数完成停止，在此之前 use_wifi_start 返回 ESP_ERR_INVALID_STATE
  */
 esp_err_t use_wifi_stop(void);
 
@@ -39,6 +79,26 @@ esp_err_t use_wifi_wait_connected(uint32_t timeout_ms);
  */
 esp_err_t tuya_publish_sensor_data(uint8_t test_value, char* device_status);
 
+/**
+ * @brief 发布一个聚合窗口：last作为当前值，另附min/max/mean属性，各自带采样时刻
+ * 
+ * @param code DP标识符，例如 "test_value"，附加属性为 code_min/code_max/code_mean
+ * @param agg 窗口聚合结果
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_NOT_FOUND表示窗口内没有样本
+ */
+esp_err_t tuya_publish_aggregate(const char* code, const iot_agg_result_t* agg);
+
+/**
+ * @brief 批量发布多个连续的聚合窗口（thing/data/batch_report）：各窗口的last带各自时刻，
+ *        min/max/mean合并为整批的一组；只有一个窗口时等同于 tuya_publish_aggregate
+ * 
+ * @param code DP标识符
+ * @param aggs 按时间先后排列的窗口聚合结果
+ * @param count 窗口数，不超过 TUYA_RATE_MAX_BATCH
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_NOT_FOUND表示所有窗口都没有样本
+ */
+esp_err_t tuya_publish_aggregate_batch(const char* code, const iot_agg_result_t* aggs, int count);
+
 /**
  * @brief 发送心跳数据到涂鸦平台
  * 
@@ -46,6 +106,39 @@ esp_err_t tuya_publish_sensor_data(uint8_t test_value, char* device_status);
  */
 esp_err_t tuya_send_heartbeat(void);
 
+/**
+ * @brief 应用新的WiFi凭据：保存到NVS并立即重连，无需重启
+ * 
+ * 提供BSSID和信道时跳过扫描直接连接
+ * 
+ * @param cred 新凭据
+ * @return esp_err_t ESP_OK表示已开始连接
+ */
+esp_err_t use_wifi_apply_credentials(const use_wifi_credentials_t* cred);
+
+/**
+ * @brief 设置连接进度回调（在WiFi/MQTT事件任务中调用）
+ * 
+ * @param cb 回调函数，NULL表示取消
+ */
+void use_wifi_set_status_callback(use_wifi_status_cb_t cb);
+
+/**
+ * @brief 获取从配网写入到MQTT连接成功的耗时统计
+ * 
+ * @param stats 输出统计数据
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_prov_stats(iot_latency_stat_t* stats);
+
+/**
+ * @brief 获取命令应答统计（命令到应答的时延等）
+ * 
+ * @param stats 输出统计数据
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_ack_stats(tuya_ack_stats_t* stats);
+
 /**
  * @brief 检查完整连接状态
  * 
@@ -54,6 +147,247 @@ esp_err_t tuya_send_heartbeat(void);
  */
 bool use_wifi_is_connected(void);
 
+/* 链路保活统计 */
+typedef struct {
+    uint16_t keepalive_s;           // 当前keepalive
+    uint16_t stable_s;              // 已验证安全的keepalive
+    uint16_t ceiling_s;             // 曾导致断线的keepalive，0表示未知
+    uint32_t publishes;             // 上行发布数
+    uint32_t pings_est;             // 估算的PINGREQ数
+    uint32_t heartbeats_sent;       // 单独发送的心跳数
+    uint32_t heartbeats_folded;     // 并入数据上报的心跳数
+    uint32_t backoffs;              // keepalive回退次数
+} tuya_link_stats_t;
+
+/**
+ * @brief 设置周期上报的基础间隔，心跳到期时若上报即将发生则并入上报
+ * 
+ * 实际间隔由上报速率控制按链路质量在基础间隔之上调整，见 use_wifi_get_report_plan
+ * 
+ * @param interval_ms 链路良好时的上报间隔（毫秒），0表示没有周期上报
+ */
+void use_wifi_set_report_interval(uint32_t interval_ms);
+
+/**
+ * @brief 获取当前的上报计划：按RSSI、PUBACK时延和重发情况调整后的上报间隔和打包数
+ * 
+ * @param interval_ms 输出上报间隔（毫秒）
+ * @param batch 输出每次上报打包的采样窗口数，窗口长度为 interval_ms / batch
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_report_plan(uint32_t* interval_ms, uint8_t* batch);
+
+/**
+ * @brief 获取上报速率控制的状态和统计（PUBACK确认数、估算重发数、丢弃数、调整次数）
+ * 
+ * @param stats 输出控制器快照
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_rate_stats(tuya_rate_t* stats);
+
+/**
+ * @brief 获取链路保活统计
+ * 
+ * @param stats 输出统计
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_link_stats(tuya_link_stats_t* stats);
+
+/**
+ * @brief 获取漫游统计：触发、BTM查询、成功切换和超时次数，以及断开旧AP到关联新AP的切换间隙
+ * 
+ * @param stats 输出漫游状态快照
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_roam_stats(tuya_roam_t* stats);
+
+/* 设备命名空间下的主题，device ID 为编译期常量，主题在编译期拼接（需包含 common.h） */
+#define TUYA_TOPIC(suffix)  "tylink/" TUYA_DEVICE_ID "/" suffix
+
+// 下行主题处理函数，在MQTT任务中调用，返回true表示消息已处理
+typedef bool (*use_wifi_topic_handler_t)(const char* topic, int topic_len,
+                                         const char* data, int data_len, void* ctx);
+
+/* 下行主题路由统计 */
+typedef struct {
+    uint16_t routes;                // 已注册的主题数
+    uint16_t nodes;                 // 前缀树节点数
+    uint32_t dispatched;            // 已处理的下行消息数
+    uint32_t unmatched;             // 没有处理函数的下行消息数
+    uint32_t avg_cycles;            // 每条消息查找路由的平均CPU周期
+    uint32_t max_cycles;            // 单条消息查找路由的最大CPU周期
+} tuya_router_stats_t;
+
+/**
+ * @brief 注册下行主题处理函数，同一过滤器重复注册时替换处理函数
+ * 
+ * 过滤器支持 '+' 和 '#' 通配符；subscribe为true时每次连接后统一订阅，
+ * 已连接时立即订阅。通配符过滤器一般只用于路由（subscribe为false），
+ * 由调用方订阅具体主题
+ * 
+ * @param filter 主题过滤器，如 TUYA_TOPIC("thing/action/execute")
+ * @param qos 订阅的服务质量等级
+ * @param subscribe 是否由连接流程订阅
+ * @param handler 处理函数
+ * @param ctx 处理函数参数
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_NO_MEM表示路由表已满
+ */
+esp_err_t use_wifi_register_topic(const char* filter, int qos, bool subscribe,
+                                  use_wifi_topic_handler_t handler, void* ctx);
+
+/**
+ * @brief 注销下行主题处理函数，已连接时同时取消订阅
+ * 
+ * @param filter 注册时使用的过滤器
+ * @return esp_err_t ESP_OK表示成功，ESP_ERR_NOT_FOUND表示未注册
+ */
+esp_err_t use_wifi_unregister_topic(const char* filter);
+
+/**
+ * @brief 获取下行主题路由统计
+ * 
+ * @param stats 输出统计
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_router_stats(tuya_router_stats_t* stats);
+
+/* MQTT扩展：其他组件复用同一MQTT连接（如网关子设备），回调在MQTT任务中执行 */
+typedef struct {
+    void (*on_connected)(void);     // 每次MQTT连接成功后调用，用于重新订阅
+    bool (*on_message)(const char* topic, int topic_len,
+                       const char* data, int data_len);    // 未被路由处理的消息，返回true表示已处理
+} use_wifi_mqtt_ext_t;
+
+/**
+ * @brief 注册MQTT扩展
+ * 
+ * @param ext 扩展回调，须在程序运行期间保持有效
+ */
+void use_wifi_set_mqtt_ext(const use_wifi_mqtt_ext_t* ext);
+
+/**
+ * @brief 发布到完整主题：放入上行发送队列，按优先级发送
+ * 
+ * @param topic 主题
+ * @param data 消息内容，不超过 TUYA_OUTBOX_DATA_LEN-1 字节
+ * @param qos 服务质量等级
+ * @param cls 优先级
+ * @return esp_err_t ESP_OK表示已入队，ESP_ERR_NO_MEM表示队列已满或消息过长
+ */
+esp_err_t use_wifi_mqtt_publish(const char* topic, const char* data, int qos, tuya_tx_class_t cls);
+
+/**
+ * @brief 订阅完整主题
+ * 
+ * @param topic 主题
+ * @param qos 服务质量等级
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_mqtt_subscribe(const char* topic, int qos);
+
+/* 上行发送队列统计 */
+typedef struct {
+    tuya_outbox_class_stats_t cls[TUYA_TX_CLASS_NUM];   // 各优先级的入队、合并、丢弃、发送数
+    iot_latency_stat_t wait[TUYA_TX_CLASS_NUM];         // 消息产生到交给MQTT客户端的时延
+    uint16_t depth;                 // 当前排队消息数
+    uint16_t max_depth;             // 最大排队消息数（不超过 TUYA_OUTBOX_SLOTS）
+} tuya_tx_stats_t;
+
+/**
+ * @brief 获取上行发送队列统计
+ * 
+ * @param stats 输出统计
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_tx_stats(tuya_tx_stats_t* stats);
+
+/* BLE桥接：MQTT断开时上行消息经手机转发（帧格式见 tuya_bridge.h） */
+typedef struct {
+    bool (*ready)(void);                                    // 手机已连接并订阅桥接通知
+    uint16_t (*max_frame)(void);                            // 单帧最大长度（协商MTU-3）
+    esp_err_t (*send)(const uint8_t* frame, uint16_t len);  // 发送一帧通知
+} use_wifi_bridge_ops_t;
+
+/* BLE桥接统计 */
+typedef struct {
+    uint32_t messages;              // 手机已确认转发的消息数
+    uint32_t frames;                // 发送的通知帧数（含重发）
+    uint32_t retransmits;           // ACK超时重发次数
+    uint32_t requeued;              // 未确认而放回发送队列的消息数
+    uint32_t commands;              // 经手机收到的云端下行消息数
+    uint32_t rejected;              // 签名错误、重放或主题不允许而丢弃的下行消息数
+    uint32_t bytes_acked;           // 已确认的消息字节数
+    uint32_t bytes_per_s;           // 有效吞吐：已确认字节 / 发出到确认的累计时间
+    uint16_t max_frame;             // 最近使用的单帧长度
+    iot_latency_stat_t ack_rtt;     // 首帧发出到收到ACK的时延
+} use_wifi_bridge_stats_t;
+
+/**
+ * @brief 设置BLE桥接传输
+ * 
+ * @param ops 传输接口，须在程序运行期间保持有效
+ */
+void use_wifi_set_bridge(const use_wifi_bridge_ops_t* ops);
+
+/**
+ * @brief 输入一帧手机写入的桥接数据（ACK或云端下行消息），可在 NimBLE 主机任务中调用
+ * 
+ * @param frame 帧
+ * @param len 帧长度
+ */
+void use_wifi_bridge_input(const uint8_t* frame, uint16_t len);
+
+/**
+ * @brief 获取BLE桥接统计
+ * 
+ * @param stats 输出统计
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_bridge_stats(use_wifi_bridge_stats_t* stats);
+
+/**
+ * @brief 获取断线恢复统计：从WiFi或MQTT断开到MQTT重新连接的耗时
+ * 
+ * @param stats 输出统计
+ * @param connect_attempts 输出MQTT连接尝试总次数，可为NULL
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_recover_stats(iot_latency_stat_t* stats, uint32_t* connect_attempts);
+
+/* MQTT重连方式和重连前后的堆占用 */
+typedef struct {
+    uint32_t reuses;                // 复用已有客户端重连的次数
+    uint32_t rebuilds;              // 销毁并重建客户端的次数
+    uint32_t free_before;           // 最近一次重连前的空闲堆
+    uint32_t min_before;            // 最近一次重连前的历史最小空闲堆
+    uint32_t free_after;            // 最近一次重连成功后的空闲堆
+    uint32_t min_after;             // 最近一次重连成功后的历史最小空闲堆
+} use_wifi_reconnect_stats_t;
+
+/**
+ * @brief 获取MQTT重连统计：复用与重建客户端的次数，最近一次重连前后的空闲堆和最小空闲堆
+ * 
+ * @param stats 输出统计
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_reconnect_stats(use_wifi_reconnect_stats_t* stats);
+
+/**
+ * @brief 获取期望属性同步统计：对账结果计数，以及从重连、从断线开始到期望值应用完成的收敛耗时
+ * 
+ * @param stats 输出同步状态快照
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_desired_stats(tuya_desired_t* stats);
+
+/**
+ * @brief 获取下行命令统计：去重、合并、执行次数，占用MQTT任务的时间和收到到执行的时延
+ *
+ * @param stats 输出统计
+ * @return esp_err_t ESP_OK表示成功
+ */
+esp_err_t use_wifi_get_cmd_stats(tuya_cmd_stats_t* stats);
+
 #ifdef __cplusplus
 }
 #endif
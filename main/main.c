@@ -4,104 +4,467 @@
 * @LastEditors: FZH
 * @LastEditTime: 2025-08-21 16:09:32
 */
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "use_wifi.h"
 #include "use_ble_server.h"
+#include "use_lan_ctrl.h"
+#include "use_gateway.h"
 #include "common.h"
+#include "iot_sysmon.h"
+#include "iot_sampler.h"
+#include "iot_history.h"
+#include "iot_sched.h"
+#include "iot_boot.h"
+#include "iot_persist.h"
+#include "iot_rule.h"
+#include "iot_static.h"
+#include "iot_trace.h"
 
 static const char *TAG = "main";
 
-void app_main(void)
+/* 周期任务，同周期的任务用相位错开 */
+#define REPORT_PERIOD_MS        10000   // 链路良好时的上报间隔，弱信号或拥塞时由WiFi组件放大
+#define STATUS_LOG_PERIOD_MS    10000
+#define STATUS_LOG_PHASE_MS     5000
+#define BLE_PUSH_PERIOD_MS      50000   // BLE连接时推送测试数据
+#define BLE_PUSH_PHASE_MS       2000
+#define SENSOR_RAMP_PERIOD_MS   10000   // 模拟传感器数据变化，在上报之后
+#define SENSOR_RAMP_PHASE_MS    9000
+#define SCHED_STATS_PERIOD_MS   (3600 * 1000)
+
+/* BLE配网：把手机写入的参数交给WiFi组件，立即重连 */
+static esp_err_t on_ble_prov(const ble_prov_config_t* config)
+{
+    use_wifi_credentials_t cred = { 0 };
+    strncpy(cred.ssid, config->ssid, sizeof(cred.ssid) - 1);
+    strncpy(cred.password, config->password, sizeof(cred.password) - 1);
+    if (config->bssid_set) {
+        memcpy(cred.bssid, config->bssid, sizeof(cred.bssid));
+        cred.bssid_set = true;
+        cred.channel = config->channel;
+    }
+    return use_wifi_apply_credentials(&cred);
+}
+
+/* 采样源：读取当前test_value */
+static int32_t read_test_value(void* ctx)
+{
+    return g_iot_state.test_value;   // 32位对齐读取，无需加锁
+}
+
+/* 每个样本同时写入本地历史，未对时的样本由历史存储丢弃 */
+static void on_sample(const iot_sample_t* sample, void* ctx)
+{
+    iot_history_append(sample->dp, iot_sampler_to_epoch_ms(sample->t_us), sample->value);
+}
+
+static bool on_history_point(const iot_hist_point_t* point, void* ctx)
+{
+    return use_ble_server_history_put(point->dp, point->t_ms, point->value) == ESP_OK;
+}
+
+/* BLE历史查询：按时间范围读取本地历史并逐条输出 */
+static esp_err_t on_ble_history_query(const ble_history_query_t* query)
+{
+    int64_t from_ms = (int64_t)query->from_s * 1000;
+    int64_t to_ms = query->to_s ? (int64_t)query->to_s * 1000 + 999 : INT64_MAX;
+    return iot_history_query(query->dp_mask, from_ms, to_ms, on_history_point, NULL);
+}
+
+/* 上报：每个采样窗口结束时收下聚合结果，攒够一批后连同传感器数据一起发布
+ * 窗口长度和批大小按WiFi组件给出的上报计划逐次调整 */
+static iot_agg_result_t s_report_batch[TUYA_RATE_MAX_BATCH];
+static int s_report_batch_len = 0;
+static int s_report_job = IOT_SCHED_NONE;
+static uint32_t s_report_window_ms = REPORT_PERIOD_MS;
+
+static void report_job(void* ctx)
+{
+    uint32_t interval_ms = REPORT_PERIOD_MS;
+    uint8_t batch = 1;
+    use_wifi_get_report_plan(&interval_ms, &batch);
+    // 周期任务按上次到期时刻换算新周期，调整窗口长度不会累积漂移
+    uint32_t window_ms = interval_ms / batch;
+    if (window_ms != s_report_window_ms) {
+        esp_err_t err = iot_sched_set_period(s_report_job, window_ms);
+        if (err == ESP_OK) {
+            ESP_LOGI(TAG, "上报窗口 %lu -> %lu ms (间隔 %lu ms x %u)", (unsigned long)s_report_window_ms,
+                     (unsigned long)window_ms, (unsigned long)interval_ms, batch);
+            s_report_window_ms = window_ms;
+        } else {
+            ESP_LOGW(TAG, "调整上报窗口失败: %s", esp_err_to_name(err));
+        }
+    }
+
+    if (!use_wifi_is_connected()) {
+        ESP_LOGW(TAG, "连接已断开，等待重连...");
+        return;
+    }
+
+    iot_agg_result_t agg;
+    if (iot_sampler_take_window(IOT_DP_TEST_VALUE, &agg) == ESP_OK && agg.count > 0) {
+        s_report_batch[s_report_batch_len++] = agg;
+    }
+    if (s_report_batch_len < batch && s_report_batch_len < TUYA_RATE_MAX_BATCH) {
+        return;
+    }
+
+    char current_device_status[32];
+    int32_t current_test_value;
+    get_current_iot_state(current_device_status, sizeof(current_device_status), &current_test_value);
+
+    esp_err_t result = tuya_publish_sensor_data(current_test_value, current_device_status);
+    if (result == ESP_OK) {
+        ESP_LOGI(TAG, "传感器数据发送成功: test_value=%d°C, device_status=%s", 
+                 current_test_value, current_device_status);
+    } else {
+        ESP_LOGW(TAG, "传感器数据发送失败");
+    }
+
+    if (s_report_batch_len > 0) {
+        tuya_publish_aggregate_batch("test_value", s_report_batch, s_report_batch_len);
+        s_report_batch_len = 0;
+    }
+}
+
+/* 打印当前状态并按设备状态执行相应操作 */
+static void status_log_job(void* ctx)
+{
+    char current_device_status[32];
+    int32_t current_test_value;
+    get_current_iot_state(current_device_status, sizeof(current_device_status), &current_test_value);
+
+    ESP_LOGI(TAG, "当前IOT状态 - device_status: %s, test_value: %ld, BLE: %s", 
+             current_device_status, (long)current_test_value, 
+             use_ble_server_is_connected() ? "已连接" : "未连接");
+
+    // 显示BLE MTU信息（仅在连接时）
+    if (use_ble_server_is_connected()) {
+        ESP_LOGI(TAG, "BLE MTU: %d 字节, 最大传输: %d 字节", 
+                 use_ble_server_get_mtu(), use_ble_server_get_max_data_len());
+    }
+
+    if (strcmp(current_device_status, "open") == 0) {
+        ESP_LOGI(TAG, "设备处于开启状态，执行开启操作");
+    } else if (strcmp(current_device_status, "close") == 0) {
+        ESP_LOGI(TAG, "设备处于关闭状态，执行关闭操作");
+    }
+}
+
+/* 仅在BLE连接时发送测试数据 */
+static void ble_push_job(void* ctx)
+{
+    if (!use_ble_server_is_connected()) {
+        return;
+    }
+    char current_device_status[32];
+    int32_t current_test_value;
+    get_current_iot_state(current_device_status, sizeof(current_device_status), &current_test_value);
+    if (use_ble_server_update_device_status(current_device_status, current_test_value) == ESP_OK) {
+        ESP_LOGI(TAG, "BLE测试数据发送成功");
+    }
+}
+
+#if CONFIG_EXAMPLE_SENSOR_RAMP
+/* 模拟传感器数据变化（调试用，每一步都会上报并写入NVS） */
+static void sensor_ramp_job(void* ctx)
+{
+    int32_t value = g_iot_state.test_value;
+    set_test_value(value >= 50 ? 10 : value + 1);
+}
+#endif
+
+static void sched_stats_job(void* ctx)
+{
+    iot_sched_log_stats();
+
+    iot_persist_info_t persist;
+    if (iot_persist_get_info(&persist) == ESP_OK) {
+        ESP_LOGI(TAG, "状态持久化: 变化 %lu 次, 写入 %lu 次 (%lu 次/小时), 内容未变省去 %lu 次, 累计写入 %lu 次",
+                 (unsigned long)persist.stats.changes, (unsigned long)persist.stats.writes,
+                 (unsigned long)persist.writes_per_hour, (unsigned long)persist.stats.skipped_same,
+                 (unsigned long)persist.lifetime_writes);
+    }
+
+    iot_rule_info_t rules;
+    if (iot_rule_get_info(&rules) == ESP_OK && rules.count > 0) {
+        ESP_LOGI(TAG, "本地规则 %u 条: 求值 %lu 次, 触发 %lu 次, 嵌套过深忽略 %lu 次, 单次变化耗时 avg %lu / max %lu us",
+                 rules.count, (unsigned long)rules.stats.evals, (unsigned long)rules.stats.fires,
+                 (unsigned long)rules.stats.depth_drops, (unsigned long)iot_latency_avg_us(&rules.eval),
+                 (unsigned long)rules.eval.max_us);
+    }
+
+    tuya_rate_t rate;
+    if (use_wifi_get_rate_stats(&rate) == ESP_OK) {
+        ESP_LOGI(TAG, "上报间隔 %lu ms x %u 窗口, RSSI %d dBm, PUBACK %lu 次 (最大 %lu ms), 重发 %lu, 丢弃 %lu, 退避 %lu / 恢复 %lu",
+                 (unsigned long)rate.interval_ms, rate.batch, rate.rssi, (unsigned long)rate.acks,
+                 (unsigned long)rate.max_rtt_ms, (unsigned long)rate.retransmits, (unsigned long)rate.lost,
+                 (unsigned long)rate.backoffs, (unsigned long)rate.recoveries);
+    }
+
+    tuya_roam_t roam;
+    if (use_wifi_get_roam_stats(&roam) == ESP_OK && (roam.triggers > 0 || roam.roams > 0)) {
+        ESP_LOGI(TAG, "漫游: 触发 %lu 次, 切换 %lu 次 (BTM查询 %lu), 无更好AP %lu, 超时 %lu, 切换间隙 avg %lu / max %lu ms",
+                 (unsigned long)roam.triggers, (unsigned long)roam.roams, (unsigned long)roam.btm_queries,
+                 (unsigned long)roam.no_candidate, (unsigned long)roam.failures,
+                 (unsigned long)(iot_latency_avg_us(&roam.gap) / 1000), (unsigned long)(roam.gap.max_us / 1000));
+    }
+
+    use_wifi_reconnect_stats_t reconn;
+    if (use_wifi_get_reconnect_stats(&reconn) == ESP_OK && (reconn.reuses > 0 || reconn.rebuilds > 0)) {
+        ESP_LOGI(TAG, "MQTT重连: 复用客户端 %lu 次, 重建 %lu 次, 最近一次空闲堆 %lu -> %lu, 最小 %lu -> %lu",
+                 (unsigned long)reconn.reuses, (unsigned long)reconn.rebuilds,
+                 (unsigned long)reconn.free_before, (unsigned long)reconn.free_after,
+                 (unsigned long)reconn.min_before, (unsigned long)reconn.min_after);
+    }
+
+    tuya_cmd_stats_t cmd;
+    if (use_wifi_get_cmd_stats(&cmd) == ESP_OK && cmd.commands > 0) {
+        ESP_LOGI(TAG, "下行命令 %lu 条 (重复 %lu): 合并 %lu 个值, 执行 %lu 次共 %lu 个DP, 占用MQTT任务 avg %lu / max %lu us, 执行时延 avg %lu / max %lu ms",
+                 (unsigned long)cmd.commands, (unsigned long)cmd.duplicates, (unsigned long)cmd.coalesced,
+                 (unsigned long)cmd.applies, (unsigned long)cmd.actuations,
+                 (unsigned long)iot_latency_avg_us(&cmd.hold), (unsigned long)cmd.hold.max_us,
+                 (unsigned long)(iot_latency_avg_us(&cmd.delay) / 1000), (unsigned long)(cmd.delay.max_us / 1000));
+    }
+
+    ble_dp_read_stats_t ble_reads;
+    if (use_ble_server_get_dp_read_stats(&ble_reads) == ESP_OK && ble_reads.reads > 0) {
+        ESP_LOGI(TAG, "BLE数据点读回调 %lu 次, 平均 %lu / 最大 %lu 周期",
+                 (unsigned long)ble_reads.reads, (unsigned long)ble_reads.avg_cycles,
+                 (unsigned long)ble_reads.max_cycles);
+    }
+
+    // 静态内存模式：联网后各组件不应再申请堆内存
+    iot_static_stats_t mem;
+    iot_static_get_stats(&mem);
+    for (int i = 0; i < mem.num_classes; i++) {
+        ESP_LOGI(TAG, "内存池 %u 字节块: 占用 %u/%u, 峰值 %u", mem.classes[i].block_size,
+                 mem.classes[i].in_use, mem.classes[i].count, mem.classes[i].peak);
+    }
+    if (mem.heap_hooks) {
+        ESP_LOGI(TAG, "稳态堆分配 %lu 次 / %lu 字节, 内存池用完 %lu 次",
+                 (unsigned long)mem.steady_allocs, (unsigned long)mem.steady_bytes,
+                 (unsigned long)mem.pool_fails);
+    }
+}
+
+#if CONFIG_IOT_TRACE
+/* 把启动和联网过程的执行轨迹导出到串口，用 tools/iot_trace_to_perfetto.py 转换 */
+static void trace_dump_job(void* ctx)
+{
+    iot_trace_dump_uart();
+}
+#endif
+
+/* 子设备命令：当前子设备只广播不连接，记录下来由后续的BLE下行通道处理 */
+static void on_subdev_command(const gw_subdev_t* dev, const char* data, int data_len)
+{
+    ESP_LOGI(TAG, "子设备 %s 命令: %.*s", dev->node_id, data_len, data);
+}
+
+/* MQTT断开时经已连接的手机转发上行消息 */
+static const use_wifi_bridge_ops_t s_ble_bridge = {
+    .ready = use_ble_server_bridge_ready,
+    .max_frame = use_ble_server_get_max_data_len,
+    .send = use_ble_server_bridge_send,
+};
+
+/* WiFi连接进度通过BLE通知手机 */
+static void on_wifi_status(use_wifi_status_t status)
+{
+    switch (status) {
+    case USE_WIFI_STATUS_CONNECTING:
+        use_ble_server_prov_notify_status(BLE_PROV_STATUS_CONNECTING);
+        break;
+    case USE_WIFI_STATUS_GOT_IP:
+        use_ble_server_prov_notify_status(BLE_PROV_STATUS_WIFI_CONNECTED);
+        break;
+    case USE_WIFI_STATUS_SNTP_SYNCED:
+        use_ble_server_prov_notify_status(BLE_PROV_STATUS_TIME_SYNCED);
+        break;
+    case USE_WIFI_STATUS_MQTT_CONNECTED:
+        use_ble_server_prov_notify_status(BLE_PROV_STATUS_CLOUD_CONNECTED);
+        break;
+    default:
+        break;
+    }
+}
+
+/* ========== 启动阶段 ==========
+ * 本地功能（状态、采样、BLE、周期任务）不等待云端，联网后再加入上报任务
+ */
+
+static esp_err_t stage_nvs(void)
 {
-    // 初始化NVS
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
         ret = nvs_flash_init();
     }
-    ESP_ERROR_CHECK(ret);
+    return ret;
+}
 
-    // 初始化公共状态
+static esp_err_t stage_state(void)
+{
+    // 初始化公共状态，再用上次保存的状态覆盖默认值
     common_init();
-    
+    esp_err_t ret = iot_persist_start();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "状态持久化启动失败: %s", esp_err_to_name(ret));
+    }
+    // 恢复的状态不触发规则，之后的变化才求值
+    ret = iot_rule_start();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "本地规则启动失败: %s", esp_err_to_name(ret));
+    }
+
+    // 启动运行时资源监控（栈余量、CPU占比、堆碎片），失败不影响其他阶段
+    if (iot_sysmon_start(IOT_SYSMON_DEFAULT_PERIOD_MS) != ESP_OK) {
+        ESP_LOGW(TAG, "资源监控启动失败");
+    }
+    return ESP_OK;
+}
+
+static esp_err_t stage_sampler(void)
+{
+    // 按固定频率采样test_value，上报时发送窗口内的min/max/mean
+    iot_sampler_add_source(IOT_DP_TEST_VALUE, read_test_value, NULL, 1);
+    if (iot_history_init() == ESP_OK) {
+        iot_sampler_set_sink(on_sample, NULL);
+    }
+    return iot_sampler_start(IOT_SAMPLER_DEFAULT_HZ);
+}
+
+/* 不依赖云端的周期任务 */
+static esp_err_t stage_local_jobs(void)
+{
+    esp_err_t ret = iot_sched_start();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    iot_sched_every("status_log", STATUS_LOG_PERIOD_MS, STATUS_LOG_PHASE_MS, status_log_job, NULL, NULL);
+    iot_sched_every("ble_push", BLE_PUSH_PERIOD_MS, BLE_PUSH_PHASE_MS, ble_push_job, NULL, NULL);
+#if CONFIG_EXAMPLE_SENSOR_RAMP
+    iot_sched_every("sensor_ramp", SENSOR_RAMP_PERIOD_MS, SENSOR_RAMP_PHASE_MS, sensor_ramp_job, NULL, NULL);
+#endif
+    iot_sched_every("sched_stats", SCHED_STATS_PERIOD_MS, SCHED_STATS_PERIOD_MS, sched_stats_job, NULL, NULL);
+    return ESP_OK;
+}
+
+static esp_err_t stage_ble(void)
+{
     // 初始化并启动BLE服务器
-    ESP_LOGI(TAG, "初始化BLE服务器...");
-    esp_err_t ble_ret = use_ble_server_init();
-    if (ble_ret == ESP_OK) {
-        ESP_LOGI(TAG, "BLE服务器初始化成功");
-        use_ble_server_start();
-    } else {
-        ESP_LOGE(TAG, "BLE服务器初始化失败: %s", esp_err_to_name(ble_ret));
-    }
-    
-    // 启动WiFi和MQTT连接
-    ESP_ERROR_CHECK(use_wifi_start());
-
-    // 等待连接成功
-    ESP_LOGI(TAG, "等待WiFi和MQTT连接...");
-    esp_err_t connect_result = use_wifi_wait_connected(0); // 永久等待
-
-    if (connect_result == ESP_OK) {
-        ESP_LOGI(TAG, "连接成功！开始IoT数据传输");
-
-        // 主循环 - 定期发送数据
-        while (1) {
-            if (use_wifi_is_connected()) {
-                // 获取当前IOT状态
-                char current_device_status[32];
-                int32_t current_test_value;
-                get_current_iot_state(current_device_status, sizeof(current_device_status), &current_test_value);
-
-                
-                ESP_LOGI(TAG, "当前IOT状态 - device_status: %s, test_value: %ld, BLE: %s", 
-                         current_device_status, (long)current_test_value, 
-                         use_ble_server_is_connected() ? "已连接" : "未连接");
-                
-                // 显示BLE MTU信息（仅在连接时）
-                if (use_ble_server_is_connected()) {
-                    ESP_LOGI(TAG, "BLE MTU: %d 字节, 最大传输: %d 字节", 
-                             use_ble_server_get_mtu(), use_ble_server_get_max_data_len());
-                }
-                
-                // 根据设备状态执行相应操作
-                if (strcmp(current_device_status, "open") == 0) {
-                    ESP_LOGI(TAG, "设备处于开启状态，执行开启操作");
-                } else if (strcmp(current_device_status, "close") == 0) {
-                    ESP_LOGI(TAG, "设备处于关闭状态，执行关闭操作");
-                }
-
-                // 发送传感器数据（使用本地测试值）
-                esp_err_t result = tuya_publish_sensor_data(current_test_value, current_device_status);
-                if (result == ESP_OK) {
-                    ESP_LOGI(TAG, "传感器数据发送成功: test_value=%d°C, device_status=%s", 
-                             current_test_value, current_device_status);
-                } else {
-                    ESP_LOGW(TAG, "传感器数据发送失败");
-                }
-
-                // 简化版本：仅在BLE连接时发送测试数据（可选）
-                static int ble_send_counter = 0;
-                if (use_ble_server_is_connected() && (ble_send_counter % 5 == 0)) {  // 每50秒发送一次测试数据
-                    esp_err_t ble_result = use_ble_server_update_device_status(current_device_status, current_test_value);
-                    if (ble_result == ESP_OK) {
-                        ESP_LOGI(TAG, "BLE测试数据发送成功");
-                    }
-                }
-                ble_send_counter++;
-
-                // 模拟传感器数据变化
-                g_iot_state.test_value += 1;
-                if (g_iot_state.test_value > 50) g_iot_state.test_value = 10;
-            } else {
-                ESP_LOGW(TAG, "连接已断开，等待重连...");
-            }
-
-            vTaskDelay(10000 / portTICK_PERIOD_MS); // 10秒间隔
-        }
-    } else {
-        ESP_LOGE(TAG, "连接失败，程序退出");
+    esp_err_t ret = use_ble_server_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    use_ble_server_set_prov_handler(on_ble_prov);
+    use_ble_server_set_history_handler(on_ble_history_query);
+    use_ble_server_set_bridge_handler(use_wifi_bridge_input);   // WiFi组件启动前写入的帧被丢弃
+    use_ble_server_set_rules_handler(iot_rule_put_chunk);
+    return use_ble_server_start();
+}
+
+static esp_err_t stage_wifi(void)
+{
+    // 启动WiFi和MQTT连接，不等待连接结果
+    use_wifi_set_status_callback(on_wifi_status);
+    use_wifi_set_bridge(&s_ble_bridge);
+    esp_err_t ret = use_wifi_start();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    use_wifi_set_report_interval(REPORT_PERIOD_MS);   // 上报间隔的基准，心跳可并入上报
+    return ESP_OK;
+}
+
+#if GATEWAY_ENABLE
+/* 网关模式：扫描BLE子设备广播，通过本机的MQTT连接代为上报 */
+static esp_err_t stage_gateway(void)
+{
+    esp_err_t ret = use_gateway_start();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    use_gateway_set_downlink_handler(on_subdev_command);
+    return use_ble_server_start_scan(use_gateway_on_adv);
+}
+#endif
+
+#if LAN_CTRL_ENABLE
+/* 启动局域网直连控制，不依赖云端 */
+static esp_err_t stage_lan(void)
+{
+    return use_lan_ctrl_start();
+}
+#endif
+
+/* 连上云端后加入上报任务，此前本地功能已在运行 */
+static esp_err_t stage_cloud(void)
+{
+    esp_err_t ret = use_wifi_wait_connected(0); // 永久等待
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ESP_LOGI(TAG, "连接成功！开始IoT数据传输");
+    iot_static_mark_steady();
+#if CONFIG_IOT_TRACE && CONFIG_IOT_TRACE_AUTO_DUMP_S > 0
+    iot_sched_after("trace_dump", CONFIG_IOT_TRACE_AUTO_DUMP_S * 1000, trace_dump_job, NULL, NULL);
+#endif
+    return iot_sched_every("report", s_report_window_ms, 0, report_job, NULL, &s_report_job);
+}
+
+enum {
+    BOOT_NVS,
+    BOOT_STATE,
+    BOOT_SAMPLER,
+    BOOT_LOCAL_JOBS,
+    BOOT_BLE,
+    BOOT_WIFI,
+#if GATEWAY_ENABLE
+    BOOT_GATEWAY,
+#endif
+#if LAN_CTRL_ENABLE
+    BOOT_LAN,
+#endif
+    BOOT_CLOUD,
+    BOOT_STAGE_COUNT,
+};
+
+static const iot_boot_stage_t s_boot_stages[BOOT_STAGE_COUNT] = {
+    [BOOT_NVS]        = { "nvs",        stage_nvs,        0 },
+    [BOOT_STATE]      = { "state",      stage_state,      IOT_BOOT_DEP(BOOT_NVS) },
+    [BOOT_SAMPLER]    = { "sampler",    stage_sampler,    IOT_BOOT_DEP(BOOT_STATE) },
+    [BOOT_LOCAL_JOBS] = { "local_jobs", stage_local_jobs, IOT_BOOT_DEP(BOOT_STATE) },
+    [BOOT_BLE]        = { "ble",        stage_ble,        IOT_BOOT_DEP(BOOT_NVS) | IOT_BOOT_DEP(BOOT_STATE) },
+    [BOOT_WIFI]       = { "wifi",       stage_wifi,       IOT_BOOT_DEP(BOOT_NVS) | IOT_BOOT_DEP(BOOT_STATE) },
+#if GATEWAY_ENABLE
+    [BOOT_GATEWAY]    = { "gateway",    stage_gateway,    IOT_BOOT_DEP(BOOT_WIFI) | IOT_BOOT_DEP(BOOT_BLE) },
+#endif
+#if LAN_CTRL_ENABLE
+    [BOOT_LAN]        = { "lan",        stage_lan,        IOT_BOOT_DEP(BOOT_WIFI) },
+#endif
+    [BOOT_CLOUD]      = { "cloud",      stage_cloud,      IOT_BOOT_DEP(BOOT_WIFI) | IOT_BOOT_DEP(BOOT_LOCAL_JOBS) },
+};
+
+void app_main(void)
+{
+#if CONFIG_IOT_TRACE
+    iot_trace_start();
+#endif
+    IOT_TRACE_BEGIN("app_main");
+    // 按依赖关系并行启动，每个阶段的开始/结束时刻记录在启动轨迹中
+    ESP_ERROR_CHECK(iot_boot_run(s_boot_stages, BOOT_STAGE_COUNT));
+
+    // 本地功能就绪即可使用，云端连接在cloud阶段中继续等待
+    uint32_t local = IOT_BOOT_ALL & ~IOT_BOOT_DEP(BOOT_CLOUD);
+    if (iot_boot_wait(local, 0) != ESP_OK) {
+        ESP_LOGE(TAG, "部分启动阶段失败");
     }
+    iot_boot_log_trace();
+    IOT_TRACE_END("app_main");
 }
@@ -0,0 +1,525 @@
+/*
+ * 设备群重连风暴模拟，用的是设备上同一份 tuya_backoff：
+ *
+ * 1. 虚拟时钟：2000台设备同时掉线，服务端中断60秒，恢复后每秒最多接受200个连接（TLS握手能力），
+ *    对比原先 esp-mqtt 固定10秒自动重连与抖动退避的风暴形状、服务端连接速率和每台设备的恢复时间
+ * 2. POSIX套接字：64台虚拟设备通过127.0.0.1连接测试内置的最小MQTT服务端（CONNECT/CONNACK），
+ *    注入服务端中断，按真实时间的1/50缩放运行。设置环境变量 IOT_FLEET_BROKER=<ip>:<port>
+ *    可改为连接本地Mosquitto（此时不注入中断，只测首次上线风暴）
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "unity.h"
+#include "tuya_backoff.h"
+
+/* 与 use_wifi.c 相同的MQTT退避参数 */
+#define MQTT_BACKOFF_BASE_MS    1000
+#define MQTT_BACKOFF_CAP_MS     120000
+#define MQTT_BACKOFF_WINDOW_MS  5000
+#define ESP_MQTT_RECONNECT_MS   10000   // esp-mqtt 默认 reconnect_timeout_ms
+
+#define FLEET_DEVICES           2000
+#define BROKER_CONNECTS_PER_S   200
+#define OUTAGE_MS               60000
+#define SIM_MS                  900000
+#define STEP_MS                 50
+
+#define SOCK_DEVICES            64
+#define TIME_SCALE              50      // 模拟毫秒 / 真实毫秒
+#define SOCK_OUTAGE_MS          10000   // 模拟时间
+#define SOCK_DEADLINE_MS        20000   // 真实时间
+
+/* ========== 虚拟时钟模拟 ========== */
+
+typedef struct {
+    tuya_backoff_t backoff;
+    int64_t next_ms;
+    int64_t recovered_ms;
+    bool connected;
+} sim_dev_t;
+
+typedef struct {
+    uint32_t attempts;
+    uint32_t broker_attempts;   // 服务端恢复后收到的连接尝试
+    uint32_t peak_per_s;        // 恢复后服务端每秒收到的最多连接尝试
+    uint32_t rejected;          // 超过服务端能力被拒绝的尝试
+    int64_t p50_ms;             // 从服务端恢复到设备重新连上的时间
+    int64_t p99_ms;
+    int64_t max_ms;
+} storm_t;
+
+static sim_dev_t s_fleet[FLEET_DEVICES];
+static int64_t s_recover[FLEET_DEVICES];
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t retry_delay(sim_dev_t *d, bool jitter)
+{
+    return jitter ? tuya_backoff_next(&d->backoff) : ESP_MQTT_RECONNECT_MS;
+}
+
+static void run_storm(bool jitter, storm_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < FLEET_DEVICES; i++) {
+        sim_dev_t *d = &s_fleet[i];
+        memset(d, 0, sizeof(*d));
+        // 设备上以 esp_random() 为种子
+        tuya_backoff_init(&d->backoff, MQTT_BACKOFF_BASE_MS, MQTT_BACKOFF_CAP_MS,
+                          MQTT_BACKOFF_WINDOW_MS, 0x9E3779B9u * (uint32_t)(i + 1));
+        d->next_ms = retry_delay(d, jitter);    // t=0 全部掉线
+    }
+
+    int connected = 0;
+    int64_t second = -1;
+    uint32_t in_second = 0;
+    for (int64_t t = 0; t <= SIM_MS && connected < FLEET_DEVICES; t += STEP_MS) {
+        if (t / 1000 != second) {
+            second = t / 1000;
+            in_second = 0;
+        }
+        for (int i = 0; i < FLEET_DEVICES; i++) {
+            sim_dev_t *d = &s_fleet[i];
+            if (d->connected || d->next_ms > t) {
+                continue;
+            }
+            out->attempts++;
+            if (t < OUTAGE_MS) {
+                d->next_ms = t + retry_delay(d, jitter);
+                continue;
+            }
+            out->broker_attempts++;
+            in_second++;
+            if (in_second > out->peak_per_s) {
+                out->peak_per_s = in_second;
+            }
+            if (in_second > BROKER_CONNECTS_PER_S) {
+                out->rejected++;
+                d->next_ms = t + retry_delay(d, jitter);
+                continue;
+            }
+            d->connected = true;
+            d->recovered_ms = t - OUTAGE_MS;
+            connected++;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(FLEET_DEVICES, connected);
+
+    for (int i = 0; i < FLEET_DEVICES; i++) {
+        s_recover[i] = s_fleet[i].recovered_ms;
+    }
+    qsort(s_recover, FLEET_DEVICES, sizeof(s_recover[0]), cmp_i64);
+    out->p50_ms = s_recover[FLEET_DEVICES / 2];
+    out->p99_ms = s_recover[FLEET_DEVICES * 99 / 100];
+    out->max_ms = s_recover[FLEET_DEVICES - 1];
+}
+
+static void print_storm(const char *name, const storm_t *s)
+{
+    printf("%-20s attempts %5u (%5u at broker), peak %4u conn/s, rejected %4u, recover p50 %5.1f s p99 %5.1f s max %5.1f s\n",
+           name, (unsigned)s->attempts, (unsigned)s->broker_attempts, (unsigned)s->peak_per_s, (unsigned)s->rejected,
+           s->p50_ms / 1000.0, s->p99_ms / 1000.0, s->max_ms / 1000.0);
+}
+
+static void test_virtual_fleet_outage(void)
+{
+    storm_t fixed, jitter;
+    run_storm(false, &fixed);
+    run_storm(true, &jitter);
+    printf("%d devices, %d s broker outage, broker accepts %d conn/s:\n", FLEET_DEVICES, OUTAGE_MS / 1000,
+           BROKER_CONNECTS_PER_S);
+    print_storm("fixed 10 s (before)", &fixed);
+    print_storm("jittered backoff", &jitter);
+
+    // 固定间隔下全体设备同一时刻重试，每轮只有服务端能力内的设备连上
+    TEST_ASSERT_EQUAL_UINT32(FLEET_DEVICES, fixed.peak_per_s);
+    // 抖动退避把峰值压到服务端能力以内，恢复后打到服务端的尝试和被拒次数大幅下降，
+    // 大部分设备也更早恢复；尾部受退避上限约束
+    TEST_ASSERT_LESS_OR_EQUAL(BROKER_CONNECTS_PER_S, jitter.peak_per_s);
+    TEST_ASSERT_LESS_THAN(fixed.rejected / 4, jitter.rejected);
+    TEST_ASSERT_LESS_THAN(fixed.broker_attempts / 2, jitter.broker_attempts);
+    TEST_ASSERT_LESS_THAN(fixed.p50_ms, jitter.p50_ms);
+    TEST_ASSERT_LESS_OR_EQUAL(MQTT_BACKOFF_CAP_MS, jitter.max_ms);
+}
+
+/* ========== POSIX套接字模拟 ========== */
+
+typedef struct {
+    uint16_t port;
+    atomic_bool down;           // 注入中断：关闭监听和所有连接
+    atomic_bool stop;
+    atomic_uint connects;       // 收到并应答的CONNECT数
+    atomic_uint peak_per_s;     // 每模拟秒（真实 1000/TIME_SCALE ms）的最多连接数
+} broker_t;
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int broker_listen(uint16_t port, uint16_t *bound)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOCK_DEVICES) != 0) {
+        close(fd);
+        return -1;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr *)&addr, &len);
+    *bound = ntohs(addr.sin_port);
+    return fd;
+}
+
+/* 读一个完整的MQTT报文头和剩余部分，返回报文类型，失败返回-1 */
+static int mqtt_read_packet(int fd)
+{
+    uint8_t hdr;
+    if (recv(fd, &hdr, 1, MSG_WAITALL) != 1) {
+        return -1;
+    }
+    uint32_t remaining = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        uint8_t b;
+        if (recv(fd, &b, 1, MSG_WAITALL) != 1) {
+            return -1;
+        }
+        remaining |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            break;
+        }
+    }
+    uint8_t body[256];
+    if (remaining > sizeof(body) || (remaining && recv(fd, body, remaining, MSG_WAITALL) != (ssize_t)remaining)) {
+        return -1;
+    }
+    return hdr >> 4;
+}
+
+static void *broker_thread(void *arg)
+{
+    broker_t *br = arg;
+    int listen_fd = -1;
+    int clients[SOCK_DEVICES * 2];
+    int nclients = 0;
+    int64_t bucket = -1;
+    unsigned in_bucket = 0;
+
+    while (!atomic_load(&br->stop)) {
+        if (atomic_load(&br->down)) {
+            if (listen_fd >= 0) {
+                close(listen_fd);
+                listen_fd = -1;
+                for (int i = 0; i < nclients; i++) {
+                    close(clients[i]);
+                }
+                nclients = 0;
+            }
+            usleep(1000);
+            continue;
+        }
+        if (listen_fd < 0) {
+            uint16_t bound;
+            listen_fd = broker_listen(br->port, &bound);
+            if (listen_fd < 0) {
+                usleep(1000);
+                continue;
+            }
+        }
+
+        struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, 2) <= 0) {
+            continue;
+        }
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        struct timeval tv = { .tv_sec = 1 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (mqtt_read_packet(fd) != 1 || nclients >= (int)(sizeof(clients) / sizeof(clients[0]))) {
+            close(fd);
+            continue;
+        }
+        // 先计数再应答，设备收到CONNACK时计数已可见
+        atomic_fetch_add(&br->connects, 1);
+        static const uint8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+        send(fd, connack, sizeof(connack), MSG_NOSIGNAL);
+        clients[nclients++] = fd;
+
+        int64_t b = now_ms() * TIME_SCALE / 1000;
+        if (b != bucket) {
+            bucket = b;
+            in_bucket = 0;
+        }
+        if (++in_bucket > atomic_load(&br->peak_per_s)) {
+            atomic_store(&br->peak_per_s, in_bucket);
+        }
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+    }
+    for (int i = 0; i < nclients; i++) {
+        close(clients[i]);
+    }
+    return NULL;
+}
+
+typedef struct {
+    tuya_backoff_t backoff;
+    int fd;                     // 已连接的套接字，-1表示未连接
+    int64_t next_ms;            // 下一次连接尝试（真实时间）
+    int64_t lost_ms;            // 掉线时刻
+    int64_t recover_ms;         // 最近一次从掉线到重新连上的时间（模拟时间）
+} sock_dev_t;
+
+static sock_dev_t s_devs[SOCK_DEVICES];
+
+/* MQTT 3.1.1 CONNECT：clean session，keepalive 60 s */
+static int mqtt_connect_once(const struct sockaddr_in *broker, int id)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct timeval tv = { .tv_sec = 1 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (const struct sockaddr *)broker, sizeof(*broker)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    char client_id[24];
+    int id_len = snprintf(client_id, sizeof(client_id), "fleet-sim-%04d", id);
+    uint8_t pkt[64];
+    int n = 0;
+    pkt[n++] = 0x10;
+    pkt[n++] = (uint8_t)(10 + 2 + id_len);
+    static const uint8_t var_hdr[] = { 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x00, 60 };
+    memcpy(&pkt[n], var_hdr, sizeof(var_hdr));
+    n += sizeof(var_hdr);
+    pkt[n++] = 0;
+    pkt[n++] = (uint8_t)id_len;
+    memcpy(&pkt[n], client_id, id_len);
+    n += id_len;
+
+    uint8_t connack[4];
+    if (send(fd, pkt, n, MSG_NOSIGNAL) != n || recv(fd, connack, sizeof(connack), MSG_WAITALL) != sizeof(connack) ||
+        connack[0] != 0x20 || connack[3] != 0x00) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* 推进所有设备直到deadline（until_online时全部在线即返回），返回连接尝试次数 */
+static uint32_t fleet_run(const struct sockaddr_in *broker, int64_t deadline_ms, bool until_online)
+{
+    uint32_t attempts = 0;
+    for (;;) {
+        int64_t now = now_ms();
+        int online = 0;
+        int64_t next_due = now + 50;
+        for (int i = 0; i < SOCK_DEVICES; i++) {
+            sock_dev_t *d = &s_devs[i];
+            if (d->fd >= 0) {
+                // 服务端断开：与设备上的 MQTT_EVENT_DISCONNECTED 相同，按退避间隔安排重连
+                struct pollfd pfd = { .fd = d->fd, .events = POLLIN };
+                uint8_t b;
+                if (poll(&pfd, 1, 0) > 0 && recv(d->fd, &b, 1, MSG_DONTWAIT) <= 0) {
+                    close(d->fd);
+                    d->fd = -1;
+                    d->lost_ms = now;
+                    d->next_ms = now + tuya_backoff_next(&d->backoff) / TIME_SCALE;
+                } else {
+                    online++;
+                    continue;
+                }
+            }
+            if (d->next_ms <= now) {
+                attempts++;
+                d->fd = mqtt_connect_once(broker, i);
+                if (d->fd >= 0) {
+                    tuya_backoff_reset(&d->backoff);
+                    d->recover_ms = (now_ms() - d->lost_ms) * TIME_SCALE;
+                    online++;
+                    continue;
+                }
+                d->next_ms = now_ms() + tuya_backoff_next(&d->backoff) / TIME_SCALE;
+            }
+            if (d->next_ms < next_due) {
+                next_due = d->next_ms;
+            }
+        }
+        if ((until_online && online == SOCK_DEVICES) || now >= deadline_ms) {
+            return attempts;
+        }
+        if (next_due > deadline_ms) {
+            next_due = deadline_ms;
+        }
+        if (next_due > now) {
+            usleep((useconds_t)(next_due - now) * 1000);
+        }
+    }
+}
+
+static int fleet_online(void)
+{
+    int n = 0;
+    for (int i = 0; i < SOCK_DEVICES; i++) {
+        n += s_devs[i].fd >= 0;
+    }
+    return n;
+}
+
+static void fleet_reset(void)
+{
+    int64_t now = now_ms();
+    for (int i = 0; i < SOCK_DEVICES; i++) {
+        sock_dev_t *d = &s_devs[i];
+        tuya_backoff_init(&d->backoff, MQTT_BACKOFF_BASE_MS, MQTT_BACKOFF_CAP_MS, MQTT_BACKOFF_WINDOW_MS,
+                          0x85EBCA6Bu * (uint32_t)(i + 1));
+        d->fd = -1;
+        d->lost_ms = now;
+        d->next_ms = now + tuya_backoff_next(&d->backoff) / TIME_SCALE;    // 首次上线同样在窗口内分散
+    }
+}
+
+static void fleet_close(void)
+{
+    for (int i = 0; i < SOCK_DEVICES; i++) {
+        if (s_devs[i].fd >= 0) {
+            close(s_devs[i].fd);
+            s_devs[i].fd = -1;
+        }
+    }
+}
+
+static int64_t max_recover_ms(void)
+{
+    int64_t m = 0;
+    for (int i = 0; i < SOCK_DEVICES; i++) {
+        if (s_devs[i].recover_ms > m) {
+            m = s_devs[i].recover_ms;
+        }
+    }
+    return m;
+}
+
+static bool parse_broker(const char *s, struct sockaddr_in *addr)
+{
+    char host[64];
+    unsigned port;
+    if (sscanf(s, "%63[^:]:%u", host, &port) != 2 || port == 0 || port > 65535) {
+        return false;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons((uint16_t)port);
+    return inet_pton(AF_INET, host, &addr->sin_addr) == 1;
+}
+
+static void test_socket_fleet_against_external_broker(void)
+{
+    const char *ext = getenv("IOT_FLEET_BROKER");
+    if (!ext) {
+        TEST_IGNORE_MESSAGE("IOT_FLEET_BROKER not set (e.g. 127.0.0.1:1883 for a local Mosquitto)");
+        return;
+    }
+    struct sockaddr_in addr;
+    TEST_ASSERT_TRUE_MESSAGE(parse_broker(ext, &addr), "IOT_FLEET_BROKER must be <ipv4>:<port>");
+
+    fleet_reset();
+    int64_t t0 = now_ms();
+    uint32_t attempts = fleet_run(&addr, now_ms() + SOCK_DEADLINE_MS, true);
+    printf("external broker %s: %d/%d online after %u attempts in %.1f s (simulated)\n", ext, fleet_online(),
+           SOCK_DEVICES, (unsigned)attempts, (now_ms() - t0) * TIME_SCALE / 1000.0);
+    TEST_ASSERT_EQUAL_INT(SOCK_DEVICES, fleet_online());
+    fleet_close();
+}
+
+static void test_socket_fleet_outage(void)
+{
+    broker_t br = { 0 };
+    uint16_t port;
+    int probe = broker_listen(0, &port);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, probe);
+    close(probe);
+    br.port = port;
+
+    pthread_t tid;
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&tid, NULL, broker_thread, &br));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // 首次上线
+    fleet_reset();
+    fleet_run(&addr, now_ms() + SOCK_DEADLINE_MS, true);
+    TEST_ASSERT_EQUAL_INT(SOCK_DEVICES, fleet_online());
+    TEST_ASSERT_EQUAL_UINT32(SOCK_DEVICES, atomic_load(&br.connects));
+    unsigned first_peak = atomic_load(&br.peak_per_s);
+
+    // 注入中断：服务端断开所有连接并停止监听
+    atomic_store(&br.peak_per_s, 0);
+    atomic_store(&br.down, true);
+    unsigned before = atomic_load(&br.connects);
+    int64_t outage_end = now_ms() + SOCK_OUTAGE_MS / TIME_SCALE;
+    uint32_t attempts = fleet_run(&addr, outage_end, false);
+    TEST_ASSERT_EQUAL_INT(0, fleet_online());
+    TEST_ASSERT_EQUAL_UINT32(before, atomic_load(&br.connects));
+    atomic_store(&br.down, false);
+
+    int64_t up = now_ms();
+    attempts += fleet_run(&addr, up + SOCK_DEADLINE_MS, true);
+    int64_t all_back = (now_ms() - up) * TIME_SCALE;
+    TEST_ASSERT_EQUAL_INT(SOCK_DEVICES, fleet_online());
+    TEST_ASSERT_EQUAL_UINT32(before + SOCK_DEVICES, atomic_load(&br.connects));
+
+    printf("sockets: %d devices, first connect peak %u conn/s; after a %d s outage: %u attempts, "
+           "peak %u conn/s, all back %.1f s after broker returned, worst device offline %.1f s (simulated time)\n",
+           SOCK_DEVICES, first_peak, SOCK_OUTAGE_MS / 1000, (unsigned)attempts, atomic_load(&br.peak_per_s),
+           all_back / 1000.0, max_recover_ms() / 1000.0);
+    // 首次上线在5秒窗口内分散，每秒不会全部挤在一起
+    TEST_ASSERT_LESS_THAN(SOCK_DEVICES, first_peak);
+
+    fleet_close();
+    atomic_store(&br.stop, true);
+    pthread_join(tid, NULL);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_virtual_fleet_outage);
+    RUN_TEST(test_socket_fleet_outage);
+    RUN_TEST(test_socket_fleet_against_external_broker);
+    return UNITY_END();
+}
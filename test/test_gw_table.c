@@ -0,0 +1,180 @@
+/*
+ * 子设备路由表负载测试：数百个模拟BLE子设备，按三个索引互查，
+ * 测量平均探测次数、每次路由耗时和每个子设备占用的内存
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "gw_table.h"
+
+#define CAPACITY        512
+#define SUBDEVS         500
+#define ROUTE_ROUNDS    2000
+
+static gw_table_t s_table;
+static uint8_t s_addr[SUBDEVS][6];
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* 同一厂商的传感器：地址高3字节相同（OUI），低3字节递增带跳号，最容易产生哈希聚集 */
+static void make_addr(int i, uint8_t addr[6])
+{
+    uint32_t serial = 0x100000 + (uint32_t)i * 7;
+    addr[0] = (uint8_t)serial;
+    addr[1] = (uint8_t)(serial >> 8);
+    addr[2] = (uint8_t)(serial >> 16);
+    addr[3] = 0x5C;
+    addr[4] = 0xE7;
+    addr[5] = 0xA4;
+}
+
+static void device_id_of(int i, char *out, size_t size)
+{
+    snprintf(out, size, "6c%018x", 0xa1b2c3u * (unsigned)(i + 1));
+}
+
+static void fill_table(void)
+{
+    char dev_id[GW_DEVICE_ID_LEN];
+    for (int i = 0; i < SUBDEVS; i++) {
+        make_addr(i, s_addr[i]);
+        gw_subdev_t *dev = gw_table_get_or_add(&s_table, s_addr[i]);
+        TEST_ASSERT_NOT_NULL(dev);
+        dev->conn_handle = (uint16_t)i;
+        device_id_of(i, dev_id, sizeof(dev_id));
+        TEST_ASSERT_EQUAL_INT(0, gw_table_set_device_id(&s_table, dev, dev_id));
+    }
+}
+
+void setUp(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, gw_table_init(&s_table, CAPACITY));
+}
+
+void tearDown(void)
+{
+    gw_table_deinit(&s_table);
+}
+
+static void test_init_limits(void)
+{
+    gw_table_t t;
+    TEST_ASSERT_EQUAL_INT(-1, gw_table_init(&t, 0));
+    TEST_ASSERT_EQUAL_INT(-1, gw_table_init(&t, 0x8000));
+    TEST_ASSERT_EQUAL_INT(0, gw_table_init(&t, 0x7FFF));
+    gw_table_deinit(&t);
+}
+
+static void test_three_indexes_agree(void)
+{
+    fill_table();
+    TEST_ASSERT_EQUAL_UINT16(SUBDEVS, s_table.count);
+
+    char dev_id[GW_DEVICE_ID_LEN];
+    for (int i = 0; i < SUBDEVS; i++) {
+        gw_subdev_t *by_addr = gw_table_find_addr(&s_table, s_addr[i]);
+        TEST_ASSERT_NOT_NULL(by_addr);
+        TEST_ASSERT_EQUAL_UINT16(i, by_addr->conn_handle);
+        TEST_ASSERT_TRUE(by_addr == gw_table_find_node(&s_table, by_addr->node_id));
+        device_id_of(i, dev_id, sizeof(dev_id));
+        TEST_ASSERT_TRUE(by_addr == gw_table_find_device(&s_table, dev_id, strlen(dev_id)));
+        // 已存在的地址不重复添加
+        TEST_ASSERT_TRUE(by_addr == gw_table_get_or_add(&s_table, s_addr[i]));
+    }
+    TEST_ASSERT_EQUAL_UINT16(SUBDEVS, s_table.count);
+
+    // nodeId 为地址倒序的十六进制
+    TEST_ASSERT_EQUAL_STRING("a4e75c100000", gw_table_find_addr(&s_table, s_addr[0])->node_id);
+
+    // 不存在的键、前缀、过长的ID都查不到
+    uint8_t unknown[6] = { 1, 2, 3, 4, 5, 6 };
+    TEST_ASSERT_NULL(gw_table_find_addr(&s_table, unknown));
+    TEST_ASSERT_NULL(gw_table_find_node(&s_table, "a4e75c10000"));
+    device_id_of(0, dev_id, sizeof(dev_id));
+    TEST_ASSERT_NULL(gw_table_find_device(&s_table, dev_id, strlen(dev_id) - 1));
+    TEST_ASSERT_NULL(gw_table_find_device(&s_table, "0123456789012345678901234", 25));
+    TEST_ASSERT_NULL(gw_table_find_device(&s_table, "", 0));
+}
+
+static void test_device_id_rules(void)
+{
+    uint8_t a[6] = { 1 }, b[6] = { 2 };
+    gw_subdev_t *da = gw_table_get_or_add(&s_table, a);
+    gw_subdev_t *db = gw_table_get_or_add(&s_table, b);
+    TEST_ASSERT_EQUAL_INT(0, gw_table_set_device_id(&s_table, da, "dev-a"));
+    // 同一子设备只能设置一次，不同子设备不能重复
+    TEST_ASSERT_EQUAL_INT(-1, gw_table_set_device_id(&s_table, da, "dev-a2"));
+    TEST_ASSERT_EQUAL_INT(-1, gw_table_set_device_id(&s_table, db, "dev-a"));
+    TEST_ASSERT_EQUAL_INT(-1, gw_table_set_device_id(&s_table, db, ""));
+    TEST_ASSERT_EQUAL_INT(-1, gw_table_set_device_id(&s_table, db, "012345678901234567890123"));
+    TEST_ASSERT_EQUAL_INT(0, gw_table_set_device_id(&s_table, db, "dev-b"));
+    TEST_ASSERT_EQUAL_UINT16(GW_CONN_NONE, db->conn_handle);
+    TEST_ASSERT_EQUAL_UINT8(GW_SUBDEV_UNBOUND, db->state);
+}
+
+static void test_table_full(void)
+{
+    gw_table_t t;
+    TEST_ASSERT_EQUAL_INT(0, gw_table_init(&t, 4));
+    for (int i = 0; i < 4; i++) {
+        make_addr(i, s_addr[i]);
+        TEST_ASSERT_NOT_NULL(gw_table_get_or_add(&t, s_addr[i]));
+    }
+    make_addr(4, s_addr[4]);
+    TEST_ASSERT_NULL(gw_table_get_or_add(&t, s_addr[4]));
+    // 表满时已有的子设备仍可查到
+    TEST_ASSERT_NOT_NULL(gw_table_get_or_add(&t, s_addr[3]));
+    gw_table_deinit(&t);
+}
+
+static void test_routing_cost_and_memory(void)
+{
+    fill_table();
+    char dev_ids[SUBDEVS][GW_DEVICE_ID_LEN];
+    size_t dev_len[SUBDEVS];
+    for (int i = 0; i < SUBDEVS; i++) {
+        device_id_of(i, dev_ids[i], sizeof(dev_ids[i]));
+        dev_len[i] = strlen(dev_ids[i]);
+    }
+
+    // 下行：云端deviceId -> BLE连接句柄；上行：BLE地址 -> 子设备条目
+    s_table.lookups = 0;
+    s_table.probes = 0;
+    uint32_t check = 0;
+    int64_t t0 = now_ns();
+    for (int r = 0; r < ROUTE_ROUNDS; r++) {
+        for (int i = 0; i < SUBDEVS; i++) {
+            check += gw_table_find_device(&s_table, dev_ids[i], dev_len[i])->conn_handle;
+            check += gw_table_find_addr(&s_table, s_addr[i])->conn_handle;
+        }
+    }
+    int64_t elapsed = now_ns() - t0;
+    uint32_t routes = 2u * ROUTE_ROUNDS * SUBDEVS;
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)ROUTE_ROUNDS * SUBDEVS * (SUBDEVS - 1), check);
+    TEST_ASSERT_EQUAL_UINT32(routes, s_table.lookups);
+
+    double probes = (double)s_table.probes / s_table.lookups;
+    size_t per_entry = gw_table_bytes_per_entry(&s_table);
+    printf("%d sub-devices: %.2f probes/lookup, %.1f ns/route on host, %u bytes/sub-device (entry %u + index)\n",
+           SUBDEVS, probes, (double)elapsed / routes, (unsigned)per_entry, (unsigned)sizeof(gw_subdev_t));
+    // 装载因子不超过0.5：平均探测次数接近1，与子设备数无关
+    TEST_ASSERT_LESS_THAN(150, (int)(probes * 100));
+    TEST_ASSERT_LESS_OR_EQUAL(96, per_entry);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_limits);
+    RUN_TEST(test_three_indexes_agree);
+    RUN_TEST(test_device_id_rules);
+    RUN_TEST(test_table_full);
+    RUN_TEST(test_routing_cost_and_memory);
+    return UNITY_END();
+}
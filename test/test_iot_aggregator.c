@@ -0,0 +1,254 @@
+/*
+ * 采样流水线：环形缓冲区 + 定点窗口聚合。
+ * 用合成信号（正弦、阶跃、负数）检查 min/max/mean/last 及其时刻，
+ * 双线程检查无锁环形缓冲区的顺序，并测量每个样本的CPU开销（入环+出环+聚合）
+ */
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "iot_ring.h"
+#include "iot_aggregator.h"
+
+#define SAMPLE_HZ       100
+#define PERIOD_US       (1000000 / SAMPLE_HZ)
+#define SPSC_SAMPLES    200000
+#define BENCH_SAMPLES   2000000
+
+static iot_aggregator_t s_agg;
+
+void setUp(void)
+{
+    iot_agg_init(&s_agg);
+}
+
+void tearDown(void)
+{
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void test_sine_window(void)
+{
+    // 1 Hz 正弦，幅值1000（定点0.01），偏置250，100 Hz 采样10秒
+    const int n = 10 * SAMPLE_HZ;
+    const int64_t t0 = 5000000;
+    for (int i = 0; i < n; i++) {
+        int32_t v = 250 + (int32_t)lround(1000.0 * sin(2 * M_PI * i / SAMPLE_HZ));
+        iot_agg_add(&s_agg, 1, v, t0 + (int64_t)i * PERIOD_US);
+    }
+
+    iot_agg_result_t r;
+    TEST_ASSERT_EQUAL_UINT32(n, iot_agg_close(&s_agg, 1, &r));
+    TEST_ASSERT_EQUAL_INT32(1250, r.max);
+    TEST_ASSERT_EQUAL_INT32(-750, r.min);
+    TEST_ASSERT_EQUAL_INT32(250, r.mean);
+    // 最大值第一次出现在 1/4 周期，最小值在 3/4 周期（之后相等的值不更新时刻）
+    TEST_ASSERT_EQUAL_INT64(t0 + 25 * PERIOD_US, r.t_max_us);
+    TEST_ASSERT_EQUAL_INT64(t0 + 75 * PERIOD_US, r.t_min_us);
+    TEST_ASSERT_EQUAL_INT64(t0, r.t_start_us);
+    TEST_ASSERT_EQUAL_INT64(t0 + (int64_t)(n - 1) * PERIOD_US, r.t_end_us);
+    TEST_ASSERT_EQUAL_INT32(250 + (int32_t)lround(1000.0 * sin(2 * M_PI * (n - 1) / SAMPLE_HZ)), r.last);
+
+    // 关闭后开始新窗口
+    TEST_ASSERT_EQUAL_UINT32(0, iot_agg_close(&s_agg, 1, &r));
+}
+
+static void test_step_and_rounding(void)
+{
+    iot_agg_result_t r;
+
+    // 阶跃：前半段0，后半段100，均值落在中间
+    for (int i = 0; i < 10; i++) {
+        iot_agg_add(&s_agg, 0, i < 5 ? 0 : 100, i);
+    }
+    iot_agg_close(&s_agg, 0, &r);
+    TEST_ASSERT_EQUAL_INT32(50, r.mean);
+    TEST_ASSERT_EQUAL_INT32(100, r.last);
+    TEST_ASSERT_EQUAL_INT64(5, r.t_max_us);
+
+    // 四舍五入远离零：2.5 -> 3，-2.5 -> -3，-1.4 -> -1
+    iot_agg_add(&s_agg, 0, 2, 0);
+    iot_agg_add(&s_agg, 0, 3, 1);
+    iot_agg_close(&s_agg, 0, &r);
+    TEST_ASSERT_EQUAL_INT32(3, r.mean);
+
+    iot_agg_add(&s_agg, 0, -2, 0);
+    iot_agg_add(&s_agg, 0, -3, 1);
+    iot_agg_close(&s_agg, 0, &r);
+    TEST_ASSERT_EQUAL_INT32(-3, r.mean);
+
+    const int32_t v[] = { -1, -1, -1, -2, -2 };
+    for (int i = 0; i < 5; i++) {
+        iot_agg_add(&s_agg, 0, v[i], i);
+    }
+    iot_agg_close(&s_agg, 0, &r);
+    TEST_ASSERT_EQUAL_INT32(-1, r.mean);
+    TEST_ASSERT_EQUAL_INT32(-2, r.min);
+    TEST_ASSERT_EQUAL_INT64(3, r.t_min_us);
+
+    // 极值不溢出：sum 为 int64
+    for (int i = 0; i < 1000; i++) {
+        iot_agg_add(&s_agg, 0, INT32_MAX, i);
+    }
+    iot_agg_close(&s_agg, 0, &r);
+    TEST_ASSERT_EQUAL_INT32(INT32_MAX, r.mean);
+}
+
+static void test_dp_isolation(void)
+{
+    iot_agg_add(&s_agg, 0, 10, 1);
+    iot_agg_add(&s_agg, 2, 20, 2);
+    iot_agg_add(&s_agg, IOT_AGG_MAX_DP, 30, 3);     // 超出范围，忽略
+
+    iot_agg_result_t r;
+    TEST_ASSERT_EQUAL_UINT32(1, iot_agg_close(&s_agg, 0, &r));
+    TEST_ASSERT_EQUAL_INT32(10, r.last);
+    TEST_ASSERT_EQUAL_UINT32(0, iot_agg_close(&s_agg, 1, &r));
+    TEST_ASSERT_EQUAL_UINT32(1, iot_agg_close(&s_agg, 2, &r));
+    TEST_ASSERT_EQUAL_INT32(20, r.last);
+    TEST_ASSERT_EQUAL_UINT32(0, iot_agg_close(&s_agg, IOT_AGG_MAX_DP, &r));
+}
+
+static void test_ring_capacity_and_wrap(void)
+{
+    iot_sample_t storage[8];
+    iot_ring_t ring;
+    TEST_ASSERT_EQUAL_INT(-1, iot_ring_init(&ring, storage, 6));
+    TEST_ASSERT_EQUAL_INT(-1, iot_ring_init(&ring, storage, 1));
+    TEST_ASSERT_EQUAL_INT(0, iot_ring_init(&ring, storage, 8));
+
+    // 多轮填满再取空，跨越下标回绕
+    for (int round = 0; round < 5; round++) {
+        for (int i = 0; i < 8; i++) {
+            iot_sample_t s = { .t_us = round * 8 + i, .value = round * 8 + i, .dp = 1 };
+            TEST_ASSERT_TRUE(iot_ring_push(&ring, &s));
+        }
+        iot_sample_t extra = { 0 };
+        TEST_ASSERT_FALSE(iot_ring_push(&ring, &extra));
+        TEST_ASSERT_EQUAL_UINT32(8, iot_ring_count(&ring));
+        for (int i = 0; i < 5; i++) {
+            iot_sample_t s;
+            TEST_ASSERT_TRUE(iot_ring_pop(&ring, &s));
+            TEST_ASSERT_EQUAL_INT32(round * 8 + i, s.value);
+        }
+        for (int i = 5; i < 8; i++) {
+            iot_sample_t s;
+            TEST_ASSERT_TRUE(iot_ring_pop(&ring, &s));
+            TEST_ASSERT_EQUAL_INT32(round * 8 + i, s.value);
+        }
+        iot_sample_t s;
+        TEST_ASSERT_FALSE(iot_ring_pop(&ring, &s));
+    }
+}
+
+/* 生产者线程：相当于设备上的 esp_timer 回调，环满时让出CPU等消费者 */
+typedef struct {
+    iot_ring_t *ring;
+    uint32_t full;
+} producer_ctx_t;
+
+static void *producer(void *arg)
+{
+    producer_ctx_t *ctx = arg;
+    for (int i = 0; i < SPSC_SAMPLES; i++) {
+        iot_sample_t s = { .t_us = (int64_t)i * PERIOD_US, .value = i, .dp = 3 };
+        while (!iot_ring_push(ctx->ring, &s)) {
+            ctx->full++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void test_ring_spsc_ordering(void)
+{
+    static iot_sample_t storage[256];
+    iot_ring_t ring;
+    TEST_ASSERT_EQUAL_INT(0, iot_ring_init(&ring, storage, 256));
+
+    producer_ctx_t ctx = { .ring = &ring };
+    pthread_t tid;
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&tid, NULL, producer, &ctx));
+
+    // 消费者：按顺序收到每个样本，且内容完整（没有读到写了一半的槽）
+    int32_t expect = 0;
+    bool ordered = true;
+    while (expect < SPSC_SAMPLES) {
+        iot_sample_t s;
+        if (!iot_ring_pop(&ring, &s)) {
+            sched_yield();
+            continue;
+        }
+        if (s.value != expect || s.t_us != (int64_t)expect * PERIOD_US || s.dp != 3) {
+            ordered = false;
+            break;
+        }
+        iot_agg_add(&s_agg, s.dp, s.value, s.t_us);
+        expect++;
+    }
+    pthread_join(tid, NULL);
+    TEST_ASSERT_TRUE(ordered);
+
+    iot_agg_result_t r;
+    TEST_ASSERT_EQUAL_UINT32(SPSC_SAMPLES, iot_agg_close(&s_agg, 3, &r));
+    TEST_ASSERT_EQUAL_INT32(0, r.min);
+    TEST_ASSERT_EQUAL_INT32(SPSC_SAMPLES - 1, r.max);
+    TEST_ASSERT_EQUAL_INT32(SPSC_SAMPLES / 2, r.mean);
+    printf("SPSC: %d samples in order, producer found the ring full %u times\n", SPSC_SAMPLES, (unsigned)ctx.full);
+}
+
+static void test_cpu_per_sample(void)
+{
+    static iot_sample_t storage[64];
+    iot_ring_t ring;
+    iot_ring_init(&ring, storage, 64);
+
+    // 与设备上相同的节奏：生产者每次写一个，消费者批量取出并聚合，每1024个样本关闭一次窗口
+    int64_t t0 = now_ns();
+    uint32_t closed = 0;
+    for (int i = 0; i < BENCH_SAMPLES; i += 32) {
+        for (int k = 0; k < 32; k++) {
+            iot_sample_t s = { .t_us = (int64_t)(i + k) * PERIOD_US, .value = (i + k) & 0x3FF, .dp = (uint8_t)(k & 3) };
+            iot_ring_push(&ring, &s);
+        }
+        iot_sample_t s;
+        while (iot_ring_pop(&ring, &s)) {
+            iot_agg_add(&s_agg, s.dp, s.value, s.t_us);
+        }
+        if (i % 1024 == 0) {
+            iot_agg_result_t r;
+            for (uint8_t dp = 0; dp < 4; dp++) {
+                closed += iot_agg_close(&s_agg, dp, &r);
+            }
+        }
+    }
+    int64_t elapsed = now_ns() - t0;
+    TEST_ASSERT_GREATER_THAN(0, closed);
+
+    double ns = (double)elapsed / BENCH_SAMPLES;
+    printf("CPU per sample (push + pop + aggregate): %.1f ns on host\n", ns);
+    // 100 Hz x 8 DP 时每秒800个样本，这里只防止回归到明显不可接受的开销
+    TEST_ASSERT_LESS_THAN(2000, (int)ns);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sine_window);
+    RUN_TEST(test_step_and_rounding);
+    RUN_TEST(test_dp_isolation);
+    RUN_TEST(test_ring_capacity_and_wrap);
+    RUN_TEST(test_ring_spsc_ordering);
+    RUN_TEST(test_cpu_per_sample);
+    return UNITY_END();
+}
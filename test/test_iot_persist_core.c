@@ -0,0 +1,315 @@
+/*
+ * 状态持久化的写入决策：防抖合并、内容未变不写、令牌桶预算、强制写入与失败重试，
+ * 以及按突发状态变化轨迹（App拖动滑块、开关来回切换、本地规则连锁）测量每小时的Flash写入次数，
+ * 与每次变化都写入的做法对比
+ */
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "iot_persist_core.h"
+
+/* 与 iot_persist.h 中的设备参数一致 */
+#define QUIET_MS        3000
+#define MAX_HOLD_MS     30000
+#define BURST           4
+#define REFILL_MS       (5 * 60 * 1000)
+
+#define MS              1000LL
+#define SEC             (1000 * MS)
+#define HOUR            (3600 * SEC)
+#define TRACE_HOURS     24
+
+typedef struct {
+    char status[8];
+    int32_t value;
+} blob_t;
+
+static iot_persist_core_t s_core;
+static blob_t s_state;
+
+void setUp(void)
+{
+    iot_persist_core_init(&s_core, QUIET_MS, MAX_HOLD_MS, BURST, REFILL_MS);
+    memset(&s_state, 0, sizeof(s_state));
+    strcpy(s_state.status, "close");
+    s_state.value = 10;
+    iot_persist_core_set_saved(&s_core, &s_state, sizeof(s_state));
+}
+
+void tearDown(void)
+{
+}
+
+static void change(int64_t now, const char *status, int32_t value)
+{
+    memset(s_state.status, 0, sizeof(s_state.status));
+    strcpy(s_state.status, status);
+    s_state.value = value;
+    iot_persist_core_note_change(&s_core, now);
+}
+
+static iot_persist_action_t poll(int64_t now, bool ok)
+{
+    iot_persist_action_t a = iot_persist_core_poll(&s_core, now, &s_state, sizeof(s_state), false);
+    if (a == IOT_PERSIST_WRITE) {
+        iot_persist_core_committed(&s_core, now, &s_state, sizeof(s_state), ok);
+    }
+    return a;
+}
+
+static void test_debounce_and_skip_same(void)
+{
+    TEST_ASSERT_EQUAL_INT64(INT64_MAX, iot_persist_core_next_due(&s_core));
+
+    // 连续变化合并，最后一次变化后安静3秒写入
+    change(0, "open", 11);
+    change(1 * SEC, "open", 12);
+    change(2 * SEC, "open", 13);
+    TEST_ASSERT_EQUAL_INT64(5 * SEC, iot_persist_core_next_due(&s_core));
+    TEST_ASSERT_EQUAL_INT(IOT_PERSIST_IDLE, poll(4 * SEC, true));
+    TEST_ASSERT_EQUAL_INT(IOT_PERSIST_WRITE, poll(5 * SEC, true));
+    TEST_ASSERT_EQUAL_UINT32(1, s_core.stats.writes);
+    TEST_ASSERT_EQUAL_INT64(INT64_MAX, iot_persist_core_next_due(&s_core));
+
+    // 来回切换回到已保存的值，不写
+    change(10 * SEC, "close", 13);
+    change(11 * SEC, "open", 13);
+    TEST_ASSERT_EQUAL_INT(IOT_PERSIST_SKIP, poll(14 * SEC, true));
+    TEST_ASSERT_EQUAL_UINT32(1, s_core.stats.writes);
+    TEST_ASSERT_EQUAL_UINT32(1, s_core.stats.skipped_same);
+}
+
+static void test_max_hold(void)
+{
+    // 每2秒变化一次，安静时刻一直后移，最多推迟30秒
+    int64_t t = 0;
+    for (; t < 40 * SEC; t += 2 * SEC) {
+        change(t, "open", (int32_t)(t / SEC));
+        if (poll(t, true) == IOT_PERSIST_WRITE) {
+            break;
+        }
+    }
+    TEST_ASSERT_EQUAL_INT64(30 * SEC, t);
+    TEST_ASSERT_EQUAL_UINT32(1, s_core.stats.writes);
+}
+
+static void test_budget_and_force(void)
+{
+    // 预算4次之后每5分钟1次
+    int64_t t = 0;
+    for (int i = 0; i < BURST; i++) {
+        change(t, "open", 100 + i);
+        t += QUIET_MS * MS;
+        TEST_ASSERT_EQUAL_INT(IOT_PERSIST_WRITE, poll(t, true));
+    }
+    int64_t fourth = t;
+    change(t, "open", 200);
+    t += QUIET_MS * MS;
+    TEST_ASSERT_EQUAL_INT(IOT_PERSIST_DEFER, poll(t, true));
+    // 第一个令牌在第一次写入后5分钟补充
+    int64_t due = iot_persist_core_next_due(&s_core);
+    TEST_ASSERT_EQUAL_INT64(QUIET_MS * MS + REFILL_MS * MS, due);
+    TEST_ASSERT_TRUE(due > fourth);
+    TEST_ASSERT_EQUAL_INT(IOT_PERSIST_WRITE, poll(due, true));
+
+    // 重启前强制写入，忽略防抖和预算
+    change(due + 1 * SEC, "close", 0);
+    TEST_ASSERT_EQUAL_INT(IOT_PERSIST_WRITE,
+                          iot_persist_core_poll(&s_core, due + 1 * SEC, &s_state, sizeof(s_state), true));
+    iot_persist_core_committed(&s_core, due + 1 * SEC, &s_state, sizeof(s_state), true);
+    TEST_ASSERT_EQUAL_UINT32(BURST + 2, s_core.stats.writes);
+}
+
+static void test_failure_retries(void)
+{
+    change(0, "open", 42);
+    TEST_ASSERT_EQUAL_INT(IOT_PERSIST_WRITE, poll(3 * SEC, false));
+    TEST_ASSERT_EQUAL_UINT32(1, s_core.stats.failed);
+    // 失败消耗令牌并保持待写，安静时间后重试
+    TEST_ASSERT_EQUAL_INT64(6 * SEC, iot_persist_core_next_due(&s_core));
+    TEST_ASSERT_EQUAL_INT(IOT_PERSIST_WRITE, poll(6 * SEC, true));
+    TEST_ASSERT_EQUAL_UINT32(1, s_core.stats.writes);
+    TEST_ASSERT_EQUAL_INT(BURST - 2, s_core.tokens);
+}
+
+/* ---------- 突发变化轨迹 ---------- */
+
+typedef struct {
+    int64_t at;
+    int32_t value;
+    bool open;
+} event_t;
+
+#define MAX_EVENTS      20000
+
+static event_t s_events[MAX_EVENTS];
+static uint32_t s_seed;
+
+static uint32_t rnd(uint32_t n)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return (s_seed >> 8) % n;
+}
+
+/* 每隔2~20分钟一阵操作：拖动滑块（5~30次变化，间隔50~400ms），或开关切换后又切回，或规则连锁 */
+static int build_bursty_trace(void)
+{
+    int n = 0;
+    int32_t value = 10;
+    bool open = false;
+    int64_t t = 0;
+    s_seed = 2024;
+    while (n < MAX_EVENTS - 64) {
+        t += (int64_t)(120 + rnd(1080)) * SEC;
+        if (t >= TRACE_HOURS * HOUR) {
+            break;
+        }
+        switch (rnd(3)) {
+        case 0: {
+            int steps = 5 + (int)rnd(26);
+            for (int i = 0; i < steps; i++) {
+                t += (int64_t)(50 + rnd(350)) * MS;
+                value = 10 + (int32_t)rnd(41);
+                s_events[n++] = (event_t){ t, value, open };
+            }
+            break;
+        }
+        case 1:
+            open = !open;
+            s_events[n++] = (event_t){ t, value, open };
+            if (rnd(2)) {
+                t += (int64_t)(500 + rnd(2000)) * MS;
+                open = !open;
+                s_events[n++] = (event_t){ t, value, open };
+            }
+            break;
+        default:
+            // 规则连锁：开关触发数值变化，再触发一次数值变化
+            open = !open;
+            s_events[n++] = (event_t){ t, value, open };
+            t += 20 * MS;
+            value = open ? 50 : 10;
+            s_events[n++] = (event_t){ t, value, open };
+            t += 20 * MS;
+            value += open ? -1 : 1;
+            s_events[n++] = (event_t){ t, value, open };
+            break;
+        }
+    }
+    return n;
+}
+
+/* 原先的 sensor_ramp：每10秒变化一次 */
+static int build_ramp_trace(void)
+{
+    int n = 0;
+    int32_t value = 10;
+    for (int64_t t = 10 * SEC; t < TRACE_HOURS * HOUR && n < MAX_EVENTS; t += 10 * SEC) {
+        value = value >= 50 ? 10 : value + 1;
+        s_events[n++] = (event_t){ t, value, false };
+    }
+    return n;
+}
+
+typedef struct {
+    uint32_t writes;
+    uint32_t max_per_hour;
+    uint32_t naive_max_per_hour;
+    int64_t lag_sum;            // 最后一次变化到写入的时间
+    int64_t lag_max;
+    uint32_t lag_count;
+} trace_result_t;
+
+static void run_trace(int n, trace_result_t *res)
+{
+    uint32_t per_hour[TRACE_HOURS] = { 0 };
+    uint32_t naive_per_hour[TRACE_HOURS] = { 0 };
+    memset(res, 0, sizeof(*res));
+
+    int i = 0;
+    int64_t last_change = 0;
+    for (int guard = 0; guard < 4 * MAX_EVENTS; guard++) {
+        int64_t due = iot_persist_core_next_due(&s_core);
+        int64_t next_event = i < n ? s_events[i].at : INT64_MAX;
+        if (due == INT64_MAX && next_event == INT64_MAX) {
+            break;
+        }
+        if (next_event <= due) {
+            const event_t *e = &s_events[i++];
+            change(e->at, e->open ? "open" : "close", e->value);
+            naive_per_hour[e->at / HOUR]++;
+            last_change = e->at;
+            continue;
+        }
+        iot_persist_action_t a = poll(due, true);
+        if (a == IOT_PERSIST_WRITE) {
+            per_hour[due / HOUR < TRACE_HOURS ? due / HOUR : TRACE_HOURS - 1]++;
+            int64_t lag = due - last_change;
+            res->lag_sum += lag;
+            res->lag_count++;
+            if (lag > res->lag_max) {
+                res->lag_max = lag;
+            }
+        }
+    }
+    TEST_ASSERT_EQUAL_INT(n, i);
+    TEST_ASSERT_FALSE(s_core.dirty);
+    // 最终状态一定落盘
+    TEST_ASSERT_EQUAL_MEMORY(&s_state, s_core.saved, sizeof(s_state));
+
+    res->writes = s_core.stats.writes;
+    for (int h = 0; h < TRACE_HOURS; h++) {
+        if (per_hour[h] > res->max_per_hour) {
+            res->max_per_hour = per_hour[h];
+        }
+        if (naive_per_hour[h] > res->naive_max_per_hour) {
+            res->naive_max_per_hour = naive_per_hour[h];
+        }
+    }
+}
+
+static void test_bursty_trace_writes_per_hour(void)
+{
+    int n = build_bursty_trace();
+    trace_result_t r;
+    run_trace(n, &r);
+
+    printf("bursty trace %d h, %d changes: %.1f writes/h (max %u in one hour), every-change %.1f/h (max %u), "
+           "skipped same %u, deferred %u, change->write avg %.1f s / max %.1f s\n",
+           TRACE_HOURS, n, (double)r.writes / TRACE_HOURS, r.max_per_hour, (double)n / TRACE_HOURS,
+           r.naive_max_per_hour, s_core.stats.skipped_same, s_core.stats.deferred,
+           (double)r.lag_sum / r.lag_count / SEC, (double)r.lag_max / SEC);
+
+    // 一小时最多：初始预算 + 12次补充
+    TEST_ASSERT_LESS_OR_EQUAL(BURST + HOUR / (REFILL_MS * MS), r.max_per_hour);
+    TEST_ASSERT_LESS_THAN(n / 5, r.writes);
+    TEST_ASSERT_GREATER_THAN(0, s_core.stats.skipped_same);
+}
+
+static void test_ramp_trace_writes_per_hour(void)
+{
+    int n = build_ramp_trace();
+    trace_result_t r;
+    run_trace(n, &r);
+
+    printf("10 s ramp %d h, %d changes: %.1f writes/h (max %u in one hour), every-change %.1f/h, "
+           "change->write max %.1f s\n",
+           TRACE_HOURS, n, (double)r.writes / TRACE_HOURS, r.max_per_hour, (double)n / TRACE_HOURS,
+           (double)r.lag_max / SEC);
+
+    // 持续变化时稳定在预算上限：每5分钟一次
+    TEST_ASSERT_LESS_OR_EQUAL(BURST + HOUR / (REFILL_MS * MS), r.max_per_hour);
+    TEST_ASSERT_LESS_OR_EQUAL(BURST + TRACE_HOURS * HOUR / (REFILL_MS * MS) + 1, r.writes);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_debounce_and_skip_same);
+    RUN_TEST(test_max_hold);
+    RUN_TEST(test_budget_and_force);
+    RUN_TEST(test_failure_retries);
+    RUN_TEST(test_bursty_trace_writes_per_hour);
+    RUN_TEST(test_ramp_trace_writes_per_hour);
+    return UNITY_END();
+}
@@ -0,0 +1,335 @@
+/*
+ * 本地联动规则：边沿触发、字节码校验、动作引起的嵌套求值，
+ * 以及满载规则集的加载耗时和单次DP变化的求值耗时（与每次变化求值全部规则对比）
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "iot_rule_core.h"
+#include "iot_hist_codec.h"
+
+#define DP_NUM          IOT_RULE_MAX_DP
+#define DP_STATUS       (DP_NUM - 1)        // 唯一的字符串DP
+#define BENCH_RULES     200
+#define BENCH_CHANGES   200000
+
+static iot_rule_core_t s_core;
+static int32_t s_ints[DP_NUM];
+static char s_status[IOT_RULE_STR_MAX + 1];
+static uint32_t s_sets;
+static iot_rule_dp_type_t s_types[DP_NUM];
+
+static uint8_t s_blob[IOT_RULE_BLOB_MAX];
+static size_t s_len;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int32_t io_get_int(uint8_t dp, void *ctx)
+{
+    return s_ints[dp];
+}
+
+static bool io_str_eq(uint8_t dp, const uint8_t *s, uint8_t len, void *ctx)
+{
+    return strlen(s_status) == len && memcmp(s_status, s, len) == 0;
+}
+
+/* 与 iot_rule.c 相同：动作写入的DP有变化时通知规则引擎，重入求值 */
+static void io_set_int(uint8_t dp, int32_t value, void *ctx)
+{
+    s_sets++;
+    if (s_ints[dp] != value) {
+        s_ints[dp] = value;
+        iot_rule_core_on_change(&s_core, dp);
+    }
+}
+
+static void io_set_str(uint8_t dp, const uint8_t *s, uint8_t len, void *ctx)
+{
+    s_sets++;
+    memcpy(s_status, s, len);
+    s_status[len] = '\0';
+    iot_rule_core_on_change(&s_core, dp);
+}
+
+static void set_dp(uint8_t dp, int32_t value)
+{
+    s_ints[dp] = value;
+    iot_rule_core_on_change(&s_core, dp);
+}
+
+void setUp(void)
+{
+    for (int i = 0; i < DP_NUM; i++) {
+        s_types[i] = i == DP_STATUS ? IOT_RULE_DP_STR : IOT_RULE_DP_INT;
+    }
+    const iot_rule_io_t io = { io_get_int, io_str_eq, io_set_int, io_set_str, NULL };
+    iot_rule_core_init(&s_core, s_types, DP_NUM, &io);
+    memset(s_ints, 0, sizeof(s_ints));
+    strcpy(s_status, "idle");
+    s_sets = 0;
+}
+
+void tearDown(void)
+{
+}
+
+/* ========== 规则集构造 ========== */
+
+static void blob_begin(void)
+{
+    s_blob[0] = 'R';
+    s_blob[1] = 'L';
+    s_blob[2] = IOT_RULE_VERSION;
+    s_blob[3] = 0;
+    s_blob[4] = 0;
+    s_len = IOT_RULE_HDR_LEN;
+}
+
+static void blob_rule(uint8_t id, const uint8_t *cond, uint8_t cond_len, const uint8_t *act, uint8_t act_len)
+{
+    s_blob[s_len++] = id;
+    s_blob[s_len++] = cond_len;
+    s_blob[s_len++] = act_len;
+    memcpy(s_blob + s_len, cond, cond_len);
+    s_len += cond_len;
+    memcpy(s_blob + s_len, act, act_len);
+    s_len += act_len;
+    uint16_t count = (uint16_t)(s_blob[3] | (s_blob[4] << 8)) + 1;
+    s_blob[3] = (uint8_t)count;
+    s_blob[4] = (uint8_t)(count >> 8);
+}
+
+static size_t blob_end(void)
+{
+    uint32_t crc = iot_hist_crc32(s_blob, (uint32_t)s_len);
+    for (int i = 0; i < 4; i++) {
+        s_blob[s_len++] = (uint8_t)(crc >> (8 * i));
+    }
+    return s_len;
+}
+
+/* dp > v  ->  set out = set_v */
+static void rule_gt_set(uint8_t id, uint8_t dp, int32_t v, uint8_t out, int32_t set_v)
+{
+    const uint8_t cond[] = { IOT_RULE_OP_PUSH_DP, dp, IOT_RULE_OP_PUSH_I32,
+                             (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24), IOT_RULE_OP_GT };
+    const uint8_t act[] = { IOT_RULE_OP_SET_INT, out,
+                            (uint8_t)set_v, (uint8_t)(set_v >> 8), (uint8_t)(set_v >> 16), (uint8_t)(set_v >> 24) };
+    blob_rule(id, cond, sizeof(cond), act, sizeof(act));
+}
+
+static void test_edge_trigger(void)
+{
+    blob_begin();
+    rule_gt_set(1, 0, 25, 1, 1);
+    s_ints[0] = 30;
+    TEST_ASSERT_EQUAL_INT(1, iot_rule_core_load(&s_core, s_blob, blob_end()));
+    // 加载时已经成立的条件不执行动作
+    TEST_ASSERT_EQUAL_UINT32(0, s_sets);
+    TEST_ASSERT_TRUE(iot_rule_core_watches(&s_core, 0));
+    TEST_ASSERT_FALSE(iot_rule_core_watches(&s_core, 1));
+
+    set_dp(0, 31);
+    TEST_ASSERT_EQUAL_UINT32(0, s_sets);
+    set_dp(0, 20);
+    set_dp(0, 26);
+    TEST_ASSERT_EQUAL_UINT32(1, s_sets);
+    TEST_ASSERT_EQUAL_INT(1, s_ints[1]);
+    set_dp(0, 40);
+    TEST_ASSERT_EQUAL_UINT32(1, s_sets);
+    // 不相关的DP变化不求值
+    uint32_t evals = s_core.stats.evals;
+    set_dp(2, 5);
+    TEST_ASSERT_EQUAL_UINT32(evals, s_core.stats.evals);
+    TEST_ASSERT_EQUAL_UINT32(1, s_core.stats.fires);
+}
+
+static void test_string_rule(void)
+{
+    // status == "alarm" && dp3 >= 2  ->  status = "safe", dp4 = -1
+    const uint8_t cond[] = { IOT_RULE_OP_STR_EQ, DP_STATUS, 5, 'a', 'l', 'a', 'r', 'm',
+                             IOT_RULE_OP_PUSH_DP, 3, IOT_RULE_OP_PUSH_I8, 2, IOT_RULE_OP_GE, IOT_RULE_OP_AND };
+    const uint8_t act[] = { IOT_RULE_OP_SET_STR, DP_STATUS, 4, 's', 'a', 'f', 'e',
+                            IOT_RULE_OP_SET_INT, 4, 0xff, 0xff, 0xff, 0xff };
+    blob_begin();
+    blob_rule(7, cond, sizeof(cond), act, sizeof(act));
+    TEST_ASSERT_EQUAL_INT(1, iot_rule_core_load(&s_core, s_blob, blob_end()));
+
+    set_dp(3, 2);
+    TEST_ASSERT_EQUAL_UINT32(0, s_sets);
+    strcpy(s_status, "alarm");
+    iot_rule_core_on_change(&s_core, DP_STATUS);
+    TEST_ASSERT_EQUAL_STRING("safe", s_status);
+    TEST_ASSERT_EQUAL_INT(-1, s_ints[4]);
+    TEST_ASSERT_EQUAL_UINT32(2, s_sets);
+}
+
+static void test_reject_malformed(void)
+{
+    blob_begin();
+    rule_gt_set(1, 0, 25, 1, 1);
+    size_t len = blob_end();
+    TEST_ASSERT_EQUAL_INT(1, iot_rule_core_load(&s_core, s_blob, len));
+
+    uint8_t bad[IOT_RULE_BLOB_MAX];
+    memcpy(bad, s_blob, len);
+    bad[len - 1] ^= 1;
+    TEST_ASSERT_EQUAL_INT(-1, iot_rule_core_verify(&s_core, bad, len));
+    TEST_ASSERT_EQUAL_INT(-1, iot_rule_core_verify(&s_core, s_blob, len - 1));
+    TEST_ASSERT_EQUAL_INT(-1, iot_rule_core_verify(&s_core, NULL, len));
+
+    // 每项都是CRC正确、但字节码不合法的规则集
+    static const uint8_t conds[][8] = {
+        { IOT_RULE_OP_GT },                                                 // 栈下溢
+        { IOT_RULE_OP_PUSH_I8, 1, IOT_RULE_OP_PUSH_I8, 2 },                 // 结束时栈上有两个值
+        { IOT_RULE_OP_PUSH_DP, DP_STATUS },                                 // 字符串DP当整数读
+        { IOT_RULE_OP_PUSH_DP, DP_NUM },                                    // DP编号越界
+        { 0x7f },                                                           // 未知操作码
+        { IOT_RULE_OP_PUSH_I32, 1, 2 },                                     // 操作数不完整
+        { IOT_RULE_OP_SET_INT, 1, 0, 0, 0, 0 },                             // 条件中出现动作
+    };
+    static const uint8_t cond_lens[] = { 1, 4, 2, 2, 1, 3, 6 };
+    const uint8_t act[] = { IOT_RULE_OP_SET_INT, 1, 1, 0, 0, 0 };
+    for (size_t i = 0; i < sizeof(cond_lens); i++) {
+        blob_begin();
+        blob_rule(2, conds[i], cond_lens[i], act, sizeof(act));
+        TEST_ASSERT_EQUAL_INT(-1, iot_rule_core_load(&s_core, s_blob, blob_end()));
+    }
+    // 动作写字符串DP的整数值
+    const uint8_t cond_ok[] = { IOT_RULE_OP_PUSH_I8, 1 };
+    const uint8_t act_bad[] = { IOT_RULE_OP_SET_INT, DP_STATUS, 1, 0, 0, 0 };
+    blob_begin();
+    blob_rule(3, cond_ok, sizeof(cond_ok), act_bad, sizeof(act_bad));
+    TEST_ASSERT_EQUAL_INT(-1, iot_rule_core_load(&s_core, s_blob, blob_end()));
+    // 栈深度超过上限
+    uint8_t deep[2 * (IOT_RULE_STACK_DEPTH + 1) + IOT_RULE_STACK_DEPTH];
+    size_t n = 0;
+    for (int i = 0; i <= IOT_RULE_STACK_DEPTH; i++) {
+        deep[n++] = IOT_RULE_OP_PUSH_I8;
+        deep[n++] = 1;
+    }
+    for (int i = 0; i < IOT_RULE_STACK_DEPTH; i++) {
+        deep[n++] = IOT_RULE_OP_AND;
+    }
+    blob_begin();
+    blob_rule(4, deep, (uint8_t)n, act, sizeof(act));
+    TEST_ASSERT_EQUAL_INT(-1, iot_rule_core_load(&s_core, s_blob, blob_end()));
+
+    // 拒绝后保留原规则集
+    TEST_ASSERT_EQUAL_UINT32(9, s_core.stats.rejects);
+    TEST_ASSERT_EQUAL_UINT16(1, s_core.count);
+    set_dp(0, 30);
+    TEST_ASSERT_EQUAL_INT(1, s_ints[1]);
+}
+
+/* dp == a  ->  set dp = b */
+static void rule_eq_set(uint8_t id, uint8_t dp, int8_t a, int32_t b)
+{
+    const uint8_t cond[] = { IOT_RULE_OP_PUSH_DP, dp, IOT_RULE_OP_PUSH_I8, (uint8_t)a, IOT_RULE_OP_EQ };
+    const uint8_t act[] = { IOT_RULE_OP_SET_INT, dp, (uint8_t)b, (uint8_t)(b >> 8), (uint8_t)(b >> 16), (uint8_t)(b >> 24) };
+    blob_rule(id, cond, sizeof(cond), act, sizeof(act));
+}
+
+static void test_nested_depth(void)
+{
+    // 三条规则依次触发：dp5 按 1 -> 2 -> 3 -> 1 循环，由嵌套层数截断
+    blob_begin();
+    rule_eq_set(1, 5, 1, 2);
+    rule_eq_set(2, 5, 2, 3);
+    rule_eq_set(3, 5, 3, 1);
+    TEST_ASSERT_EQUAL_INT(3, iot_rule_core_load(&s_core, s_blob, blob_end()));
+
+    set_dp(5, 1);
+    TEST_ASSERT_EQUAL_UINT8(0, s_core.depth);
+    // 每层至少触发一条，外层继续求值剩余规则时可能再触发，但总数有界
+    TEST_ASSERT_GREATER_OR_EQUAL(IOT_RULE_MAX_DEPTH, s_core.stats.fires);
+    TEST_ASSERT_LESS_OR_EQUAL(3 * IOT_RULE_MAX_DEPTH, s_core.stats.fires);
+    TEST_ASSERT_GREATER_THAN(0, s_core.stats.depth_drops);
+}
+
+/* ========== 基准：满载规则集 ========== */
+
+/* 第r条规则读 dp r%14、写 dp 14，阈值各不相同；字符串DP不参与 */
+static size_t bench_blob(void)
+{
+    blob_begin();
+    for (int r = 0; r < BENCH_RULES; r++) {
+        rule_gt_set((uint8_t)r, (uint8_t)(r % (DP_NUM - 2)), r * 7 % 100, DP_NUM - 2, r);
+    }
+    return blob_end();
+}
+
+static void test_bench(void)
+{
+    size_t len = bench_blob();
+    int64_t t0 = now_ns();
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_EQUAL_INT(BENCH_RULES, iot_rule_core_load(&s_core, s_blob, len));
+    }
+    double load_us = (double)(now_ns() - t0) / 1000 / 1000;
+
+    // 传感器DP在0..99之间变化，每次变化只求值引用它的规则
+    uint32_t seed = 1;
+    uint32_t evals0 = s_core.stats.evals;
+    uint32_t fires0 = s_core.stats.fires;
+    t0 = now_ns();
+    for (int i = 0; i < BENCH_CHANGES; i++) {
+        seed = seed * 1103515245u + 12345u;
+        set_dp((uint8_t)(i % (DP_NUM - 2)), (int32_t)((seed >> 16) % 100));
+    }
+    int64_t incr_ns = now_ns() - t0;
+    uint32_t evals = s_core.stats.evals - evals0;
+    uint32_t fires = s_core.stats.fires - fires0;
+
+    // 对照：所有规则都引用同一个DP，每次变化求值全部规则
+    blob_begin();
+    for (int r = 0; r < BENCH_RULES; r++) {
+        rule_gt_set((uint8_t)r, 0, r * 7 % 100, DP_NUM - 2, r);
+    }
+    TEST_ASSERT_EQUAL_INT(BENCH_RULES, iot_rule_core_load(&s_core, s_blob, blob_end()));
+    seed = 1;
+    evals0 = s_core.stats.evals;
+    t0 = now_ns();
+    for (int i = 0; i < BENCH_CHANGES; i++) {
+        seed = seed * 1103515245u + 12345u;
+        set_dp(0, (int32_t)((seed >> 16) % 100));
+    }
+    int64_t full_ns = now_ns() - t0;
+    uint32_t full_evals = s_core.stats.evals - evals0;
+
+    printf("rule set: %d rules, %u bytes, verify+load %.1f us; per DP change (host): %.0f ns, "
+           "%.1f rules evaluated, %.2f fired; evaluating all rules: %.0f ns (%.1fx)\n",
+           BENCH_RULES, (unsigned)len, load_us, (double)incr_ns / BENCH_CHANGES,
+           (double)evals / BENCH_CHANGES, (double)fires / BENCH_CHANGES,
+           (double)full_ns / BENCH_CHANGES, (double)full_ns / incr_ns);
+
+    // 第d个DP被 BENCH_RULES/14 条左右的规则引用
+    uint32_t expect = 0;
+    for (int d = 0; d < DP_NUM - 2; d++) {
+        uint32_t rules = (BENCH_RULES - d + DP_NUM - 3) / (DP_NUM - 2);
+        uint32_t changes = (BENCH_CHANGES - d + DP_NUM - 3) / (DP_NUM - 2);
+        expect += rules * changes;
+    }
+    TEST_ASSERT_EQUAL_UINT32(expect, evals);
+    // 耗时受主机负载影响，只断言求值条数
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)BENCH_CHANGES * BENCH_RULES, full_evals);
+    TEST_ASSERT_LESS_THAN(full_evals / 10, evals);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_edge_trigger);
+    RUN_TEST(test_string_rule);
+    RUN_TEST(test_reject_malformed);
+    RUN_TEST(test_nested_depth);
+    RUN_TEST(test_bench);
+    return UNITY_END();
+}
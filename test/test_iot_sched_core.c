@@ -0,0 +1,309 @@
+/*
+ * 周期任务调度核心：在虚拟时钟上模拟工作任务的主循环（睡到最早到期时刻再执行），
+ * 验证周期任务不漂移、相位错开、一次性任务、取消、超时与跳过周期的统计，
+ * 并与原先“干完活再 vTaskDelay(10 s)”的主循环对比一小时后的累计漂移
+ */
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "iot_sched_core.h"
+
+#define SEC                 1000000LL
+#define MAX_STARTS          512
+
+typedef struct {
+    int64_t cost_us;                // 每次执行消耗的虚拟时间
+    int64_t starts[MAX_STARTS];     // 每次开始执行的时刻
+    int count;
+} sim_job_t;
+
+static iot_sched_core_t s_core;
+static int64_t s_now;
+
+static int64_t clock_now(void *ctx)
+{
+    return s_now;
+}
+
+static void job_fn(void *ctx)
+{
+    sim_job_t *job = ctx;
+    if (job->count < MAX_STARTS) {
+        job->starts[job->count] = s_now;
+    }
+    job->count++;
+    s_now += job->cost_us;
+}
+
+/* 与 iot_sched 的工作任务相同：没有到期任务时睡到最早到期时刻；执行到 end_us（含）为止 */
+static void run_until(int64_t end_us)
+{
+    while (s_now <= end_us) {
+        int64_t next = iot_sched_core_next_due(&s_core);
+        if (next > end_us) {
+            s_now = end_us;
+            break;
+        }
+        if (next > s_now) {
+            s_now = next;
+        }
+        iot_sched_core_run_due(&s_core, clock_now, NULL);
+    }
+}
+
+void setUp(void)
+{
+    iot_sched_core_init(&s_core);
+    s_now = 1000 * SEC;
+}
+
+void tearDown(void)
+{
+}
+
+static void test_periodic_does_not_drift(void)
+{
+    // 上报任务：周期10 s，每次发布耗时300 ms
+    static sim_job_t report = { .cost_us = 300000 };
+    int64_t t0 = s_now;
+    int id = iot_sched_core_add(&s_core, "report", job_fn, &report, 10 * SEC, 10 * SEC, s_now);
+    TEST_ASSERT_NOT_EQUAL(IOT_SCHED_NONE, id);
+    run_until(t0 + 3600 * SEC);
+
+    TEST_ASSERT_EQUAL_INT(360, report.count);
+    for (int i = 0; i < report.count; i++) {
+        TEST_ASSERT_EQUAL_INT64(t0 + (i + 1) * 10 * SEC, report.starts[i]);
+    }
+    const iot_job_t *job = &s_core.jobs[id];
+    TEST_ASSERT_EQUAL_UINT32(360, job->runs);
+    TEST_ASSERT_EQUAL_UINT32(0, job->max_late_us);
+    TEST_ASSERT_EQUAL_UINT32(0, job->overruns);
+    TEST_ASSERT_EQUAL_UINT32(300000, iot_latency_avg_us(&job->run_time));
+
+    // 原先的主循环：干完活再延时10 s，实际周期是10.3 s，每次的发布耗时都累加成漂移
+    int64_t t = t0;
+    int loop_runs = 0;
+    while (t + 10 * SEC <= t0 + 3600 * SEC) {
+        t += 10 * SEC + report.cost_us;
+        loop_runs++;
+    }
+    printf("1 h of a 10 s job costing 300 ms: scheduler %d runs, drift 0 s; delay loop %d runs, drift %.1f s\n",
+           report.count, loop_runs, (double)(loop_runs * report.cost_us) / SEC);
+    TEST_ASSERT_LESS_THAN(360, loop_runs);
+}
+
+static void test_phases_spread_jobs(void)
+{
+    // 同周期的三个任务错开相位，到期时刻互不重叠，按到期先后执行
+    static sim_job_t a, b, c;
+    int64_t t0 = s_now;
+    iot_sched_core_add(&s_core, "c", job_fn, &c, 5 * SEC, 3 * SEC, s_now);
+    iot_sched_core_add(&s_core, "a", job_fn, &a, 5 * SEC, 1 * SEC, s_now);
+    iot_sched_core_add(&s_core, "b", job_fn, &b, 5 * SEC, 2 * SEC, s_now);
+    run_until(t0 + 60 * SEC);
+
+    TEST_ASSERT_EQUAL_INT(12, a.count);
+    TEST_ASSERT_EQUAL_INT(12, b.count);
+    TEST_ASSERT_EQUAL_INT(12, c.count);
+    for (int i = 0; i < 12; i++) {
+        TEST_ASSERT_EQUAL_INT64(t0 + 1 * SEC + i * 5 * SEC, a.starts[i]);
+        TEST_ASSERT_EQUAL_INT64(t0 + 2 * SEC + i * 5 * SEC, b.starts[i]);
+        TEST_ASSERT_EQUAL_INT64(t0 + 3 * SEC + i * 5 * SEC, c.starts[i]);
+    }
+
+    // 同一时刻到期时先到期的先执行，后面的任务延迟一个执行耗时
+    static sim_job_t x = { .cost_us = 40000 }, y = { .cost_us = 10000 };
+    iot_sched_core_init(&s_core);
+    t0 = s_now;
+    int ix = iot_sched_core_add(&s_core, "x", job_fn, &x, SEC, SEC, s_now);
+    int iy = iot_sched_core_add(&s_core, "y", job_fn, &y, SEC, SEC, s_now);
+    run_until(t0 + 10 * SEC);
+    TEST_ASSERT_EQUAL_INT(10, x.count);
+    TEST_ASSERT_EQUAL_INT(10, y.count);
+    TEST_ASSERT_EQUAL_UINT32(0, s_core.jobs[ix].max_late_us);
+    TEST_ASSERT_EQUAL_UINT32(40000, s_core.jobs[iy].max_late_us);
+}
+
+static void test_one_shot_and_cancel(void)
+{
+    static sim_job_t once, periodic, never;
+    int64_t t0 = s_now;
+    int io = iot_sched_core_add(&s_core, "once", job_fn, &once, 0, 2500000, s_now);
+    int ip = iot_sched_core_add(&s_core, "periodic", job_fn, &periodic, SEC, SEC, s_now);
+    int in = iot_sched_core_add(&s_core, "never", job_fn, &never, 0, 5 * SEC, s_now);
+    iot_sched_core_cancel(&s_core, in);
+    run_until(t0 + 3 * SEC);
+
+    TEST_ASSERT_EQUAL_INT(1, once.count);
+    TEST_ASSERT_EQUAL_INT64(t0 + 2500000, once.starts[0]);
+    TEST_ASSERT_FALSE(s_core.jobs[io].active);
+    TEST_ASSERT_EQUAL_INT(3, periodic.count);
+
+    iot_sched_core_cancel(&s_core, ip);
+    run_until(t0 + 10 * SEC);
+    TEST_ASSERT_EQUAL_INT(3, periodic.count);
+    TEST_ASSERT_EQUAL_INT(0, never.count);
+    TEST_ASSERT_EQUAL_INT64(INT64_MAX, iot_sched_core_next_due(&s_core));
+
+    // 执行完的一次性任务和取消的任务槽位可复用
+    TEST_ASSERT_EQUAL_INT(io, iot_sched_core_add(&s_core, "again", job_fn, &once, 0, 0, s_now));
+    iot_sched_core_cancel(&s_core, -1);
+    iot_sched_core_cancel(&s_core, IOT_SCHED_MAX_JOBS);
+}
+
+static void test_overrun_skips_missed_periods(void)
+{
+    // 周期10 s的任务某次卡了35 s：跳过错过的周期，不连续补跑
+    static sim_job_t slow = { .cost_us = 100000 };
+    int64_t t0 = s_now;
+    int id = iot_sched_core_add(&s_core, "slow", job_fn, &slow, 10 * SEC, 10 * SEC, s_now);
+    run_until(t0 + 20 * SEC);
+    TEST_ASSERT_EQUAL_INT(2, slow.count);
+
+    slow.cost_us = 35 * SEC;
+    run_until(t0 + 30 * SEC + 1);
+    slow.cost_us = 100000;
+    TEST_ASSERT_EQUAL_INT(3, slow.count);
+    TEST_ASSERT_EQUAL_INT64(t0 + 65 * SEC, s_now);
+
+    run_until(t0 + 95 * SEC);
+    // 结束后只补跑一次（40 s那次，迟到25 s），50 s、60 s跳过，之后回到原相位：70 s、80 s、90 s
+    TEST_ASSERT_EQUAL_INT(7, slow.count);
+    TEST_ASSERT_EQUAL_INT64(t0 + 65 * SEC, slow.starts[3]);
+    TEST_ASSERT_EQUAL_INT64(t0 + 70 * SEC, slow.starts[4]);
+    TEST_ASSERT_EQUAL_INT64(t0 + 90 * SEC, slow.starts[6]);
+
+    const iot_job_t *job = &s_core.jobs[id];
+    TEST_ASSERT_EQUAL_UINT32(1, job->overruns);
+    TEST_ASSERT_EQUAL_UINT32(35 * SEC, job->run_time.max_us);
+    TEST_ASSERT_EQUAL_UINT32(25 * SEC, job->max_late_us);
+    TEST_ASSERT_EQUAL_UINT32(2, job->missed);
+}
+
+static void test_round_runs_only_due_jobs(void)
+{
+    // 一轮里只执行开始时已到期的任务；执行期间到期的留到下一轮
+    static sim_job_t hog = { .cost_us = 3 * SEC }, quick;
+    iot_sched_core_add(&s_core, "hog", job_fn, &hog, 0, 0, s_now);
+    iot_sched_core_add(&s_core, "quick", job_fn, &quick, SEC, SEC, s_now);
+    TEST_ASSERT_EQUAL_INT(1, iot_sched_core_run_due(&s_core, clock_now, NULL));
+    TEST_ASSERT_EQUAL_INT(0, quick.count);
+    TEST_ASSERT_EQUAL_INT(1, iot_sched_core_run_due(&s_core, clock_now, NULL));
+    TEST_ASSERT_EQUAL_INT(1, quick.count);
+
+    // 取出后未结束的任务不会被再次取出
+    int id = iot_sched_core_take_due(&s_core, s_now + 10 * SEC);
+    TEST_ASSERT_NOT_EQUAL(IOT_SCHED_NONE, id);
+    TEST_ASSERT_EQUAL_INT(IOT_SCHED_NONE, iot_sched_core_take_due(&s_core, s_now + 20 * SEC));
+    TEST_ASSERT_EQUAL_INT64(INT64_MAX, iot_sched_core_next_due(&s_core));
+    iot_sched_core_finish(&s_core, id, s_now + 10 * SEC, 10);
+    TEST_ASSERT_NOT_EQUAL(INT64_MAX, iot_sched_core_next_due(&s_core));
+}
+
+/* 上报任务：在任务函数中按上报计划修改周期 */
+typedef struct {
+    sim_job_t sim;
+    int id;
+    int change_at;                  // 第几次执行时修改周期
+    int64_t new_period_us;
+    bool rearm_once;                // 对照组：每次执行后重新添加一次性任务
+    int64_t period_us;
+    int64_t last_start_us;
+} plan_job_t;
+
+// 设备上从到期到任务函数开始执行的延迟（定时器唤醒、一个100 Hz tick）
+#define WAKE_US     (10 * 1000)
+
+static void plan_job_fn(void *ctx)
+{
+    plan_job_t *job = ctx;
+    s_now += WAKE_US;
+    if (job->sim.count + 1 == job->change_at) {
+        job->period_us = job->new_period_us;
+        if (!job->rearm_once) {
+            TEST_ASSERT_TRUE(iot_sched_core_set_period(&s_core, job->id, job->new_period_us));
+        }
+    }
+    if (job->rearm_once) {
+        job->id = iot_sched_core_add(&s_core, "report", plan_job_fn, job, 0, job->period_us, s_now);
+        TEST_ASSERT_NOT_EQUAL(IOT_SCHED_NONE, job->id);
+    }
+    job->last_start_us = s_now;
+    job_fn(&job->sim);
+}
+
+static void test_set_period_keeps_phase(void)
+{
+    // 同时到期的BLE推送排在前面，上报再晚开始150 ms
+    static sim_job_t ble = { .cost_us = 150000 };
+    static plan_job_t job = { .sim.cost_us = 300000, .change_at = 3, .new_period_us = 4 * SEC };
+    int64_t t0 = s_now;
+    iot_sched_core_add(&s_core, "ble_push", job_fn, &ble, 3 * SEC, 3 * SEC, s_now);
+    job.id = iot_sched_core_add(&s_core, "report", plan_job_fn, &job, 10 * SEC, 10 * SEC, s_now);
+    run_until(t0 + 3600 * SEC);
+
+    // 第3次（30 s）执行时改为4 s：之后按 30 s + n*4 s 到期，延迟和执行耗时不累积
+    for (int i = 0; i < job.sim.count && i < MAX_STARTS; i++) {
+        int64_t due = i < 3 ? t0 + (i + 1) * 10 * SEC : t0 + 30 * SEC + (i - 2) * 4 * SEC;
+        int64_t late = job.sim.starts[i] - due;
+        TEST_ASSERT_TRUE(late == WAKE_US || late == ble.cost_us + WAKE_US);
+    }
+    TEST_ASSERT_EQUAL_INT(3 + (3600 - 30) / 4, job.sim.count);
+    int64_t ideal_last = t0 + 30 * SEC + (job.sim.count - 3) * 4 * SEC;
+    TEST_ASSERT_LESS_OR_EQUAL(ble.cost_us + WAKE_US, job.last_start_us - ideal_last);
+
+    // 不是周期任务、不存在或周期为0时拒绝
+    int once = iot_sched_core_add(&s_core, "once", job_fn, &job.sim, 0, SEC, s_now);
+    TEST_ASSERT_FALSE(iot_sched_core_set_period(&s_core, once, SEC));
+    TEST_ASSERT_FALSE(iot_sched_core_set_period(&s_core, job.id, 0));
+    TEST_ASSERT_FALSE(iot_sched_core_set_period(&s_core, IOT_SCHED_MAX_JOBS, SEC));
+
+    // 对照组：原先每次执行时重新添加一次性任务，延迟从开始执行算起，每次的唤醒延迟都累积下来
+    static plan_job_t rearm = { .sim.cost_us = 300000, .change_at = 3, .new_period_us = 4 * SEC,
+                                .rearm_once = true, .period_us = 10 * SEC };
+    static sim_job_t ble2 = { .cost_us = 150000 };
+    iot_sched_core_init(&s_core);
+    s_now = t0;
+    iot_sched_core_add(&s_core, "ble_push", job_fn, &ble2, 3 * SEC, 3 * SEC, s_now);
+    rearm.id = iot_sched_core_add(&s_core, "report", plan_job_fn, &rearm, 0, 10 * SEC, s_now);
+    run_until(t0 + 3600 * SEC);
+    int64_t rearm_ideal = t0 + 30 * SEC + (rearm.sim.count - 3) * 4 * SEC;
+    printf("report 10 s -> 4 s at 30 s, sharing the worker with a 3 s / 150 ms job: periodic %d runs in 1 h "
+           "(last start %.2f s late), re-armed one-shot %d runs (%.2f s drift)\n",
+           job.sim.count, (double)(job.last_start_us - ideal_last) / SEC,
+           rearm.sim.count, (double)(rearm.last_start_us - rearm_ideal) / SEC);
+    TEST_ASSERT_GREATER_THAN(WAKE_US * (rearm.sim.count - 3), rearm.last_start_us - rearm_ideal);
+    TEST_ASSERT_LESS_THAN(job.sim.count, rearm.sim.count);
+}
+
+static void test_limits(void)
+{
+    static sim_job_t dummy;
+    TEST_ASSERT_EQUAL_INT(IOT_SCHED_NONE, iot_sched_core_add(&s_core, "x", NULL, NULL, SEC, 0, s_now));
+    TEST_ASSERT_EQUAL_INT(IOT_SCHED_NONE, iot_sched_core_add(&s_core, "x", job_fn, &dummy, -1, 0, s_now));
+    TEST_ASSERT_EQUAL_INT(IOT_SCHED_NONE, iot_sched_core_add(&s_core, "x", job_fn, &dummy, SEC, -1, s_now));
+    for (int i = 0; i < IOT_SCHED_MAX_JOBS; i++) {
+        TEST_ASSERT_EQUAL_INT(i, iot_sched_core_add(&s_core, "x", job_fn, &dummy, SEC, 0, s_now));
+    }
+    TEST_ASSERT_EQUAL_INT(IOT_SCHED_NONE, iot_sched_core_add(&s_core, "x", job_fn, &dummy, SEC, 0, s_now));
+
+    // 正在执行的任务即使被取消，槽位也要等执行完才能复用
+    int id = iot_sched_core_take_due(&s_core, s_now);
+    iot_sched_core_cancel(&s_core, id);
+    TEST_ASSERT_EQUAL_INT(IOT_SCHED_NONE, iot_sched_core_add(&s_core, "x", job_fn, &dummy, SEC, 0, s_now));
+    iot_sched_core_finish(&s_core, id, s_now, 0);
+    TEST_ASSERT_EQUAL_INT(id, iot_sched_core_add(&s_core, "x", job_fn, &dummy, SEC, 0, s_now));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_periodic_does_not_drift);
+    RUN_TEST(test_phases_spread_jobs);
+    RUN_TEST(test_one_shot_and_cancel);
+    RUN_TEST(test_overrun_skips_missed_periods);
+    RUN_TEST(test_round_runs_only_due_jobs);
+    RUN_TEST(test_set_period_keeps_phase);
+    RUN_TEST(test_limits);
+    return UNITY_END();
+}
@@ -0,0 +1,118 @@
+/*
+ * 执行轨迹环形缓冲区：事件顺序、满时覆盖并计数、周期计数器回绕后的40位时间，
+ * 以及单个事件的记录开销（设备上另有 iot_trace_start 打印的实测周期数）
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "iot_trace_core.h"
+
+#define BENCH_EVENTS    20000000
+#define BENCH_ROUNDS    20      // 取最快一轮，避开主机上其他测试并行时的抢占
+#define RING_EVENTS     1024
+
+static iot_trace_event_t s_events[RING_EVENTS];
+static iot_trace_ring_t s_ring;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void setUp(void)
+{
+    memset(s_events, 0, sizeof(s_events));
+    iot_trace_ring_init(&s_ring, s_events, RING_EVENTS);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_order_and_overwrite(void)
+{
+    iot_trace_ring_init(&s_ring, s_events, 8);
+    TEST_ASSERT_EQUAL_UINT32(0, iot_trace_ring_count(&s_ring));
+    for (int i = 0; i < 5; i++) {
+        iot_trace_ring_put(&s_ring, 100 + i, 'i', "ev", (uint16_t)i, NULL);
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, iot_trace_ring_count(&s_ring));
+    TEST_ASSERT_EQUAL_UINT32(0, iot_trace_ring_overwritten(&s_ring));
+    TEST_ASSERT_EQUAL_UINT16(0, iot_trace_ring_at(&s_ring, 0)->arg);
+
+    // 满后覆盖最旧的事件，导出仍从最旧到最新
+    for (int i = 5; i < 20; i++) {
+        iot_trace_ring_put(&s_ring, 100 + i, 'i', "ev", (uint16_t)i, NULL);
+    }
+    TEST_ASSERT_EQUAL_UINT32(8, iot_trace_ring_count(&s_ring));
+    TEST_ASSERT_EQUAL_UINT32(12, iot_trace_ring_overwritten(&s_ring));
+    for (uint32_t i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL_UINT16(12 + i, iot_trace_ring_at(&s_ring, i)->arg);
+    }
+
+    // 重新开始记录时清空，覆盖计数归零
+    iot_trace_ring_clear(&s_ring);
+    TEST_ASSERT_EQUAL_UINT32(0, iot_trace_ring_count(&s_ring));
+    TEST_ASSERT_EQUAL_UINT32(0, iot_trace_ring_overwritten(&s_ring));
+}
+
+static void test_cycle_wrap(void)
+{
+    iot_trace_ring_put(&s_ring, 0xFFFFFF00u, 'B', "a", 0, NULL);
+    iot_trace_ring_put(&s_ring, 0x00000010u, 'E', "a", 0, NULL);
+    iot_trace_ring_put(&s_ring, 0x00000020u, 'i', "b", 0, NULL);
+    iot_trace_ring_put(&s_ring, 0x00000005u, 'i', "c", 0, NULL);
+
+    TEST_ASSERT_EQUAL_UINT64(0xFFFFFF00ull, iot_trace_event_cycles(iot_trace_ring_at(&s_ring, 0)));
+    TEST_ASSERT_EQUAL_UINT64(0x100000010ull, iot_trace_event_cycles(iot_trace_ring_at(&s_ring, 1)));
+    TEST_ASSERT_EQUAL_UINT64(0x100000020ull, iot_trace_event_cycles(iot_trace_ring_at(&s_ring, 2)));
+    TEST_ASSERT_EQUAL_UINT64(0x200000005ull, iot_trace_event_cycles(iot_trace_ring_at(&s_ring, 3)));
+    for (uint32_t i = 1; i < 4; i++) {
+        TEST_ASSERT_TRUE(iot_trace_event_cycles(iot_trace_ring_at(&s_ring, i)) >
+                         iot_trace_event_cycles(iot_trace_ring_at(&s_ring, i - 1)));
+    }
+}
+
+static void test_record_overhead(void)
+{
+    static const char *names[] = { "mqtt_event", "tx_publish", "cmd_apply", "trace_sync" };
+    // 模拟周期计数器：每次前进约一个事件间隔，跨越多次回绕
+    uint32_t cycles = 0xF0000000u;
+
+    int64_t put_ns = INT64_MAX;
+    for (uint32_t r = 0; r < BENCH_ROUNDS; r++) {
+        int64_t t0 = now_ns();
+        for (uint32_t i = r * (BENCH_EVENTS / BENCH_ROUNDS); i < (r + 1) * (BENCH_EVENTS / BENCH_ROUNDS); i++) {
+            cycles += 977;
+            iot_trace_ring_put(&s_ring, cycles, (i & 1) ? 'E' : 'B', names[i & 3], (uint16_t)i, &s_ring);
+        }
+        int64_t t = now_ns() - t0;
+        put_ns = t < put_ns ? t : put_ns;
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(RING_EVENTS, iot_trace_ring_count(&s_ring));
+    TEST_ASSERT_EQUAL_UINT32(BENCH_EVENTS - RING_EVENTS, iot_trace_ring_overwritten(&s_ring));
+    TEST_ASSERT_EQUAL_UINT16((uint16_t)(BENCH_EVENTS - 1), iot_trace_ring_at(&s_ring, RING_EVENTS - 1)->arg);
+    // 977 * 2000万 周期约回绕4次
+    uint64_t last = iot_trace_event_cycles(iot_trace_ring_at(&s_ring, RING_EVENTS - 1));
+    TEST_ASSERT_EQUAL_UINT64(0xF0000000ull + 977ull * BENCH_EVENTS, last);
+
+    double ns = (double)put_ns / (BENCH_EVENTS / BENCH_ROUNDS);
+    // 每秒1万个事件（任务切换 + 业务事件）时占用一个核的比例
+    printf("trace record: %.2f ns/event (host, without critical section), %.4f%% of a core at 10k events/s, "
+           "%u events overwritten\n", ns, ns * 10000 / 1e7, (unsigned)iot_trace_ring_overwritten(&s_ring));
+    // 断言的是结论（10k事件/s时不到1%的核），主机上ASan与并行测试会把单次记录放慢数倍
+    TEST_ASSERT_TRUE(ns * 10000 / 1e7 < 1.0);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_order_and_overwrite);
+    RUN_TEST(test_cycle_wrap);
+    RUN_TEST(test_record_overhead);
+    return UNITY_END();
+}
@@ -0,0 +1,313 @@
+/*
+ * 局域网控制协议：帧编解码、签名、防重放，以及127.0.0.1上的TCP往返测试
+ * （设备端线程按 use_lan_ctrl 的流程握手并应答SET，测量命令往返时延和每秒命令数）
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "unity.h"
+#include "lan_proto.h"
+
+#define LOOPBACK_COMMANDS   2000
+#define DP_STATUS           0
+#define DP_VALUE            1
+
+static uint8_t s_device_key[LAN_PROTO_KEY_LEN];
+
+void setUp(void)
+{
+    lan_proto_derive_device_key("test-device-secret", s_device_key);
+}
+
+void tearDown(void)
+{
+}
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void test_frame_roundtrip(void)
+{
+    uint8_t payload[32];
+    int plen = lan_dp_put_int(payload, sizeof(payload), 0, DP_VALUE, -42);
+    plen = lan_dp_put_str(payload, sizeof(payload), plen, DP_STATUS, "open");
+    TEST_ASSERT_EQUAL_INT(7 + 3 + 4, plen);
+
+    uint8_t frame_buf[LAN_PROTO_MAX_FRAME];
+    int n = lan_proto_encode(s_device_key, LAN_MSG_SET, 7, payload, (uint16_t)plen, frame_buf, sizeof(frame_buf));
+    TEST_ASSERT_EQUAL_INT(LAN_PROTO_OVERHEAD + plen, n);
+
+    lan_frame_t frame;
+    TEST_ASSERT_EQUAL_INT(0, lan_proto_decode(s_device_key, frame_buf, LAN_PROTO_HEADER_LEN - 1, &frame));
+    TEST_ASSERT_EQUAL_INT(0, lan_proto_decode(s_device_key, frame_buf, n - 1, &frame));
+    TEST_ASSERT_EQUAL_INT(n, lan_proto_decode(s_device_key, frame_buf, n, &frame));
+    TEST_ASSERT_EQUAL_UINT8(LAN_MSG_SET, frame.type);
+    TEST_ASSERT_EQUAL_UINT32(7, frame.seq);
+    TEST_ASSERT_EQUAL_UINT16(plen, frame.len);
+    TEST_ASSERT_EQUAL_MEMORY(payload, frame.payload, plen);
+}
+
+static void test_tampered_frame_rejected(void)
+{
+    uint8_t buf[LAN_PROTO_MAX_FRAME];
+    uint8_t payload[8];
+    int plen = lan_dp_put_int(payload, sizeof(payload), 0, DP_VALUE, 1);
+    int n = lan_proto_encode(s_device_key, LAN_MSG_SET, 1, payload, (uint16_t)plen, buf, sizeof(buf));
+    lan_frame_t frame;
+
+    buf[LAN_PROTO_HEADER_LEN + 6] ^= 1;
+    TEST_ASSERT_EQUAL_INT(-LAN_ERR_AUTH, lan_proto_decode(s_device_key, buf, n, &frame));
+    buf[LAN_PROTO_HEADER_LEN + 6] ^= 1;
+
+    uint8_t other_key[LAN_PROTO_KEY_LEN];
+    lan_proto_derive_device_key("another-secret", other_key);
+    TEST_ASSERT_EQUAL_INT(-LAN_ERR_AUTH, lan_proto_decode(other_key, buf, n, &frame));
+
+    buf[0] = 0;
+    TEST_ASSERT_EQUAL_INT(-LAN_ERR_BAD_FRAME, lan_proto_decode(s_device_key, buf, n, &frame));
+}
+
+static void test_session_rejects_replay(void)
+{
+    lan_session_t tx = { 0 };
+    lan_session_t rx = { 0 };
+    memcpy(tx.key, s_device_key, LAN_PROTO_KEY_LEN);
+    memcpy(rx.key, s_device_key, LAN_PROTO_KEY_LEN);
+
+    uint8_t a[LAN_PROTO_MAX_FRAME];
+    uint8_t b[LAN_PROTO_MAX_FRAME];
+    int na = lan_session_send(&tx, LAN_MSG_GET, NULL, 0, a, sizeof(a));
+    int nb = lan_session_send(&tx, LAN_MSG_GET, NULL, 0, b, sizeof(b));
+    lan_frame_t frame;
+    TEST_ASSERT_EQUAL_INT(na, lan_session_recv(&rx, a, na, &frame));
+    TEST_ASSERT_EQUAL_INT(nb, lan_session_recv(&rx, b, nb, &frame));
+    TEST_ASSERT_EQUAL_INT(-LAN_ERR_REPLAY, lan_session_recv(&rx, a, na, &frame));
+    TEST_ASSERT_EQUAL_INT(-LAN_ERR_REPLAY, lan_session_recv(&rx, b, nb, &frame));
+}
+
+static void count_dp(uint8_t dp, uint8_t type, const uint8_t *value, uint8_t len, void *ctx)
+{
+    (*(int *)ctx)++;
+}
+
+static void test_tlv_parse_rejects_truncation(void)
+{
+    uint8_t payload[16];
+    int plen = lan_dp_put_int(payload, sizeof(payload), 0, DP_VALUE, 5);
+    int count = 0;
+    TEST_ASSERT_EQUAL_INT(0, lan_dp_parse(payload, (uint16_t)plen, count_dp, &count));
+    TEST_ASSERT_EQUAL_INT(1, count);
+    TEST_ASSERT_EQUAL_INT(-1, lan_dp_parse(payload, (uint16_t)(plen - 1), count_dp, &count));
+    payload[2] = 3;     // 整型长度必须为4
+    TEST_ASSERT_EQUAL_INT(-1, lan_dp_parse(payload, (uint16_t)plen, count_dp, &count));
+    TEST_ASSERT_EQUAL_INT(-1, lan_dp_put_int(payload, 6, 0, DP_VALUE, 1));
+}
+
+/* ---------- 127.0.0.1 往返 ---------- */
+
+typedef struct {
+    int fd;
+    uint8_t buf[LAN_PROTO_MAX_FRAME * 2];
+    size_t len;
+} conn_t;
+
+/* 设备端线程中也会调用，不能用Unity断言 */
+static bool send_all(int fd, const uint8_t *p, int n)
+{
+    while (n > 0) {
+        ssize_t w = send(fd, p, (size_t)n, 0);
+        if (w <= 0) {
+            return false;
+        }
+        p += w;
+        n -= (int)w;
+    }
+    return true;
+}
+
+/* 读到一个完整帧，返回帧长度，连接关闭返回-1 */
+static int recv_frame(conn_t *c, lan_session_t *s, lan_frame_t *frame)
+{
+    for (;;) {
+        int used = lan_session_recv(s, c->buf, c->len, frame);
+        if (used != 0) {
+            return used;
+        }
+        ssize_t r = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+        if (r <= 0) {
+            return -1;
+        }
+        c->len += (size_t)r;
+    }
+}
+
+static void consume(conn_t *c, int used)
+{
+    c->len -= (size_t)used;
+    memmove(c->buf, c->buf + used, c->len);
+}
+
+typedef struct {
+    int listen_fd;
+    int32_t value;
+    int commands;
+} device_t;
+
+static void apply_dp(uint8_t dp, uint8_t type, const uint8_t *value, uint8_t len, void *ctx)
+{
+    if (dp == DP_VALUE && type == LAN_DP_TYPE_INT) {
+        ((device_t *)ctx)->value = lan_dp_get_int(value);
+    }
+}
+
+/* 设备端：与 use_lan_ctrl 相同，先用设备密钥校验HELLO，派生会话密钥后应答，之后每个SET回一帧STATE */
+static void *device_thread(void *arg)
+{
+    device_t *dev = arg;
+    conn_t c = { .fd = accept(dev->listen_fd, NULL, NULL) };
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    lan_session_t session = { 0 };
+    memcpy(session.key, s_device_key, LAN_PROTO_KEY_LEN);
+    uint8_t out[LAN_PROTO_MAX_FRAME];
+
+    for (;;) {
+        lan_frame_t frame;
+        int used = recv_frame(&c, &session, &frame);
+        if (used < 0) {
+            break;
+        }
+        if (frame.type == LAN_MSG_HELLO && frame.len == LAN_PROTO_NONCE_LEN) {
+            uint8_t device_nonce[LAN_PROTO_NONCE_LEN];
+            for (int i = 0; i < LAN_PROTO_NONCE_LEN; i++) {
+                device_nonce[i] = (uint8_t)rand();
+            }
+            lan_proto_derive_session_key(s_device_key, frame.payload, device_nonce, session.key);
+            session.authed = true;
+            session.rx_seq = 0;
+            session.tx_seq = 0;
+            consume(&c, used);
+            int n = lan_session_send(&session, LAN_MSG_HELLO_ACK, device_nonce, sizeof(device_nonce), out, sizeof(out));
+            if (!send_all(c.fd, out, n)) {
+                break;
+            }
+            continue;
+        }
+        if (frame.type == LAN_MSG_SET && session.authed) {
+            lan_dp_parse(frame.payload, frame.len, apply_dp, dev);
+            dev->commands++;
+            uint8_t state[16];
+            int plen = lan_dp_put_int(state, sizeof(state), 0, DP_VALUE, dev->value);
+            consume(&c, used);
+            int n = lan_session_send(&session, LAN_MSG_STATE, state, (uint16_t)plen, out, sizeof(out));
+            if (!send_all(c.fd, out, n)) {
+                break;
+            }
+            continue;
+        }
+        consume(&c, used);
+    }
+    close(c.fd);
+    return NULL;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void test_loopback_round_trip(void)
+{
+    device_t dev = { .listen_fd = socket(AF_INET, SOCK_STREAM, 0) };
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t alen = sizeof(addr);
+    TEST_ASSERT_EQUAL_INT(0, bind(dev.listen_fd, (struct sockaddr *)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL_INT(0, listen(dev.listen_fd, 1));
+    getsockname(dev.listen_fd, (struct sockaddr *)&addr, &alen);
+    pthread_t th;
+    pthread_create(&th, NULL, device_thread, &dev);
+
+    conn_t c = { .fd = socket(AF_INET, SOCK_STREAM, 0) };
+    TEST_ASSERT_EQUAL_INT(0, connect(c.fd, (struct sockaddr *)&addr, sizeof(addr)));
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // 握手：HELLO用设备密钥签名，HELLO_ACK用会话密钥签名
+    lan_session_t session = { 0 };
+    memcpy(session.key, s_device_key, LAN_PROTO_KEY_LEN);
+    uint8_t client_nonce[LAN_PROTO_NONCE_LEN] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+    uint8_t out[LAN_PROTO_MAX_FRAME];
+    int n = lan_session_send(&session, LAN_MSG_HELLO, client_nonce, sizeof(client_nonce), out, sizeof(out));
+    TEST_ASSERT_TRUE(send_all(c.fd, out, n));
+
+    lan_session_t ack_session = { 0 };
+    lan_frame_t frame;
+    ssize_t r = recv(c.fd, c.buf, sizeof(c.buf), 0);
+    TEST_ASSERT_GREATER_THAN(0, r);
+    c.len = (size_t)r;
+    int used = lan_proto_decode(NULL, c.buf, c.len, &frame);
+    TEST_ASSERT_GREATER_THAN(0, used);
+    TEST_ASSERT_EQUAL_UINT8(LAN_MSG_HELLO_ACK, frame.type);
+    lan_proto_derive_session_key(s_device_key, client_nonce, frame.payload, ack_session.key);
+    TEST_ASSERT_EQUAL_INT(used, lan_session_recv(&ack_session, c.buf, c.len, &frame));
+    consume(&c, used);
+    session = ack_session;
+    session.tx_seq = 0;
+
+    static int64_t rtt[LOOPBACK_COMMANDS];
+    int64_t t_start = now_us();
+    for (int i = 0; i < LOOPBACK_COMMANDS; i++) {
+        uint8_t payload[16];
+        int plen = lan_dp_put_int(payload, sizeof(payload), 0, DP_VALUE, i);
+        int64_t t0 = now_us();
+        n = lan_session_send(&session, LAN_MSG_SET, payload, (uint16_t)plen, out, sizeof(out));
+        TEST_ASSERT_TRUE(send_all(c.fd, out, n));
+        used = recv_frame(&c, &session, &frame);
+        rtt[i] = now_us() - t0;
+        TEST_ASSERT_GREATER_THAN(0, used);
+        TEST_ASSERT_EQUAL_UINT8(LAN_MSG_STATE, frame.type);
+        TEST_ASSERT_EQUAL_INT32(i, lan_dp_get_int(frame.payload + 3));
+        consume(&c, used);
+    }
+    int64_t elapsed = now_us() - t_start;
+    close(c.fd);
+    pthread_join(th, NULL);
+    close(dev.listen_fd);
+
+    qsort(rtt, LOOPBACK_COMMANDS, sizeof(rtt[0]), cmp_i64);
+    int64_t sum = 0;
+    for (int i = 0; i < LOOPBACK_COMMANDS; i++) {
+        sum += rtt[i];
+    }
+    printf("LAN loopback: %d commands, RTT avg %lld us, p50 %lld us, p99 %lld us, %lld commands/s\n",
+           LOOPBACK_COMMANDS, (long long)(sum / LOOPBACK_COMMANDS), (long long)rtt[LOOPBACK_COMMANDS / 2],
+           (long long)rtt[LOOPBACK_COMMANDS * 99 / 100], (long long)(LOOPBACK_COMMANDS * 1000000LL / elapsed));
+    TEST_ASSERT_EQUAL_INT(LOOPBACK_COMMANDS, dev.commands);
+    // 协议处理本身不能吃掉10 ms的时延预算
+    TEST_ASSERT_LESS_THAN(10000, rtt[LOOPBACK_COMMANDS / 2]);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_roundtrip);
+    RUN_TEST(test_tampered_frame_rejected);
+    RUN_TEST(test_session_rejects_replay);
+    RUN_TEST(test_tlv_parse_rejects_truncation);
+    RUN_TEST(test_loopback_round_trip);
+    return UNITY_END();
+}
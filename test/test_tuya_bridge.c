@@ -0,0 +1,287 @@
+/*
+ * BLE桥接：分片编码与重组、下行消息签名校验（错误密钥、篡改、重放、会话切换），
+ * 以及按BLE连接间隔和每个连接事件可发的通知数模拟“一条在途、等ACK”的上行转发，
+ * 测量不同MTU下每秒转发的消息数和有效字节数，另测编码和签名校验的主机耗时
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "mbedtls/md.h"
+#include "tuya_bridge.h"
+
+#define SECRET              "ecw9VrT7fLlgP6br"
+#define TOPIC_REPORT        "tylink/26f1c0a7e3d9b8f5a4xyz1/thing/property/report"
+#define TOPIC_SET           "tylink/26f1c0a7e3d9b8f5a4xyz1/thing/property/set"
+#define BENCH_ROUNDS        20000
+
+typedef struct {
+    uint8_t frames[64][TUYA_BRIDGE_HDR_LEN + TUYA_BRIDGE_MSG_MAX];
+    uint16_t lens[64];
+    int count;
+} frame_sink_t;
+
+static tuya_bridge_auth_t s_auth;
+static tuya_bridge_rx_t s_rx;
+static frame_sink_t s_sink;
+static const uint8_t s_nonce[TUYA_BRIDGE_NONCE_LEN] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int collect(const uint8_t *frame, uint16_t len, void *ctx)
+{
+    frame_sink_t *sink = ctx;
+    if (sink->count >= 64) {
+        return -1;
+    }
+    memcpy(sink->frames[sink->count], frame, len);
+    sink->lens[sink->count++] = len;
+    return 0;
+}
+
+/* 手机侧签名，按协议说明独立实现：[counter u32][topic\ndata][tag 16] */
+static uint16_t phone_sign(const char *secret, const uint8_t nonce[TUYA_BRIDGE_NONCE_LEN], uint32_t counter,
+                           const char *topic, const char *data, uint8_t *out)
+{
+    const mbedtls_md_info_t *sha = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    uint8_t key[32], tag[32];
+    mbedtls_md_hmac(sha, (const uint8_t *)secret, strlen(secret), (const uint8_t *)"tuya-bridge-v1", 14, key);
+
+    uint16_t len = 0;
+    out[len++] = (uint8_t)counter;
+    out[len++] = (uint8_t)(counter >> 8);
+    out[len++] = (uint8_t)(counter >> 16);
+    out[len++] = (uint8_t)(counter >> 24);
+    len += (uint16_t)sprintf((char *)&out[len], "%s\n%s", topic, data);
+
+    uint8_t signed_buf[TUYA_BRIDGE_NONCE_LEN + TUYA_BRIDGE_MSG_MAX + 4];
+    memcpy(signed_buf, nonce, TUYA_BRIDGE_NONCE_LEN);
+    memcpy(&signed_buf[TUYA_BRIDGE_NONCE_LEN], out, len);
+    mbedtls_md_hmac(sha, key, sizeof(key), signed_buf, TUYA_BRIDGE_NONCE_LEN + len, tag);
+    memcpy(&out[len], tag, TUYA_BRIDGE_TAG_LEN);
+    return len + TUYA_BRIDGE_TAG_LEN;
+}
+
+/* 把签名好的下行消息按 max_frame 分片写入，返回最后一帧的处理结果 */
+static tuya_bridge_rx_result_t phone_write(const uint8_t *msg, uint16_t len, uint16_t seq, uint16_t max_frame)
+{
+    uint8_t frame[TUYA_BRIDGE_HDR_LEN + TUYA_BRIDGE_MSG_MAX];
+    uint16_t chunk = max_frame - TUYA_BRIDGE_HDR_LEN;
+    tuya_bridge_rx_result_t res = TUYA_BRIDGE_RX_NONE;
+    uint16_t out_seq;
+    for (uint16_t pos = 0, frag = 0; pos < len; pos += chunk, frag++) {
+        uint16_t n = len - pos < chunk ? len - pos : chunk;
+        frame[0] = TUYA_BRIDGE_DOWN_DATA;
+        frame[1] = (uint8_t)seq;
+        frame[2] = (uint8_t)(seq >> 8);
+        frame[3] = (uint8_t)frag | (pos + n == len ? TUYA_BRIDGE_FRAG_LAST : 0);
+        memcpy(&frame[TUYA_BRIDGE_HDR_LEN], &msg[pos], n);
+        res = tuya_bridge_rx_frame(&s_rx, frame, TUYA_BRIDGE_HDR_LEN + n, &out_seq);
+    }
+    return res;
+}
+
+void setUp(void)
+{
+    tuya_bridge_auth_init(&s_auth, SECRET);
+    tuya_bridge_rx_reset(&s_rx);
+    memset(&s_sink, 0, sizeof(s_sink));
+}
+
+void tearDown(void)
+{
+}
+
+static void test_encode_fragments(void)
+{
+    const char *data = "{\"msgId\":\"1\",\"time\":1700000000000,\"data\":{\"test_value\":{\"value\":42}}}";
+    int frames = tuya_bridge_encode(7, TOPIC_REPORT, data, (uint16_t)strlen(data), 20, collect, &s_sink);
+    size_t total = strlen(TOPIC_REPORT) + 1 + strlen(data);
+    TEST_ASSERT_EQUAL_INT((int)((total + 15) / 16), frames);
+
+    // 拼回原消息；只有最后一帧带结束标志
+    char joined[TUYA_BRIDGE_MSG_MAX + 1];
+    size_t pos = 0;
+    for (int i = 0; i < frames; i++) {
+        TEST_ASSERT_EQUAL_HEX8(TUYA_BRIDGE_UP_DATA, s_sink.frames[i][0]);
+        TEST_ASSERT_EQUAL_HEX8(7, s_sink.frames[i][1]);
+        TEST_ASSERT_EQUAL_HEX8(i | (i == frames - 1 ? TUYA_BRIDGE_FRAG_LAST : 0), s_sink.frames[i][3]);
+        memcpy(&joined[pos], &s_sink.frames[i][TUYA_BRIDGE_HDR_LEN], s_sink.lens[i] - TUYA_BRIDGE_HDR_LEN);
+        pos += s_sink.lens[i] - TUYA_BRIDGE_HDR_LEN;
+    }
+    joined[pos] = '\0';
+    TEST_ASSERT_EQUAL_UINT32(total, pos);
+    TEST_ASSERT_EQUAL_STRING_LEN(TOPIC_REPORT "\n", joined, strlen(TOPIC_REPORT) + 1);
+
+    // 大MTU一帧发完；消息过长拒绝
+    s_sink.count = 0;
+    TEST_ASSERT_EQUAL_INT(1, tuya_bridge_encode(8, TOPIC_REPORT, data, (uint16_t)strlen(data), 244, collect, &s_sink));
+    static char big[TUYA_BRIDGE_MSG_MAX];
+    memset(big, 'x', sizeof(big) - 1);
+    TEST_ASSERT_EQUAL_INT(-1, tuya_bridge_encode(9, TOPIC_REPORT, big, sizeof(big) - 1, 244, collect, &s_sink));
+}
+
+static void test_signed_downlink(void)
+{
+    uint8_t nonce_frame[TUYA_BRIDGE_NONCE_FRAME];
+    uint8_t msg[TUYA_BRIDGE_MSG_MAX + TUYA_BRIDGE_AUTH_LEN];
+    const char *cmd = "{\"msgId\":\"45\",\"data\":{\"test_value\":7}}";
+
+    // 会话开始前一律拒绝
+    uint16_t len = phone_sign(SECRET, s_nonce, 1, TOPIC_SET, cmd, msg);
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_RX_MESSAGE, phone_write(msg, len, 1, 20));
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_NO_SESSION, tuya_bridge_auth_verify(&s_auth, &s_rx));
+
+    TEST_ASSERT_EQUAL_UINT16(TUYA_BRIDGE_NONCE_FRAME, tuya_bridge_auth_start(&s_auth, s_nonce, nonce_frame));
+    TEST_ASSERT_EQUAL_HEX8(TUYA_BRIDGE_UP_NONCE, nonce_frame[0]);
+    TEST_ASSERT_EQUAL_MEMORY(s_nonce, &nonce_frame[1], TUYA_BRIDGE_NONCE_LEN);
+
+    // 正确签名：去掉counter和tag后可按原格式拆分
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_RX_MESSAGE, phone_write(msg, len, 1, 20));
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_OK, tuya_bridge_auth_verify(&s_auth, &s_rx));
+    const char *topic, *data;
+    int topic_len, data_len;
+    TEST_ASSERT_TRUE(tuya_bridge_split(&s_rx, &topic, &topic_len, &data, &data_len));
+    TEST_ASSERT_EQUAL_INT((int)strlen(TOPIC_SET), topic_len);
+    TEST_ASSERT_EQUAL_STRING_LEN(TOPIC_SET, topic, topic_len);
+    TEST_ASSERT_EQUAL_STRING(cmd, data);
+
+    // 重放同一条（同一counter）、counter回退都拒绝
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_RX_MESSAGE, phone_write(msg, len, 2, 64));
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_REPLAY, tuya_bridge_auth_verify(&s_auth, &s_rx));
+    len = phone_sign(SECRET, s_nonce, 5, TOPIC_SET, cmd, msg);
+    phone_write(msg, len, 3, 64);
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_OK, tuya_bridge_auth_verify(&s_auth, &s_rx));
+    len = phone_sign(SECRET, s_nonce, 4, TOPIC_SET, cmd, msg);
+    phone_write(msg, len, 4, 64);
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_REPLAY, tuya_bridge_auth_verify(&s_auth, &s_rx));
+
+    // 错误的设备密钥、篡改任意一字节都拒绝
+    len = phone_sign("wrong-secret", s_nonce, 6, TOPIC_SET, cmd, msg);
+    phone_write(msg, len, 5, 64);
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_BAD_TAG, tuya_bridge_auth_verify(&s_auth, &s_rx));
+    len = phone_sign(SECRET, s_nonce, 6, TOPIC_SET, cmd, msg);
+    msg[10] ^= 0x01;
+    phone_write(msg, len, 6, 64);
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_BAD_TAG, tuya_bridge_auth_verify(&s_auth, &s_rx));
+    phone_write(msg, TUYA_BRIDGE_AUTH_LEN, 7, 64);
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_BAD_TAG, tuya_bridge_auth_verify(&s_auth, &s_rx));
+
+    // 新会话换了随机数：旧会话签名的消息失效，counter重新计
+    uint8_t nonce2[TUYA_BRIDGE_NONCE_LEN] = { 0xA5 };
+    tuya_bridge_auth_start(&s_auth, nonce2, nonce_frame);
+    len = phone_sign(SECRET, s_nonce, 100, TOPIC_SET, cmd, msg);
+    phone_write(msg, len, 8, 64);
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_BAD_TAG, tuya_bridge_auth_verify(&s_auth, &s_rx));
+    len = phone_sign(SECRET, nonce2, 1, TOPIC_SET, cmd, msg);
+    phone_write(msg, len, 9, 64);
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_OK, tuya_bridge_auth_verify(&s_auth, &s_rx));
+
+    tuya_bridge_auth_stop(&s_auth);
+    len = phone_sign(SECRET, nonce2, 2, TOPIC_SET, cmd, msg);
+    phone_write(msg, len, 10, 64);
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_NO_SESSION, tuya_bridge_auth_verify(&s_auth, &s_rx));
+}
+
+static void test_rx_control_frames(void)
+{
+    uint16_t seq;
+    const uint8_t ack[] = { TUYA_BRIDGE_DOWN_ACK, 0x34, 0x12 };
+    const uint8_t hello[] = { TUYA_BRIDGE_DOWN_HELLO, 0, 0 };
+    const uint8_t bad[] = { 0x55, 0, 0, 0 };
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_RX_ACK, tuya_bridge_rx_frame(&s_rx, ack, sizeof(ack), &seq));
+    TEST_ASSERT_EQUAL_HEX16(0x1234, seq);
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_RX_HELLO, tuya_bridge_rx_frame(&s_rx, hello, sizeof(hello), &seq));
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_RX_ERROR, tuya_bridge_rx_frame(&s_rx, bad, sizeof(bad), &seq));
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_RX_ERROR, tuya_bridge_rx_frame(&s_rx, ack, 2, &seq));
+
+    // 分片乱序丢弃整条消息
+    const uint8_t f0[] = { TUYA_BRIDGE_DOWN_DATA, 1, 0, 0, 'a' };
+    const uint8_t f2[] = { TUYA_BRIDGE_DOWN_DATA, 1, 0, 2 | TUYA_BRIDGE_FRAG_LAST, 'c' };
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_RX_NONE, tuya_bridge_rx_frame(&s_rx, f0, sizeof(f0), &seq));
+    TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_RX_ERROR, tuya_bridge_rx_frame(&s_rx, f2, sizeof(f2), &seq));
+    TEST_ASSERT_EQUAL_UINT16(0, s_rx.len);
+}
+
+/*
+ * 上行转发模型：一条消息在途，分片按连接事件发出（每个事件最多 per_event 个通知），
+ * 手机收齐后发布到云端（cloud_rtt_ms），再在下一个连接事件写回ACK
+ */
+static double bridge_msgs_per_s(uint16_t mtu, int interval_ms, int per_event, int cloud_rtt_ms, uint16_t msg_len,
+                                int *frames_out)
+{
+    static char data[TUYA_BRIDGE_MSG_MAX];
+    memset(data, 'x', msg_len);
+    s_sink.count = 0;
+    int frames = tuya_bridge_encode(1, TOPIC_REPORT, data, msg_len, mtu - 3, collect, &s_sink);
+    TEST_ASSERT_GREATER_THAN(0, frames);
+    *frames_out = frames;
+
+    int events_tx = (frames + per_event - 1) / per_event;
+    int ack_wait_ms = ((cloud_rtt_ms + interval_ms - 1) / interval_ms) * interval_ms + interval_ms;
+    int per_msg_ms = events_tx * interval_ms + ack_wait_ms;
+    return 1000.0 / per_msg_ms;
+}
+
+static void test_uplink_throughput(void)
+{
+    // 典型属性上报约120字节；连接间隔30 ms，手机到云端150 ms
+    static const struct {
+        uint16_t mtu;
+        int per_event;
+        const char *name;
+    } links[] = {
+        { 23, 1, "MTU 23, 1 notify/event" },
+        { 23, 4, "MTU 23, 4 notify/event" },
+        { 185, 4, "MTU 185, 4 notify/event" },
+        { 247, 6, "MTU 247, 6 notify/event" },
+    };
+    const uint16_t msg_len = 120;
+    double rate[4];
+    for (int i = 0; i < 4; i++) {
+        int frames;
+        rate[i] = bridge_msgs_per_s(links[i].mtu, 30, links[i].per_event, 150, msg_len, &frames);
+        printf("%-26s %2d frames/msg, %.2f msg/s, %.0f B/s\n", links[i].name, frames, rate[i],
+               rate[i] * (msg_len + strlen(TOPIC_REPORT) + 1));
+    }
+    // 默认MTU下分片数决定吞吐；协商大MTU后一条消息一帧，吞吐受ACK往返限制
+    TEST_ASSERT_GREATER_THAN((int)(rate[0] * 200), (int)(rate[3] * 100));
+    TEST_ASSERT_GREATER_OR_EQUAL(4, (int)rate[3]);
+
+    // 主机CPU：编码一条 + 校验一条签名的下行命令
+    uint8_t msg[TUYA_BRIDGE_MSG_MAX + TUYA_BRIDGE_AUTH_LEN];
+    uint8_t nonce_frame[TUYA_BRIDGE_NONCE_FRAME];
+    tuya_bridge_auth_start(&s_auth, s_nonce, nonce_frame);
+    static char data[TUYA_BRIDGE_MSG_MAX];
+    memset(data, 'x', msg_len);
+    int64_t encode_ns = 0, verify_ns = 0;
+    for (uint32_t i = 1; i <= BENCH_ROUNDS; i++) {
+        s_sink.count = 0;
+        int64_t t0 = now_ns();
+        tuya_bridge_encode((uint16_t)i, TOPIC_REPORT, data, msg_len, 20, collect, &s_sink);
+        encode_ns += now_ns() - t0;
+
+        uint16_t len = phone_sign(SECRET, s_nonce, i, TOPIC_SET, "{\"data\":{\"test_value\":1}}", msg);
+        phone_write(msg, len, (uint16_t)i, 244);
+        t0 = now_ns();
+        TEST_ASSERT_EQUAL_INT(TUYA_BRIDGE_AUTH_OK, tuya_bridge_auth_verify(&s_auth, &s_rx));
+        verify_ns += now_ns() - t0;
+    }
+    printf("host: encode %u B at MTU 23 %.0f ns, HMAC verify %.0f ns per message\n", (unsigned)msg_len,
+           (double)encode_ns / BENCH_ROUNDS, (double)verify_ns / BENCH_ROUNDS);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_encode_fragments);
+    RUN_TEST(test_signed_downlink);
+    RUN_TEST(test_rx_control_frames);
+    RUN_TEST(test_uplink_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,239 @@
+/*
+ * 下行命令暂存：msgId去重、执行窗口、待应答已满时立即执行，
+ * 以及滑条连续拖动的命令突发（夹杂QoS1重发）在虚拟时钟上的执行次数、时延和应答
+ */
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "tuya_cmd.h"
+
+#define MS              1000LL
+#define BURST_MS        2000
+#define BURST_GAP_MS    20      // 手机滑条每20 ms下发一次
+#define DUP_EVERY       5       // 每5条命令有一条在重连后被重发
+#define DUP_DELAY_MS    200
+#define BURST_T0_MS     1000    // 与设备上一样从非0时刻开始，last_apply_us为0表示还没有执行过
+
+static tuya_cmd_t s_cmd;
+static tuya_cmd_batch_t s_batch;
+
+void setUp(void)
+{
+    tuya_cmd_init(&s_cmd, TUYA_CMD_WINDOW_MS);
+}
+
+void tearDown(void)
+{
+}
+
+static void put_int(iot_dp_id_t dp, int32_t v, int64_t now_us)
+{
+    tuya_cmd_value_t value = { .i = v };
+    tuya_cmd_put(&s_cmd, dp, &value, now_us);
+}
+
+static void test_dedup(void)
+{
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, "m1"));
+    TEST_ASSERT_TRUE(tuya_cmd_seen(&s_cmd, "m1"));
+    // 没有msgId的命令不去重
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, ""));
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, ""));
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, NULL));
+
+    // 只记最近 TUYA_CMD_RECENT_NUM 个
+    char id[16];
+    for (int i = 0; i < TUYA_CMD_RECENT_NUM - 1; i++) {
+        snprintf(id, sizeof(id), "n%d", i);
+        TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, id));
+    }
+    TEST_ASSERT_TRUE(tuya_cmd_seen(&s_cmd, "m1"));
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, "n99"));
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, "m1"));
+    TEST_ASSERT_EQUAL_UINT32(2, s_cmd.stats.duplicates);
+    TEST_ASSERT_EQUAL_UINT32(4 + TUYA_CMD_RECENT_NUM - 1 + 2, s_cmd.stats.commands);
+}
+
+static void test_dedup_exact(void)
+{
+    // FNV-1a 32位哈希相同的两组msgId，按原文比较不会互相误判
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, "costarring"));
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, "liquid"));
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, "declinate"));
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, "macallums"));
+    TEST_ASSERT_TRUE(tuya_cmd_seen(&s_cmd, "liquid"));
+
+    // 最长可保存的msgId去重，更长的无法逐字比较，照常执行
+    char id[TUYA_CMD_MSG_ID_MAX + 1];
+    memset(id, 'a', sizeof(id) - 1);
+    id[TUYA_CMD_MSG_ID_MAX - 1] = '\0';
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, id));
+    TEST_ASSERT_TRUE(tuya_cmd_seen(&s_cmd, id));
+    id[TUYA_CMD_MSG_ID_MAX - 1] = 'a';
+    id[TUYA_CMD_MSG_ID_MAX] = '\0';
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, id));
+    TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, id));
+    TEST_ASSERT_EQUAL_UINT32(2, s_cmd.stats.duplicates);
+}
+
+static void test_window_and_coalesce(void)
+{
+    TEST_ASSERT_EQUAL_INT64(INT64_MAX, tuya_cmd_due_us(&s_cmd));
+    TEST_ASSERT_FALSE(tuya_cmd_take(&s_cmd, 0, &s_batch));
+
+    // 第一条命令立即执行
+    put_int(IOT_DP_TEST_VALUE, 1, 1000 * MS);
+    TEST_ASSERT_TRUE(tuya_cmd_add_ack(&s_cmd, "a", IOT_DP_BIT(IOT_DP_TEST_VALUE), 1000 * MS));
+    TEST_ASSERT_EQUAL_INT64(0, tuya_cmd_due_us(&s_cmd));
+    TEST_ASSERT_TRUE(tuya_cmd_take(&s_cmd, 1000 * MS, &s_batch));
+    TEST_ASSERT_EQUAL_UINT32(IOT_DP_BIT(IOT_DP_TEST_VALUE), s_batch.dp_mask);
+    TEST_ASSERT_EQUAL_INT(1, s_batch.values[IOT_DP_TEST_VALUE].i);
+    TEST_ASSERT_EQUAL_UINT8(1, s_batch.ack_count);
+
+    // 窗口内到达的合并到窗口结束，只执行最新值，每条命令都应答
+    put_int(IOT_DP_TEST_VALUE, 2, 1020 * MS);
+    tuya_cmd_add_ack(&s_cmd, "b", IOT_DP_BIT(IOT_DP_TEST_VALUE), 1020 * MS);
+    tuya_cmd_value_t status = { 0 };
+    strcpy(status.s, "open");
+    tuya_cmd_put(&s_cmd, IOT_DP_DEVICE_STATUS, &status, 1050 * MS);
+    put_int(IOT_DP_TEST_VALUE, 3, 1060 * MS);
+    tuya_cmd_add_ack(&s_cmd, "c", IOT_DP_BIT(IOT_DP_DEVICE_STATUS) | IOT_DP_BIT(IOT_DP_TEST_VALUE), 1060 * MS);
+    TEST_ASSERT_EQUAL_INT64(1000 * MS + TUYA_CMD_WINDOW_MS * MS, tuya_cmd_due_us(&s_cmd));
+    TEST_ASSERT_TRUE(tuya_cmd_take(&s_cmd, 1100 * MS, &s_batch));
+    TEST_ASSERT_EQUAL_UINT32(IOT_DP_ALL_MASK, s_batch.dp_mask);
+    TEST_ASSERT_EQUAL_INT(3, s_batch.values[IOT_DP_TEST_VALUE].i);
+    TEST_ASSERT_EQUAL_STRING("open", s_batch.values[IOT_DP_DEVICE_STATUS].s);
+    TEST_ASSERT_EQUAL_UINT8(2, s_batch.ack_count);
+    TEST_ASSERT_EQUAL_STRING("b", s_batch.acks[0].msg_id);
+    TEST_ASSERT_EQUAL_UINT32(1, s_cmd.stats.coalesced);
+    TEST_ASSERT_EQUAL_UINT32(80 * 1000, s_cmd.stats.delay.max_us);
+
+    // 只有应答（如规则分片）时立即发出，不占用执行窗口
+    tuya_cmd_add_ack(&s_cmd, "r", 0, 1110 * MS);
+    TEST_ASSERT_EQUAL_INT64(0, tuya_cmd_due_us(&s_cmd));
+    TEST_ASSERT_TRUE(tuya_cmd_take(&s_cmd, 1110 * MS, &s_batch));
+    TEST_ASSERT_EQUAL_UINT32(0, s_batch.dp_mask);
+    TEST_ASSERT_EQUAL_INT64(1100 * MS, s_cmd.last_apply_us);
+    TEST_ASSERT_EQUAL_UINT32(2, s_cmd.stats.applies);
+}
+
+static void test_acks_full(void)
+{
+    put_int(IOT_DP_TEST_VALUE, 0, 0);
+    tuya_cmd_take(&s_cmd, 1 * MS, &s_batch);
+
+    char id[16];
+    for (int i = 0; i < TUYA_CMD_MAX_ACKS; i++) {
+        snprintf(id, sizeof(id), "f%d", i);
+        put_int(IOT_DP_TEST_VALUE, i, (2 + i) * MS);
+        TEST_ASSERT_TRUE(tuya_cmd_add_ack(&s_cmd, id, IOT_DP_BIT(IOT_DP_TEST_VALUE), (2 + i) * MS));
+        TEST_ASSERT_EQUAL_INT64(i + 1 < TUYA_CMD_MAX_ACKS ? 101 * MS : 0, tuya_cmd_due_us(&s_cmd));
+    }
+    // 已满时立即执行，执行前再来的命令不应答
+    TEST_ASSERT_FALSE(tuya_cmd_add_ack(&s_cmd, "over", IOT_DP_BIT(IOT_DP_TEST_VALUE), 20 * MS));
+    TEST_ASSERT_EQUAL_UINT32(1, s_cmd.stats.acks_dropped);
+    TEST_ASSERT_TRUE(tuya_cmd_take(&s_cmd, 20 * MS, &s_batch));
+    TEST_ASSERT_EQUAL_UINT8(TUYA_CMD_MAX_ACKS, s_batch.ack_count);
+    TEST_ASSERT_EQUAL_INT(TUYA_CMD_MAX_ACKS - 1, s_batch.values[IOT_DP_TEST_VALUE].i);
+}
+
+/*
+ * 按毫秒推进：MQTT任务按 parse_iot_command 的顺序去重、暂存、登记应答；
+ * 命令任务与 tuya_cmd_task 相同，到期就取出执行
+ */
+static void test_burst(void)
+{
+    static int64_t dup_at[BURST_MS / BURST_GAP_MS];
+    static char dup_id[BURST_MS / BURST_GAP_MS][16];
+    int dup_count = 0;
+    int sent = 0;
+    int last_value = -1;
+    int applied_value = -1;
+    char applied_status[TUYA_CMD_STR_MAX] = "";
+    uint32_t acks = 0;
+    uint32_t ack_delay_max_ms = 0;
+    int max_per_s = 0;
+    int per_s = 0;
+
+    for (int64_t t = 0; t < BURST_MS + 500; t++) {
+        int64_t now = (BURST_T0_MS + t) * MS;
+        char id[16];
+
+        if (t < BURST_MS && t % BURST_GAP_MS == 0) {
+            snprintf(id, sizeof(id), "s%d", sent);
+            last_value = (sent * 7) % 100;
+            uint32_t mask = IOT_DP_BIT(IOT_DP_TEST_VALUE);
+            TEST_ASSERT_FALSE(tuya_cmd_seen(&s_cmd, id));
+            put_int(IOT_DP_TEST_VALUE, last_value, now);
+            if (t % 500 == 0) {
+                tuya_cmd_value_t status = { 0 };
+                snprintf(status.s, sizeof(status.s), "mode%d", (int)(t / 500));
+                tuya_cmd_put(&s_cmd, IOT_DP_DEVICE_STATUS, &status, now);
+                mask |= IOT_DP_BIT(IOT_DP_DEVICE_STATUS);
+            }
+            TEST_ASSERT_TRUE(tuya_cmd_add_ack(&s_cmd, id, mask, now));
+            if (sent % DUP_EVERY == 0) {
+                dup_at[dup_count] = t + DUP_DELAY_MS;
+                strcpy(dup_id[dup_count++], id);
+            }
+            sent++;
+        }
+        // 重发的命令在暂存之前就被丢弃
+        for (int i = 0; i < dup_count; i++) {
+            if (dup_at[i] == t) {
+                TEST_ASSERT_TRUE(tuya_cmd_seen(&s_cmd, dup_id[i]));
+            }
+        }
+
+        if (tuya_cmd_due_us(&s_cmd) <= now && tuya_cmd_take(&s_cmd, now, &s_batch)) {
+            if (s_batch.dp_mask & IOT_DP_BIT(IOT_DP_TEST_VALUE)) {
+                applied_value = s_batch.values[IOT_DP_TEST_VALUE].i;
+            }
+            if (s_batch.dp_mask & IOT_DP_BIT(IOT_DP_DEVICE_STATUS)) {
+                strcpy(applied_status, s_batch.values[IOT_DP_DEVICE_STATUS].s);
+            }
+            for (int i = 0; i < s_batch.ack_count; i++) {
+                uint32_t d = (uint32_t)((now - s_batch.acks[i].rx_us) / MS);
+                ack_delay_max_ms = d > ack_delay_max_ms ? d : ack_delay_max_ms;
+            }
+            acks += s_batch.ack_count;
+            per_s++;
+        }
+        if (t % 1000 == 999) {
+            max_per_s = per_s > max_per_s ? per_s : max_per_s;
+            per_s = 0;
+        }
+    }
+
+    const tuya_cmd_stats_t *st = &s_cmd.stats;
+    printf("burst: %d commands in %d ms (+%d redelivered) -> %u executions (max %d/s), %u values coalesced, "
+           "delay avg %.1f ms max %.1f ms, %u acks (max %u ms after receive)\n",
+           sent, BURST_MS, dup_count, (unsigned)st->applies, max_per_s, (unsigned)st->coalesced,
+           iot_latency_avg_us(&st->delay) / 1000.0, st->delay.max_us / 1000.0, (unsigned)acks,
+           (unsigned)ack_delay_max_ms);
+
+    // 最终执行的是最后下发的值，每条非重复命令应答一次
+    TEST_ASSERT_EQUAL_INT(last_value, applied_value);
+    TEST_ASSERT_EQUAL_STRING("mode3", applied_status);
+    TEST_ASSERT_EQUAL_UINT32(sent, acks);
+    TEST_ASSERT_EQUAL_UINT32(sent, st->commands);
+    TEST_ASSERT_EQUAL_UINT32(dup_count, st->duplicates);
+    TEST_ASSERT_EQUAL_UINT32(0, st->acks_dropped);
+    // 每秒最多执行 1000/窗口 次，时延不超过一个窗口
+    TEST_ASSERT_LESS_OR_EQUAL(1000 / TUYA_CMD_WINDOW_MS, max_per_s);
+    TEST_ASSERT_LESS_OR_EQUAL(BURST_MS / TUYA_CMD_WINDOW_MS + 1, st->applies);
+    TEST_ASSERT_LESS_OR_EQUAL(TUYA_CMD_WINDOW_MS * 1000, st->delay.max_us);
+    TEST_ASSERT_LESS_OR_EQUAL(TUYA_CMD_WINDOW_MS, ack_delay_max_ms);
+    TEST_ASSERT_EQUAL_UINT32(st->values - st->actuations, st->coalesced);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_dedup);
+    RUN_TEST(test_dedup_exact);
+    RUN_TEST(test_window_and_coalesce);
+    RUN_TEST(test_acks_full);
+    RUN_TEST(test_burst);
+    return UNITY_END();
+}
@@ -0,0 +1,256 @@
+/*
+ * 期望属性对账：版本去重、请求窗口内的实时命令优先、离线期间较新的本地修改优先、重复和迟到的响应、超时，
+ * 以及模拟服务端的多次断线重连：测量从连上云端、从断线开始到期望值应用完成的收敛时间，
+ * 并与不对账直接应用全部期望值的做法比较最终状态是否正确
+ */
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "tuya_desired.h"
+
+#define SESSIONS        500
+#define LOSS_PERMILLE   20          // desired/get 或其响应丢失的概率
+
+static tuya_desired_t s_d;
+
+void setUp(void)
+{
+    tuya_desired_init(&s_d);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_version_and_live_set(void)
+{
+    tuya_desired_on_request(&s_d, 1000, 0);
+    TEST_ASSERT_EQUAL_INT(TUYA_DESIRED_APPLY, tuya_desired_check(&s_d, IOT_DP_TEST_VALUE, 5, 0));
+    // 同一版本重复下发、更旧的版本都丢弃
+    TEST_ASSERT_EQUAL_INT(TUYA_DESIRED_STALE, tuya_desired_check(&s_d, IOT_DP_TEST_VALUE, 5, 0));
+    TEST_ASSERT_EQUAL_INT(TUYA_DESIRED_STALE, tuya_desired_check(&s_d, IOT_DP_TEST_VALUE, 4, 0));
+
+    // 请求窗口内收到的实时命令取代期望值，版本仍记下
+    tuya_desired_on_live_set(&s_d, IOT_DP_BIT(IOT_DP_DEVICE_STATUS));
+    TEST_ASSERT_EQUAL_INT(TUYA_DESIRED_SUPERSEDED, tuya_desired_check(&s_d, IOT_DP_DEVICE_STATUS, 3, 0));
+    TEST_ASSERT_EQUAL_INT(TUYA_DESIRED_STALE, tuya_desired_check(&s_d, IOT_DP_DEVICE_STATUS, 3, 0));
+
+    TEST_ASSERT_TRUE(tuya_desired_on_response(&s_d, 1250));
+    TEST_ASSERT_EQUAL_UINT32(250000, s_d.converge.last_us);
+    // 重复的响应不再统计
+    TEST_ASSERT_FALSE(tuya_desired_on_response(&s_d, 1300));
+    TEST_ASSERT_EQUAL_UINT32(1, s_d.responses);
+
+    // 窗口外的实时命令不影响下一次对账
+    tuya_desired_on_live_set(&s_d, IOT_DP_BIT(IOT_DP_TEST_VALUE));
+    tuya_desired_on_request(&s_d, 5000, 0);
+    TEST_ASSERT_EQUAL_INT(TUYA_DESIRED_APPLY, tuya_desired_check(&s_d, IOT_DP_TEST_VALUE, 6, 0));
+}
+
+static void test_offline_local_change(void)
+{
+    // 离线期间本地修改晚于期望值：本地值保留；早于期望值：应用期望值
+    tuya_desired_on_local_change(&s_d, IOT_DP_TEST_VALUE, 2000, false);
+    tuya_desired_on_local_change(&s_d, IOT_DP_DEVICE_STATUS, 1000, false);
+    // 在线时的修改已上报，不参与对账
+    tuya_desired_on_local_change(&s_d, IOT_DP_DEVICE_STATUS, 1200, true);
+    tuya_desired_on_request(&s_d, 3000, 500);
+    TEST_ASSERT_EQUAL_INT(TUYA_DESIRED_STALE, tuya_desired_check(&s_d, IOT_DP_TEST_VALUE, 1, 1500));
+    TEST_ASSERT_EQUAL_INT(TUYA_DESIRED_APPLY, tuya_desired_check(&s_d, IOT_DP_DEVICE_STATUS, 1, 1100));
+    TEST_ASSERT_TRUE(tuya_desired_on_response(&s_d, 3400));
+    TEST_ASSERT_EQUAL_UINT32(2900000, s_d.outage_converge.last_us);
+
+    // 对账完成后本地修改记录清除
+    tuya_desired_on_request(&s_d, 9000, 0);
+    TEST_ASSERT_EQUAL_INT(TUYA_DESIRED_APPLY, tuya_desired_check(&s_d, IOT_DP_TEST_VALUE, 2, 1500));
+}
+
+static void test_timeout(void)
+{
+    tuya_desired_on_request(&s_d, 0, 0);
+    TEST_ASSERT_FALSE(tuya_desired_tick(&s_d, TUYA_DESIRED_TIMEOUT_MS - 1));
+    TEST_ASSERT_TRUE(tuya_desired_tick(&s_d, TUYA_DESIRED_TIMEOUT_MS));
+    TEST_ASSERT_FALSE(tuya_desired_tick(&s_d, TUYA_DESIRED_TIMEOUT_MS + 1));
+    // 迟到的响应不计入收敛时间
+    TEST_ASSERT_FALSE(tuya_desired_on_response(&s_d, TUYA_DESIRED_TIMEOUT_MS + 500));
+    TEST_ASSERT_EQUAL_UINT32(1, s_d.timeouts);
+    TEST_ASSERT_EQUAL_UINT32(0, s_d.converge.count);
+}
+
+/* ---------- 模拟服务端 ---------- */
+
+typedef struct {
+    int32_t value;
+    int64_t version;            // 0表示没有期望值
+    int64_t time_ms;
+} sim_desired_t;
+
+typedef struct {
+    int32_t value;
+    int64_t time_ms;            // 最近一次修改的时刻（无论来自App还是本地）
+} sim_truth_t;
+
+static sim_desired_t s_cloud[IOT_DP_MAX];
+static int64_t s_cloud_version = 0;
+static sim_truth_t s_truth[IOT_DP_MAX];
+static int32_t s_dev[IOT_DP_MAX];       // 按对账结果应用
+static int32_t s_naive[IOT_DP_MAX];     // 直接应用全部期望值
+static uint32_t s_seed;
+
+static uint32_t rnd(uint32_t n)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return (s_seed >> 8) % n;
+}
+
+/* App修改：云端保存为期望值；在线时同时实时下发 */
+static void app_set(int dp, int32_t v, int64_t t, bool delivered)
+{
+    s_cloud[dp] = (sim_desired_t){ v, ++s_cloud_version, t };
+    s_truth[dp] = (sim_truth_t){ v, t };
+    if (delivered) {
+        s_dev[dp] = v;
+        s_naive[dp] = v;
+    }
+}
+
+/* 本地按键等修改：在线时即时上报，云端不再保留更旧的期望值；离线时参与对账 */
+static void local_set(int dp, int32_t v, int64_t t, bool online)
+{
+    if (online && s_cloud[dp].time_ms < t) {
+        s_cloud[dp].version = 0;
+    }
+    s_truth[dp] = (sim_truth_t){ v, t };
+    s_dev[dp] = v;
+    s_naive[dp] = v;
+    tuya_desired_on_local_change(&s_d, (iot_dp_id_t)dp, t, online);
+}
+
+static void test_simulated_broker_convergence(void)
+{
+    s_seed = 7;
+    memset(s_cloud, 0, sizeof(s_cloud));
+    memset(s_truth, 0, sizeof(s_truth));
+    memset(s_dev, 0, sizeof(s_dev));
+    memset(s_naive, 0, sizeof(s_naive));
+
+    int64_t t = 0;
+    uint32_t wrong = 0, naive_wrong = 0, checked = 0, lost = 0;
+    int32_t next_value = 1;
+
+    for (int s = 0; s < SESSIONS; s++) {
+        // 在线：App和本地修改即时生效
+        int64_t online_end = t + 30000 + rnd(570000);
+        while ((t += 5000 + rnd(60000)) < online_end) {
+            if (rnd(2)) {
+                app_set((int)rnd(IOT_DP_MAX), next_value++, t, true);
+            } else {
+                local_set((int)rnd(IOT_DP_MAX), next_value++, t, true);
+            }
+        }
+        t = online_end;
+
+        // 断线：App修改只保存在云端，本地修改记下时刻
+        int64_t outage_start = t;
+        int64_t outage_end = t + 5000 + rnd(295000);
+        int n = (int)rnd(6);
+        int64_t at = outage_start;
+        for (int i = 0; i < n; i++) {
+            at += 1 + rnd((uint32_t)((outage_end - at) / (n - i)));
+            if (rnd(5) < 3) {
+                app_set((int)rnd(IOT_DP_MAX), next_value++, at, false);
+            } else {
+                local_set((int)rnd(IOT_DP_MAX), next_value++, at, false);
+            }
+        }
+        t = outage_end;
+
+        // 重连：WiFi和MQTT连接 1~4 s，请求排在上线上报之后 0~200 ms，往返 80~600 ms
+        int64_t conn = t + 1000 + rnd(3000);
+        tuya_desired_on_request(&s_d, conn, outage_start);
+        int64_t sent = conn + rnd(200);
+        uint32_t rtt = 80 + rnd(520);
+        int64_t snapshot = sent + rtt / 2;
+        int64_t resp = sent + rtt;
+
+        // 请求窗口内 10% 概率收到一条实时命令
+        int live_dp = -1;
+        int64_t live_at = 0;
+        if (rnd(10) == 0) {
+            live_dp = (int)rnd(IOT_DP_MAX);
+            live_at = conn + rnd((uint32_t)(resp - conn));
+            if (live_at < snapshot) {
+                app_set(live_dp, next_value++, live_at, true);
+                tuya_desired_on_live_set(&s_d, IOT_DP_BIT(live_dp));
+                live_dp = -1;
+            }
+        }
+
+        // 服务端在收到请求时生成响应
+        sim_desired_t reply[IOT_DP_MAX];
+        memcpy(reply, s_cloud, sizeof(reply));
+        if (live_dp >= 0) {
+            app_set(live_dp, next_value++, live_at, true);
+            tuya_desired_on_live_set(&s_d, IOT_DP_BIT(live_dp));
+        }
+
+        if (rnd(1000) < LOSS_PERMILLE) {
+            // 超时后等下次连接再拉取
+            TEST_ASSERT_TRUE(tuya_desired_tick(&s_d, conn + TUYA_DESIRED_TIMEOUT_MS));
+            lost++;
+            t = conn + TUYA_DESIRED_TIMEOUT_MS;
+            continue;
+        }
+
+        for (int dp = 0; dp < IOT_DP_MAX; dp++) {
+            if (reply[dp].version == 0) {
+                continue;
+            }
+            if (tuya_desired_check(&s_d, (iot_dp_id_t)dp, reply[dp].version, reply[dp].time_ms) ==
+                TUYA_DESIRED_APPLY) {
+                s_dev[dp] = reply[dp].value;
+            }
+            s_naive[dp] = reply[dp].value;
+            // 处理过的版本从云端删除；其后又有新的期望值则保留
+            if (s_cloud[dp].version == reply[dp].version) {
+                s_cloud[dp].version = 0;
+            }
+        }
+        TEST_ASSERT_TRUE(tuya_desired_on_response(&s_d, resp));
+
+        for (int dp = 0; dp < IOT_DP_MAX; dp++) {
+            checked++;
+            wrong += s_dev[dp] != s_truth[dp].value;
+            naive_wrong += s_naive[dp] != s_truth[dp].value;
+        }
+        // 不对账时错误的值会一直保留，下一轮从正确状态开始，只统计每次重连新引入的错误
+        memcpy(s_naive, s_dev, sizeof(s_naive));
+        t = resp;
+    }
+
+    printf("%d reconnects (%d lost requests): converge after connect avg %lu / max %lu ms, "
+           "after outage start avg %.1f / max %.1f s; applied %lu, stale %lu, superseded %lu; "
+           "wrong DP values %u/%u vs %u/%u when applying every desired value\n",
+           SESSIONS, (int)lost, (unsigned long)(iot_latency_avg_us(&s_d.converge) / 1000),
+           (unsigned long)(s_d.converge.max_us / 1000),
+           iot_latency_avg_us(&s_d.outage_converge) / 1e6, s_d.outage_converge.max_us / 1e6,
+           (unsigned long)s_d.applied, (unsigned long)s_d.stale, (unsigned long)s_d.superseded,
+           wrong, checked, naive_wrong, checked);
+
+    TEST_ASSERT_EQUAL_UINT32(0, wrong);
+    TEST_ASSERT_GREATER_THAN(0, naive_wrong);
+    TEST_ASSERT_EQUAL_UINT32(SESSIONS - lost, s_d.converge.count);
+    TEST_ASSERT_EQUAL_UINT32(lost, s_d.timeouts);
+    // 收敛时间只取决于连接后的排队和往返
+    TEST_ASSERT_LESS_OR_EQUAL(200 + 600, s_d.converge.max_us / 1000);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_version_and_live_set);
+    RUN_TEST(test_offline_local_change);
+    RUN_TEST(test_timeout);
+    RUN_TEST(test_simulated_broker_convergence);
+    return UNITY_END();
+}
@@ -0,0 +1,221 @@
+/*
+ * 链路保活策略：在虚拟时钟上模拟空闲设备24小时，NAT映射空闲超时后断开连接，
+ * 统计每小时上行包数（PINGREQ + 心跳 + 上报 + 重连），与原先固定keepalive=60 s 对比
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "tuya_liveness.h"
+
+#define SIM_HOURS       24
+#define WARMUP_HOURS    4       // 探测阶段，之后统计稳态
+
+typedef struct {
+    uint32_t pings;
+    uint32_t heartbeats;
+    uint32_t reports;
+    uint32_t connects;
+    uint32_t nat_drops;
+} sim_packets_t;
+
+typedef struct {
+    bool adaptive;              // false：原先的固定keepalive、不发心跳
+    uint32_t nat_timeout_s;     // NAT映射的空闲超时
+    uint32_t report_interval_s; // 周期上报间隔，0表示没有
+} sim_cfg_t;
+
+static tuya_liveness_t s_lv;
+
+void setUp(void)
+{
+    tuya_liveness_init(&s_lv, NULL);
+}
+
+void tearDown(void)
+{
+}
+
+static uint32_t total(const sim_packets_t *p)
+{
+    return p->pings + p->heartbeats + p->reports + p->connects;
+}
+
+/* 一次上行：NAT映射已过期时这个包发不出去，设备检测到断线后重连 */
+static bool outbound(const sim_cfg_t *cfg, sim_packets_t *p, int64_t now, int64_t *last_out, uint16_t *keepalive)
+{
+    if (now - *last_out > (int64_t)cfg->nat_timeout_s * 1000) {
+        p->nat_drops++;
+        if (cfg->adaptive) {
+            tuya_liveness_on_disconnect(&s_lv, now, true);
+            *keepalive = s_lv.keepalive_s;
+            tuya_liveness_on_connect(&s_lv, now);
+        }
+        p->connects++;
+        *last_out = now;
+        return false;
+    }
+    *last_out = now;
+    return true;
+}
+
+/*
+ * 按秒推进：与 tuya_link_task 相同，每秒调用一次 tick 和 heartbeat；
+ * MQTT客户端在连续 keepalive/2 无上行时发PINGREQ；任何上行都刷新NAT映射
+ */
+static void simulate(const sim_cfg_t *cfg, sim_packets_t *steady)
+{
+    sim_packets_t all = { 0 };
+    int64_t last_out = 0;
+    int64_t last_report = 0;
+    uint16_t keepalive = TUYA_KEEPALIVE_MIN_S;
+
+    tuya_liveness_set_report_interval(&s_lv, cfg->report_interval_s * 1000);
+    tuya_liveness_on_connect(&s_lv, 0);
+    all.connects++;
+
+    for (int64_t s = 1; s <= SIM_HOURS * 3600; s++) {
+        int64_t now = s * 1000;
+        if (s == WARMUP_HOURS * 3600) {
+            memset(&all, 0, sizeof(all));
+        }
+
+        if (cfg->report_interval_s && now - last_report >= (int64_t)cfg->report_interval_s * 1000) {
+            last_report = now;
+            if (outbound(cfg, &all, now, &last_out, &keepalive)) {
+                if (cfg->adaptive) {
+                    tuya_liveness_take_heartbeat(&s_lv);
+                    tuya_liveness_on_tx(&s_lv, now, true);
+                }
+                all.reports++;
+            }
+            continue;
+        }
+
+        if (cfg->adaptive) {
+            if (tuya_liveness_tick(&s_lv, now)) {
+                keepalive = s_lv.keepalive_s;   // 设备上用新keepalive重连，只发生在探测阶段，不计入
+            }
+            if (tuya_liveness_heartbeat(&s_lv, now) == TUYA_HB_SEND) {
+                if (outbound(cfg, &all, now, &last_out, &keepalive)) {
+                    tuya_liveness_on_tx(&s_lv, now, false);
+                    all.heartbeats++;
+                }
+                continue;
+            }
+        }
+
+        if (now - last_out >= (int64_t)keepalive * 500 && outbound(cfg, &all, now, &last_out, &keepalive)) {
+            all.pings++;
+        }
+    }
+    *steady = all;
+}
+
+static double per_hour(uint32_t n)
+{
+    return (double)n / (SIM_HOURS - WARMUP_HOURS);
+}
+
+static void print_row(const char *name, const sim_packets_t *p)
+{
+    printf("%-34s %6.1f pkt/h (ping %.1f, heartbeat %.1f, report %.1f, connect %.1f)\n", name,
+           per_hour(total(p)), per_hour(p->pings), per_hour(p->heartbeats), per_hour(p->reports),
+           per_hour(p->connects));
+}
+
+static void test_idle_device_generous_nat(void)
+{
+    sim_packets_t before, after;
+    const sim_cfg_t base = { .adaptive = false, .nat_timeout_s = 3600 };
+    const sim_cfg_t adap = { .adaptive = true, .nat_timeout_s = 3600 };
+    simulate(&base, &before);
+    simulate(&adap, &after);
+    print_row("idle, NAT 3600 s, before", &before);
+    print_row("idle, NAT 3600 s, after", &after);
+
+    // 探测到上限；空闲时只剩心跳，心跳本身就重置了PING计时
+    TEST_ASSERT_EQUAL_UINT16(TUYA_KEEPALIVE_MAX_S, s_lv.keepalive_s);
+    TEST_ASSERT_UINT32_WITHIN(1, 120 * (SIM_HOURS - WARMUP_HOURS), before.pings);
+    TEST_ASSERT_EQUAL_UINT32(0, after.nat_drops);
+    TEST_ASSERT_EQUAL_UINT32(0, after.pings);
+    TEST_ASSERT_UINT32_WITHIN(1, 3600 / TUYA_HEARTBEAT_INTERVAL_S * (SIM_HOURS - WARMUP_HOURS), after.heartbeats);
+    TEST_ASSERT_LESS_THAN(total(&before) / 5, total(&after));
+}
+
+static void test_tight_nat_backs_off(void)
+{
+    // NAT 200 s：keepalive 420 时PING间隔210 s，PING发出时映射已过期；回退到360并不再越过
+    sim_packets_t before, after;
+    const sim_cfg_t base = { .adaptive = false, .nat_timeout_s = 200 };
+    const sim_cfg_t adap = { .adaptive = true, .nat_timeout_s = 200 };
+    simulate(&base, &before);
+    simulate(&adap, &after);
+    print_row("idle, NAT 200 s, before", &before);
+    print_row("idle, NAT 200 s, after", &after);
+
+    TEST_ASSERT_EQUAL_UINT16(360, s_lv.keepalive_s);
+    TEST_ASSERT_EQUAL_UINT16(360, s_lv.stable_s);
+    TEST_ASSERT_EQUAL_UINT16(420, s_lv.ceiling_s);
+    TEST_ASSERT_EQUAL_UINT32(1, s_lv.backoffs);
+    // 稳态不再被NAT断开
+    TEST_ASSERT_EQUAL_UINT32(0, after.nat_drops);
+    TEST_ASSERT_EQUAL_UINT32(0, before.nat_drops);
+    TEST_ASSERT_LESS_THAN(total(&before) / 4, total(&after));
+
+    // 探测结果持久化后，重启直接从验证过的值开始
+    tuya_liveness_persist_t saved;
+    tuya_liveness_export(&s_lv, &saved);
+    tuya_liveness_t again;
+    tuya_liveness_init(&again, &saved);
+    TEST_ASSERT_EQUAL_UINT16(360, again.keepalive_s);
+    TEST_ASSERT_EQUAL_UINT16(420, again.ceiling_s);
+}
+
+static void test_heartbeat_folds_into_reports(void)
+{
+    // 上报间隔330 s：心跳在上报前30 s到期，并入上报而不单独发送
+    sim_packets_t before, after;
+    const sim_cfg_t base = { .adaptive = false, .nat_timeout_s = 3600, .report_interval_s = 330 };
+    const sim_cfg_t adap = { .adaptive = true, .nat_timeout_s = 3600, .report_interval_s = 330 };
+    simulate(&base, &before);
+    simulate(&adap, &after);
+    print_row("report every 330 s, before", &before);
+    print_row("report every 330 s, after", &after);
+
+    TEST_ASSERT_EQUAL_UINT32(0, after.heartbeats);
+    TEST_ASSERT_GREATER_THAN(0, s_lv.heartbeats_folded);
+    // keepalive上限600 s时PING间隔300 s，两次上报之间最多还有一个PING
+    TEST_ASSERT_LESS_OR_EQUAL(after.reports, after.pings);
+    TEST_ASSERT_EQUAL_UINT32(before.reports, after.reports);
+    // 上报本身就是存活证明，原先在两次上报之间还要发10个PING
+    TEST_ASSERT_LESS_THAN(total(&before) / 5, total(&after));
+}
+
+static void test_non_idle_disconnect_keeps_probe(void)
+{
+    tuya_liveness_on_connect(&s_lv, 0);
+    for (int64_t s = 1; s <= 3 * 30 + 1; s++) {
+        tuya_liveness_tick(&s_lv, s * 1000);
+    }
+    TEST_ASSERT_EQUAL_UINT16(120, s_lv.keepalive_s);
+
+    // 刚发过数据就断线（例如服务端重启），不是NAT问题，不回退
+    tuya_liveness_on_tx(&s_lv, 100000, false);
+    TEST_ASSERT_FALSE(tuya_liveness_on_disconnect(&s_lv, 101000, true));
+    TEST_ASSERT_EQUAL_UINT16(120, s_lv.keepalive_s);
+    // 主动断开（WiFi断开）也不回退
+    tuya_liveness_on_connect(&s_lv, 200000);
+    TEST_ASSERT_FALSE(tuya_liveness_on_disconnect(&s_lv, 900000, false));
+    TEST_ASSERT_EQUAL_UINT32(0, s_lv.backoffs);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_idle_device_generous_nat);
+    RUN_TEST(test_tight_nat_backs_off);
+    RUN_TEST(test_heartbeat_folds_into_reports);
+    RUN_TEST(test_non_idle_disconnect_keeps_probe);
+    return UNITY_END();
+}
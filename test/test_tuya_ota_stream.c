@@ -0,0 +1,193 @@
+/*
+ * OTA下载级：用内存中的文件服务器替身模拟断线、不支持Range的服务器，
+ * 检查续传后写入的镜像与原始镜像一致，并测量流水线吞吐和缓冲区内存
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "tuya_ota_stream.h"
+
+#define IMAGE_SIZE  (1024 * 1024 + 1234)    // 不是缓冲区大小的整数倍
+
+/* 文件服务器替身：从offset开始返回镜像，读到drop_at后断开连接，每次最多返回max_read字节 */
+typedef struct {
+    const uint8_t *image;
+    uint32_t size;
+    uint32_t pos;
+    uint32_t drop_at;
+    int max_read;
+} file_server_t;
+
+static uint8_t *s_image;
+static uint8_t *s_flash;
+
+void setUp(void)
+{
+    s_image = malloc(IMAGE_SIZE);
+    s_flash = malloc(IMAGE_SIZE);
+    TEST_ASSERT_NOT_NULL(s_image);
+    TEST_ASSERT_NOT_NULL(s_flash);
+    uint32_t x = 12345;
+    for (uint32_t i = 0; i < IMAGE_SIZE; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        s_image[i] = (uint8_t)x;
+    }
+    memset(s_flash, 0xFF, IMAGE_SIZE);
+}
+
+void tearDown(void)
+{
+    free(s_image);
+    free(s_flash);
+}
+
+static int server_read(void *ctx, uint8_t *buf, int len)
+{
+    file_server_t *srv = ctx;
+    if (srv->pos >= srv->drop_at || srv->pos >= srv->size) {
+        return -1;
+    }
+    uint32_t n = (uint32_t)len;
+    if (n > (uint32_t)srv->max_read) {
+        n = (uint32_t)srv->max_read;
+    }
+    if (n > srv->drop_at - srv->pos) {
+        n = srv->drop_at - srv->pos;
+    }
+    if (n > srv->size - srv->pos) {
+        n = srv->size - srv->pos;
+    }
+    memcpy(buf, srv->image + srv->pos, n);
+    srv->pos += n;
+    return (int)n;
+}
+
+/*
+ * 与设备上的 ota_download 相同的循环：每条连接先 reopen，再用两个缓冲区交替读满后写入"flash"。
+ * drops为每条连接在第几个字节断开（相对整个镜像），0表示不断开
+ */
+static uint32_t run_download(bool range, const uint32_t *drops, int drop_count, uint32_t *written_out)
+{
+    static uint8_t buf[2][TUYA_OTA_BUF_SIZE];
+    tuya_ota_stream_t stream;
+    tuya_ota_stream_init(&stream, IMAGE_SIZE);
+    uint32_t written = 0;
+    uint32_t connections = 0;
+    int idx = 0;
+
+    while (!tuya_ota_stream_done(&stream) && connections < 32) {
+        file_server_t srv = {
+            .image = s_image,
+            .size = IMAGE_SIZE,
+            .pos = range ? stream.downloaded : 0,
+            .drop_at = (int)connections < drop_count && drops[connections] ? drops[connections] : IMAGE_SIZE,
+            .max_read = 1460,
+        };
+        connections++;
+        tuya_ota_stream_reopen(&stream, range);
+        for (;;) {
+            uint32_t fill = tuya_ota_stream_fill(&stream, server_read, &srv, buf[idx], TUYA_OTA_BUF_SIZE);
+            if (fill == 0) {
+                break;
+            }
+            memcpy(s_flash + written, buf[idx], fill);
+            written += fill;
+            idx ^= 1;
+        }
+    }
+    *written_out = written;
+    return connections;
+}
+
+static void test_download_without_drops(void)
+{
+    uint32_t written = 0;
+    TEST_ASSERT_EQUAL_UINT32(1, run_download(true, NULL, 0, &written));
+    TEST_ASSERT_EQUAL_UINT32(IMAGE_SIZE, written);
+    TEST_ASSERT_EQUAL_MEMORY(s_image, s_flash, IMAGE_SIZE);
+}
+
+static void test_resume_with_range(void)
+{
+    // 断在缓冲区中间、缓冲区边界和最后一个字节之前
+    const uint32_t drops[] = { 10000, 3 * TUYA_OTA_BUF_SIZE * 20, IMAGE_SIZE - 1 };
+    uint32_t written = 0;
+    TEST_ASSERT_EQUAL_UINT32(4, run_download(true, drops, 3, &written));
+    TEST_ASSERT_EQUAL_UINT32(IMAGE_SIZE, written);
+    TEST_ASSERT_EQUAL_MEMORY(s_image, s_flash, IMAGE_SIZE);
+}
+
+static void test_resume_without_range_skips_written_part(void)
+{
+    // 服务器每次都从头返回，已写入的部分必须丢弃而不是重复写入
+    const uint32_t drops[] = { 300000, 700000 };
+    uint32_t written = 0;
+    TEST_ASSERT_EQUAL_UINT32(3, run_download(false, drops, 2, &written));
+    TEST_ASSERT_EQUAL_UINT32(IMAGE_SIZE, written);
+    TEST_ASSERT_EQUAL_MEMORY(s_image, s_flash, IMAGE_SIZE);
+}
+
+static void test_fill_never_reads_past_image(void)
+{
+    // 服务器多返回数据时（如镜像后还有内容），只取size字节
+    uint8_t buf[TUYA_OTA_BUF_SIZE];
+    tuya_ota_stream_t stream;
+    tuya_ota_stream_init(&stream, 100);
+    file_server_t srv = { s_image, IMAGE_SIZE, 0, IMAGE_SIZE, 1460 };
+    tuya_ota_stream_reopen(&stream, true);
+    TEST_ASSERT_EQUAL_UINT32(100, tuya_ota_stream_fill(&stream, server_read, &srv, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_UINT32(100, srv.pos);
+    TEST_ASSERT_TRUE(tuya_ota_stream_done(&stream));
+    TEST_ASSERT_EQUAL_UINT32(0, tuya_ota_stream_fill(&stream, server_read, &srv, buf, sizeof(buf)));
+}
+
+static void test_sha256_hex_compare(void)
+{
+    // SHA-256("abc")
+    static const uint8_t digest[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+    };
+    TEST_ASSERT_TRUE(tuya_ota_sha256_match(digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    TEST_ASSERT_TRUE(tuya_ota_sha256_match(digest, "BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD"));
+    TEST_ASSERT_FALSE(tuya_ota_sha256_match(digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ae"));
+    TEST_ASSERT_FALSE(tuya_ota_sha256_match(digest, "ba7816bf"));
+    TEST_ASSERT_FALSE(tuya_ota_sha256_match(digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad00"));
+    TEST_ASSERT_FALSE(tuya_ota_sha256_match(digest, NULL));
+}
+
+static void test_pipeline_throughput_and_ram(void)
+{
+    const int rounds = 16;
+    const uint32_t drops[] = { 500000 };
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < rounds; i++) {
+        uint32_t written = 0;
+        run_download(true, drops, 1, &written);
+        TEST_ASSERT_EQUAL_UINT32(IMAGE_SIZE, written);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double mbps = (double)IMAGE_SIZE * rounds / secs / (1024 * 1024);
+    unsigned ram = 2 * TUYA_OTA_BUF_SIZE + (unsigned)sizeof(tuya_ota_stream_t);
+    printf("OTA pipeline: %.0f MB/s on host, buffers + stream state %u bytes\n", mbps, ram);
+    // 流水线只用两个缓冲区，与镜像大小无关
+    TEST_ASSERT_LESS_OR_EQUAL(2 * TUYA_OTA_BUF_SIZE + 64, ram);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_download_without_drops);
+    RUN_TEST(test_resume_with_range);
+    RUN_TEST(test_resume_without_range_skips_written_part);
+    RUN_TEST(test_fill_never_reads_past_image);
+    RUN_TEST(test_sha256_hex_compare);
+    RUN_TEST(test_pipeline_throughput_and_ram);
+    return UNITY_END();
+}
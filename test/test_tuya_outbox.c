@@ -0,0 +1,289 @@
+/*
+ * 上行发送队列：优先级顺序、同键合并只保留最新值、队列满时的挤出顺序、发送失败放回，
+ * 以及在虚拟时钟上模拟限速并周期性卡顿的链路，测量队列深度和命令应答延迟，
+ * 与原先所有消息按FIFO排队发送的方式对比
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "tuya_outbox.h"
+
+#define TOPIC_REPORT        "tylink/dev/thing/property/report"
+#define TOPIC_ACK           "tylink/dev/thing/property/set_response"
+
+#define SIM_SECONDS         600
+#define TELEMETRY_DPS       8       // 每个DP每200 ms采样一次
+#define LINK_MSG_PER_S      10      // 链路正常时每秒能发出的消息数
+#define STALL_PERIOD_S      60      // 每分钟卡顿一次
+#define STALL_S             15      // 卡顿时长，期间一条也发不出去
+#define COMMAND_PERIOD_MS   3000
+#define FIFO_CAPACITY       (SIM_SECONDS * 1000)
+
+typedef struct {
+    uint32_t acks;
+    int64_t ack_latency_sum;
+    int64_t ack_latency_max;
+    uint32_t max_depth;
+    uint32_t sent;
+    int64_t telemetry_age_max;      // 发出的遥测值距产生时刻
+} sim_result_t;
+
+typedef struct {
+    int64_t t_origin;
+    uint8_t cls;
+} fifo_msg_t;
+
+static tuya_outbox_t s_ob;
+
+void setUp(void)
+{
+    tuya_outbox_init(&s_ob);
+}
+
+void tearDown(void)
+{
+}
+
+static tuya_outbox_result_t put(tuya_tx_class_t cls, const char *key, const char *data, int64_t t)
+{
+    return tuya_outbox_put(&s_ob, cls, key ? tuya_outbox_key(key) : 0, TOPIC_REPORT, data, 1, 0, t);
+}
+
+static void test_priority_and_coalescing(void)
+{
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_QUEUED, put(TUYA_TX_TELEMETRY, "temp", "{\"temp\":1}", 1));
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_QUEUED, put(TUYA_TX_DIAG, NULL, "{\"rssi\":-60}", 2));
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_QUEUED, put(TUYA_TX_TELEMETRY, "humi", "{\"humi\":40}", 3));
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_QUEUED, put(TUYA_TX_STATE, "status", "{\"status\":\"on\"}", 4));
+    // 同键未发送的遥测原地替换，位置不变
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_COALESCED, put(TUYA_TX_TELEMETRY, "temp", "{\"temp\":2}", 5));
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_COALESCED, put(TUYA_TX_TELEMETRY, "temp", "{\"temp\":3}", 6));
+    // 不同优先级的同键消息互不合并
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_QUEUED, put(TUYA_TX_STATE, "temp", "{\"temp\":4}", 7));
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_QUEUED, tuya_outbox_put(&s_ob, TUYA_TX_ACK, 0, TOPIC_ACK, "{\"ack\":1}", 1,
+                                                              TUYA_OUTBOX_FLAG_ACK, 8));
+    TEST_ASSERT_EQUAL_UINT16(6, s_ob.depth);
+
+    static const char *order[] = {
+        "{\"ack\":1}", "{\"status\":\"on\"}", "{\"temp\":4}", "{\"temp\":3}", "{\"humi\":40}", "{\"rssi\":-60}",
+    };
+    tuya_outbox_msg_t msg;
+    for (int i = 0; i < 6; i++) {
+        TEST_ASSERT_TRUE(tuya_outbox_pop(&s_ob, &msg));
+        TEST_ASSERT_EQUAL_STRING(order[i], msg.data);
+    }
+    TEST_ASSERT_FALSE(tuya_outbox_pop(&s_ob, &msg));
+    TEST_ASSERT_EQUAL_UINT16(0, s_ob.depth);
+    // 合并后的遥测带最新值的产生时刻
+    TEST_ASSERT_EQUAL_UINT32(2, s_ob.stats[TUYA_TX_TELEMETRY].coalesced);
+    TEST_ASSERT_EQUAL_UINT32(2, s_ob.stats[TUYA_TX_TELEMETRY].sent);
+}
+
+static void test_eviction_order_when_full(void)
+{
+    char key[16];
+    for (int i = 0; i < TUYA_OUTBOX_SLOTS; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_QUEUED, put(i < 2 ? TUYA_TX_DIAG : TUYA_TX_TELEMETRY, key, key, i));
+    }
+    TEST_ASSERT_EQUAL_UINT16(TUYA_OUTBOX_SLOTS, s_ob.depth);
+
+    // 先挤掉诊断（最旧的那条），再挤掉最旧的遥测
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_EVICTED, put(TUYA_TX_ACK, NULL, "a0", 100));
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_EVICTED, put(TUYA_TX_ACK, NULL, "a1", 101));
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_EVICTED, put(TUYA_TX_STATE, NULL, "s0", 102));
+    TEST_ASSERT_EQUAL_UINT32(2, s_ob.stats[TUYA_TX_DIAG].dropped);
+    TEST_ASSERT_EQUAL_UINT32(1, s_ob.stats[TUYA_TX_TELEMETRY].dropped);
+    TEST_ASSERT_EQUAL_UINT16(TUYA_OUTBOX_SLOTS, s_ob.depth);
+
+    // 遥测挤掉同级更旧的遥测；队列里只剩更重要的消息时，新的低优先级消息被拒绝
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_EVICTED, put(TUYA_TX_TELEMETRY, "new", "t", 103));
+    for (int i = 0; i < TUYA_OUTBOX_SLOTS; i++) {
+        put(TUYA_TX_ACK, NULL, "a", 200 + i);
+    }
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_REJECTED, put(TUYA_TX_STATE, NULL, "s1", 300));
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_REJECTED, put(TUYA_TX_DIAG, NULL, "d", 301));
+    TEST_ASSERT_EQUAL_UINT16(TUYA_OUTBOX_SLOTS, s_ob.depth);
+    TEST_ASSERT_EQUAL_UINT16(TUYA_OUTBOX_SLOTS, s_ob.max_depth);
+
+    // 过长的消息直接拒绝
+    static char big[TUYA_OUTBOX_DATA_LEN + 1];
+    memset(big, 'x', TUYA_OUTBOX_DATA_LEN);
+    TEST_ASSERT_EQUAL_INT(TUYA_OUTBOX_REJECTED, put(TUYA_TX_ACK, NULL, big, 400));
+}
+
+static void test_requeue_keeps_order(void)
+{
+    put(TUYA_TX_TELEMETRY, "a", "a1", 1);
+    put(TUYA_TX_TELEMETRY, "b", "b1", 2);
+    put(TUYA_TX_TELEMETRY, "c", "c1", 3);
+
+    tuya_outbox_msg_t first, second;
+    TEST_ASSERT_TRUE(tuya_outbox_pop(&s_ob, &first));
+    TEST_ASSERT_TRUE(tuya_outbox_pop(&s_ob, &second));
+    TEST_ASSERT_EQUAL_STRING("a1", first.data);
+
+    // 发送失败放回后仍排在原来的位置
+    tuya_outbox_requeue(&s_ob, &second);
+    tuya_outbox_requeue(&s_ob, &first);
+    tuya_outbox_msg_t msg;
+    TEST_ASSERT_TRUE(tuya_outbox_pop(&s_ob, &msg));
+    TEST_ASSERT_EQUAL_STRING("a1", msg.data);
+
+    // 发送期间同键已有新值入队：旧值不再放回
+    put(TUYA_TX_TELEMETRY, "a", "a2", 4);
+    tuya_outbox_requeue(&s_ob, &msg);
+    TEST_ASSERT_TRUE(tuya_outbox_pop(&s_ob, &msg));
+    TEST_ASSERT_EQUAL_STRING("b1", msg.data);
+    TEST_ASSERT_TRUE(tuya_outbox_pop(&s_ob, &msg));
+    TEST_ASSERT_EQUAL_STRING("c1", msg.data);
+    TEST_ASSERT_TRUE(tuya_outbox_pop(&s_ob, &msg));
+    TEST_ASSERT_EQUAL_STRING("a2", msg.data);
+    TEST_ASSERT_FALSE(tuya_outbox_pop(&s_ob, &msg));
+    TEST_ASSERT_EQUAL_UINT32(1, s_ob.stats[TUYA_TX_TELEMETRY].dropped);
+    TEST_ASSERT_EQUAL_UINT32(3, s_ob.stats[TUYA_TX_TELEMETRY].sent);
+}
+
+/* 链路在 t 时刻这一毫秒能否发出一条消息：正常时匀速，卡顿期间完全发不出去 */
+static bool link_can_send(int64_t t)
+{
+    if ((t / 1000) % STALL_PERIOD_S >= STALL_PERIOD_S - STALL_S) {
+        return false;
+    }
+    return t % (1000 / LINK_MSG_PER_S) == 0;
+}
+
+static void account(sim_result_t *r, uint8_t cls, int64_t t_origin, int64_t now)
+{
+    r->sent++;
+    if (cls == TUYA_TX_ACK) {
+        int64_t latency = now - t_origin;
+        r->acks++;
+        r->ack_latency_sum += latency;
+        if (latency > r->ack_latency_max) {
+            r->ack_latency_max = latency;
+        }
+    } else if (cls == TUYA_TX_TELEMETRY && now - t_origin > r->telemetry_age_max) {
+        r->telemetry_age_max = now - t_origin;
+    }
+}
+
+typedef struct {
+    bool use_outbox;
+    fifo_msg_t *fifo;
+    size_t head;
+    size_t tail;
+} sim_queue_t;
+
+static void produce(sim_queue_t *q, tuya_tx_class_t cls, const char *key, const char *data, int64_t t)
+{
+    if (!q->use_outbox) {
+        q->fifo[q->tail++] = (fifo_msg_t){ t, (uint8_t)cls };
+        return;
+    }
+    const char *topic = cls == TUYA_TX_ACK ? TOPIC_ACK : TOPIC_REPORT;
+    uint8_t flags = cls == TUYA_TX_ACK ? TUYA_OUTBOX_FLAG_ACK : 0;
+    tuya_outbox_result_t res = tuya_outbox_put(&s_ob, cls, key ? tuya_outbox_key(key) : 0, topic, data, 1, flags, t);
+    if (cls == TUYA_TX_ACK) {
+        TEST_ASSERT_NOT_EQUAL(TUYA_OUTBOX_REJECTED, res);
+    }
+}
+
+/*
+ * 产生的流量：8个遥测DP各5 Hz、每秒1条诊断、每2 s一次状态变化、每3 s一条命令应答，
+ * 约41条/秒，链路正常时只能发10条/秒
+ */
+static void simulate(bool use_outbox, sim_result_t *r)
+{
+    static fifo_msg_t fifo[FIFO_CAPACITY];
+    sim_queue_t q = { .use_outbox = use_outbox, .fifo = fifo };
+    char key[16], data[32];
+
+    memset(r, 0, sizeof(*r));
+    tuya_outbox_init(&s_ob);
+
+    for (int64_t t = 0; t < SIM_SECONDS * 1000; t++) {
+        for (int dp = 0; dp < TELEMETRY_DPS; dp++) {
+            if ((t + dp * 25) % 200 == 0) {
+                snprintf(key, sizeof(key), "dp%d", dp);
+                snprintf(data, sizeof(data), "{\"dp%d\":%lld}", dp, (long long)t);
+                produce(&q, TUYA_TX_TELEMETRY, key, data, t);
+            }
+        }
+        if (t % 1000 == 500) {
+            produce(&q, TUYA_TX_DIAG, NULL, "{\"rssi\":-61}", t);
+        }
+        if (t % 2000 == 700) {
+            produce(&q, TUYA_TX_STATE, "status", "{\"status\":\"on\"}", t);
+        }
+        if (t % COMMAND_PERIOD_MS == 1300) {
+            produce(&q, TUYA_TX_ACK, NULL, "{\"code\":0}", t);
+        }
+
+        uint32_t depth = use_outbox ? s_ob.depth : (uint32_t)(q.tail - q.head);
+        if (depth > r->max_depth) {
+            r->max_depth = depth;
+        }
+        if (!link_can_send(t)) {
+            continue;
+        }
+        tuya_outbox_msg_t msg;
+        if (use_outbox && tuya_outbox_pop(&s_ob, &msg)) {
+            account(r, msg.cls, msg.t_origin, t);
+        } else if (!use_outbox && q.head < q.tail) {
+            account(r, fifo[q.head].cls, fifo[q.head].t_origin, t);
+            q.head++;
+        }
+    }
+}
+
+static void print_row(const char *name, const sim_result_t *r)
+{
+    printf("%-10s max depth %6u, acks sent %3u, ack latency avg %7.1f ms max %7lld ms, "
+           "oldest telemetry sent %lld ms\n",
+           name, (unsigned)r->max_depth, (unsigned)r->acks,
+           r->acks ? (double)r->ack_latency_sum / r->acks : 0.0, (long long)r->ack_latency_max,
+           (long long)r->telemetry_age_max);
+}
+
+static void test_throttled_link(void)
+{
+    sim_result_t fifo, outbox;
+    simulate(false, &fifo);
+    simulate(true, &outbox);
+    printf("%d s, link %d msg/s stalling %d s of every %d s:\n", SIM_SECONDS, LINK_MSG_PER_S, STALL_S,
+           STALL_PERIOD_S);
+    print_row("FIFO", &fifo);
+    print_row("outbox", &outbox);
+    printf("outbox: telemetry coalesced %u, dropped %u; acks dropped %u\n",
+           (unsigned)s_ob.stats[TUYA_TX_TELEMETRY].coalesced, (unsigned)s_ob.stats[TUYA_TX_TELEMETRY].dropped,
+           (unsigned)s_ob.stats[TUYA_TX_ACK].dropped);
+
+    // 队列内存固定，深度不超过槽位数；FIFO则随卡顿无限增长
+    TEST_ASSERT_LESS_OR_EQUAL(TUYA_OUTBOX_SLOTS, outbox.max_depth);
+    TEST_ASSERT_EQUAL_UINT16(outbox.max_depth, s_ob.max_depth);
+    TEST_ASSERT_GREATER_THAN(100 * TUYA_OUTBOX_SLOTS, fifo.max_depth);
+
+    // 应答一条不丢（结束时仍在最后一次卡顿里的除外）；链路正常时下一个发送时机就发出，卡顿时最多等到卡顿结束
+    TEST_ASSERT_EQUAL_UINT32(SIM_SECONDS * 1000 / COMMAND_PERIOD_MS, s_ob.stats[TUYA_TX_ACK].queued);
+    TEST_ASSERT_EQUAL_UINT32(s_ob.stats[TUYA_TX_ACK].sent, outbox.acks);
+    TEST_ASSERT_GREATER_THAN(fifo.acks * 4, outbox.acks);
+    TEST_ASSERT_EQUAL_UINT32(0, s_ob.stats[TUYA_TX_ACK].dropped);
+    TEST_ASSERT_LESS_OR_EQUAL(STALL_S * 1000 + 1000 / LINK_MSG_PER_S, outbox.ack_latency_max);
+    TEST_ASSERT_LESS_THAN(fifo.ack_latency_max / 10, outbox.ack_latency_max);
+
+    // 发出去的遥测值是最新的，不会是卡顿前积压的旧值
+    TEST_ASSERT_LESS_OR_EQUAL(STALL_S * 1000 + 2000, outbox.telemetry_age_max);
+    TEST_ASSERT_GREATER_THAN(0, s_ob.stats[TUYA_TX_TELEMETRY].coalesced);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_priority_and_coalescing);
+    RUN_TEST(test_eviction_order_when_full);
+    RUN_TEST(test_requeue_keeps_order);
+    RUN_TEST(test_throttled_link);
+    return UNITY_END();
+}
@@ -0,0 +1,258 @@
+/*
+ * 上报速率控制：按一段链路轨迹（RSSI、丢包率、回程时延分段变化）在虚拟时钟上模拟6小时的周期上报，
+ * 统计每毫秒空口时间送达的数据量（送达的采样窗口覆盖的秒数），与原先固定10 s、每次1个窗口对比
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "tuya_rate.h"
+
+#define SIM_S               (6 * 3600)
+#define BASE_MS             10000
+#define RSSI_PERIOD_MS      5000    // 与 use_wifi.c 的 RATE_RSSI_PERIOD_MS 相同
+#define RETRANSMIT_MS       1000    // esp-mqtt 的QoS1重发间隔
+#define MAX_ATTEMPTS        5       // 超过后消息从outbox删除，计为丢弃
+#define MAX_PENDING         64
+
+// 消息长度按设备上的实际报文估算（字节）
+#define SENSOR_MSG_LEN      150     // tuya_publish_sensor_data
+#define AGG_MSG_LEN         160     // 单个窗口的聚合上报
+#define AGG_BATCH_LEN(n)    (110 + 60 * (n))
+#define PUBACK_LEN          33
+#define FRAME_HDR_LEN       105     // 802.11 MAC + IP + TCP + TLS记录头
+
+/* 链路轨迹中的一段 */
+typedef struct {
+    uint32_t dur_s;
+    int8_t rssi;
+    uint8_t loss_pct;       // 每次发送（含重发）的丢失概率
+    uint32_t rtt_ms;        // 回程时延（不含重发）
+} link_seg_t;
+
+static const link_seg_t s_trace[] = {
+    { 2400, -55,  0,   80 },    // 信号良好
+    { 1800, -70,  2,  200 },
+    { 1500, -78,  8,  600 },
+    { 1200, -84, 20, 1200 },    // 弱信号、1 Mbps
+    { 1800, -58,  1, 2200 },    // 信号良好但回程拥塞
+    { 1500, -74,  5,  400 },
+    { 1200, -86, 25, 1500 },
+    { 2400, -60,  0,  100 },
+    { 4800, -76,  6,  500 },
+    { 3000, -56,  0,   80 },
+};
+
+typedef struct {
+    bool adaptive;              // false：原先的固定间隔、每次1个窗口
+    // 结果
+    uint32_t messages;
+    uint32_t attempts;
+    uint32_t lost;
+    uint32_t windows;
+    uint64_t delivered_ms;      // 送达的窗口覆盖的时长
+    uint64_t generated_ms;      // 产生的窗口覆盖的时长
+    uint64_t airtime_us;
+    uint32_t max_interval_ms;
+    uint32_t final_interval_ms;
+} sim_result_t;
+
+typedef struct {
+    int64_t at_ms;
+    uint32_t rtt_ms;
+    bool lost;
+} pending_t;
+
+static tuya_rate_t s_rate;
+static uint32_t s_rng;
+static pending_t s_pending[MAX_PENDING];
+static int s_pending_len;
+
+void setUp(void)
+{
+    tuya_rate_config_t cfg = TUYA_RATE_CONFIG_DEFAULT();
+    tuya_rate_init(&s_rate, &cfg);
+    s_rng = 12345;
+    s_pending_len = 0;
+}
+
+void tearDown(void)
+{
+}
+
+static uint32_t rnd(void)
+{
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static const link_seg_t *seg_at(int64_t now_ms)
+{
+    int64_t t = 0;
+    for (size_t i = 0; i < sizeof(s_trace) / sizeof(s_trace[0]); i++) {
+        t += (int64_t)s_trace[i].dur_s * 1000;
+        if (now_ms < t) {
+            return &s_trace[i];
+        }
+    }
+    return &s_trace[sizeof(s_trace) / sizeof(s_trace[0]) - 1];
+}
+
+/* RSSI对应的物理速率（Mbps），-80 dBm 以下退到 802.11b 1 Mbps */
+static uint32_t phy_mbps(int rssi)
+{
+    return rssi >= -65 ? 54 : rssi >= -72 ? 24 : rssi >= -80 ? 6 : 1;
+}
+
+/* 一帧加上链路层确认的空口时间：前导码、帧间隔、平均退避、ACK */
+static uint32_t frame_us(uint32_t len, uint32_t mbps)
+{
+    uint32_t overhead_us = mbps == 1 ? 192 + 50 + 310 + 304 : 20 + 34 + 67 + 44;
+    return overhead_us + (len + FRAME_HDR_LEN) * 8 / mbps;
+}
+
+/* 发布一条QoS1消息：每次发送按当前丢包率失败，PUBACK在时延之后到达 */
+static bool publish(sim_result_t *r, const link_seg_t *seg, int64_t now_ms, uint32_t len)
+{
+    uint32_t mbps = phy_mbps(seg->rssi);
+    r->messages++;
+    for (int i = 0; i < MAX_ATTEMPTS; i++) {
+        r->attempts++;
+        r->airtime_us += frame_us(len, mbps);
+        if (rnd() % 100 >= seg->loss_pct) {
+            r->airtime_us += frame_us(PUBACK_LEN, mbps);
+            if (s_pending_len < MAX_PENDING) {
+                uint32_t rtt = seg->rtt_ms + (uint32_t)i * RETRANSMIT_MS;
+                s_pending[s_pending_len++] = (pending_t){ now_ms + rtt, rtt, false };
+            }
+            return true;
+        }
+    }
+    r->lost++;
+    if (s_pending_len < MAX_PENDING) {
+        s_pending[s_pending_len++] = (pending_t){ now_ms + MAX_ATTEMPTS * RETRANSMIT_MS, 0, true };
+    }
+    return false;
+}
+
+/* 到时的PUBACK和丢弃通知交给速率控制 */
+static void deliver_feedback(int64_t now_ms)
+{
+    int n = 0;
+    for (int i = 0; i < s_pending_len; i++) {
+        if (s_pending[i].at_ms > now_ms) {
+            s_pending[n++] = s_pending[i];
+        } else if (s_pending[i].lost) {
+            tuya_rate_on_lost(&s_rate);
+        } else {
+            tuya_rate_on_ack(&s_rate, s_pending[i].rtt_ms, s_pending[i].rtt_ms / RETRANSMIT_MS);
+        }
+    }
+    s_pending_len = n;
+}
+
+/*
+ * 按秒推进：与 tuya_link_task 的 rate_tick 相同，每5 s采样一次RSSI（±4 dB 抖动），每个上报间隔评估一次；
+ * 与 main.c 的 report_job 相同，上报任务按 间隔/打包数 的周期取一个采样窗口，攒够打包数后发状态和聚合两条消息
+ */
+static void simulate(sim_result_t *r)
+{
+    uint32_t window_ms = BASE_MS;
+    int64_t next_report = BASE_MS;
+    int64_t last_rssi = -RSSI_PERIOD_MS;
+    int64_t last_eval = 0;
+    int64_t window_start = 0;
+    uint32_t batch_ms = 0;
+    int batch_len = 0;
+
+    for (int64_t now = 0; now < (int64_t)SIM_S * 1000; now += 1000) {
+        const link_seg_t *seg = seg_at(now);
+        if (r->adaptive) {
+            deliver_feedback(now);
+            if (now - last_rssi >= RSSI_PERIOD_MS) {
+                tuya_rate_on_rssi(&s_rate, (int8_t)(seg->rssi - 4 + (int)(rnd() % 9)));
+                last_rssi = now;
+            }
+            if (now - last_eval >= s_rate.interval_ms) {
+                tuya_rate_update(&s_rate);
+                last_eval = now;
+            }
+            if (s_rate.interval_ms > r->max_interval_ms) {
+                r->max_interval_ms = s_rate.interval_ms;
+            }
+        }
+        if (now < next_report) {
+            continue;
+        }
+
+        // 周期任务：新周期从本次到期时刻算起
+        uint32_t interval = r->adaptive ? s_rate.interval_ms : BASE_MS;
+        uint8_t batch = r->adaptive ? s_rate.batch : 1;
+        batch_ms += (uint32_t)(now - window_start);
+        r->generated_ms += (uint64_t)(now - window_start);
+        window_start = now;
+        r->windows++;
+        batch_len++;
+        window_ms = interval / batch;
+        next_report += window_ms;
+
+        if (batch_len < batch && batch_len < TUYA_RATE_MAX_BATCH) {
+            continue;
+        }
+        publish(r, seg, now, SENSOR_MSG_LEN);
+        if (publish(r, seg, now, batch_len == 1 ? AGG_MSG_LEN : AGG_BATCH_LEN(batch_len))) {
+            r->delivered_ms += batch_ms;
+        }
+        batch_ms = 0;
+        batch_len = 0;
+    }
+    r->final_interval_ms = r->adaptive ? s_rate.interval_ms : BASE_MS;
+}
+
+static double data_per_airtime(const sim_result_t *r)
+{
+    return (double)r->delivered_ms / 1000 / ((double)r->airtime_us / 1000);
+}
+
+static void test_link_trace(void)
+{
+    sim_result_t fixed = { .adaptive = false };
+    sim_result_t adaptive = { .adaptive = true };
+    simulate(&fixed);
+    setUp();
+    simulate(&adaptive);
+
+    const sim_result_t *rs[] = { &fixed, &adaptive };
+    for (int i = 0; i < 2; i++) {
+        const sim_result_t *r = rs[i];
+        printf("%-8s: %5u msgs, %5u tx, %2u lost, airtime %7.1f ms, delivered %5.1f%% of %.0f s, "
+               "%.1f s windows, %.2f data-s per airtime-ms\n", r->adaptive ? "adaptive" : "fixed",
+               (unsigned)r->messages, (unsigned)r->attempts, (unsigned)r->lost, r->airtime_us / 1000.0,
+               100.0 * r->delivered_ms / r->generated_ms, r->generated_ms / 1000.0,
+               (double)r->generated_ms / r->windows / 1000, data_per_airtime(r));
+    }
+    printf("adaptive: max interval %u ms, %u backoffs, %u recoveries, %.2fx data per airtime\n",
+           (unsigned)adaptive.max_interval_ms, (unsigned)s_rate.backoffs, (unsigned)s_rate.recoveries,
+           data_per_airtime(&adaptive) / data_per_airtime(&fixed));
+
+    // 两种方式都覆盖整段时间，丢掉的只有重发用尽的消息
+    TEST_ASSERT_GREATER_THAN(SIM_S * 1000ull * 99 / 100, fixed.generated_ms);
+    TEST_ASSERT_GREATER_THAN(SIM_S * 1000ull * 99 / 100, adaptive.generated_ms);
+    TEST_ASSERT_GREATER_THAN(adaptive.generated_ms * 98 / 100, adaptive.delivered_ms);
+    // 弱信号和拥塞时退避，整体空口效率更高
+    TEST_ASSERT_GREATER_THAN(BASE_MS * 4, adaptive.max_interval_ms);
+    TEST_ASSERT_GREATER_THAN(0, s_rate.backoffs);
+    TEST_ASSERT_LESS_THAN(fixed.airtime_us / 2, adaptive.airtime_us);
+    TEST_ASSERT_TRUE(data_per_airtime(&adaptive) > 2 * data_per_airtime(&fixed));
+    // 最后一段信号良好，间隔回到基础间隔
+    TEST_ASSERT_EQUAL_UINT32(BASE_MS, adaptive.final_interval_ms);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_link_trace);
+    return UNITY_END();
+}
@@ -0,0 +1,430 @@
+/*
+ * AP漫游状态机：按脚本给出邻居报告、扫描结果和关联事件，检查每一步的动作、选择规则、超时和拉黑；
+ * 最后模拟在三个AP之间来回走动，统计漫游次数、切换间隙和弱信号时间，与不主动漫游对比
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "tuya_roam.h"
+
+static const uint8_t AP_A[6] = { 0x02, 0, 0, 0, 0, 0x0a };
+static const uint8_t AP_B[6] = { 0x02, 0, 0, 0, 0, 0x0b };
+static const uint8_t AP_C[6] = { 0x02, 0, 0, 0, 0, 0x0c };
+
+static tuya_roam_t s_roam;
+
+void setUp(void)
+{
+    tuya_roam_init(&s_roam);
+}
+
+void tearDown(void)
+{
+}
+
+/* 追加一个邻居报告元素，pref<0时不带候选优先级子元素 */
+static size_t put_neighbor(uint8_t *ie, size_t pos, const uint8_t bssid[6], uint8_t channel, int pref)
+{
+    ie[pos++] = 52;
+    ie[pos++] = pref < 0 ? 13 : 16;
+    memcpy(&ie[pos], bssid, 6);
+    pos += 6;
+    ie[pos++] = 0x8f;                   // BSSID信息
+    ie[pos++] = 0x10;
+    ie[pos++] = 0;
+    ie[pos++] = 0;
+    ie[pos++] = channel > 14 ? 115 : 81;
+    ie[pos++] = channel;
+    ie[pos++] = channel > 14 ? 9 : 7;
+    if (pref >= 0) {
+        ie[pos++] = 3;
+        ie[pos++] = 1;
+        ie[pos++] = (uint8_t)pref;
+    }
+    return pos;
+}
+
+static tuya_roam_cand_t cand(const uint8_t bssid[6], uint8_t channel, int8_t rssi)
+{
+    tuya_roam_cand_t c = { .channel = channel, .rssi = rssi };
+    memcpy(c.bssid, bssid, 6);
+    return c;
+}
+
+static void test_parse_neighbors(void)
+{
+    uint8_t ie[64];
+    size_t len = put_neighbor(ie, 0, AP_B, 36, 200);
+    // 其他元素和过短的邻居报告跳过
+    ie[len++] = 221;
+    ie[len++] = 2;
+    ie[len++] = 0;
+    ie[len++] = 0;
+    ie[len++] = 52;
+    ie[len++] = 4;
+    len += 4;
+    len = put_neighbor(ie, len, AP_C, 6, -1);
+
+    tuya_roam_neighbor_t nb[4];
+    TEST_ASSERT_EQUAL_INT(2, tuya_roam_parse_neighbors(ie, len, nb, 4));
+    TEST_ASSERT_EQUAL_MEMORY(AP_B, nb[0].bssid, 6);
+    TEST_ASSERT_EQUAL_UINT32(0x108f, nb[0].bssid_info);
+    TEST_ASSERT_EQUAL_UINT8(115, nb[0].op_class);
+    TEST_ASSERT_EQUAL_UINT8(36, nb[0].channel);
+    TEST_ASSERT_TRUE(nb[0].pref_set);
+    TEST_ASSERT_EQUAL_UINT8(200, nb[0].pref);
+    TEST_ASSERT_EQUAL_MEMORY(AP_C, nb[1].bssid, 6);
+    TEST_ASSERT_FALSE(nb[1].pref_set);
+
+    // 容量不足、元素被截断
+    TEST_ASSERT_EQUAL_INT(1, tuya_roam_parse_neighbors(ie, len, nb, 1));
+    TEST_ASSERT_EQUAL_INT(0, tuya_roam_parse_neighbors(ie, 10, nb, 4));
+}
+
+static void test_select_rules(void)
+{
+    uint8_t ie[64];
+    size_t len;
+    tuya_roam_on_connected(&s_roam, AP_A, true, true, 0);
+    s_roam.cur_rssi = -78;
+
+    // 当前AP、低于最小RSSI、增益不够的都不选
+    tuya_roam_cand_t c1[] = { cand(AP_A, 1, -50), cand(AP_C, 6, -76), cand(AP_B, 36, -69) };
+    TEST_ASSERT_EQUAL_INT(2, tuya_roam_select(&s_roam, c1, 3, 0));
+    s_roam.cur_rssi = -72;
+    TEST_ASSERT_EQUAL_INT(-1, tuya_roam_select(&s_roam, c1, 3, 0));
+
+    // 5GHz信号足够时加分
+    s_roam.cur_rssi = -80;
+    tuya_roam_cand_t c2[] = { cand(AP_C, 6, -62), cand(AP_B, 36, -66) };
+    TEST_ASSERT_EQUAL_INT(0, tuya_roam_select(&s_roam, c2, 2, 0));
+    c2[1].rssi = -64;
+    TEST_ASSERT_EQUAL_INT(1, tuya_roam_select(&s_roam, c2, 2, 0));
+
+    // 邻居报告中的AP加分
+    len = put_neighbor(ie, 0, AP_C, 6, 100);
+    s_roam.neighbor_count = (uint8_t)tuya_roam_parse_neighbors(ie, len, s_roam.neighbors, TUYA_ROAM_MAX_NEIGHBORS);
+    TEST_ASSERT_EQUAL_INT(0, tuya_roam_select(&s_roam, c2, 2, 0));
+
+    // AP声明优先级0的邻居不选，即使信号最好
+    c2[1].rssi = -50;
+    len = put_neighbor(ie, 0, AP_B, 36, 0);
+    s_roam.neighbor_count = (uint8_t)tuya_roam_parse_neighbors(ie, len, s_roam.neighbors, TUYA_ROAM_MAX_NEIGHBORS);
+    TEST_ASSERT_EQUAL_INT(0, tuya_roam_select(&s_roam, c2, 2, 0));
+
+    // 同分时邻居优先级高者优先
+    len = put_neighbor(ie, 0, AP_B, 36, 50);
+    len = put_neighbor(ie, len, AP_C, 6, 200);
+    s_roam.neighbor_count = (uint8_t)tuya_roam_parse_neighbors(ie, len, s_roam.neighbors, TUYA_ROAM_MAX_NEIGHBORS);
+    tuya_roam_cand_t c3[] = { cand(AP_B, 36, -68), cand(AP_C, 6, -65) };
+    TEST_ASSERT_EQUAL_INT(1, tuya_roam_select(&s_roam, c3, 2, 0));
+}
+
+/* 支持11k/11v的AP：邻居报告 -> 扫描 -> BTM查询 -> AP引导漫游，IP和MQTT保持 */
+static void test_script_11kv(void)
+{
+    TEST_ASSERT_FALSE(tuya_roam_on_connected(&s_roam, AP_A, true, true, 1000));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NEIGHBOR_REQ, tuya_roam_on_rssi_low(&s_roam, -74, 10000));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_WAIT_NEIGHBORS, s_roam.state);
+    // 状态机忙时不重复触发
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NONE, tuya_roam_on_rssi_low(&s_roam, -75, 10100));
+
+    uint8_t ie[64];
+    size_t len = put_neighbor(ie, 0, AP_B, 36, 120);
+    len = put_neighbor(ie, len, AP_C, 6, 0);
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_SCAN, tuya_roam_on_neighbors(&s_roam, ie, len, 10050));
+    TEST_ASSERT_EQUAL_INT(2, s_roam.neighbor_count);
+
+    tuya_roam_cand_t scan[] = { cand(AP_A, 1, -75), cand(AP_C, 6, -55), cand(AP_B, 36, -60) };
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_BTM_QUERY, tuya_roam_on_scan(&s_roam, scan, 3, 12000));
+    TEST_ASSERT_EQUAL_MEMORY(AP_B, s_roam.target.bssid, 6);
+
+    // 目标排首位、最高优先级；当前AP和优先级0的邻居不列出
+    char list[160];
+    TEST_ASSERT_GREATER_THAN(0, tuya_roam_format_btm(&s_roam, list, sizeof(list)));
+    TEST_ASSERT_EQUAL_STRING("neighbor=02:00:00:00:00:0b,0x108f,115,36,9,0301ff", list);
+    TEST_ASSERT_EQUAL_INT(-1, tuya_roam_format_btm(&s_roam, list, 20));
+
+    // AP下发切换请求，驱动以漫游原因断开后关联到B
+    TEST_ASSERT_TRUE(tuya_roam_on_disconnect(&s_roam, true, 12200));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_HANDOFF, s_roam.state);
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NONE, tuya_roam_tick(&s_roam, 12250));
+    TEST_ASSERT_TRUE(tuya_roam_on_connected(&s_roam, AP_B, true, true, 12260));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_IDLE, s_roam.state);
+    TEST_ASSERT_EQUAL_UINT32(1, s_roam.roams);
+    TEST_ASSERT_EQUAL_UINT32(1, s_roam.btm_queries);
+    TEST_ASSERT_EQUAL_UINT32(1, s_roam.neighbor_reports);
+    TEST_ASSERT_EQUAL_UINT32(60000, s_roam.gap.max_us);
+
+    // 冷却时间内不再触发
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NONE, tuya_roam_on_rssi_low(&s_roam, -74, 10000 + TUYA_ROAM_COOLDOWN_MS - 1));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NEIGHBOR_REQ, tuya_roam_on_rssi_low(&s_roam, -74, 10000 + TUYA_ROAM_COOLDOWN_MS));
+}
+
+/* 不支持11k/11v的AP：直接扫描并重关联；邻居报告和BTM都超时时退回直接重关联 */
+static void test_script_legacy_and_timeouts(void)
+{
+    tuya_roam_on_connected(&s_roam, AP_C, false, false, 0);
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_SCAN, tuya_roam_on_rssi_low(&s_roam, -76, 5000));
+    // 扫描结果中没有明显更好的AP
+    tuya_roam_cand_t weak[] = { cand(AP_C, 6, -76), cand(AP_B, 36, -72) };
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NONE, tuya_roam_on_scan(&s_roam, weak, 2, 7000));
+    TEST_ASSERT_EQUAL_UINT32(1, s_roam.no_candidate);
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_IDLE, s_roam.state);
+
+    int64_t t = 5000 + TUYA_ROAM_COOLDOWN_MS;
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_SCAN, tuya_roam_on_rssi_low(&s_roam, -78, t));
+    tuya_roam_cand_t good[] = { cand(AP_B, 36, -60) };
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_REASSOC, tuya_roam_on_scan(&s_roam, good, 1, t + 2000));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NONE, tuya_roam_on_scan(&s_roam, good, 1, t + 2001));
+    TEST_ASSERT_TRUE(tuya_roam_on_disconnect(&s_roam, false, t + 2010));
+    TEST_ASSERT_TRUE(tuya_roam_on_connected(&s_roam, AP_B, true, true, t + 2300));
+    TEST_ASSERT_EQUAL_UINT32(300000, s_roam.gap.max_us);
+
+    // B的邻居报告和BTM都没有响应
+    t += TUYA_ROAM_COOLDOWN_MS;
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NEIGHBOR_REQ, tuya_roam_on_rssi_low(&s_roam, -79, t));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NONE, tuya_roam_tick(&s_roam, t + TUYA_ROAM_NEIGHBOR_TIMEOUT_MS - 1));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_SCAN, tuya_roam_tick(&s_roam, t + TUYA_ROAM_NEIGHBOR_TIMEOUT_MS));
+    t += TUYA_ROAM_NEIGHBOR_TIMEOUT_MS;
+    tuya_roam_cand_t back[] = { cand(AP_A, 1, -58), cand(AP_C, 6, -66) };
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_BTM_QUERY, tuya_roam_on_scan(&s_roam, back, 2, t + 2000));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_REASSOC, tuya_roam_tick(&s_roam, t + 2000 + TUYA_ROAM_BTM_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_HANDOFF, s_roam.state);
+
+    // 扫描一直没有结果时回到空闲
+    tuya_roam_on_connected(&s_roam, AP_A, false, false, t + 5000);
+    t += TUYA_ROAM_COOLDOWN_MS;
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_SCAN, tuya_roam_on_rssi_low(&s_roam, -79, t));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NONE, tuya_roam_tick(&s_roam, t + TUYA_ROAM_SCAN_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_IDLE, s_roam.state);
+    TEST_ASSERT_EQUAL_UINT32(2, s_roam.roams);
+}
+
+/* 重关联超时：恢复原配置按普通断线处理，目标拉黑一段时间 */
+static void test_script_handoff_failure(void)
+{
+    tuya_roam_on_connected(&s_roam, AP_A, false, false, 0);
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_SCAN, tuya_roam_on_rssi_low(&s_roam, -78, 1000));
+    tuya_roam_cand_t scan[] = { cand(AP_B, 36, -60), cand(AP_C, 6, -65) };
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_REASSOC, tuya_roam_on_scan(&s_roam, scan, 2, 3000));
+    TEST_ASSERT_TRUE(tuya_roam_on_disconnect(&s_roam, false, 3010));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_NONE, tuya_roam_tick(&s_roam, 3000 + TUYA_ROAM_HANDOFF_TIMEOUT_MS - 1));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_RESTORE, tuya_roam_tick(&s_roam, 3000 + TUYA_ROAM_HANDOFF_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL_UINT32(1, s_roam.failures);
+    TEST_ASSERT_FALSE(s_roam.connected);
+    // 断线后普通重连不算漫游
+    TEST_ASSERT_FALSE(tuya_roam_on_disconnect(&s_roam, false, 6100));
+    TEST_ASSERT_FALSE(tuya_roam_on_connected(&s_roam, AP_A, false, false, 9000));
+
+    // 拉黑期间选次优的C，到期后B重新可选
+    int64_t t = 1000 + TUYA_ROAM_COOLDOWN_MS;
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_SCAN, tuya_roam_on_rssi_low(&s_roam, -78, t));
+    TEST_ASSERT_EQUAL_INT(TUYA_ROAM_ACT_REASSOC, tuya_roam_on_scan(&s_roam, scan, 2, t + 2000));
+    TEST_ASSERT_EQUAL_MEMORY(AP_C, s_roam.target.bssid, 6);
+    s_roam.state = TUYA_ROAM_IDLE;
+    TEST_ASSERT_EQUAL_INT(1, tuya_roam_select(&s_roam, scan, 2, 6000 + TUYA_ROAM_BLACKLIST_MS - 1));
+    TEST_ASSERT_EQUAL_INT(0, tuya_roam_select(&s_roam, scan, 2, 6000 + TUYA_ROAM_BLACKLIST_MS));
+}
+
+/* ========== 走动模拟 ========== */
+
+#define WALK_STEP_MS        100
+#define WALK_SPEED_MM_S     500     // 0.5 m/s
+#define WALK_LEN_M          60
+#define WALK_LAPS           5
+#define WALK_WEAK_RSSI      (-75)
+#define SCAN_MS             2000
+#define NEIGHBOR_MS         50
+#define BTM_MS              150     // 查询到AP下发切换请求
+#define ASSOC_MS            60      // AP引导的重关联
+#define REASSOC_MS          300     // 本地指定BSSID重关联（含认证和四次握手）
+
+typedef struct {
+    const uint8_t *bssid;
+    uint8_t channel;
+    int x_m;
+    bool rrm;
+    bool btm;
+} sim_ap_t;
+
+// 走廊两端和中间各一个AP，C是不支持11k/11v的老AP
+static const sim_ap_t s_aps[] = {
+    { AP_A, 1, 0, true, true },
+    { AP_B, 36, 30, true, true },
+    { AP_C, 6, 60, false, false },
+};
+#define SIM_AP_NUM  (int)(sizeof(s_aps) / sizeof(s_aps[0]))
+
+typedef enum {
+    EV_NONE = 0,
+    EV_NEIGHBORS,
+    EV_SCAN_DONE,
+    EV_BTM_REQ,
+    EV_ASSOC,
+} sim_event_t;
+
+typedef struct {
+    bool roam;                  // false：不主动漫游，一直连着起始AP
+    uint32_t steps;
+    uint32_t weak_steps;        // 当前AP低于 WALK_WEAK_RSSI
+    uint32_t down_steps;        // 与AP断开
+    int worst_rssi;
+} walk_result_t;
+
+static int rssi_at(const sim_ap_t *ap, double x_m)
+{
+    return (int)lround(-30 - 30 * log10(1 + fabs(x_m - ap->x_m)));
+}
+
+static double pos_at(int64_t t_ms)
+{
+    int64_t lap_ms = (int64_t)WALK_LEN_M * 2 * 1000000 / WALK_SPEED_MM_S;
+    int64_t in_lap = t_ms % lap_ms;
+    double x = (double)in_lap * WALK_SPEED_MM_S / 1000000;
+    return x <= WALK_LEN_M ? x : 2 * WALK_LEN_M - x;
+}
+
+static int find_ap(const uint8_t bssid[6])
+{
+    for (int i = 0; i < SIM_AP_NUM; i++) {
+        if (memcmp(s_aps[i].bssid, bssid, 6) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void walk(walk_result_t *r)
+{
+    int cur = 0;
+    bool up = true;
+    int target = -1;
+    sim_event_t ev = EV_NONE;
+    int64_t ev_ms = 0;
+    int64_t end_ms = (int64_t)WALK_LAPS * WALK_LEN_M * 2 * 1000000 / WALK_SPEED_MM_S;
+
+    r->worst_rssi = 0;
+    tuya_roam_on_connected(&s_roam, s_aps[cur].bssid, s_aps[cur].rrm, s_aps[cur].btm, 0);
+    for (int64_t now = 0; now < end_ms; now += WALK_STEP_MS) {
+        double x = pos_at(now);
+        int rssi = rssi_at(&s_aps[cur], x);
+        tuya_roam_action_t act = TUYA_ROAM_ACT_NONE;
+
+        if (r->roam && ev != EV_NONE && now >= ev_ms) {
+            sim_event_t done = ev;
+            ev = EV_NONE;
+            if (done == EV_NEIGHBORS) {
+                uint8_t ie[64];
+                size_t len = 0;
+                for (int i = 0; i < SIM_AP_NUM; i++) {
+                    if (i != cur) {
+                        len = put_neighbor(ie, len, s_aps[i].bssid, s_aps[i].channel, -1);
+                    }
+                }
+                act = tuya_roam_on_neighbors(&s_roam, ie, len, now);
+            } else if (done == EV_SCAN_DONE) {
+                tuya_roam_cand_t cands[SIM_AP_NUM];
+                for (int i = 0; i < SIM_AP_NUM; i++) {
+                    cands[i] = cand(s_aps[i].bssid, s_aps[i].channel, (int8_t)rssi_at(&s_aps[i], x));
+                }
+                act = tuya_roam_on_scan(&s_roam, cands, SIM_AP_NUM, now);
+            } else if (done == EV_BTM_REQ) {
+                TEST_ASSERT_TRUE(tuya_roam_on_disconnect(&s_roam, true, now));
+                up = false;
+                ev = EV_ASSOC;
+                ev_ms = now + ASSOC_MS;
+            } else if (done == EV_ASSOC) {
+                TEST_ASSERT_TRUE(tuya_roam_on_connected(&s_roam, s_aps[target].bssid, s_aps[target].rrm,
+                                                        s_aps[target].btm, now));
+                cur = target;
+                up = true;
+                rssi = rssi_at(&s_aps[cur], x);
+            }
+        }
+
+        // 与 roam_tick 相同：空闲且过了冷却时间才重新设置RSSI门限
+        if (r->roam && act == TUYA_ROAM_ACT_NONE) {
+            act = tuya_roam_tick(&s_roam, now);
+            if (act == TUYA_ROAM_ACT_NONE && up && rssi < TUYA_ROAM_RSSI_TRIGGER) {
+                act = tuya_roam_on_rssi_low(&s_roam, (int8_t)rssi, now);
+            }
+        }
+
+        switch (act) {
+        case TUYA_ROAM_ACT_NEIGHBOR_REQ:
+            if (s_aps[cur].rrm) {
+                ev = EV_NEIGHBORS;
+                ev_ms = now + NEIGHBOR_MS;
+            }
+            break;
+        case TUYA_ROAM_ACT_SCAN:
+            ev = EV_SCAN_DONE;
+            ev_ms = now + SCAN_MS;
+            break;
+        case TUYA_ROAM_ACT_BTM_QUERY:
+            target = find_ap(s_roam.target.bssid);
+            ev = EV_BTM_REQ;
+            ev_ms = now + BTM_MS;
+            break;
+        case TUYA_ROAM_ACT_REASSOC:
+            target = find_ap(s_roam.target.bssid);
+            TEST_ASSERT_TRUE(tuya_roam_on_disconnect(&s_roam, false, now));
+            up = false;
+            ev = EV_ASSOC;
+            ev_ms = now + REASSOC_MS;
+            break;
+        case TUYA_ROAM_ACT_RESTORE:
+            TEST_FAIL_MESSAGE("handoff should not time out in the walk");
+            break;
+        default:
+            break;
+        }
+
+        r->steps++;
+        if (!up) {
+            r->down_steps++;
+        } else {
+            r->weak_steps += rssi < WALK_WEAK_RSSI;
+            r->worst_rssi = rssi < r->worst_rssi ? rssi : r->worst_rssi;
+        }
+    }
+}
+
+static void test_walk(void)
+{
+    walk_result_t sticky = { .roam = false };
+    walk_result_t roam = { .roam = true };
+    walk(&sticky);
+    setUp();
+    walk(&roam);
+
+    printf("walk %d x %d m at 0.5 m/s past 3 APs: no roaming %.1f%% of time below %d dBm (worst %d dBm); "
+           "roaming %.1f%% (worst %d dBm), %u roams, %u via BTM, gap avg %.0f ms max %.0f ms, offline %.2f%%\n",
+           WALK_LAPS, WALK_LEN_M, 100.0 * sticky.weak_steps / sticky.steps, WALK_WEAK_RSSI, sticky.worst_rssi,
+           100.0 * roam.weak_steps / roam.steps, roam.worst_rssi, (unsigned)s_roam.roams,
+           (unsigned)s_roam.btm_queries, iot_latency_avg_us(&s_roam.gap) / 1000.0, s_roam.gap.max_us / 1000.0,
+           100.0 * roam.down_steps / roam.steps);
+
+    // 每经过一个AP切换一次，来回不在两个AP间反复切换
+    TEST_ASSERT_GREATER_OR_EQUAL(WALK_LAPS * 4 - 1, s_roam.roams);
+    TEST_ASSERT_LESS_OR_EQUAL(WALK_LAPS * 4 + 1, s_roam.roams);
+    TEST_ASSERT_EQUAL_UINT32(0, s_roam.failures);
+    TEST_ASSERT_GREATER_THAN(0, s_roam.btm_queries);
+    TEST_ASSERT_LESS_OR_EQUAL(REASSOC_MS * 1000, s_roam.gap.max_us);
+    TEST_ASSERT_LESS_THAN(sticky.weak_steps / 4, roam.weak_steps);
+    TEST_ASSERT_LESS_THAN(roam.steps / 100, roam.down_steps);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_neighbors);
+    RUN_TEST(test_select_rules);
+    RUN_TEST(test_script_11kv);
+    RUN_TEST(test_script_legacy_and_timeouts);
+    RUN_TEST(test_script_handoff_failure);
+    RUN_TEST(test_walk);
+    return UNITY_END();
+}
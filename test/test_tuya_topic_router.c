@@ -0,0 +1,243 @@
+/*
+ * 主题路由：精确分段优先、'+'/'#' 通配符与回溯、注销后重新注册、过滤器校验，
+ * 以及按设备实际注册的下行主题测量每条消息的分发开销（与逐条strcmp/通配比较的线性表对比）
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "tuya_topic_router.h"
+
+#define DEV                 "26f1c0a7e3d9b8f5a4xyz1"
+#define TOPIC(s)            "tylink/" DEV "/" s
+#define BENCH_MESSAGES      2000000
+
+static tuya_router_t s_router;
+static int s_calls[TUYA_ROUTER_MAX_ROUTES];
+
+static bool on_msg(const char *topic, int topic_len, const char *data, int data_len, void *ctx)
+{
+    s_calls[(intptr_t)ctx]++;
+    return true;
+}
+
+static bool on_refuse(const char *topic, int topic_len, const char *data, int data_len, void *ctx)
+{
+    return false;
+}
+
+static int match(const char *topic)
+{
+    return tuya_router_match(&s_router, topic, (int)strlen(topic));
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void setUp(void)
+{
+    tuya_router_init(&s_router);
+    memset(s_calls, 0, sizeof(s_calls));
+}
+
+void tearDown(void)
+{
+}
+
+static void test_exact_beats_wildcards(void)
+{
+    int any = tuya_router_add(&s_router, "tylink/+/thing/property/set", 0, false, on_msg, (void *)0);
+    int mine = tuya_router_add(&s_router, TOPIC("thing/property/set"), 1, true, on_msg, (void *)1);
+    int rest = tuya_router_add(&s_router, "tylink/#", 0, false, on_msg, (void *)2);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, any);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, mine);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, rest);
+
+    // 精确分段在前，与注册顺序无关
+    TEST_ASSERT_EQUAL_INT(mine, match(TOPIC("thing/property/set")));
+    TEST_ASSERT_EQUAL_INT(any, match("tylink/subdev01/thing/property/set"));
+    // '+' 分支走到底没有匹配时回溯到 '#'
+    TEST_ASSERT_EQUAL_INT(rest, match("tylink/subdev01/thing/property/get"));
+    TEST_ASSERT_EQUAL_INT(rest, match(TOPIC("ota/issue")));
+    TEST_ASSERT_EQUAL_INT(-1, match("other/" DEV));
+    // '+' 只匹配一层
+    TEST_ASSERT_EQUAL_INT(rest, match("tylink/a/b/thing/property/set"));
+}
+
+static void test_multi_level_matches_parent(void)
+{
+    // MQTT：'#' 也匹配父层本身，"a/#" 匹配 "a"，"#" 匹配所有主题
+    int sub = tuya_router_add(&s_router, "a/b/#", 0, false, on_msg, (void *)0);
+    TEST_ASSERT_EQUAL_INT(sub, match("a/b"));
+    TEST_ASSERT_EQUAL_INT(sub, match("a/b/c"));
+    TEST_ASSERT_EQUAL_INT(sub, match("a/b/c/d"));
+    TEST_ASSERT_EQUAL_INT(sub, match("a/b/"));
+    TEST_ASSERT_EQUAL_INT(-1, match("a"));
+    TEST_ASSERT_EQUAL_INT(-1, match("a/bc"));
+
+    // 父层本身有精确路由时优先
+    int exact = tuya_router_add(&s_router, "a/b", 0, false, on_msg, (void *)1);
+    TEST_ASSERT_EQUAL_INT(exact, match("a/b"));
+    TEST_ASSERT_EQUAL_INT(sub, match("a/b/c"));
+
+    // "+/#" 经过 '+' 后同样匹配父层
+    int plus = tuya_router_add(&s_router, "x/+/#", 0, false, on_msg, (void *)2);
+    TEST_ASSERT_EQUAL_INT(plus, match("x/y"));
+    TEST_ASSERT_EQUAL_INT(-1, match("x"));
+
+    int all = tuya_router_add(&s_router, "#", 0, false, on_msg, (void *)3);
+    TEST_ASSERT_EQUAL_INT(all, match("a"));
+    TEST_ASSERT_EQUAL_INT(all, match("z/z/z"));
+}
+
+static void test_remove_and_readd(void)
+{
+    int a = tuya_router_add(&s_router, TOPIC("ota/issue"), 1, true, on_msg, (void *)0);
+    int w = tuya_router_add(&s_router, "tylink/+/ota/issue", 1, false, on_msg, (void *)1);
+    TEST_ASSERT_EQUAL_INT(a, match(TOPIC("ota/issue")));
+
+    // 注销后落到通配符路由；重新注册复用原来的路由下标，不占用新节点
+    uint8_t nodes = s_router.node_count;
+    TEST_ASSERT_EQUAL_INT(a, tuya_router_remove(&s_router, TOPIC("ota/issue")));
+    TEST_ASSERT_EQUAL_INT(-1, tuya_router_remove(&s_router, TOPIC("ota/issue")));
+    TEST_ASSERT_EQUAL_INT(w, match(TOPIC("ota/issue")));
+    TEST_ASSERT_EQUAL_INT(a, tuya_router_add(&s_router, TOPIC("ota/issue"), 1, true, on_msg, (void *)2));
+    TEST_ASSERT_EQUAL_UINT8(nodes, s_router.node_count);
+    TEST_ASSERT_EQUAL_INT(a, match(TOPIC("ota/issue")));
+
+    // 分发：处理函数拒绝时计为未处理
+    TEST_ASSERT_TRUE(tuya_router_dispatch(&s_router, TOPIC("ota/issue"), (int)strlen(TOPIC("ota/issue")), "{}", 2));
+    TEST_ASSERT_EQUAL_INT(1, s_calls[2]);
+    tuya_router_add(&s_router, "tylink/+/ota/issue", 1, false, on_refuse, NULL);
+    TEST_ASSERT_FALSE(tuya_router_dispatch(&s_router, "tylink/x/ota/issue", 18, "{}", 2));
+    TEST_ASSERT_FALSE(tuya_router_dispatch(&s_router, "nothing", 7, "{}", 2));
+    TEST_ASSERT_EQUAL_UINT32(1, s_router.dispatched);
+    TEST_ASSERT_EQUAL_UINT32(2, s_router.unmatched);
+}
+
+static void test_invalid_filters_and_limits(void)
+{
+    TEST_ASSERT_EQUAL_INT(-1, tuya_router_add(&s_router, "", 0, false, on_msg, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, tuya_router_add(&s_router, "a/#/b", 0, false, on_msg, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, tuya_router_add(&s_router, "a/b#", 0, false, on_msg, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, tuya_router_add(&s_router, "a/+b", 0, false, on_msg, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, tuya_router_add(&s_router, "a/b", 0, false, NULL, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, tuya_router_add(&s_router, NULL, 0, false, on_msg, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, match(""));
+
+    char filter[32];
+    for (int i = 0; i < TUYA_ROUTER_MAX_ROUTES; i++) {
+        snprintf(filter, sizeof(filter), "r/%d", i);
+        TEST_ASSERT_EQUAL_INT(i, tuya_router_add(&s_router, filter, 0, false, on_msg, NULL));
+    }
+    TEST_ASSERT_EQUAL_INT(-1, tuya_router_add(&s_router, "r/full", 0, false, on_msg, NULL));
+    // 已注册的过滤器仍可替换处理函数
+    TEST_ASSERT_EQUAL_INT(3, tuya_router_add(&s_router, "r/3", 1, true, on_msg, NULL));
+}
+
+/* 对照组：原先逐个比较主题的线性表，通配符按分段比较 */
+static bool naive_match(const char *filter, const char *topic, int topic_len)
+{
+    const char *t = topic, *end = topic + topic_len;
+    const char *f = filter;
+    while (*f) {
+        if (f[0] == '#') {
+            return true;
+        }
+        const char *fs = strchr(f, '/');
+        size_t flen = fs ? (size_t)(fs - f) : strlen(f);
+        const char *ts = memchr(t, '/', (size_t)(end - t));
+        size_t tlen = (size_t)((ts ? ts : end) - t);
+        if (!(flen == 1 && f[0] == '+') && (flen != tlen || memcmp(f, t, flen) != 0)) {
+            return false;
+        }
+        if (!fs) {
+            return !ts;
+        }
+        if (!ts) {
+            return strcmp(fs + 1, "#") == 0;
+        }
+        f = fs + 1;
+        t = ts + 1;
+    }
+    return false;
+}
+
+static void test_dispatch_cost(void)
+{
+    // 与设备上相同的注册：本设备的下行主题 + 网关的子设备通配路由
+    static const char *filters[] = {
+        TOPIC("thing/property/set"),
+        TOPIC("thing/property/desired/get_response"),
+        TOPIC("ota/issue"),
+        TOPIC("device/sub/bind_response"),
+        TOPIC("thing/action/execute"),
+        TOPIC("thing/property/batch_report_response"),
+        "tylink/+/thing/property/set",
+    };
+    static const char *traffic[] = {
+        TOPIC("thing/property/set"),
+        TOPIC("thing/property/set"),
+        TOPIC("thing/property/set"),
+        "tylink/6c0000000000a1b2c3d4/thing/property/set",
+        TOPIC("thing/property/desired/get_response"),
+        TOPIC("ota/issue"),
+        TOPIC("thing/action/execute"),
+        "tylink/6c0000000000a1b2c3d4/thing/property/set",
+    };
+    const int nf = sizeof(filters) / sizeof(filters[0]);
+    const int nt = sizeof(traffic) / sizeof(traffic[0]);
+    int len[8];
+    for (int i = 0; i < nf; i++) {
+        TEST_ASSERT_EQUAL_INT(i, tuya_router_add(&s_router, filters[i], 1, true, on_msg, (void *)(intptr_t)i));
+    }
+    for (int i = 0; i < nt; i++) {
+        len[i] = (int)strlen(traffic[i]);
+        // 两种实现的结果一致
+        int idx = match(traffic[i]);
+        TEST_ASSERT_GREATER_OR_EQUAL(0, idx);
+        for (int k = 0; k < idx; k++) {
+            TEST_ASSERT_FALSE(naive_match(filters[k], traffic[i], len[i]));
+        }
+        TEST_ASSERT_TRUE(naive_match(filters[idx], traffic[i], len[i]));
+    }
+
+    int64_t t0 = now_ns();
+    for (int i = 0; i < BENCH_MESSAGES; i++) {
+        tuya_router_dispatch(&s_router, traffic[i % nt], len[i % nt], "{}", 2);
+    }
+    int64_t trie_ns = now_ns() - t0;
+    TEST_ASSERT_EQUAL_UINT32(BENCH_MESSAGES, s_router.dispatched);
+
+    volatile int sink = 0;
+    t0 = now_ns();
+    for (int i = 0; i < BENCH_MESSAGES; i++) {
+        for (int k = 0; k < nf; k++) {
+            if (naive_match(filters[k], traffic[i % nt], len[i % nt])) {
+                sink += k;
+                break;
+            }
+        }
+    }
+    int64_t naive_ns = now_ns() - t0;
+    (void)sink;
+
+    printf("dispatch, %d routes: trie %.1f ns/msg, linear filter scan %.1f ns/msg (host)\n", nf,
+           (double)trie_ns / BENCH_MESSAGES, (double)naive_ns / BENCH_MESSAGES);
+    TEST_ASSERT_LESS_THAN(2000, (int)(trie_ns / BENCH_MESSAGES));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_exact_beats_wildcards);
+    RUN_TEST(test_multi_level_matches_parent);
+    RUN_TEST(test_remove_and_readd);
+    RUN_TEST(test_invalid_filters_and_limits);
+    RUN_TEST(test_dispatch_cost);
+    return UNITY_END();
+}
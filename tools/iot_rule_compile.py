@@ -0,0 +1,286 @@
+#!/usr/bin/env python3
+# 把文本形式的本地联动规则编译成设备端字节码（格式见 components/common/iot_rule_core.h）
+#
+# 每行一条规则，# 之后为注释：
+#   test_value > 30 => device_status = "open"
+#   device_status == "open" && test_value - 5 <= 0 => test_value = 10, device_status = "close"
+#
+# 用法: python tools/iot_rule_compile.py rules.txt             每行输出一个base64分片，依次填入property/set的local_rules字段
+#       python tools/iot_rule_compile.py rules.txt --hex --chunk 180  输出BLE规则特征值的分片（hex），每次写入不超过MTU-3
+#       python tools/iot_rule_compile.py rules.txt -o rules.bin   输出完整规则集
+import argparse
+import base64
+import os
+import re
+import struct
+import sys
+import zlib
+from typing import Dict
+from typing import List
+from typing import Tuple
+
+OP_PUSH_DP = 0x01
+OP_PUSH_I8 = 0x02
+OP_PUSH_I32 = 0x03
+OP_CMP = {'==': 0x10, '!=': 0x11, '<': 0x12, '<=': 0x13, '>': 0x14, '>=': 0x15}
+OP_AND = 0x20
+OP_OR = 0x21
+OP_NOT = 0x22
+OP_ADD = 0x28
+OP_SUB = 0x29
+OP_STR_EQ = 0x30
+OP_SET_INT = 0x80
+OP_SET_STR = 0x81
+
+VERSION = 1
+MAX_RULES = 256
+BLOB_MAX = 4096
+STACK_DEPTH = 8
+STR_MAX = 31
+CHUNK_HDR_LEN = 4
+CHUNK_MAX = 512
+
+SCHEMA_RE = re.compile(r'X\(\s*(\w+)\s*,\s*"(\w+)"\s*,\s*IOT_DP_TYPE_(INT|STR)\b')
+TOKEN_RE = re.compile(r'\s*(?:(\d+)|(\w+)|"([^"]*)"|(=>|==|!=|<=|>=|&&|\|\||[<>()!+\-=,]))')
+
+DEFAULT_SCHEMA = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'components', 'common', 'common.h')
+
+
+def load_schema(path: str) -> Dict[str, Tuple[int, str]]:
+    """从 IOT_DP_SCHEMA 读取DP编号和类型，按云端标识符索引"""
+    with open(path, encoding='utf-8') as f:
+        entries = SCHEMA_RE.findall(f.read())
+    if not entries:
+        raise ValueError('IOT_DP_SCHEMA not found in %s' % path)
+    return {code: (i, typ) for i, (_, code, typ) in enumerate(entries)}
+
+
+def tokenize(text: str) -> List[Tuple[str, str]]:
+    tokens = []
+    pos = 0
+    text = text.rstrip()
+    while pos < len(text):
+        m = TOKEN_RE.match(text, pos)
+        if not m:
+            raise ValueError('unexpected input at: %s' % text[pos:])
+        num, name, string, op = m.groups()
+        if num is not None:
+            tokens.append(('num', num))
+        elif name is not None:
+            tokens.append(('name', name))
+        elif string is not None:
+            tokens.append(('str', string))
+        else:
+            tokens.append(('op', op))
+        pos = m.end()
+    return tokens
+
+
+class Parser:
+    def __init__(self, tokens: List[Tuple[str, str]], schema: Dict[str, Tuple[int, str]]) -> None:
+        self.tokens = tokens
+        self.pos = 0
+        self.schema = schema
+        self.code = bytearray()
+        self.depth = 0
+        self.max_depth = 0
+
+    def peek(self) -> Tuple[str, str]:
+        return self.tokens[self.pos] if self.pos < len(self.tokens) else ('end', '')
+
+    def take(self, kind: str, value: str = '') -> str:
+        tok = self.peek()
+        if tok[0] != kind or (value and tok[1] != value):
+            raise ValueError('expected %s, got %s' % (value or kind, tok[1] or 'end of line'))
+        self.pos += 1
+        return tok[1]
+
+    def dp(self, name: str, typ: str) -> int:
+        if name not in self.schema:
+            raise ValueError('unknown DP: %s' % name)
+        idx, actual = self.schema[name]
+        if actual != typ:
+            raise ValueError('%s is %s, not %s' % (name, actual, typ))
+        return idx
+
+    def push(self, code: bytes) -> None:
+        self.code += code
+        self.depth += 1
+        self.max_depth = max(self.max_depth, self.depth)
+
+    def pop(self, op: int, n: int = 1) -> None:
+        self.code.append(op)
+        self.depth -= n
+
+    def expr(self) -> None:
+        self.conj()
+        while self.peek() == ('op', '||'):
+            self.pos += 1
+            self.conj()
+            self.pop(OP_OR)
+
+    def conj(self) -> None:
+        self.unary()
+        while self.peek() == ('op', '&&'):
+            self.pos += 1
+            self.unary()
+            self.pop(OP_AND)
+
+    def unary(self) -> None:
+        if self.peek() == ('op', '!'):
+            self.pos += 1
+            self.unary()
+            self.pop(OP_NOT, 0)
+        else:
+            self.compare()
+
+    def compare(self) -> None:
+        # 字符串DP只能与字符串常量比较相等
+        kind, value = self.peek()
+        if kind == 'name' and value in self.schema and self.schema[value][1] == 'STR':
+            self.pos += 1
+            op = self.take('op')
+            if op not in ('==', '!='):
+                raise ValueError('string DP %s supports only == and !=' % value)
+            text = self.take('str').encode('utf-8')
+            if len(text) > STR_MAX:
+                raise ValueError('string too long: %s' % text.decode('utf-8'))
+            self.push(bytes([OP_STR_EQ, self.dp(value, 'STR'), len(text)]) + text)
+            if op == '!=':
+                self.pop(OP_NOT, 0)
+            return
+        self.sum()
+        kind, op = self.peek()
+        if kind == 'op' and op in OP_CMP:
+            self.pos += 1
+            self.sum()
+            self.pop(OP_CMP[op])
+
+    def sum(self) -> None:
+        self.atom()
+        while self.peek() in (('op', '+'), ('op', '-')):
+            op = self.take('op')
+            self.atom()
+            self.pop(OP_ADD if op == '+' else OP_SUB)
+
+    def number(self) -> int:
+        sign = 1
+        if self.peek() == ('op', '-'):
+            self.pos += 1
+            sign = -1
+        v = sign * int(self.take('num'))
+        if not -2**31 <= v < 2**31:
+            raise ValueError('number out of range: %d' % v)
+        return v
+
+    def atom(self) -> None:
+        kind, value = self.peek()
+        if kind == 'num' or (kind, value) == ('op', '-'):
+            v = self.number()
+            if -128 <= v <= 127:
+                self.push(struct.pack('<Bb', OP_PUSH_I8, v))
+            else:
+                self.push(struct.pack('<Bi', OP_PUSH_I32, v))
+        elif kind == 'name':
+            self.pos += 1
+            self.push(bytes([OP_PUSH_DP, self.dp(value, 'INT')]))
+        elif (kind, value) == ('op', '('):
+            self.pos += 1
+            self.expr()
+            self.take('op', ')')
+        else:
+            raise ValueError('unexpected %s' % (value or 'end of line'))
+
+    def actions(self) -> bytes:
+        out = bytearray()
+        while True:
+            name = self.take('name')
+            self.take('op', '=')
+            kind, value = self.peek()
+            if kind == 'num' or (kind, value) == ('op', '-'):
+                out += struct.pack('<BBi', OP_SET_INT, self.dp(name, 'INT'), self.number())
+            elif kind == 'str':
+                self.pos += 1
+                text = value.encode('utf-8')
+                if len(text) > STR_MAX:
+                    raise ValueError('string too long: %s' % value)
+                out += bytes([OP_SET_STR, self.dp(name, 'STR'), len(text)]) + text
+            else:
+                raise ValueError('expected number or string after %s =' % name)
+            if self.peek() != ('op', ','):
+                break
+            self.pos += 1
+        self.take('end')
+        return bytes(out)
+
+
+def compile_rule(line: str, schema: Dict[str, Tuple[int, str]]) -> Tuple[bytes, bytes]:
+    p = Parser(tokenize(line), schema)
+    p.expr()
+    p.take('op', '=>')
+    cond = bytes(p.code)
+    if p.max_depth > STACK_DEPTH:
+        raise ValueError('expression too deep')
+    act = p.actions()
+    if len(cond) > 255 or len(act) > 255:
+        raise ValueError('rule too long')
+    return cond, act
+
+
+def compile_rules(lines: List[str], schema: Dict[str, Tuple[int, str]]) -> bytes:
+    rules = []
+    for lineno, raw in enumerate(lines, 1):
+        line = raw.split('#', 1)[0].strip()
+        if not line:
+            continue
+        try:
+            cond, act = compile_rule(line, schema)
+        except ValueError as e:
+            raise ValueError('line %d: %s' % (lineno, e)) from None
+        rules.append(bytes([len(rules) & 0xFF, len(cond), len(act)]) + cond + act)
+    if len(rules) > MAX_RULES:
+        raise ValueError('too many rules: %d > %d' % (len(rules), MAX_RULES))
+    body = b'RL' + struct.pack('<BH', VERSION, len(rules)) + b''.join(rules)
+    blob = body + struct.pack('<I', zlib.crc32(body))
+    if len(blob) > BLOB_MAX:
+        raise ValueError('rule set too large: %d > %d bytes' % (len(blob), BLOB_MAX))
+    return blob
+
+
+def chunks(blob: bytes, size: int) -> List[bytes]:
+    """分片: 偏移(2) + 总长(2) + 数据"""
+    step = size - CHUNK_HDR_LEN
+    return [struct.pack('<HH', off, len(blob)) + blob[off:off + step] for off in range(0, len(blob), step)]
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description='Compile local automation rules to iot_rule bytecode')
+    parser.add_argument('input', help='rule text file, - for stdin')
+    parser.add_argument('-o', '--output', help='write the binary rule set here instead of printing base64')
+    parser.add_argument('--schema', default=DEFAULT_SCHEMA, help='header containing IOT_DP_SCHEMA')
+    parser.add_argument('--chunk', type=int, default=CHUNK_MAX, metavar='BYTES',
+                        help='max frame size including the 4-byte header (default %d)' % CHUNK_MAX)
+    parser.add_argument('--hex', action='store_true', help='print frames as hex (BLE) instead of base64 (MQTT)')
+    args = parser.parse_args()
+    if not CHUNK_HDR_LEN < args.chunk <= CHUNK_MAX:
+        parser.error('--chunk must be in %d..%d' % (CHUNK_HDR_LEN + 1, CHUNK_MAX))
+
+    lines = sys.stdin.readlines() if args.input == '-' else open(args.input, encoding='utf-8').readlines()
+    try:
+        blob = compile_rules(lines, load_schema(args.schema))
+    except ValueError as e:
+        print('error: %s' % e, file=sys.stderr)
+        return 1
+
+    if args.output:
+        with open(args.output, 'wb') as f:
+            f.write(blob)
+    else:
+        for frame in chunks(blob, args.chunk):
+            print(frame.hex() if args.hex else base64.b64encode(frame).decode('ascii'))
+    print('%d bytes' % len(blob), file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
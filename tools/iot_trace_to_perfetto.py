@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+# 把设备串口导出的执行轨迹（iot_trace_dump_uart）转换为 Chrome/Perfetto 轨迹JSON
+#
+# 用法: python tools/iot_trace_to_perfetto.py monitor.log -o trace.json
+# 然后在 https://ui.perfetto.dev 中打开 trace.json
+import argparse
+import json
+import re
+import sys
+from typing import Dict
+from typing import List
+from typing import Optional
+
+ANSI_RE = re.compile(r'\x1b\[[0-9;]*m')
+PID_TASKS = 1
+PID_CPU = 2
+
+
+def extract_block(lines: List[str]) -> List[str]:
+    """取日志中最后一段 IOTTRACE BEGIN/END 之间的行"""
+    block: Optional[List[str]] = None
+    last: List[str] = []
+    for raw in lines:
+        line = ANSI_RE.sub('', raw).strip()
+        if line.endswith('IOTTRACE BEGIN'):
+            block = []
+        elif line.endswith('IOTTRACE END'):
+            if block is not None:
+                last = block
+            block = None
+        elif block is not None and line:
+            block.append(line)
+    return last
+
+
+def convert(block: List[str]) -> Dict[str, object]:
+    cpu_hz = 0
+    names: Dict[str, str] = {}
+    tids: Dict[str, int] = {}
+    events: List[Dict[str, object]] = []
+    stacks: Dict[int, List[str]] = {}
+    running: Optional[str] = None
+    running_since = 0.0
+
+    def tid_of(handle: str) -> int:
+        if handle not in tids:
+            tids[handle] = len(tids) + 1
+        return tids[handle]
+
+    for line in block:
+        parts = line.split(',', 4)
+        if parts[0] == 'H':
+            cpu_hz = int(parts[1])
+            if len(parts) >= 4 and int(parts[3]) > 0:
+                print(f'ring overflowed, {parts[3]} oldest events lost', file=sys.stderr)
+            if len(parts) >= 5 and int(parts[4]) > 0:
+                print(f'{parts[4]} tasks not named, raise CONFIG_IOT_TRACE_MAX_TASKS', file=sys.stderr)
+            continue
+        if parts[0] == 'K':
+            names[parts[1]] = line.split(',', 2)[2]
+            continue
+        if len(parts) < 5 or not cpu_hz:
+            continue
+        kind, cycles, handle, arg, name = parts
+        ts = int(cycles) * 1e6 / cpu_hz
+        tid = tid_of(handle)
+
+        if kind == 'S':
+            # CPU轨道：每段表示一个任务占用CPU的时间
+            if running is not None and running != handle:
+                events.append({'ph': 'X', 'name': names.get(running, running), 'ts': running_since,
+                               'dur': ts - running_since, 'pid': PID_CPU, 'tid': 0})
+            if running != handle:
+                running, running_since = handle, ts
+        elif kind == 'B':
+            stacks.setdefault(tid, []).append(name)
+            events.append({'ph': 'B', 'name': name, 'ts': ts, 'pid': PID_TASKS, 'tid': tid})
+        elif kind == 'E':
+            # 环形缓冲区覆盖了开头时，丢弃找不到开始的结束事件
+            stack = stacks.get(tid, [])
+            if name in stack:
+                while stack and stack.pop() != name:
+                    pass
+                events.append({'ph': 'E', 'name': name, 'ts': ts, 'pid': PID_TASKS, 'tid': tid})
+        elif kind == 'i':
+            events.append({'ph': 'i', 's': 't', 'name': name, 'ts': ts, 'pid': PID_TASKS, 'tid': tid,
+                           'args': {'arg': int(arg)}})
+
+    meta: List[Dict[str, object]] = [
+        {'ph': 'M', 'name': 'process_name', 'pid': PID_TASKS, 'args': {'name': 'tasks'}},
+        {'ph': 'M', 'name': 'process_name', 'pid': PID_CPU, 'args': {'name': 'CPU'}},
+        {'ph': 'M', 'name': 'thread_name', 'pid': PID_CPU, 'tid': 0, 'args': {'name': 'running'}},
+    ]
+    for handle, tid in tids.items():
+        meta.append({'ph': 'M', 'name': 'thread_name', 'pid': PID_TASKS, 'tid': tid,
+                     'args': {'name': names.get(handle, 'task@' + handle)}})
+    return {'traceEvents': meta + events, 'displayTimeUnit': 'ms'}
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description='Convert an iot_trace UART dump to Perfetto/Chrome JSON')
+    parser.add_argument('log', help='serial monitor log containing IOTTRACE BEGIN/END')
+    parser.add_argument('-o', '--output', default='trace.json')
+    args = parser.parse_args()
+
+    with open(args.log, encoding='utf-8', errors='replace') as f:
+        block = extract_block(f.readlines())
+    if not block:
+        print('no IOTTRACE block found', file=sys.stderr)
+        return 1
+
+    trace = convert(block)
+    with open(args.output, 'w', encoding='utf-8') as f:
+        json.dump(trace, f)
+    print(f'{len(trace["traceEvents"])} events -> {args.output}')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())